@@ -16,6 +16,7 @@
 #include "lib/jpegli/decode.h"
 #include "lib/jxl/base/compiler_specific.h"
 #include "lib/jxl/base/sanitizers.h"
+#include "lib/jxl/base/span.h"
 #include "lib/jxl/base/status.h"
 
 namespace jxl {
@@ -28,7 +29,7 @@ constexpr unsigned char kExifSignature[6] = {0x45, 0x78, 0x69,
 constexpr int kExifMarker = JPEG_APP0 + 1;
 constexpr int kICCMarker = JPEG_APP0 + 2;
 
-inline bool IsJPG(const std::vector<uint8_t>& bytes) {
+inline bool IsJPG(Span<const uint8_t> bytes) {
   if (bytes.size() < 2) return false;
   if (bytes[0] != 0xFF || bytes[1] != 0xD8) return false;
   return true;
@@ -142,6 +143,12 @@ Status UnmapColors(uint8_t* row, size_t xsize, int components,
 Status DecodeJpeg(const std::vector<uint8_t>& compressed,
                   const JpegDecompressParams& dparams, ThreadPool* pool,
                   PackedPixelFile* ppf) {
+  return DecodeJpeg(Span<const uint8_t>(compressed), dparams, pool, ppf);
+}
+
+Status DecodeJpeg(Span<const uint8_t> compressed,
+                  const JpegDecompressParams& dparams, ThreadPool* pool,
+                  PackedPixelFile* ppf) {
   // Don't do anything for non-JPEG files (no need to report an error)
   if (!IsJPG(compressed)) return false;
 
@@ -166,6 +173,10 @@ Status DecodeJpeg(const std::vector<uint8_t>& compressed,
     cinfo.client_data = static_cast<void*>(&env);
 
     jpegli_create_decompress(&cinfo);
+    if (pool != nullptr) {
+      jpegli_set_decompress_parallel_runner(&cinfo, pool->runner(),
+                                            pool->runner_opaque());
+    }
     jpegli_mem_src(&cinfo,
                    reinterpret_cast<const unsigned char*>(compressed.data()),
                    compressed.size());
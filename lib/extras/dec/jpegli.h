@@ -15,6 +15,7 @@
 
 #include "lib/extras/packed_image.h"
 #include "lib/jxl/base/data_parallel.h"
+#include "lib/jxl/base/span.h"
 #include "lib/jxl/base/status.h"
 
 namespace jxl {
@@ -35,6 +36,12 @@ Status DecodeJpeg(const std::vector<uint8_t>& compressed,
                   const JpegDecompressParams& dparams, ThreadPool* pool,
                   PackedPixelFile* ppf);
 
+// Same as above, but the compressed data can be e.g. a memory mapped file, the
+// decoder reads it in place without copying it.
+Status DecodeJpeg(Span<const uint8_t> compressed,
+                  const JpegDecompressParams& dparams, ThreadPool* pool,
+                  PackedPixelFile* ppf);
+
 }  // namespace extras
 }  // namespace jxl
 
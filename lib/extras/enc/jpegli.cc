@@ -33,6 +33,9 @@
 #include "lib/jxl/base/status.h"
 #include "lib/jxl/color_encoding_internal.h"
 #include "lib/jxl/enc_xyb.h"
+#include "lib/jxl/frame_dimensions.h"
+#include "lib/jxl/jpeg/enc_jpeg_data_reader.h"
+#include "lib/jxl/jpeg/jpeg_data.h"
 #include "lib/jxl/simd_util.h"
 
 namespace jxl {
@@ -47,6 +50,31 @@ void MyErrorExit(j_common_ptr cinfo) {
   longjmp(*env, 1);
 }
 
+// Lets the encoder write the compressed data directly into the output vector,
+// which is grown as needed and shrunk to the final size at the end.
+struct OutputVector {
+  std::vector<uint8_t>* bytes;
+  size_t pos;
+};
+
+int GrowOutputVector(void* opaque, const uint8_t* filled, size_t filled_size,
+                     uint8_t** next_buffer, size_t* next_size) {
+  constexpr size_t kMinBufferSize = 64 << 10;
+  OutputVector* output = static_cast<OutputVector*>(opaque);
+  output->pos += filled_size;
+  if (next_buffer == nullptr) {
+    output->bytes->resize(output->pos);
+    return 1;
+  }
+  size_t min_size = output->pos + kMinBufferSize;
+  if (output->bytes->size() < min_size) {
+    output->bytes->resize(std::max(2 * output->bytes->size(), min_size));
+  }
+  *next_buffer = output->bytes->data() + output->pos;
+  *next_size = output->bytes->size() - output->pos;
+  return 1;
+}
+
 Status VerifyInput(const PackedPixelFile& ppf) {
   const JxlBasicInfo& info = ppf.info;
   JXL_RETURN_IF_ERROR(Encoder::VerifyBasicInfo(info));
@@ -298,10 +326,150 @@ void ToFloatRow(const uint8_t* row_in, JxlPixelFormat format, size_t xsize,
   }
 }
 
+// Quantized DCT coefficients of the components of a jpegli encoded image, in
+// natural order.
+struct JpegliCoefficients {
+  struct Component {
+    size_t width_in_blocks;
+    size_t height_in_blocks;
+    std::vector<jpeg::coeff_t> coeffs;
+  };
+  std::vector<Component> components;
+};
+
+void CopyCoefficients(j_compress_ptr cinfo, jvirt_barray_ptr* coef_arrays,
+                      void* opaque) {
+  JpegliCoefficients* out = static_cast<JpegliCoefficients*>(opaque);
+  out->components.resize(cinfo->num_components);
+  for (int c = 0; c < cinfo->num_components; ++c) {
+    const jpeg_component_info* comp = &cinfo->comp_info[c];
+    JpegliCoefficients::Component& out_comp = out->components[c];
+    out_comp.width_in_blocks = comp->width_in_blocks;
+    out_comp.height_in_blocks = comp->height_in_blocks;
+    out_comp.coeffs.resize(comp->width_in_blocks * comp->height_in_blocks *
+                           DCTSIZE2);
+    for (JDIMENSION by = 0; by < comp->height_in_blocks; ++by) {
+      JBLOCKARRAY blocks = (*cinfo->mem->access_virt_barray)(
+          reinterpret_cast<j_common_ptr>(cinfo), coef_arrays[c], by, 1, FALSE);
+      for (JDIMENSION bx = 0; bx < comp->width_in_blocks; ++bx) {
+        const JCOEF* block = &blocks[0][bx][0];
+        jpeg::coeff_t* out_block =
+            &out_comp.coeffs[(by * comp->width_in_blocks + bx) * DCTSIZE2];
+        for (int k = 0; k < DCTSIZE2; ++k) {
+          out_block[jpeg::kJPEGNaturalOrder[k]] = block[k];
+        }
+      }
+    }
+  }
+}
+
+// Adds the reset points of a progressive AC scan of a jpegli encoded image.
+// These are the blocks that start an end-of-block run right after another one
+// ended, which happens where jpegli splits a run because it became too long,
+// or because it had too many refinement bits.
+void AddResetPoints(const jpeg::JPEGData& jpg, jpeg::JPEGScanInfo* scan) {
+  const jpeg::JPEGComponent& c = jpg.components[scan->components[0].comp_idx];
+  int MCUs_per_row;
+  int MCU_rows;
+  jpg.CalculateMcuSize(*scan, &MCUs_per_row, &MCU_rows);
+  const int Ss = scan->Ss;
+  const int Se = scan->Se;
+  const int Al = scan->Al;
+  const bool is_refinement = scan->Ah > 0;
+  int eob_run = 0;
+  int eob_refbits = 0;
+  bool run_capped = false;
+  uint32_t block_scan_index = 0;
+  for (int by = 0; by < MCU_rows; ++by) {
+    for (int bx = 0; bx < MCUs_per_row; ++bx, ++block_scan_index) {
+      if (jpg.restart_interval > 0 && block_scan_index > 0 &&
+          block_scan_index % jpg.restart_interval == 0) {
+        eob_run = eob_refbits = 0;
+        run_capped = false;
+      }
+      const jpeg::coeff_t* block =
+          &c.coeffs[(by * c.width_in_blocks + bx) * kDCTBlockSize];
+      // Position of the last coefficient coded with its own symbol, and the
+      // number of refinement bits after it.
+      int last_coded = Ss - 1;
+      int num_refbits = 0;
+      for (int k = Ss; k <= Se; ++k) {
+        int absval = std::abs(block[jpeg::kJPEGNaturalOrder[k]]) >> Al;
+        if (absval == 0) continue;
+        if (is_refinement && absval > 1) {
+          ++num_refbits;
+          continue;
+        }
+        last_coded = k;
+        num_refbits = 0;
+      }
+      const bool starts_with_eob = last_coded < Ss;
+      const bool prev_run_capped = run_capped;
+      bool run_split = false;
+      run_capped = false;
+      if (!starts_with_eob) {
+        eob_run = eob_refbits = 0;
+      }
+      if (last_coded < Se) {
+        ++eob_run;
+        eob_refbits += num_refbits;
+        if (eob_refbits > 255) {
+          eob_refbits = num_refbits;
+          eob_run = 1;
+          run_split = true;
+        }
+        if (eob_run == 0x7FFF) {
+          eob_run = eob_refbits = 0;
+          run_capped = true;
+        }
+      }
+      if (starts_with_eob && (prev_run_capped || run_split)) {
+        scan->reset_points.push_back(block_scan_index);
+      }
+    }
+  }
+}
+
+// Parses the headers of the jpegli output and fills in the rest of *jpg from
+// the coefficients, without entropy decoding the scans. jpegli pads with one
+// bits and never writes extra zero runs, so only the reset points are needed.
+Status SetJPEGDataFromJpegli(const std::vector<uint8_t>& compressed,
+                             const JpegliCoefficients& coefficients,
+                             jpeg::JPEGData* jpg) {
+  *jpg = jpeg::JPEGData();
+  if (!jpeg::ReadJpeg(compressed.data(), compressed.size(),
+                      jpeg::JpegReadMode::kReadAllButScanData, jpg)) {
+    return JXL_FAILURE("Could not parse jpegli output.");
+  }
+  if (jpg->components.size() != coefficients.components.size()) {
+    return JXL_FAILURE("Unexpected number of components.");
+  }
+  for (size_t c = 0; c < jpg->components.size(); ++c) {
+    jpeg::JPEGComponent& comp = jpg->components[c];
+    const JpegliCoefficients::Component& in = coefficients.components[c];
+    if (in.width_in_blocks > comp.width_in_blocks ||
+        in.height_in_blocks > comp.height_in_blocks) {
+      return JXL_FAILURE("Unexpected component dimensions.");
+    }
+    // The blocks outside of the component are encoded as zeros by jpegli.
+    const size_t row_size = in.width_in_blocks * kDCTBlockSize;
+    const size_t stride = comp.width_in_blocks * kDCTBlockSize;
+    for (size_t by = 0; by < in.height_in_blocks; ++by) {
+      std::copy_n(&in.coeffs[by * row_size], row_size,
+                  &comp.coeffs[by * stride]);
+    }
+  }
+  for (jpeg::JPEGScanInfo& scan : jpg->scan_info) {
+    if (scan.Ss > 0) AddResetPoints(*jpg, &scan);
+  }
+  return true;
+}
+
 Status EncodeJpegToTargetSize(const PackedPixelFile& ppf,
                               const JpegSettings& jpeg_settings,
                               size_t target_size, ThreadPool* pool,
-                              std::vector<uint8_t>* output) {
+                              std::vector<uint8_t>* output,
+                              jpeg::JPEGData* jpeg_data) {
   output->clear();
   size_t best_error = std::numeric_limits<size_t>::max();
   float distance0 = -1.0f;
@@ -313,7 +481,9 @@ Status EncodeJpegToTargetSize(const PackedPixelFile& ppf,
     settings.distance = distance;
     settings.target_size = 0;
     std::vector<uint8_t> compressed;
-    JXL_RETURN_IF_ERROR(EncodeJpeg(ppf, settings, pool, &compressed));
+    jpeg::JPEGData data;
+    JXL_RETURN_IF_ERROR(EncodeJpeg(ppf, settings, pool, &compressed,
+                                   jpeg_data ? &data : nullptr));
     size_t size = compressed.size();
     // prefer being under the target size to being over it
     size_t error = size < target_size
@@ -322,6 +492,7 @@ Status EncodeJpegToTargetSize(const PackedPixelFile& ppf,
     if (error < best_error) {
       best_error = error;
       std::swap(*output, compressed);
+      if (jpeg_data) *jpeg_data = std::move(data);
     }
     float rel_error = size * 1.0f / target_size;
     if (std::abs(rel_error - 1.0f) < 0.002f) {
@@ -347,6 +518,12 @@ Status EncodeJpegToTargetSize(const PackedPixelFile& ppf,
 
 Status EncodeJpeg(const PackedPixelFile& ppf, const JpegSettings& jpeg_settings,
                   ThreadPool* pool, std::vector<uint8_t>* compressed) {
+  return EncodeJpeg(ppf, jpeg_settings, pool, compressed, nullptr);
+}
+
+Status EncodeJpeg(const PackedPixelFile& ppf, const JpegSettings& jpeg_settings,
+                  ThreadPool* pool, std::vector<uint8_t>* compressed,
+                  jpeg::JPEGData* jpeg_data) {
   if (jpeg_settings.libjpeg_quality > 0) {
     auto encoder = Encoder::FromExtension(".jpg");
     encoder->SetOption("q", std::to_string(jpeg_settings.libjpeg_quality));
@@ -358,11 +535,11 @@ Status EncodeJpeg(const PackedPixelFile& ppf, const JpegSettings& jpeg_settings,
     JXL_RETURN_IF_ERROR(encoder->Encode(ppf, &encoded, pool));
     size_t target_size = encoded.bitstreams[0].size();
     return EncodeJpegToTargetSize(ppf, jpeg_settings, target_size, pool,
-                                  compressed);
+                                  compressed, jpeg_data);
   }
   if (jpeg_settings.target_size > 0) {
     return EncodeJpegToTargetSize(ppf, jpeg_settings, jpeg_settings.target_size,
-                                  pool, compressed);
+                                  pool, compressed, jpeg_data);
   }
   JXL_RETURN_IF_ERROR(VerifyInput(ppf));
 
@@ -388,9 +565,9 @@ Status EncodeJpeg(const PackedPixelFile& ppf, const JpegSettings& jpeg_settings,
   // We need to declare all the non-trivial destructor local variables
   // before the call to setjmp().
   std::vector<uint8_t> pixels;
-  unsigned char* output_buffer = nullptr;
-  unsigned long output_size = 0;  // NOLINT
+  OutputVector output = {compressed, 0};
   std::vector<uint8_t> row_bytes;
+  JpegliCoefficients coefficients;
   const size_t max_vector_size = MaxVectorSize();
   size_t rowlen = RoundUpTo(ppf.info.xsize, max_vector_size);
   hwy::AlignedFreeUniquePtr<float[]> xyb_tmp =
@@ -410,7 +587,7 @@ Status EncodeJpeg(const PackedPixelFile& ppf, const JpegSettings& jpeg_settings,
     }
     cinfo.client_data = static_cast<void*>(&env);
     jpegli_create_compress(&cinfo);
-    jpegli_mem_dest(&cinfo, &output_buffer, &output_size);
+    jpegli_buffer_ring_dest(&cinfo, &GrowOutputVector, &output);
     const JxlBasicInfo& info = ppf.info;
     cinfo.image_width = info.xsize;
     cinfo.image_height = info.ysize;
@@ -473,6 +650,7 @@ Status EncodeJpeg(const PackedPixelFile& ppf, const JpegSettings& jpeg_settings,
     }
     jpegli_set_progressive_level(&cinfo, jpeg_settings.progressive_level);
     cinfo.optimize_coding = TO_JXL_BOOL(jpeg_settings.optimize_coding);
+    cinfo.restart_interval = jpeg_settings.restart_interval;
     if (!jpeg_settings.app_data.empty()) {
       // Make sure jpegli_start_compress() does not write any APP markers.
       cinfo.write_JFIF_header = JXL_FALSE;
@@ -485,6 +663,13 @@ Status EncodeJpeg(const PackedPixelFile& ppf, const JpegSettings& jpeg_settings,
       jpegli_set_input_format(&cinfo, ConvertDataType(image.format.data_type),
                               ConvertEndianness(image.format.endianness));
     }
+    if (jpeg_data != nullptr) {
+      jpegli_set_coefficient_callback(&cinfo, &CopyCoefficients,
+                                      &coefficients);
+    }
+    if (pool != nullptr) {
+      jpegli_set_parallel_runner(&cinfo, pool->runner(), pool->runner_opaque());
+    }
     jpegli_start_compress(&cinfo, TRUE);
     if (!jpeg_settings.app_data.empty()) {
       JXL_RETURN_IF_ERROR(WriteAppData(&cinfo, jpeg_settings.app_data));
@@ -556,14 +741,20 @@ Status EncodeJpeg(const PackedPixelFile& ppf, const JpegSettings& jpeg_settings,
       }
     }
     jpegli_finish_compress(&cinfo);
-    compressed->resize(output_size);
-    std::copy_n(output_buffer, output_size, compressed->data());
     return true;
   };
   bool success = try_catch_block();
   jpegli_destroy_compress(&cinfo);
-  if (output_buffer) free(output_buffer);
-  return success;
+  if (!success) {
+    // The output may have been left partly written and padded.
+    compressed->clear();
+    return false;
+  }
+  if (jpeg_data != nullptr) {
+    JXL_RETURN_IF_ERROR(
+        SetJPEGDataFromJpegli(*compressed, coefficients, jpeg_data));
+  }
+  return true;
 }
 
 }  // namespace extras
@@ -16,6 +16,7 @@
 #include "lib/extras/packed_image.h"
 #include "lib/jxl/base/data_parallel.h"
 #include "lib/jxl/base/status.h"
+#include "lib/jxl/jpeg/jpeg_data.h"
 
 namespace jxl {
 namespace extras {
@@ -29,6 +30,8 @@ struct JpegSettings {
   bool use_std_quant_tables = false;
   int progressive_level = 2;
   bool optimize_coding = true;
+  // Number of MCUs between restart markers, or 0 for no restart markers.
+  unsigned int restart_interval = 0;
   std::string chroma_subsampling;
   int libjpeg_quality = 0;
   std::string libjpeg_chroma_subsampling;
@@ -47,6 +50,14 @@ struct JpegSettings {
 Status EncodeJpeg(const PackedPixelFile& ppf, const JpegSettings& jpeg_settings,
                   ThreadPool* pool, std::vector<uint8_t>* compressed);
 
+// Like the above, but also fills in *jpeg_data with the parsed form of the
+// output, built from the quantized DCT coefficients that jpegli encoded. It
+// can be transcoded to JPEG XL with jxl::AddJPEGFrame() without entropy
+// decoding the output again.
+Status EncodeJpeg(const PackedPixelFile& ppf, const JpegSettings& jpeg_settings,
+                  ThreadPool* pool, std::vector<uint8_t>* compressed,
+                  jpeg::JPEGData* jpeg_data);
+
 }  // namespace extras
 }  // namespace jxl
 
@@ -31,6 +31,9 @@
 #include "lib/jxl/base/span.h"
 #include "lib/jxl/base/status.h"
 #include "lib/jxl/color_encoding_internal.h"
+#include "lib/jxl/jpeg/dec_jpeg_data_writer.h"
+#include "lib/jxl/jpeg/enc_jpeg_data_reader.h"
+#include "lib/jxl/jpeg/jpeg_data.h"
 #include "lib/jxl/test_image.h"
 #include "lib/jxl/test_utils.h"
 #include "lib/jxl/testing.h"
@@ -271,6 +274,120 @@ TEST(JpegliTest, JpegliHDRRoundtripTest) {
   EXPECT_SLIGHTLY_BELOW(ButteraugliDistance(ppf_in, ppf_out), 1.05f);
 }
 
+// Checks that the JPEGData built from the jpegli coefficients is the same as
+// the parsed output, and that the output can be reconstructed from it.
+void TestEncodeWithJPEGData(const PackedPixelFile& ppf,
+                            const JpegSettings& settings) {
+  std::vector<uint8_t> compressed;
+  jpeg::JPEGData jpeg_data;
+  ASSERT_TRUE(EncodeJpeg(ppf, settings, nullptr, &compressed, &jpeg_data));
+
+  jpeg::JPEGData parsed;
+  ASSERT_TRUE(jpeg::ReadJpeg(compressed.data(), compressed.size(),
+                             jpeg::JpegReadMode::kReadAll, &parsed));
+  ASSERT_EQ(parsed.components.size(), jpeg_data.components.size());
+  for (size_t c = 0; c < parsed.components.size(); ++c) {
+    EXPECT_EQ(parsed.components[c].coeffs, jpeg_data.components[c].coeffs);
+  }
+  ASSERT_EQ(parsed.scan_info.size(), jpeg_data.scan_info.size());
+  for (size_t i = 0; i < parsed.scan_info.size(); ++i) {
+    EXPECT_EQ(parsed.scan_info[i].reset_points,
+              jpeg_data.scan_info[i].reset_points);
+    EXPECT_TRUE(jpeg_data.scan_info[i].extra_zero_runs.empty());
+  }
+
+  std::vector<uint8_t> reconstructed;
+  ASSERT_TRUE(jpeg::WriteJpeg(
+      jpeg_data, [&reconstructed](const uint8_t* buf, size_t len) {
+        reconstructed.insert(reconstructed.end(), buf, buf + len);
+        return len;
+      }));
+  EXPECT_EQ(compressed, reconstructed);
+}
+
+TEST(JpegliTest, JpegliEncodeWithJPEGData) {
+  std::string testimage = "jxl/flower/flower_small.rgb.depth8.ppm";
+  PackedPixelFile ppf_in;
+  ASSERT_TRUE(ReadTestImage(testimage, &ppf_in));
+  for (int progressive_level = 0; progressive_level <= 2;
+       ++progressive_level) {
+    for (const char* subsampling : {"444", "420"}) {
+      JpegSettings settings;
+      settings.progressive_level = progressive_level;
+      settings.chroma_subsampling = subsampling;
+      TestEncodeWithJPEGData(ppf_in, settings);
+    }
+  }
+  JpegSettings settings;
+  settings.xyb = true;
+  TestEncodeWithJPEGData(ppf_in, settings);
+}
+
+TEST(JpegliTest, JpegliEncodeWithJPEGDataLongEndOfBlockRuns) {
+  // More than 0x7fff consecutive blocks with all-zero AC coefficients, so that
+  // jpegli has to split end-of-block runs.
+  TestImage t;
+  ASSERT_TRUE(t.SetDimensions(2048, 1040));
+  ASSERT_TRUE(t.SetChannels(3));
+  t.SetAllBitDepths(8).SetEndianness(JXL_NATIVE_ENDIAN);
+  JXL_TEST_ASSIGN_OR_DIE(TestImage::Frame frame, t.AddFrame());
+  frame.ZeroFill();
+  JpegSettings settings;
+  settings.chroma_subsampling = "444";
+  TestEncodeWithJPEGData(t.ppf(), settings);
+}
+
+TEST(JpegliTest, WriteJpegWithRestartsInParallel) {
+  // 1024 MCUs in one sequential scan, with a restart marker every 10 MCUs.
+  TestImage t;
+  ASSERT_TRUE(t.SetDimensions(256, 256));
+  ASSERT_TRUE(t.SetChannels(3));
+  t.SetAllBitDepths(8).SetEndianness(JXL_NATIVE_ENDIAN);
+  JXL_TEST_ASSIGN_OR_DIE(TestImage::Frame frame, t.AddFrame());
+  frame.RandomFill();
+  JpegSettings settings;
+  settings.progressive_level = 0;
+  settings.chroma_subsampling = "444";
+  settings.restart_interval = 10;
+  std::vector<uint8_t> compressed;
+  ASSERT_TRUE(EncodeJpeg(t.ppf(), settings, nullptr, &compressed));
+
+  jpeg::JPEGData jpeg_data;
+  ASSERT_TRUE(jpeg::ReadJpeg(compressed.data(), compressed.size(),
+                             jpeg::JpegReadMode::kReadAll, &jpeg_data));
+  ASSERT_EQ(10, jpeg_data.restart_interval);
+  ASSERT_EQ(1, jpeg_data.scan_info.size());
+  EXPECT_FALSE(jpeg_data.has_zero_padding_bit);
+  EXPECT_TRUE(jpeg_data.scan_info[0].extra_zero_runs.empty());
+
+  test::ThreadPoolForTests pool(4);
+  const auto write = [&](ThreadPool* thread_pool,
+                         size_t* num_parallel_scans) {
+    std::vector<uint8_t> reconstructed;
+    EXPECT_TRUE(jpeg::WriteJpeg(
+        jpeg_data,
+        [&reconstructed](const uint8_t* buf, size_t len) {
+          reconstructed.insert(reconstructed.end(), buf, buf + len);
+          return len;
+        },
+        thread_pool, num_parallel_scans));
+    return reconstructed;
+  };
+  size_t num_parallel_scans;
+  EXPECT_EQ(compressed, write(nullptr, &num_parallel_scans));
+  EXPECT_EQ(0, num_parallel_scans);
+  EXPECT_EQ(compressed, write(pool.get(), &num_parallel_scans));
+  EXPECT_EQ(1, num_parallel_scans);
+
+  // With explicit padding bits, each restart interval depends on the padding
+  // of the previous ones, so the scan is written serially. The parsed padding
+  // bits are all ones, as written by jpegli, so the output does not change.
+  jpeg_data.has_zero_padding_bit = true;
+  ASSERT_FALSE(jpeg_data.padding_bits.empty());
+  EXPECT_EQ(compressed, write(pool.get(), &num_parallel_scans));
+  EXPECT_EQ(0, num_parallel_scans);
+}
+
 TEST(JpegliTest, JpegliSetAppData) {
   std::string testimage = "jxl/flower/flower_small.rgb.depth8.ppm";
   PackedPixelFile ppf_in;
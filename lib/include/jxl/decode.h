@@ -380,6 +380,7 @@ typedef enum {
  * The difference to @ref JxlDecoderReset is that some state is kept, namely
  * settings set by a call to
  *  - @ref JxlDecoderSetCoalescing,
+ *  - @ref JxlDecoderSetCmsLutMaxError,
  *  - @ref JxlDecoderSetDesiredIntensityTarget,
  *  - @ref JxlDecoderSetDecompressBoxes,
  *  - @ref JxlDecoderSetKeepOrientation,
@@ -900,6 +901,24 @@ JXL_EXPORT JxlDecoderStatus JxlDecoderSetOutputColorProfile(
  */
 JXL_EXPORT JxlDecoderStatus JxlDecoderSetCms(JxlDecoder* dec,
                                              JxlCmsInterface cms);
+
+/**
+ * Allows the decoder to replace the color conversion by the CMS with a 3D
+ * lookup table with tetrahedral interpolation, which is much faster for
+ * conversions between ICC profiles. The table is computed once per frame with
+ * the CMS set by @ref JxlDecoderSetCms, and is only used if its largest error
+ * on a set of sample colors, in output sample values normalized to the range
+ * [0, 1], is at most @p max_error. Otherwise, or for colors outside of the
+ * range of the table, the CMS is used directly. The default value of 0
+ * disables the lookup table. May only be set before starting decoding.
+ *
+ * @param dec decoder object
+ * @param max_error largest accepted error of the lookup table
+ * @return ::JXL_DEC_SUCCESS if the value was set successfully, @ref
+ *     JXL_DEC_ERROR otherwise.
+ */
+JXL_EXPORT JxlDecoderStatus JxlDecoderSetCmsLutMaxError(JxlDecoder* dec,
+                                                        float max_error);
 // TODO(firsching): add a function JxlDecoderSetDefaultCms() for setting a
 // default in case libjxl is build with a CMS.
 
@@ -1018,6 +1037,161 @@ JXL_EXPORT JxlDecoderStatus JxlDecoderImageOutBufferSize(
 JXL_EXPORT JxlDecoderStatus JxlDecoderSetImageOutBuffer(
     JxlDecoder* dec, const JxlPixelFormat* format, void* buffer, size_t size);
 
+/**
+ * Same as @ref JxlDecoderSetImageOutBuffer, but with an explicit distance in
+ * bytes between the starts of consecutive rows, e.g. to decode into a larger
+ * image, a mapped texture or a GPU upload buffer with its own row pitch. The
+ * pixels are written to the buffer directly, without going through an
+ * intermediate copy of the frame. The bytes between the end of a row and the
+ * start of the next one are not written. The align field of @p format is
+ * ignored.
+ *
+ * @param dec decoder object
+ * @param format format of the pixels. Object owned by user and its contents
+ *     are copied internally.
+ * @param buffer buffer type to output the pixel data to
+ * @param size size of buffer in bytes, must be at least @p stride times the
+ *     number of rows minus one, plus the size of one row.
+ * @param stride distance in bytes between the starts of two rows, must be at
+ *     least the size of one row.
+ * @return ::JXL_DEC_SUCCESS on success, ::JXL_DEC_ERROR on error, such as
+ *     size or stride too small.
+ */
+JXL_EXPORT JxlDecoderStatus JxlDecoderSetImageOutBufferWithStride(
+    JxlDecoder* dec, const JxlPixelFormat* format, void* buffer, size_t size,
+    size_t stride);
+
+/**
+ * Sets a grid of caller-owned tiles to write the full resolution image to,
+ * instead of a single buffer, e.g. to decode directly into the pages of a
+ * texture atlas. The image (or the region set with @ref
+ * JxlDecoderSetImageOutRegion) is split into tiles of @p tile_xsize by @p
+ * tile_ysize pixels, the tiles at the right and bottom edges may be smaller.
+ * Tile i of row j of tiles is written to @p tiles[j * tiles_per_row + i], with
+ * tiles_per_row the number of tiles in a row of tiles. Each tile follows the
+ * format described by @ref JxlPixelFormat, with rows @p tile_stride bytes
+ * apart. The align field of @p format is ignored.
+ *
+ * The table of tiles is copied internally, the tiles are owned by the caller.
+ * Like @ref JxlDecoderSetImageOutBuffer, this applies only to the current
+ * frame.
+ *
+ * @param dec decoder object
+ * @param format format of the pixels. Object owned by user and its contents
+ *     are copied internally.
+ * @param tile_xsize width of the tiles in pixels, must be non-zero
+ * @param tile_ysize height of the tiles in pixels, must be non-zero
+ * @param tiles pointers to the tiles, none of them may be NULL
+ * @param num_tiles number of entries of @p tiles, must be at least the number
+ *     of tiles of the image.
+ * @param tile_stride distance in bytes between the starts of two rows of a
+ *     tile, must be at least the size of one row of a tile.
+ * @return ::JXL_DEC_SUCCESS on success, ::JXL_DEC_ERROR on error, such as
+ *     too few tiles.
+ */
+JXL_EXPORT JxlDecoderStatus JxlDecoderSetImageOutTiles(
+    JxlDecoder* dec, const JxlPixelFormat* format, uint32_t tile_xsize,
+    uint32_t tile_ysize, void* const* tiles, size_t num_tiles,
+    size_t tile_stride);
+
+/**
+ * Restricts the output of the full resolution image to a rectangular region
+ * of it. Once set, the image out buffer, the extra channel buffers and the
+ * image out callback only receive the pixels inside this region, with
+ * coordinates relative to its top-left corner, and @ref
+ * JxlDecoderImageOutBufferSize and @ref JxlDecoderExtraChannelBufferSize
+ * return the size required for the region. The region is given in the
+ * coordinates of the image as it is output, i.e. after applying the
+ * orientation unless @ref JxlDecoderSetKeepOrientation is used.
+ *
+ * The decoder uses the table of contents of each frame to skip decoding, and
+ * reading the input of, the groups of the image that do not contribute to the
+ * region, when this does not affect other frames. The DC of the frames is
+ * always decoded completely. The decoded pixels are the same as the ones of
+ * the same region of a full decode.
+ *
+ * This can only be called after the ::JXL_DEC_BASIC_INFO event, with
+ * coalescing enabled, and before the image out buffer or callback for the
+ * next frame is set. The region applies to all the following frames, but not
+ * to the preview image, until @ref JxlDecoderReset is called.
+ *
+ * @param dec decoder object
+ * @param x0 horizontal offset of the region
+ * @param y0 vertical offset of the region
+ * @param xsize width of the region, must be non-zero
+ * @param ysize height of the region, must be non-zero
+ * @return ::JXL_DEC_SUCCESS on success, ::JXL_DEC_ERROR on error, such as the
+ *     region not being inside of the image.
+ */
+JXL_EXPORT JxlDecoderStatus JxlDecoderSetImageOutRegion(JxlDecoder* dec,
+                                                        uint32_t x0,
+                                                        uint32_t y0,
+                                                        uint32_t xsize,
+                                                        uint32_t ysize);
+
+/**
+ * One JPEG XL file or codestream of a batch decoded with @ref
+ * JxlDecoderDecodeBatch.
+ */
+typedef struct {
+  /** Complete contents of the file. Owned by the caller. */
+  const uint8_t* data;
+
+  /** Size of data in bytes. */
+  size_t size;
+} JxlDecoderBatchInput;
+
+/**
+ * Decodes the first frame of each of the given files to pixels in @p format.
+ *
+ * The files are independent of each other and of the state of @p dec. If a
+ * parallel runner was set with @ref JxlDecoderSetParallelRunner, the files
+ * are decoded in parallel, each file on a single thread. For small images,
+ * which have too few groups to be decoded in parallel, this scales much
+ * better than decoding the files one after the other with multiple threads
+ * each. The per-thread decoder state, including the decoding buffers, is kept
+ * in @p dec and reused by the following files and batches.
+ *
+ * The settings of @ref JxlDecoderSetKeepOrientation, @ref
+ * JxlDecoderSetUnpremultiplyAlpha, @ref JxlDecoderSetRenderSpotcolors and
+ * @ref JxlDecoderSetDesiredIntensityTarget made on @p dec apply to all the
+ * files. The pixels are in the color space that is returned for
+ * ::JXL_COLOR_PROFILE_TARGET_DATA by default.
+ *
+ * The decoded images are retrieved with @ref JxlDecoderGetBatchOutput.
+ *
+ * @param dec decoder object
+ * @param format format of the pixels of all images. Object owned by user.
+ * @param inputs array of @p num_inputs files. Owned by the caller, and only
+ *     accessed during this call.
+ * @param num_inputs number of files of the batch.
+ * @return ::JXL_DEC_SUCCESS if all the files were decoded, ::JXL_DEC_ERROR
+ *     otherwise.
+ */
+JXL_EXPORT JxlDecoderStatus JxlDecoderDecodeBatch(
+    JxlDecoder* dec, const JxlPixelFormat* format,
+    const JxlDecoderBatchInput* inputs, size_t num_inputs);
+
+/**
+ * Gets a decoded image of the last batch decoded with @ref
+ * JxlDecoderDecodeBatch.
+ *
+ * @param dec decoder object
+ * @param index index of the file in the batch.
+ * @param xsize output variable for the width of the image.
+ * @param ysize output variable for the height of the image.
+ * @param pixels output variable for the pixels, in the format given to @ref
+ *     JxlDecoderDecodeBatch. Owned by the decoder, and valid until the next
+ *     call of @ref JxlDecoderDecodeBatch, @ref JxlDecoderReset or @ref
+ *     JxlDecoderDestroy.
+ * @param size output variable for the size of @p pixels in bytes.
+ * @return ::JXL_DEC_SUCCESS on success, ::JXL_DEC_ERROR if there is no such
+ *     image.
+ */
+JXL_EXPORT JxlDecoderStatus JxlDecoderGetBatchOutput(
+    const JxlDecoder* dec, size_t index, uint32_t* xsize, uint32_t* ysize,
+    const void** pixels, size_t* size);
+
 /**
  * Function type for @ref JxlDecoderSetImageOutCallback.
  *
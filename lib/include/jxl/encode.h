@@ -700,6 +700,78 @@ JXL_EXPORT JxlEncoderStatus JxlEncoderAddImageFrame(
     const JxlEncoderFrameSettings* frame_settings,
     const JxlPixelFormat* pixel_format, const void* buffer, size_t size);
 
+/**
+ * One image of a batch encoded with @ref JxlEncoderEncodeBatch.
+ */
+typedef struct {
+  /** Width of the image in pixels. */
+  uint32_t xsize;
+
+  /** Height of the image in pixels. */
+  uint32_t ysize;
+
+  /** Pixel data of the image, in the pixel format given to @ref
+   * JxlEncoderEncodeBatch. Owned by the caller.
+   */
+  const void* buffer;
+
+  /** Size of buffer in bytes. */
+  size_t size;
+} JxlEncoderBatchImage;
+
+/**
+ * Encodes each of the given images into its own single-frame codestream.
+ *
+ * The images share all the settings of the encoder: the basic info (except
+ * for its dimensions, which are given per image), the color encoding or ICC
+ * profile, the extra channel info, the container and level settings, and
+ * the frame settings in @p frame_settings. These must be set as for a call of
+ * @ref JxlEncoderAddImageFrame. Only interleaved alpha is supported, other
+ * extra channels can not be given.
+ *
+ * If a parallel runner was set with @ref JxlEncoderSetParallelRunner, the
+ * images are encoded in parallel, each image on a single thread. This is
+ * faster than encoding the images one after the other with multiple threads
+ * each if the images are small. The per-thread encoder state is kept in @p
+ * frame_settings->enc and reused by later batches.
+ *
+ * The codestreams are retrieved with @ref JxlEncoderGetBatchOutput. The
+ * encoder does not produce any output of its own with this function, and can
+ * encode more batches afterwards.
+ *
+ * @param frame_settings set of options for the frames. Also includes
+ * reference to the encoder object.
+ * @param pixel_format format of the pixels of all images. Object owned by the
+ * caller.
+ * @param images array of @p num_images images. Owned by the caller, and only
+ * accessed during this call.
+ * @param num_images number of images of the batch.
+ * @return ::JXL_ENC_SUCCESS if all images were encoded, ::JXL_ENC_ERROR
+ * otherwise
+ */
+JXL_EXPORT JxlEncoderStatus JxlEncoderEncodeBatch(
+    const JxlEncoderFrameSettings* frame_settings,
+    const JxlPixelFormat* pixel_format, const JxlEncoderBatchImage* images,
+    size_t num_images);
+
+/**
+ * Gets the encoded codestream of an image of the last batch encoded with @ref
+ * JxlEncoderEncodeBatch.
+ *
+ * @param enc encoder object.
+ * @param index index of the image in the batch.
+ * @param data pointer to the encoded bytes. Owned by the encoder, and valid
+ * until the next call of @ref JxlEncoderEncodeBatch, @ref JxlEncoderReset or
+ * @ref JxlEncoderDestroy.
+ * @param size number of encoded bytes.
+ * @return ::JXL_ENC_SUCCESS on success, ::JXL_ENC_ERROR if there is no such
+ * image.
+ */
+JXL_EXPORT JxlEncoderStatus JxlEncoderGetBatchOutput(JxlEncoder* enc,
+                                                     size_t index,
+                                                     const uint8_t** data,
+                                                     size_t* size);
+
 /**
  * The @ref JxlEncoderOutputProcessor structure provides an interface for the
  * encoder's output processing. Users of the library, who want to do streaming
@@ -0,0 +1,86 @@
+/* Copyright (c) the JPEG XL Project Authors. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+/** @addtogroup libjxl_common
+ * @{
+ * @file memory_arena.h
+ * @brief Memory manager that recycles the memory released by the library.
+ */
+
+#ifndef JXL_MEMORY_ARENA_H_
+#define JXL_MEMORY_ARENA_H_
+
+#include <jxl/jxl_export.h>
+#include <jxl/memory_manager.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Opaque structure that holds the memory released by the library for reuse.
+ *
+ * Allocations made through the memory manager of an arena are not returned to
+ * the underlying memory manager when they are freed, but kept and handed out
+ * again for the next allocation of the same size. The temporaries of a frame
+ * are thus reused by the next frames, and the memory released by @ref
+ * JxlDecoderReset by the next image: a decoder created with the memory manager
+ * of an arena decodes a stream of images of the same dimensions and format
+ * without allocating from the underlying memory manager after the first
+ * one.
+ *
+ * The memory manager of an arena can be used by several decoders and
+ * encoders, also concurrently.
+ */
+typedef struct JxlMemoryArenaStruct JxlMemoryArena;
+
+/**
+ * Creates an arena.
+ *
+ * @param memory_manager underlying memory manager, used for the arena itself
+ *     and for the memory it hands out. It may be NULL. The memory manager will
+ *     be copied internally.
+ * @return @c NULL if the instance can not be allocated or initialized.
+ */
+JXL_EXPORT JxlMemoryArena* JxlMemoryArenaCreate(
+    const JxlMemoryManager* memory_manager);
+
+/**
+ * Destroys the arena and returns all the memory it keeps to the underlying
+ * memory manager. The decoders and encoders using the arena must be destroyed
+ * before.
+ *
+ * @param arena instance to be destroyed.
+ */
+JXL_EXPORT void JxlMemoryArenaDestroy(JxlMemoryArena* arena);
+
+/**
+ * Returns the memory manager to pass to @ref JxlDecoderCreate or @ref
+ * JxlEncoderCreate to allocate through the arena. It is valid until the arena
+ * is destroyed.
+ *
+ * @param arena the arena.
+ * @return the memory manager of the arena.
+ */
+JXL_EXPORT const JxlMemoryManager* JxlMemoryArenaGetMemoryManager(
+    JxlMemoryArena* arena);
+
+/**
+ * Returns the memory that is currently unused to the underlying memory
+ * manager, e.g. when the images to be decoded change size.
+ *
+ * @param arena the arena.
+ */
+JXL_EXPORT void JxlMemoryArenaTrim(JxlMemoryArena* arena);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* JXL_MEMORY_ARENA_H_ */
+
+/** @}*/
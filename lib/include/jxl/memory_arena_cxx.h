@@ -0,0 +1,51 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+/// @addtogroup libjxl_cpp
+/// @{
+///
+/// @file memory_arena_cxx.h
+/// @brief C++ header-only helper for @ref memory_arena.h.
+///
+/// There's no binary library associated with the header since this is a header
+/// only library.
+
+#ifndef JXL_MEMORY_ARENA_CXX_H_
+#define JXL_MEMORY_ARENA_CXX_H_
+
+#include <jxl/memory_arena.h>
+#include <jxl/memory_manager.h>
+
+#include <memory>
+
+#ifndef __cplusplus
+#error "This a C++ only header. Use jxl/memory_arena.h from C sources."
+#endif
+
+/// Struct to call JxlMemoryArenaDestroy from the JxlMemoryArenaPtr unique_ptr.
+struct JxlMemoryArenaDestroyStruct {
+  /// Calls @ref JxlMemoryArenaDestroy() on the passed arena.
+  void operator()(JxlMemoryArena* arena) { JxlMemoryArenaDestroy(arena); }
+};
+
+/// std::unique_ptr<> type that calls JxlMemoryArenaDestroy() when releasing
+/// the arena.
+typedef std::unique_ptr<JxlMemoryArena, JxlMemoryArenaDestroyStruct>
+    JxlMemoryArenaPtr;
+
+/// Creates an instance of JxlMemoryArena into a JxlMemoryArenaPtr.
+///
+/// @param memory_manager underlying allocator. It may be NULL. The memory
+///        manager will be copied internally.
+/// @return a @c NULL JxlMemoryArenaPtr if the instance can not be allocated
+/// @return initialized JxlMemoryArenaPtr instance otherwise.
+static inline JxlMemoryArenaPtr JxlMemoryArenaMake(
+    const JxlMemoryManager* memory_manager) {
+  return JxlMemoryArenaPtr(JxlMemoryArenaCreate(memory_manager));
+}
+
+#endif  // JXL_MEMORY_ARENA_CXX_H_
+
+/// @}
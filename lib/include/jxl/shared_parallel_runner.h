@@ -0,0 +1,97 @@
+/* Copyright (c) the JPEG XL Project Authors. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+/** @addtogroup libjxl_threads
+ * @{
+ * @file shared_parallel_runner.h
+ * @brief implementation using std::thread of a ::JxlParallelRunner shared by
+ * many encoder and decoder instances.
+ */
+
+/** Implementation of JxlParallelRunner for processes that run many encoders
+ * and decoders at the same time, such as image servers. A single pool of
+ * worker threads is created for the whole process, and any number of
+ * concurrent JxlSharedParallelRunner calls, from different threads or nested
+ * inside the tasks of another call, are multiplexed onto it. The total number
+ * of threads thus stays bounded while throughput scales with the number of
+ * concurrent requests.
+ *
+ * Each encoder or decoder uses its own client, created with @ref
+ * JxlSharedParallelRunnerCreateClient, as the opaque runner. Idle workers pick
+ * the call of the client with the highest priority; calls of equal priority
+ * share the workers evenly. Workers leave a call when a call with a higher
+ * priority arrives. The calling thread always runs tasks of its own call, so
+ * that calls make progress even when all workers are busy.
+ */
+
+#ifndef JXL_SHARED_PARALLEL_RUNNER_H_
+#define JXL_SHARED_PARALLEL_RUNNER_H_
+
+#include <jxl/jxl_threads_export.h>
+#include <jxl/memory_manager.h>
+#include <jxl/parallel_runner.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Parallel runner multiplexing concurrent calls onto a shared pool of
+ * threads. Use as @ref JxlParallelRunner, with a client created by @ref
+ * JxlSharedParallelRunnerCreateClient as the opaque runner.
+ */
+JXL_THREADS_EXPORT JxlParallelRetCode JxlSharedParallelRunner(
+    void* runner_opaque, void* jpegxl_opaque, JxlParallelRunInit init,
+    JxlParallelRunFunction func, uint32_t start_range, uint32_t end_range);
+
+/** Creates the shared pool of worker threads.
+ *
+ * @param memory_manager custom allocator function. It may be NULL. The memory
+ *     manager will be copied internally.
+ * @param num_worker_threads number of worker threads. The calling thread of
+ *     each call runs tasks as well.
+ * @return @c NULL if the instance can not be allocated or initialized.
+ */
+JXL_THREADS_EXPORT void* JxlSharedParallelRunnerCreate(
+    const JxlMemoryManager* memory_manager, size_t num_worker_threads);
+
+/** Destroys the pool created by @ref JxlSharedParallelRunnerCreate. All the
+ * clients of the pool must be destroyed before.
+ */
+JXL_THREADS_EXPORT void JxlSharedParallelRunnerDestroy(void* pool_opaque);
+
+/** Creates a client of the pool, to be used as the opaque runner of @ref
+ * JxlSharedParallelRunner by one encoder or decoder. Clients are cheap; one
+ * client may also be shared by several encoders and decoders with the same
+ * priority.
+ *
+ * @param pool_opaque the pool created by @ref JxlSharedParallelRunnerCreate.
+ * @param priority priority of the calls made through this client. Calls with a
+ *     higher value are served first.
+ * @return @c NULL if the instance can not be allocated.
+ */
+JXL_THREADS_EXPORT void* JxlSharedParallelRunnerCreateClient(void* pool_opaque,
+                                                             int32_t priority);
+
+/** Destroys the client created by @ref JxlSharedParallelRunnerCreateClient.
+ * No call may be running through the client.
+ */
+JXL_THREADS_EXPORT void JxlSharedParallelRunnerDestroyClient(
+    void* runner_opaque);
+
+/** Returns a default num_worker_threads value for
+ * @ref JxlSharedParallelRunnerCreate.
+ */
+JXL_THREADS_EXPORT size_t JxlSharedParallelRunnerDefaultNumWorkerThreads(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* JXL_SHARED_PARALLEL_RUNNER_H_ */
+
+/** @}*/
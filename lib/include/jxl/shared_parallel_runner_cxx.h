@@ -0,0 +1,90 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+/// @addtogroup libjxl_cpp
+/// @{
+///
+/// @file shared_parallel_runner_cxx.h
+/// @brief C++ header-only helper for @ref shared_parallel_runner.h.
+///
+/// There's no binary library associated with the header since this is a header
+/// only library.
+
+#ifndef JXL_SHARED_PARALLEL_RUNNER_CXX_H_
+#define JXL_SHARED_PARALLEL_RUNNER_CXX_H_
+
+#include <jxl/memory_manager.h>
+#include <jxl/shared_parallel_runner.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#ifndef __cplusplus
+#error \
+    "This a C++ only header. Use jxl/shared_parallel_runner.h from C" \
+    "sources."
+#endif
+
+/// Struct to call JxlSharedParallelRunnerDestroy from the
+/// JxlSharedParallelRunnerPtr unique_ptr.
+struct JxlSharedParallelRunnerDestroyStruct {
+  /// Calls @ref JxlSharedParallelRunnerDestroy() on the passed pool.
+  void operator()(void* pool) { JxlSharedParallelRunnerDestroy(pool); }
+};
+
+/// std::unique_ptr<> type that calls JxlSharedParallelRunnerDestroy() when
+/// releasing the pool.
+typedef std::unique_ptr<void, JxlSharedParallelRunnerDestroyStruct>
+    JxlSharedParallelRunnerPtr;
+
+/// Struct to call JxlSharedParallelRunnerDestroyClient from the
+/// JxlSharedParallelRunnerClientPtr unique_ptr.
+struct JxlSharedParallelRunnerDestroyClientStruct {
+  /// Calls @ref JxlSharedParallelRunnerDestroyClient() on the passed client.
+  void operator()(void* client) {
+    JxlSharedParallelRunnerDestroyClient(client);
+  }
+};
+
+/// std::unique_ptr<> type that calls JxlSharedParallelRunnerDestroyClient()
+/// when releasing the client.
+typedef std::unique_ptr<void, JxlSharedParallelRunnerDestroyClientStruct>
+    JxlSharedParallelRunnerClientPtr;
+
+/// Creates an instance of the shared pool into a JxlSharedParallelRunnerPtr.
+/// See @ref JxlSharedParallelRunnerCreate for details on the instance
+/// creation.
+///
+/// @param memory_manager custom allocator function. It may be NULL. The memory
+///        manager will be copied internally.
+/// @param num_worker_threads the number of worker threads to create.
+/// @return a @c NULL JxlSharedParallelRunnerPtr if the instance can not be
+/// allocated or initialized
+/// @return initialized JxlSharedParallelRunnerPtr instance otherwise.
+static inline JxlSharedParallelRunnerPtr JxlSharedParallelRunnerMake(
+    const JxlMemoryManager* memory_manager, size_t num_worker_threads) {
+  return JxlSharedParallelRunnerPtr(
+      JxlSharedParallelRunnerCreate(memory_manager, num_worker_threads));
+}
+
+/// Creates a client of the shared pool into a
+/// JxlSharedParallelRunnerClientPtr. See @ref
+/// JxlSharedParallelRunnerCreateClient for details.
+///
+/// @param pool the pool created by @ref JxlSharedParallelRunnerCreate.
+/// @param priority priority of the calls made through this client.
+/// @return a @c NULL JxlSharedParallelRunnerClientPtr if the instance can not
+/// be allocated
+/// @return initialized JxlSharedParallelRunnerClientPtr instance otherwise.
+static inline JxlSharedParallelRunnerClientPtr
+JxlSharedParallelRunnerMakeClient(void* pool, int32_t priority) {
+  return JxlSharedParallelRunnerClientPtr(
+      JxlSharedParallelRunnerCreateClient(pool, priority));
+}
+
+#endif  // JXL_SHARED_PARALLEL_RUNNER_CXX_H_
+
+/// @}
@@ -0,0 +1,107 @@
+/* Copyright (c) the JPEG XL Project Authors. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+/** @addtogroup libjxl_threads
+ * @{
+ * @file work_stealing_parallel_runner.h
+ * @brief work-stealing implementation using std::thread of a
+ * ::JxlParallelRunner.
+ */
+
+/** Implementation of JxlParallelRunner for machines with many cores. Each
+ * thread owns a range of the tasks of a call and takes tasks from its front;
+ * threads that run out of tasks steal half of the remaining range of another
+ * thread, preferring threads on the same NUMA node. This avoids the single
+ * shared task counter and the single wake-up condition variable of @ref
+ * JxlThreadParallelRunner. Idle workers spin for a short while before
+ * sleeping, so that back-to-back calls do not pay for a wake-up. The calling
+ * thread also runs tasks.
+ *
+ * The number of threads is fixed at construction time and the threads are
+ * re-used for every call. Only one concurrent JxlWorkStealingParallelRunner
+ * call per instance is allowed at a time.
+ */
+
+#ifndef JXL_WORK_STEALING_PARALLEL_RUNNER_H_
+#define JXL_WORK_STEALING_PARALLEL_RUNNER_H_
+
+#include <jxl/jxl_threads_export.h>
+#include <jxl/memory_manager.h>
+#include <jxl/parallel_runner.h>
+#include <jxl/types.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Options for @ref JxlWorkStealingParallelRunnerCreate. Initialize with @ref
+ * JxlWorkStealingParallelRunnerDefaultOptions before changing fields.
+ */
+typedef struct {
+  /** Number of worker threads, in addition to the calling thread. If zero, all
+   * tasks run on the calling thread.
+   */
+  size_t num_worker_threads;
+
+  /** If true, each worker thread is bound to a single CPU, and workers are
+   * spread evenly over the NUMA nodes. Only supported on Linux, ignored on
+   * other platforms.
+   */
+  JXL_BOOL pin_threads;
+
+  /** If true, workers are grouped by NUMA node and steal tasks from workers of
+   * their own node before trying other nodes. Only has an effect if the NUMA
+   * topology is known (on Linux).
+   */
+  JXL_BOOL numa_aware;
+
+  /** Number of times an idle worker checks for new tasks before going to
+   * sleep. Higher values reduce the latency of consecutive calls at the cost of
+   * CPU time.
+   */
+  uint32_t spin_iterations;
+} JxlWorkStealingParallelRunnerOptions;
+
+/** Parallel runner internally using std::thread and work stealing. Use as
+ * @ref JxlParallelRunner.
+ */
+JXL_THREADS_EXPORT JxlParallelRetCode JxlWorkStealingParallelRunner(
+    void* runner_opaque, void* jpegxl_opaque, JxlParallelRunInit init,
+    JxlParallelRunFunction func, uint32_t start_range, uint32_t end_range);
+
+/** Initializes @p options with default values: one thread per hyperthread
+ * (including the calling thread), NUMA-aware stealing and no pinning.
+ */
+JXL_THREADS_EXPORT void JxlWorkStealingParallelRunnerDefaultOptions(
+    JxlWorkStealingParallelRunnerOptions* options);
+
+/** Creates the runner for @ref JxlWorkStealingParallelRunner. Use as the
+ * opaque runner.
+ *
+ * @param memory_manager custom allocator function. It may be NULL. The memory
+ *     manager will be copied internally.
+ * @param options options for the runner. It may be NULL, in which case the
+ *     default options are used.
+ * @return @c NULL if the instance can not be allocated or initialized.
+ */
+JXL_THREADS_EXPORT void* JxlWorkStealingParallelRunnerCreate(
+    const JxlMemoryManager* memory_manager,
+    const JxlWorkStealingParallelRunnerOptions* options);
+
+/** Destroys the runner created by @ref JxlWorkStealingParallelRunnerCreate.
+ */
+JXL_THREADS_EXPORT void JxlWorkStealingParallelRunnerDestroy(
+    void* runner_opaque);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* JXL_WORK_STEALING_PARALLEL_RUNNER_H_ */
+
+/** @}*/
@@ -21,6 +21,7 @@
 #include <hwy/highway.h>
 
 #include "lib/jpegli/encode_internal.h"
+#include "lib/jpegli/parallel.h"
 #include "lib/jxl/base/compiler_specific.h"
 #include "lib/jxl/base/status.h"
 HWY_BEFORE_NAMESPACE();
@@ -538,8 +539,21 @@ void ComputeAdaptiveQuantField(j_compress_ptr cinfo) {
   if (m->next_iMCU_row + 1 == cinfo->total_iMCU_rows) {
     ylen -= 4;
   }
-  HWY_DYNAMIC_DISPATCH(ComputePreErosion)
-  (input, xsize, y0, ylen, kPreErosionBorder, m->diff_buffer, &m->pre_erosion);
+  if (m->parallel_runner != nullptr) {
+    // Each group of 4 input rows contributes to a separate pre-erosion row, so
+    // these can be computed independently.
+    const auto compute_pre_erosion = [&](const uint32_t task) {
+      HWY_DYNAMIC_DISPATCH(ComputePreErosion)
+      (input, xsize, y0 + 4 * task, 4, kPreErosionBorder,
+       m->diff_buffer + task * m->diff_buffer_stride, &m->pre_erosion);
+    };
+    RunParallel(cinfo, m->parallel_runner, m->parallel_runner_opaque, 0,
+                ylen / 4, compute_pre_erosion, "ComputePreErosion");
+  } else {
+    HWY_DYNAMIC_DISPATCH(ComputePreErosion)
+    (input, xsize, y0, ylen, kPreErosionBorder, m->diff_buffer,
+     &m->pre_erosion);
+  }
   if (y0 == 0) {
     m->pre_erosion.CopyRow(-1, 0, kPreErosionBorder);
   }
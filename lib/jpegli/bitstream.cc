@@ -5,11 +5,14 @@
 
 #include "lib/jpegli/bitstream.h"
 
+#include <algorithm>
 #include <cmath>
+#include <vector>
 
 #include "lib/jpegli/bit_writer.h"
 #include "lib/jpegli/error.h"
 #include "lib/jpegli/memory_manager.h"
+#include "lib/jpegli/parallel.h"
 
 namespace jpegli {
 
@@ -352,6 +355,128 @@ void WriteTokens(j_compress_ptr cinfo, int scan_index, JpegBitWriter* bw) {
   }
 }
 
+// Minimum number of tokens written by one task of the parallel runner.
+constexpr size_t kMinTokensPerTask = 1 << 14;
+// Maximum size of the output buffers of the tasks that run at the same time.
+constexpr size_t kMaxBytesInFlight = 1 << 24;
+
+// Huffman codes the tokens of a scan with restart intervals on the parallel
+// runner. Since each restart interval starts on a byte boundary with an empty
+// bit buffer, the tasks can code ranges of restart intervals into separate
+// buffers that are then concatenated with restart markers in between. Returns
+// false if the scan has to be written sequentially.
+bool WriteTokensInParallel(j_compress_ptr cinfo, int scan_index,
+                           JpegBitWriter* bw) {
+  jpeg_comp_master* m = cinfo->master;
+  const ScanTokenInfo& sti = m->scan_token_info[scan_index];
+  if (m->parallel_runner == nullptr || sti.restart_interval == 0 ||
+      sti.num_restarts < 2) {
+    return false;
+  }
+  // Index of the first restart interval of each task, and the end index.
+  std::vector<size_t> task_start = {0};
+  size_t task_begin_token = sti.token_offset;
+  for (size_t r = 0; r < sti.num_restarts; ++r) {
+    if (sti.restarts[r] - task_begin_token >= kMinTokensPerTask ||
+        r + 1 == sti.num_restarts) {
+      task_start.push_back(r + 1);
+      task_begin_token = sti.restarts[r];
+    }
+  }
+  const size_t num_tasks = task_start.size() - 1;
+  if (num_tasks < 2) {
+    return false;
+  }
+  // Index of the first token of each token array, and the total token count.
+  const size_t num_token_arrays = m->cur_token_array + 1;
+  std::vector<size_t> array_start(num_token_arrays + 1);
+  for (size_t i = 0; i < num_token_arrays; ++i) {
+    array_start[i + 1] = array_start[i] + m->token_arrays[i].num_tokens;
+  }
+  const auto first_token = [&](size_t r) {
+    return r == 0 ? sti.token_offset : sti.restarts[r - 1];
+  };
+  // Each token is at most 32 bits that can become 8 bytes with byte stuffing,
+  // and each restart interval adds at most one padding byte and a marker.
+  const auto max_task_bytes = [&](size_t task) {
+    size_t num_tokens =
+        first_token(task_start[task + 1]) - first_token(task_start[task]);
+    size_t num_intervals = task_start[task + 1] - task_start[task];
+    return 8 * num_tokens + 8 * num_intervals + 64;
+  };
+
+  if (!EmptyBitWriterBuffer(bw)) {
+    JPEGLI_ERROR("Output suspension is not supported in finish_compress");
+  }
+  HuffmanCodeTable* coding_tables = &m->coding_tables[0];
+  uint8_t* context_map = m->context_map;
+  std::vector<uint8_t> buffer;
+  std::vector<size_t> task_offset;
+  std::vector<size_t> task_len;
+  std::vector<uint8_t> task_healthy;
+  size_t batch_start = 0;
+  while (batch_start < num_tasks) {
+    size_t batch_end = batch_start;
+    task_offset.assign(1, 0);
+    while (batch_end < num_tasks &&
+           (batch_end == batch_start ||
+            task_offset.back() + max_task_bytes(batch_end) <=
+                kMaxBytesInFlight)) {
+      task_offset.push_back(task_offset.back() + max_task_bytes(batch_end));
+      ++batch_end;
+    }
+    buffer.resize(task_offset.back());
+    task_len.resize(batch_end - batch_start);
+    task_healthy.resize(batch_end - batch_start);
+    const auto write_task = [&](uint32_t task) {
+      const size_t slot = task - batch_start;
+      JpegBitWriter task_bw;
+      task_bw.cinfo = cinfo;
+      task_bw.data = &buffer[task_offset[slot]];
+      task_bw.len = task_offset[slot + 1] - task_offset[slot];
+      task_bw.pos = 0;
+      task_bw.output_pos = 0;
+      task_bw.put_buffer = 0;
+      task_bw.free_bits = 64;
+      task_bw.healthy = true;
+      size_t r = task_start[task];
+      const size_t begin = first_token(r);
+      const size_t end = first_token(task_start[task + 1]);
+      size_t array_idx =
+          std::upper_bound(array_start.begin(), array_start.end(), begin) -
+          array_start.begin() - 1;
+      for (size_t i = begin; i < end; ++i) {
+        if (i == sti.restarts[r]) {
+          JumpToByteBoundary(&task_bw);
+          EmitMarker(&task_bw, 0xD0 + (r & 0x7));
+          ++r;
+        }
+        while (i >= array_start[array_idx + 1]) ++array_idx;
+        Token t = m->token_arrays[array_idx].tokens[i - array_start[array_idx]];
+        const HuffmanCodeTable* code = &coding_tables[context_map[t.context]];
+        WriteBits(&task_bw, code->depth[t.symbol],
+                  code->code[t.symbol] | t.bits);
+      }
+      JumpToByteBoundary(&task_bw);
+      task_len[slot] = task_bw.pos;
+      task_healthy[slot] = task_bw.healthy ? 1 : 0;
+    };
+    RunParallel(cinfo, m->parallel_runner, m->parallel_runner_opaque,
+                batch_start, batch_end, write_task, "WriteTokens");
+    for (size_t task = batch_start; task < batch_end; ++task) {
+      const size_t slot = task - batch_start;
+      if (task > 0) {
+        WriteOutput(cinfo, {0xFF, static_cast<uint8_t>(
+                                      0xD0 + ((task_start[task] - 1) & 0x7))});
+      }
+      WriteOutput(cinfo, &buffer[task_offset[slot]], task_len[slot]);
+      if (!task_healthy[slot]) bw->healthy = false;
+    }
+    batch_start = batch_end;
+  }
+  return true;
+}
+
 void WriteACRefinementTokens(j_compress_ptr cinfo, int scan_index,
                              JpegBitWriter* bw) {
   jpeg_comp_master* m = cinfo->master;
@@ -433,7 +558,9 @@ void WriteScanData(j_compress_ptr cinfo, int scan_index) {
   const jpeg_scan_info* scan_info = &cinfo->scan_info[scan_index];
   JpegBitWriter* bw = &cinfo->master->bw;
   if (scan_info->Ah == 0) {
-    WriteTokens(cinfo, scan_index, bw);
+    if (!WriteTokensInParallel(cinfo, scan_index, bw)) {
+      WriteTokens(cinfo, scan_index, bw);
+    }
   } else if (scan_info->Ss > 0) {
     WriteACRefinementTokens(cinfo, scan_index, bw);
   } else {
@@ -50,6 +50,7 @@ void InitializeImage(j_decompress_ptr cinfo) {
   m->input_buffer_.clear();
   m->input_buffer_pos_ = 0;
   m->codestream_bits_ahead_ = 0;
+  m->skipping_scan_ = false;
   m->is_multiscan_ = false;
   m->found_soi_ = false;
   m->found_dri_ = false;
@@ -309,6 +310,8 @@ int ConsumeInput(j_decompress_ptr cinfo) {
     size_t pos = 0;
     if (cinfo->global_state == kDecProcessScan) {
       status = ProcessScan(cinfo, data, len, &pos, &m->codestream_bits_ahead_);
+    } else if (m->skipping_scan_) {
+      status = SkipScan(cinfo, data, len, &pos);
     } else {
       status = ProcessMarkers(cinfo, data, len, &pos);
     }
@@ -381,6 +384,9 @@ int ConsumeInput(j_decompress_ptr cinfo) {
   } else if (status == JPEG_REACHED_SOS) {
     if (cinfo->global_state == kDecInHeader) {
       cinfo->global_state = kDecHeaderDone;
+    } else if (m->dc_only_ && cinfo->Ss > 0) {
+      // The AC scans do not contribute to the output in DC-only mode.
+      m->skipping_scan_ = true;
     } else {
       PrepareForScan(cinfo);
     }
@@ -530,6 +536,23 @@ void AllocateOutputBuffers(j_decompress_ptr cinfo) {
       cinfo, bytes_per_pixel * scratch_stride, JPOOL_IMAGE_ALIGNED);
   m->smoothing_scratch_ =
       Allocate<int16_t>(cinfo, DCTSIZE2, JPOOL_IMAGE_ALIGNED);
+  m->render_scratch_.clear();
+  if (m->parallel_runner_ != nullptr) {
+    // Buffers for rendering a few row groups in parallel.
+    size_t num_slots = 2 * m->min_scaled_dct_size;
+    m->render_scratch_.resize(num_slots);
+    for (auto& scratch : m->render_scratch_) {
+      for (int c = 0; c < num_all_components; ++c) {
+        scratch.render_output[c].Allocate(cinfo, cinfo->max_v_samp_factor,
+                                          output_stride);
+      }
+      scratch.upsample_scratch =
+          Allocate<float>(cinfo, output_stride + kPaddingLeft + kPaddingRight,
+                          JPOOL_IMAGE_ALIGNED);
+      scratch.output_scratch = Allocate<uint8_t>(
+          cinfo, bytes_per_pixel * scratch_stride, JPOOL_IMAGE_ALIGNED);
+    }
+  }
   size_t coeffs_per_block = cinfo->num_components * DCTSIZE2;
   m->nonzeros_ = Allocate<int>(cinfo, coeffs_per_block, JPOOL_IMAGE_ALIGNED);
   m->sumabs_ = Allocate<int>(cinfo, coeffs_per_block, JPOOL_IMAGE_ALIGNED);
@@ -567,6 +590,8 @@ void jpegli_CreateDecompress(j_decompress_ptr cinfo, int version,
   }
   m->com_marker_parser = nullptr;
   memset(m->markers_to_save_, 0, sizeof(m->markers_to_save_));
+  m->parallel_runner_ = nullptr;
+  m->parallel_runner_opaque_ = nullptr;
   jpegli::InitializeDecompressParams(cinfo);
   jpegli::InitializeImage(cinfo);
 }
@@ -1058,3 +1083,26 @@ void jpegli_set_output_format(j_decompress_ptr cinfo, JpegliDataType data_type,
       JPEGLI_ERROR("Unsupported endianness %d", endianness);
   }
 }
+
+void jpegli_set_decompress_parallel_runner(j_decompress_ptr cinfo,
+                                           JpegliParallelRunner runner,
+                                           void* runner_opaque) {
+  if (cinfo->global_state != jpegli::kDecStart &&
+      cinfo->global_state != jpegli::kDecInHeader &&
+      cinfo->global_state != jpegli::kDecHeaderDone) {
+    JPEGLI_ERROR("jpegli_set_decompress_parallel_runner: unexpected state %d",
+                 cinfo->global_state);
+  }
+  cinfo->master->parallel_runner_ = runner;
+  cinfo->master->parallel_runner_opaque_ = runner_opaque;
+}
+
+void jpegli_set_decompress_dc_only(j_decompress_ptr cinfo, boolean dc_only) {
+  if (cinfo->global_state != jpegli::kDecStart &&
+      cinfo->global_state != jpegli::kDecInHeader &&
+      cinfo->global_state != jpegli::kDecHeaderDone) {
+    JPEGLI_ERROR("jpegli_set_decompress_dc_only: unexpected state %d",
+                 cinfo->global_state);
+  }
+  cinfo->master->dc_only_ = FROM_JXL_BOOL(dc_only);
+}
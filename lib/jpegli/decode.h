@@ -100,6 +100,25 @@ void jpegli_new_colormap(j_decompress_ptr cinfo);
 void jpegli_set_output_format(j_decompress_ptr cinfo, JpegliDataType data_type,
                               JpegliEndianness endianness);
 
+// Sets the parallel runner that the decoder uses to decode the restart
+// intervals of each iMCU row, and to compute the inverse DCT, upsampling and
+// color conversion of the decoded rows. The output is the same as without a
+// parallel runner. Restart intervals are only decoded in parallel within one
+// iMCU row, so the entropy decoding is only sped up if there are at least two
+// restart intervals per iMCU row. Must be called before
+// jpegli_start_decompress() or jpegli_read_coefficients().
+void jpegli_set_decompress_parallel_runner(j_decompress_ptr cinfo,
+                                           JpegliParallelRunner runner,
+                                           void *runner_opaque);
+
+// Sets whether the decoder skips the scans of progressive JPEG files that only
+// contain AC coefficients, without decoding their entropy coded data. The
+// output is then reconstructed as if the image had only its DC scans. Together
+// with a scale_num / scale_denom of 1/8 this gives a fast thumbnail with one
+// pixel per 8x8 block. Sequential JPEG files are decoded as usual. Must be
+// called before jpegli_start_decompress() or jpegli_read_coefficients().
+void jpegli_set_decompress_dc_only(j_decompress_ptr cinfo, boolean dc_only);
+
 #ifdef __cplusplus
 }  // extern "C"
 #endif
@@ -497,6 +497,96 @@ TEST(DecodeAPITest, ReuseCinfoSameMemSource) {
   if (buffer) free(buffer);
 }
 
+TEST(DecodeAPITest, ParallelRunnerSameOutput) {
+  std::vector<TestConfig> all_configs = GenerateBasicConfigs();
+  // Images with enough restart intervals per iMCU row to decode them in more
+  // than one task.
+  for (int samp : {1, 2}) {
+    for (int progr : {0, 2}) {
+      TestConfig config;
+      config.input.xsize = 1024 - samp * 13;
+      config.input.ysize = 768;
+      config.jparams.h_sampling = {samp, 1, 1};
+      config.jparams.v_sampling = {samp, 1, 1};
+      config.jparams.progressive_mode = progr;
+      config.jparams.restart_interval = 7;
+      GeneratePixels(&config.input);
+      all_configs.push_back(config);
+    }
+  }
+  for (const TestConfig& config : all_configs) {
+    std::vector<uint8_t> compressed;
+    ASSERT_TRUE(EncodeWithJpegli(config.input, config.jparams, &compressed));
+    TestImage outputs[2];
+    for (int use_runner = 0; use_runner < 2; ++use_runner) {
+      jpeg_decompress_struct cinfo;
+      const auto try_catch_block = [&]() -> bool {
+        ERROR_HANDLER_SETUP(jpegli);
+        jpegli_create_decompress(&cinfo);
+        jpegli_mem_src(&cinfo, compressed.data(), compressed.size());
+        if (use_runner) {
+          jpegli_set_decompress_parallel_runner(&cinfo, &TestParallelRunner,
+                                                nullptr);
+        }
+        TestAPINonBuffered(config.jparams, DecompressParams(), config.input,
+                           &cinfo, &outputs[use_runner]);
+        return true;
+      };
+      EXPECT_TRUE(try_catch_block());
+      jpegli_destroy_decompress(&cinfo);
+    }
+    ASSERT_EQ(outputs[0].pixels.size(), outputs[1].pixels.size());
+    EXPECT_EQ(0, memcmp(outputs[0].pixels.data(), outputs[1].pixels.data(),
+                        outputs[0].pixels.size()));
+  }
+}
+
+TEST(DecodeAPITest, DCOnlyThumbnail) {
+  // Without block smoothing and chroma subsampling, the 1/8 scaled output only
+  // depends on the DC coefficients, so skipping the AC scans must not change
+  // it.
+  std::vector<TestConfig> all_configs;
+  for (int progr : {0, 1, 2, 3}) {
+    TestConfig config;
+    config.input.xsize = 517;
+    config.input.ysize = 331;
+    config.jparams.h_sampling = {1, 1, 1};
+    config.jparams.v_sampling = {1, 1, 1};
+    config.jparams.progressive_mode = progr;
+    config.jparams.restart_interval = progr == 3 ? 11 : 0;
+    GeneratePixels(&config.input);
+    all_configs.push_back(config);
+  }
+  for (const TestConfig& config : all_configs) {
+    std::vector<uint8_t> compressed;
+    ASSERT_TRUE(EncodeWithJpegli(config.input, config.jparams, &compressed));
+    TestImage outputs[2];
+    for (int dc_only = 0; dc_only < 2; ++dc_only) {
+      jpeg_decompress_struct cinfo;
+      const auto try_catch_block = [&]() -> bool {
+        ERROR_HANDLER_SETUP(jpegli);
+        jpegli_create_decompress(&cinfo);
+        jpegli_mem_src(&cinfo, compressed.data(), compressed.size());
+        jpegli_set_decompress_dc_only(&cinfo, dc_only ? TRUE : FALSE);
+        jpegli_read_header(&cinfo, /*require_image=*/TRUE);
+        cinfo.scale_num = 1;
+        cinfo.scale_denom = 8;
+        cinfo.do_block_smoothing = FALSE;
+        jpegli_start_decompress(&cinfo);
+        EXPECT_EQ(DivCeil(config.input.xsize, 8), cinfo.output_width);
+        ReadOutputImage(DecompressParams(), &cinfo, &outputs[dc_only]);
+        jpegli_finish_decompress(&cinfo);
+        return true;
+      };
+      EXPECT_TRUE(try_catch_block());
+      jpegli_destroy_decompress(&cinfo);
+    }
+    ASSERT_EQ(outputs[0].pixels.size(), outputs[1].pixels.size());
+    EXPECT_EQ(0, memcmp(outputs[0].pixels.data(), outputs[1].pixels.data(),
+                        outputs[0].pixels.size()));
+  }
+}
+
 TEST(DecodeAPITest, ReuseCinfoSameStdSource) {
   std::vector<TestConfig> all_configs = GenerateBasicConfigs();
   FILE* tmpf = tmpfile();
@@ -34,6 +34,13 @@ struct MCUCodingState {
   coeff_t coeffs[D_MAX_BLOCKS_IN_MCU * DCTSIZE2];
 };
 
+// Buffers of one task of the parallel upsampling and color conversion.
+struct RenderScratch {
+  RowBuffer<float> render_output[kMaxComponents];
+  float* upsample_scratch;
+  uint8_t* output_scratch;
+};
+
 }  // namespace jpegli
 
 // Use this forward-declared libjpeg struct to hold all our private variables.
@@ -46,6 +53,10 @@ struct jpeg_decomp_master {
   size_t input_buffer_pos_;
   // Number of bits after codestream_pos_ that were already processed.
   size_t codestream_bits_ahead_;
+  // Whether the scans with only AC coefficients are skipped.
+  bool dc_only_ = false;
+  // Whether the entropy coded data of the current scan is being skipped.
+  bool skipping_scan_;
 
   // Coefficient buffers
   jvirt_barray_ptr* coef_arrays;
@@ -151,6 +162,13 @@ struct jpeg_decomp_master {
   // i.e. the bottom half when rendering incomplete scans.
   int (*coef_bits_latch)[SAVED_COEFS];
   int (*prev_coef_bits_latch)[SAVED_COEFS];
+
+  //
+  // Parallel decoding state.
+  //
+  JpegliParallelRunner parallel_runner_;
+  void* parallel_runner_opaque_;
+  std::vector<jpegli::RenderScratch> render_scratch_;
 };
 
 #endif  // LIB_JPEGLI_DECODE_INTERNAL_H_
@@ -8,9 +8,11 @@
 #include <string.h>
 
 #include <hwy/base.h>  // HWY_ALIGN_MAX
+#include <vector>
 
 #include "lib/jpegli/decode_internal.h"
 #include "lib/jpegli/error.h"
+#include "lib/jpegli/parallel.h"
 #include "lib/jxl/base/status.h"
 
 namespace jpegli {
@@ -414,8 +416,199 @@ bool FinishScan(j_decompress_ptr cinfo, const uint8_t* data, const size_t len,
   return true;
 }
 
+// Returns the coefficients of block (ix, iy) of the MCU at the given position
+// in the ith component of the scan, or nullptr if the block is outside of the
+// component.
+coeff_t* GetMCUBlock(j_decompress_ptr cinfo, int i, size_t mcu_row,
+                     size_t mcu_col, int iy, int ix) {
+  jpeg_decomp_master* m = cinfo->master;
+  const jpeg_component_info* comp = cinfo->cur_comp_info[i];
+  size_t block_y = mcu_row * comp->MCU_height + iy;
+  size_t block_x = mcu_col * comp->MCU_width + ix;
+  if (block_x >= comp->width_in_blocks || block_y >= comp->height_in_blocks) {
+    return nullptr;
+  }
+  int biy = block_y % comp->v_samp_factor;
+  return &m->coeff_rows[comp->component_index][biy][block_x][0];
+}
+
+// Decodes the MCU at the given position of the current iMCU row.
+bool DecodeMCU(j_decompress_ptr cinfo, size_t mcu_row, size_t mcu_col,
+               BitReaderState* br, coeff_t* last_dc_coeff, int* eobrun,
+               coeff_t* sink_block) {
+  jpeg_decomp_master* m = cinfo->master;
+  bool scan_ok = true;
+  for (int i = 0; i < cinfo->comps_in_scan; ++i) {
+    const jpeg_component_info* comp = cinfo->cur_comp_info[i];
+    const HuffmanTableEntry* dc_lut =
+        &m->dc_huff_lut_[comp->dc_tbl_no * kJpegHuffmanLutSize];
+    const HuffmanTableEntry* ac_lut =
+        &m->ac_huff_lut_[comp->ac_tbl_no * kJpegHuffmanLutSize];
+    for (int iy = 0; iy < comp->MCU_height; ++iy) {
+      for (int ix = 0; ix < comp->MCU_width; ++ix) {
+        coeff_t* coeffs = GetMCUBlock(cinfo, i, mcu_row, mcu_col, iy, ix);
+        if (coeffs == nullptr) {
+          // Note that it is OK that sink_block is uninitialized because
+          // it will never be used in any branches, even in the RefineDCTBlock
+          // case, because only DC scans can be interleaved and we don't use
+          // the zero-ness of the DC coeff in the DC refinement code-path.
+          coeffs = sink_block;
+        }
+        if (cinfo->Ah == 0) {
+          if (!DecodeDCTBlock(dc_lut, ac_lut, cinfo->Ss, cinfo->Se, cinfo->Al,
+                              eobrun, br,
+                              &last_dc_coeff[comp->component_index], coeffs)) {
+            scan_ok = false;
+          }
+        } else {
+          if (!RefineDCTBlock(ac_lut, cinfo->Ss, cinfo->Se, cinfo->Al, eobrun,
+                              br, coeffs)) {
+            scan_ok = false;
+          }
+        }
+      }
+    }
+  }
+  return scan_ok;
+}
+
+// Decodes the restart intervals that start at the current position of the
+// scan and end in the current iMCU row on the parallel runner, each task
+// decoding one restart interval. This requires the whole entropy coded data
+// of these restart intervals to be in the input buffer already.
+// Returns the number of decoded MCUs and updates the decoder state as if the
+// intervals were decoded sequentially. Returns 0 and leaves the decoder state
+// unchanged if the intervals have to be decoded sequentially, e.g. because
+// their data is not available yet, or it is corrupt or has fill bytes, in which
+// case the sequential decoder will report the same warnings or errors as
+// without a parallel runner.
+size_t DecodeRestartIntervalsInParallel(j_decompress_ptr cinfo,
+                                        const uint8_t* data, const size_t len,
+                                        size_t* pos) {
+  jpeg_decomp_master* m = cinfo->master;
+  const size_t restart_interval = cinfo->restart_interval;
+  if (m->parallel_runner_ == nullptr || restart_interval == 0 ||
+      cinfo->Ah > 0 ||
+      static_cast<size_t>(m->restarts_to_go_) != restart_interval) {
+    return 0;
+  }
+  const size_t MCUs_per_row = cinfo->MCUs_per_row;
+  const size_t mcu_begin = m->scan_mcu_row_ * MCUs_per_row + m->scan_mcu_col_;
+  const size_t scan_end = cinfo->MCU_rows_in_scan * MCUs_per_row;
+  const size_t iMCU_row_end =
+      std::min<size_t>((m->scan_mcu_row_ / m->mcu_rows_per_iMCU_row_ + 1) *
+                           m->mcu_rows_per_iMCU_row_,
+                       cinfo->MCU_rows_in_scan) *
+      MCUs_per_row;
+  size_t num_intervals = (iMCU_row_end - mcu_begin) / restart_interval;
+  if (iMCU_row_end == scan_end) {
+    num_intervals = DivCeil(scan_end - mcu_begin, restart_interval);
+  }
+  if (num_intervals < 2) {
+    return 0;
+  }
+  // Find the entropy coded segment of each restart interval.
+  std::vector<size_t> segment_start(num_intervals);
+  std::vector<size_t> segment_end(num_intervals);
+  size_t p = *pos;
+  for (size_t i = 0; i < num_intervals; ++i) {
+    segment_start[i] = p;
+    for (;;) {
+      if (p + 1 >= len) return 0;
+      const void* next = memchr(&data[p], 0xff, len - 1 - p);
+      if (next == nullptr) return 0;
+      p = static_cast<const uint8_t*>(next) - data;
+      if (data[p + 1] != 0) break;
+      // Skip the stuffed zero byte.
+      p += 2;
+    }
+    if (data[p + 1] == 0xff) {
+      return 0;
+    }
+    segment_end[i] = p;
+    if (i + 1 < num_intervals) {
+      if (data[p + 1] != 0xd0 + ((m->next_restart_marker_ + i) & 0x7)) {
+        return 0;
+      }
+      p += 2;
+    }
+  }
+  std::vector<uint8_t> interval_ok(num_intervals);
+  const auto decode_interval = [&](uint32_t i) {
+    HWY_ALIGN_MAX coeff_t sink_block[DCTSIZE2];
+    coeff_t last_dc_coeff[kMaxComponents] = {0};
+    int eobrun = -1;
+    BitReaderState br(data, segment_end[i], segment_start[i]);
+    bool ok = true;
+    size_t mcu_end = std::min(scan_end, mcu_begin + (i + 1) * restart_interval);
+    for (size_t mcu = mcu_begin + i * restart_interval; mcu < mcu_end; ++mcu) {
+      if (!DecodeMCU(cinfo, mcu / MCUs_per_row, mcu % MCUs_per_row, &br,
+                     last_dc_coeff, &eobrun, sink_block)) {
+        ok = false;
+      }
+    }
+    size_t new_pos;
+    size_t new_bit_pos;
+    if (!br.FinishStream(&new_pos, &new_bit_pos)) {
+      ok = false;
+    } else if (new_bit_pos > 0) {
+      new_pos += data[new_pos] == 0xff ? 2 : 1;
+    }
+    interval_ok[i] = ok && eobrun <= 0 && new_pos == segment_end[i];
+  };
+  RunParallel(cinfo, m->parallel_runner_, m->parallel_runner_opaque_, 0,
+              num_intervals, decode_interval, "DecodeRestartIntervals");
+  const size_t mcu_end =
+      std::min(scan_end, mcu_begin + num_intervals * restart_interval);
+  for (size_t i = 0; i < num_intervals; ++i) {
+    if (interval_ok[i]) continue;
+    // Undo the partial decoding, since the sequential decoder assumes that
+    // the coefficients of this scan are zero.
+    for (size_t mcu = mcu_begin; mcu < mcu_end; ++mcu) {
+      for (int c = 0; c < cinfo->comps_in_scan; ++c) {
+        const jpeg_component_info* comp = cinfo->cur_comp_info[c];
+        for (int iy = 0; iy < comp->MCU_height; ++iy) {
+          for (int ix = 0; ix < comp->MCU_width; ++ix) {
+            coeff_t* coeffs = GetMCUBlock(cinfo, c, mcu / MCUs_per_row,
+                                          mcu % MCUs_per_row, iy, ix);
+            if (coeffs == nullptr) continue;
+            for (int k = cinfo->Ss; k <= cinfo->Se; ++k) {
+              coeffs[kJPEGNaturalOrder[k]] = 0;
+            }
+          }
+        }
+      }
+    }
+    return 0;
+  }
+  *pos = segment_end[num_intervals - 1];
+  m->next_restart_marker_ += num_intervals - 1;
+  m->next_restart_marker_ &= 0x7;
+  m->restarts_to_go_ = 0;
+  return mcu_end - mcu_begin;
+}
+
 }  // namespace
 
+int SkipScan(j_decompress_ptr cinfo, const uint8_t* const data,
+             const size_t len, size_t* pos) {
+  while (*pos + 1 < len) {
+    const void* next = memchr(&data[*pos], 0xff, len - 1 - *pos);
+    if (next == nullptr) {
+      *pos = len - 1;
+      break;
+    }
+    *pos = static_cast<const uint8_t*>(next) - data;
+    uint8_t marker = data[*pos + 1];
+    if (marker != 0 && marker != 0xff && (marker < 0xd0 || marker > 0xd7)) {
+      cinfo->master->skipping_scan_ = false;
+      return JPEG_SCAN_COMPLETED;
+    }
+    ++(*pos);
+  }
+  return kNeedMoreInput;
+}
+
 void PrepareForiMCURow(j_decompress_ptr cinfo) {
   jpeg_decomp_master* m = cinfo->master;
   for (int i = 0; i < cinfo->comps_in_scan; ++i) {
@@ -462,6 +655,28 @@ int ProcessScan(j_decompress_ptr cinfo, const uint8_t* const data,
       return kHandleRestart;
     }
 
+    if (*bit_pos == 0) {
+      size_t num_mcus = DecodeRestartIntervalsInParallel(cinfo, data, len, pos);
+      if (num_mcus > 0) {
+        size_t mcu_idx =
+            m->scan_mcu_row_ * cinfo->MCUs_per_row + m->scan_mcu_col_;
+        mcu_idx += num_mcus;
+        m->scan_mcu_row_ = mcu_idx / cinfo->MCUs_per_row;
+        m->scan_mcu_col_ = mcu_idx % cinfo->MCUs_per_row;
+        if (m->scan_mcu_col_ > 0) {
+          continue;
+        } else if (m->scan_mcu_row_ == cinfo->MCU_rows_in_scan) {
+          if (!FinishScan(cinfo, data, len, pos, bit_pos)) {
+            return kNeedMoreInput;
+          }
+          break;
+        } else if ((m->scan_mcu_row_ % m->mcu_rows_per_iMCU_row_) == 0) {
+          break;
+        }
+        continue;
+      }
+    }
+
     size_t start_pos = *pos;
     BitReaderState br(data, len, start_pos);
     if (*bit_pos > 0) {
@@ -473,46 +688,8 @@ int ProcessScan(j_decompress_ptr cinfo, const uint8_t* const data,
 
     // Decode one MCU.
     HWY_ALIGN_MAX static coeff_t sink_block[DCTSIZE2] = {0};
-    bool scan_ok = true;
-    for (int i = 0; i < cinfo->comps_in_scan; ++i) {
-      const jpeg_component_info* comp = cinfo->cur_comp_info[i];
-      int c = comp->component_index;
-      const HuffmanTableEntry* dc_lut =
-          &m->dc_huff_lut_[comp->dc_tbl_no * kJpegHuffmanLutSize];
-      const HuffmanTableEntry* ac_lut =
-          &m->ac_huff_lut_[comp->ac_tbl_no * kJpegHuffmanLutSize];
-      for (int iy = 0; iy < comp->MCU_height; ++iy) {
-        size_t block_y = m->scan_mcu_row_ * comp->MCU_height + iy;
-        int biy = block_y % comp->v_samp_factor;
-        for (int ix = 0; ix < comp->MCU_width; ++ix) {
-          size_t block_x = m->scan_mcu_col_ * comp->MCU_width + ix;
-          coeff_t* coeffs;
-          if (block_x >= comp->width_in_blocks ||
-              block_y >= comp->height_in_blocks) {
-            // Note that it is OK that sink_block is uninitialized because
-            // it will never be used in any branches, even in the RefineDCTBlock
-            // case, because only DC scans can be interleaved and we don't use
-            // the zero-ness of the DC coeff in the DC refinement code-path.
-            coeffs = sink_block;
-          } else {
-            coeffs = &m->coeff_rows[c][biy][block_x][0];
-          }
-          if (cinfo->Ah == 0) {
-            if (!DecodeDCTBlock(dc_lut, ac_lut, cinfo->Ss, cinfo->Se, cinfo->Al,
-                                &m->eobrun_, &br,
-                                &m->last_dc_coeff_[comp->component_index],
-                                coeffs)) {
-              scan_ok = false;
-            }
-          } else {
-            if (!RefineDCTBlock(ac_lut, cinfo->Ss, cinfo->Se, cinfo->Al,
-                                &m->eobrun_, &br, coeffs)) {
-              scan_ok = false;
-            }
-          }
-        }
-      }
-    }
+    bool scan_ok = DecodeMCU(cinfo, m->scan_mcu_row_, m->scan_mcu_col_, &br,
+                             m->last_dc_coeff_, &m->eobrun_, sink_block);
     size_t new_pos;
     size_t new_bit_pos;
     bool stream_ok = br.FinishStream(&new_pos, &new_bit_pos);
@@ -24,6 +24,14 @@ namespace jpegli {
 int ProcessScan(j_decompress_ptr cinfo, const uint8_t* data, size_t len,
                 size_t* pos, size_t* bit_pos);
 
+// Skips the entropy coded data of the current scan, including its restart
+// markers, without decoding it.
+// Return value is one of:
+//   * kNeedMoreInput, if the input buffer ends before the end of the scan;
+//   * JPEG_SCAN_COMPLETED, if the marker after the scan is reached.
+int SkipScan(j_decompress_ptr cinfo, const uint8_t* data, size_t len,
+             size_t* pos);
+
 void PrepareForiMCURow(j_decompress_ptr cinfo);
 
 }  // namespace jpegli
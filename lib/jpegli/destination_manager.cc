@@ -85,6 +85,53 @@ struct MemoryDestinationManager {
   }
 };
 
+struct BufferRingDestinationManager {
+  jpeg_destination_mgr pub;
+  JpegliOutputBufferFunc func;
+  void* opaque;
+  // Current output buffer, supplied by the application.
+  uint8_t* buffer;
+  size_t buffer_size;
+
+  static void next_buffer(j_compress_ptr cinfo, size_t filled_size) {
+    auto* dest = reinterpret_cast<BufferRingDestinationManager*>(cinfo->dest);
+    uint8_t* next = nullptr;
+    size_t next_size = 0;
+    if (!dest->func(dest->opaque, dest->buffer, filled_size, &next,
+                    &next_size) ||
+        next == nullptr || next_size == 0) {
+      JPEGLI_ERROR("Failed to get output buffer.");
+    }
+    dest->buffer = next;
+    dest->buffer_size = next_size;
+    dest->pub.next_output_byte = next;
+    dest->pub.free_in_buffer = next_size;
+  }
+
+  static void init_destination(j_compress_ptr cinfo) {
+    auto* dest = reinterpret_cast<BufferRingDestinationManager*>(cinfo->dest);
+    dest->buffer = nullptr;
+    next_buffer(cinfo, 0);
+  }
+
+  static boolean empty_output_buffer(j_compress_ptr cinfo) {
+    auto* dest = reinterpret_cast<BufferRingDestinationManager*>(cinfo->dest);
+    next_buffer(cinfo, dest->buffer_size);
+    return TRUE;
+  }
+
+  static void term_destination(j_compress_ptr cinfo) {
+    auto* dest = reinterpret_cast<BufferRingDestinationManager*>(cinfo->dest);
+    size_t filled_size = dest->buffer_size - dest->pub.free_in_buffer;
+    if (!dest->func(dest->opaque, dest->buffer, filled_size, nullptr,
+                    nullptr)) {
+      JPEGLI_ERROR("Failed to write to output buffer.");
+    }
+    dest->buffer = nullptr;
+    dest->buffer_size = 0;
+  }
+};
+
 }  // namespace jpegli
 
 void jpegli_stdio_dest(j_compress_ptr cinfo, FILE* outfile) {
@@ -146,3 +193,34 @@ void jpegli_mem_dest(j_compress_ptr cinfo, unsigned char** outbuffer,
   dest->pub.next_output_byte = dest->current_buffer;
   dest->pub.free_in_buffer = dest->buffer_size;
 }
+
+void jpegli_buffer_ring_dest(j_compress_ptr cinfo, JpegliOutputBufferFunc func,
+                             void* opaque) {
+  if (func == nullptr) {
+    JPEGLI_ERROR("jpegli_buffer_ring_dest: Invalid destination.");
+  }
+  if (cinfo->dest &&
+      cinfo->dest->init_destination !=
+          jpegli::BufferRingDestinationManager::init_destination) {
+    JPEGLI_ERROR(
+        "jpegli_buffer_ring_dest: a different dest manager was already set");
+  }
+  if (!cinfo->dest) {
+    cinfo->dest = reinterpret_cast<jpeg_destination_mgr*>(
+        jpegli::Allocate<jpegli::BufferRingDestinationManager>(cinfo, 1));
+  }
+  auto* dest =
+      reinterpret_cast<jpegli::BufferRingDestinationManager*>(cinfo->dest);
+  dest->func = func;
+  dest->opaque = opaque;
+  dest->buffer = nullptr;
+  dest->buffer_size = 0;
+  dest->pub.next_output_byte = nullptr;
+  dest->pub.free_in_buffer = 0;
+  dest->pub.init_destination =
+      jpegli::BufferRingDestinationManager::init_destination;
+  dest->pub.empty_output_buffer =
+      jpegli::BufferRingDestinationManager::empty_output_buffer;
+  dest->pub.term_destination =
+      jpegli::BufferRingDestinationManager::term_destination;
+}
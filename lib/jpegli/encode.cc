@@ -391,6 +391,9 @@ bool IsStreamingSupported(j_compress_ptr cinfo) {
   if (cinfo->master->psnr_target > 0) {
     return false;
   }
+  if (cinfo->master->coefficient_callback != nullptr) {
+    return false;
+  }
   return true;
 }
 
@@ -442,6 +445,12 @@ void AllocateBuffers(j_compress_ptr cinfo) {
   }
   m->dct_buffer = Allocate<float>(cinfo, 2 * DCTSIZE2, JPOOL_IMAGE_ALIGNED);
   m->block_tmp = Allocate<int32_t>(cinfo, DCTSIZE2 * 4, JPOOL_IMAGE_ALIGNED);
+  if (m->parallel_runner != nullptr) {
+    m->imcu_row_coeffs = Allocate<int32_t>(
+        cinfo, m->blocks_per_iMCU_row * DCTSIZE2, JPOOL_IMAGE_ALIGNED);
+    m->imcu_row_dc =
+        Allocate<float>(cinfo, 2 * m->blocks_per_iMCU_row, JPOOL_IMAGE);
+  }
   if (!IsStreamingSupported(cinfo)) {
     m->coeff_buffers =
         Allocate<jvirt_barray_ptr>(cinfo, cinfo->num_components, JPOOL_IMAGE);
@@ -460,8 +469,16 @@ void AllocateBuffers(j_compress_ptr cinfo) {
     const size_t xsize_blocks = y_comp->width_in_blocks;
     const size_t vecsize = VectorSize();
     const size_t xsize_padded = DivCeil(2 * xsize_blocks, vecsize) * vecsize;
-    m->diff_buffer =
-        Allocate<float>(cinfo, xsize_blocks * DCTSIZE + 8, JPOOL_IMAGE_ALIGNED);
+    // With a parallel runner, the pre-erosion of each group of 4 input rows of
+    // an iMCU row (and the 4 extra rows at the top of the image) is computed
+    // in a separate task, each having its own diff buffer.
+    size_t num_diff_buffers = 1;
+    if (m->parallel_runner != nullptr) {
+      num_diff_buffers = 2 * cinfo->max_v_samp_factor + 1;
+    }
+    m->diff_buffer_stride = RoundUpTo(xsize_blocks * DCTSIZE + 8, vecsize);
+    m->diff_buffer = Allocate<float>(
+        cinfo, num_diff_buffers * m->diff_buffer_stride, JPOOL_IMAGE_ALIGNED);
     m->fuzzy_erosion_tmp.Allocate(cinfo, 2, xsize_padded);
     m->pre_erosion.Allocate(cinfo, 6 * cinfo->max_v_samp_factor, xsize_padded);
     size_t qf_height = cinfo->max_v_samp_factor;
@@ -687,6 +704,10 @@ void jpegli_CreateCompress(j_compress_ptr cinfo, int version,
   cinfo->master->data_type = JPEGLI_TYPE_UINT8;
   cinfo->master->endianness = JPEGLI_NATIVE_ENDIAN;
   cinfo->master->coeff_buffers = nullptr;
+  cinfo->master->coefficient_callback = nullptr;
+  cinfo->master->coefficient_callback_opaque = nullptr;
+  cinfo->master->parallel_runner = nullptr;
+  cinfo->master->parallel_runner_opaque = nullptr;
 }
 
 void jpegli_set_xyb_mode(j_compress_ptr cinfo) {
@@ -930,6 +951,24 @@ void jpegli_set_progressive_level(j_compress_ptr cinfo, int level) {
   cinfo->master->progressive_level = level;
 }
 
+void jpegli_set_coefficient_callback(
+    j_compress_ptr cinfo,
+    void (*callback)(j_compress_ptr cinfo, jvirt_barray_ptr* coef_arrays,
+                     void* opaque),
+    void* opaque) {
+  CheckState(cinfo, jpegli::kEncStart);
+  cinfo->master->coefficient_callback = callback;
+  cinfo->master->coefficient_callback_opaque = opaque;
+}
+
+void jpegli_set_parallel_runner(j_compress_ptr cinfo,
+                                JpegliParallelRunner runner,
+                                void* runner_opaque) {
+  CheckState(cinfo, jpegli::kEncStart);
+  cinfo->master->parallel_runner = runner;
+  cinfo->master->parallel_runner_opaque = runner_opaque;
+}
+
 void jpegli_set_input_format(j_compress_ptr cinfo, JpegliDataType data_type,
                              JpegliEndianness endianness) {
   CheckState(cinfo, jpegli::kEncStart);
@@ -1232,6 +1271,11 @@ void jpegli_finish_compress(j_compress_ptr cinfo) {
     jpegli::QuantizetoPSNR(cinfo);
   }
 
+  if (m->coefficient_callback != nullptr) {
+    (*m->coefficient_callback)(cinfo, m->coeff_buffers,
+                               m->coefficient_callback_opaque);
+  }
+
   const bool tokens_done = jpegli::IsStreamingSupported(cinfo);
   const bool bitstream_done =
       tokens_done && !FROM_JXL_BOOL(cinfo->optimize_coding);
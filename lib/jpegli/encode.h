@@ -152,6 +152,32 @@ void jpegli_set_progressive_level(j_compress_ptr cinfo, int level);
 // AC coefficients. Must be called before jpegli_set_defaults().
 void jpegli_use_standard_quant_tables(j_compress_ptr cinfo);
 
+// Sets a function that jpegli_finish_compress() calls with the quantized DCT
+// coefficients of the components, in zig-zag order, right before writing the
+// entropy coded data. The coefficient arrays are only valid during the call.
+// Must be called before jpegli_start_compress(). Setting a callback disables
+// the streaming encoder, as all the coefficients must be kept in memory.
+void jpegli_set_coefficient_callback(
+    j_compress_ptr cinfo,
+    void (*callback)(j_compress_ptr cinfo, jvirt_barray_ptr* coef_arrays,
+                     void* opaque),
+    void* opaque);
+
+// Sets the parallel runner that the encoder uses to compute the adaptive
+// quantization field and the quantized DCT coefficients of each iMCU row, and
+// to entropy code the restart intervals of each scan. The output is the same
+// as without a parallel runner. Must be called before jpegli_start_compress().
+void jpegli_set_parallel_runner(j_compress_ptr cinfo,
+                                JpegliParallelRunner runner,
+                                void* runner_opaque);
+
+// Sets a destination manager that writes the compressed data directly into
+// output buffers provided by the application through func, e.g. a ring of
+// buffers or the growing tail of a single buffer, so that no intermediate copy
+// of the output is made. See JpegliOutputBufferFunc for the details.
+void jpegli_buffer_ring_dest(j_compress_ptr cinfo, JpegliOutputBufferFunc func,
+                             void* opaque);
+
 #ifdef __cplusplus
 }  // extern "C"
 #endif
@@ -183,6 +183,107 @@ TEST(EncodeAPITest, ReuseCinfoSameStdOutput) {
   }
 }
 
+struct BufferRing {
+  std::vector<std::vector<uint8_t>> buffers;
+  size_t next = 0;
+  std::vector<uint8_t> output;
+};
+
+int WriteToBufferRing(void* opaque, const uint8_t* filled, size_t filled_size,
+                      uint8_t** next_buffer, size_t* next_size) {
+  BufferRing* ring = reinterpret_cast<BufferRing*>(opaque);
+  ring->output.insert(ring->output.end(), filled, filled + filled_size);
+  if (next_buffer != nullptr) {
+    std::vector<uint8_t>& buffer = ring->buffers[ring->next];
+    ring->next = (ring->next + 1) % ring->buffers.size();
+    // Grow the buffers as they are reused.
+    buffer.resize(buffer.size() * 2);
+    *next_buffer = buffer.data();
+    *next_size = buffer.size();
+  }
+  return 1;
+}
+
+TEST(EncodeAPITest, ReuseCinfoSameBufferRingOutput) {
+  std::vector<TestConfig> all_configs = GenerateBasicConfigs();
+  std::vector<uint8_t> expected;
+  for (const TestConfig& config : all_configs) {
+    std::vector<uint8_t> compressed;
+    ASSERT_TRUE(EncodeWithJpegli(config.input, config.jparams, &compressed));
+    expected.insert(expected.end(), compressed.begin(), compressed.end());
+  }
+  BufferRing ring;
+  ring.buffers = {std::vector<uint8_t>(16), std::vector<uint8_t>(37),
+                  std::vector<uint8_t>(64)};
+  {
+    jpeg_compress_struct cinfo;
+    const auto try_catch_block = [&]() -> bool {
+      ERROR_HANDLER_SETUP(jpegli);
+      jpegli_create_compress(&cinfo);
+      jpegli_buffer_ring_dest(&cinfo, &WriteToBufferRing, &ring);
+      for (const TestConfig& config : all_configs) {
+        EncodeWithJpegli(config.input, config.jparams, &cinfo);
+      }
+      return true;
+    };
+    EXPECT_TRUE(try_catch_block());
+    jpegli_destroy_compress(&cinfo);
+  }
+  ASSERT_EQ(expected.size(), ring.output.size());
+  EXPECT_EQ(0, memcmp(expected.data(), ring.output.data(), expected.size()));
+}
+
+TEST(EncodeAPITest, ParallelRunnerSameOutput) {
+  std::vector<TestConfig> all_configs = GenerateBasicConfigs();
+  TestConfig restart_config;
+  restart_config.input.xsize = 517;
+  restart_config.input.ysize = 133;
+  restart_config.jparams.restart_interval = 7;
+  restart_config.jparams.smoothing_factor = 10;
+  GeneratePixels(&restart_config.input);
+  all_configs.push_back(restart_config);
+  // Images large enough to tokenize and Huffman code the restart intervals of
+  // each scan in more than one task.
+  for (int progressive_mode = 0; progressive_mode <= 3; ++progressive_mode) {
+    for (int restart_in_rows : {0, 2}) {
+      TestConfig config;
+      config.input.xsize = 1024;
+      config.input.ysize = 768;
+      config.jparams.h_sampling = {2, 1, 1};
+      config.jparams.v_sampling = {2, 1, 1};
+      config.jparams.progressive_mode = progressive_mode;
+      config.jparams.restart_interval = restart_in_rows == 0 ? 3 : 0;
+      config.jparams.restart_in_rows = restart_in_rows;
+      if (progressive_mode == 0 && restart_in_rows > 0) {
+        config.jparams.optimize_coding = 0;
+      }
+      GeneratePixels(&config.input);
+      all_configs.push_back(config);
+    }
+  }
+  for (const TestConfig& config : all_configs) {
+    std::vector<uint8_t> expected;
+    ASSERT_TRUE(EncodeWithJpegli(config.input, config.jparams, &expected));
+    uint8_t* buffer = nullptr;
+    unsigned long buffer_size = 0;  // NOLINT
+    jpeg_compress_struct cinfo;
+    const auto try_catch_block = [&]() -> bool {
+      ERROR_HANDLER_SETUP(jpegli);
+      jpegli_create_compress(&cinfo);
+      jpegli_mem_dest(&cinfo, &buffer, &buffer_size);
+      jpegli_set_parallel_runner(&cinfo, &TestParallelRunner, nullptr);
+      EncodeWithJpegli(config.input, config.jparams, &cinfo);
+      return true;
+    };
+    EXPECT_TRUE(try_catch_block());
+    jpegli_destroy_compress(&cinfo);
+    std::vector<uint8_t> compressed(buffer, buffer + buffer_size);
+    if (buffer) free(buffer);
+    ASSERT_EQ(expected.size(), compressed.size());
+    EXPECT_EQ(0, memcmp(expected.data(), compressed.data(), expected.size()));
+  }
+}
+
 TEST(EncodeAPITest, ReuseCinfoChangeParams) {
   TestImage input;
   TestImage output;
@@ -136,6 +136,18 @@ struct jpeg_comp_master {
   float psnr_tolerance;
   float min_distance;
   float max_distance;
+  void (*coefficient_callback)(j_compress_ptr cinfo,
+                               jvirt_barray_ptr* coef_arrays, void* opaque);
+  void* coefficient_callback_opaque;
+  JpegliParallelRunner parallel_runner;
+  void* parallel_runner_opaque;
+  // Quantized coefficients of the current iMCU row, in the order of the blocks
+  // in the MCUs, and the quantized DC values and their zero-bias thresholds,
+  // before rounding. Only used with a parallel runner.
+  int32_t* imcu_row_coeffs;
+  float* imcu_row_dc;
+  // Distance between the per-task diff buffers of the adaptive quantization.
+  size_t diff_buffer_stride;
 };
 
 #endif  // LIB_JPEGLI_ENCODE_INTERNAL_H_
@@ -5,6 +5,7 @@
 
 #include "lib/jpegli/encode_streaming.h"
 
+#include <algorithm>
 #include <cmath>
 
 #include "lib/jpegli/bit_writer.h"
@@ -12,6 +13,7 @@
 #include "lib/jpegli/entropy_coding.h"
 #include "lib/jpegli/error.h"
 #include "lib/jpegli/memory_manager.h"
+#include "lib/jpegli/parallel.h"
 #include "lib/jxl/base/bits.h"
 
 #undef HWY_TARGET_INCLUDE
@@ -30,6 +32,9 @@ static const int kStreamingModeCoefficients = 0;
 static const int kStreamingModeTokens = 1;
 static const int kStreamingModeBits = 2;
 
+// Number of MCUs in one task of the parallel DCT computation.
+static const int kMCUsPerTask = 16;
+
 namespace {
 void ZigZagShuffle(int32_t* JXL_RESTRICT block) {
   // TODO(szabadka) SIMDify this.
@@ -100,6 +105,64 @@ void ZigZagShuffle(int32_t* JXL_RESTRICT block) {
   tmp[63] = block[63];
   memcpy(block, tmp, DCTSIZE2 * sizeof(tmp[0]));
 }
+
+// Computes the DCT and the quantized AC coefficients of all blocks of the
+// current iMCU row into m->imcu_row_coeffs, using the parallel runner. Blocks
+// are stored in the order in which ProcessiMCURow() visits them, including
+// those outside of the component.
+void ComputeBlocksForiMCURow(j_compress_ptr cinfo) {
+  jpeg_comp_master* m = cinfo->master;
+  int xsize_mcus = DivCeil(cinfo->image_width, 8 * cinfo->max_h_samp_factor);
+  int mcu_y = m->next_iMCU_row;
+  size_t blocks_per_mcu = m->blocks_per_iMCU_row / xsize_mcus;
+  bool adaptive_quant = m->use_adaptive_quantization && m->psnr_target == 0;
+  const float* imcu_start[kMaxComponents];
+  for (int c = 0; c < cinfo->num_components; ++c) {
+    jpeg_component_info* comp = &cinfo->comp_info[c];
+    imcu_start[c] = m->raw_data[c]->Row(mcu_y * comp->v_samp_factor * DCTSIZE);
+  }
+  const float* qf = nullptr;
+  if (adaptive_quant) {
+    qf = m->quant_field.Row(0);
+  }
+  const size_t qf_stride = m->quant_field.stride();
+  const auto compute_blocks = [&](const uint32_t task) {
+    HWY_ALIGN float dct_buffer[2 * DCTSIZE2];
+    int mcu_x0 = task * kMCUsPerTask;
+    int mcu_x1 = std::min(mcu_x0 + kMCUsPerTask, xsize_mcus);
+    size_t block_idx = mcu_x0 * blocks_per_mcu;
+    for (int mcu_x = mcu_x0; mcu_x < mcu_x1; ++mcu_x) {
+      for (int c = 0; c < cinfo->num_components; ++c) {
+        jpeg_component_info* comp = &cinfo->comp_info[c];
+        const size_t stride = m->raw_data[c]->stride();
+        float aq_strength = 0.0f;
+        for (int iy = 0; iy < comp->v_samp_factor; ++iy) {
+          for (int ix = 0; ix < comp->h_samp_factor; ++ix, ++block_idx) {
+            size_t by = mcu_y * comp->v_samp_factor + iy;
+            size_t bx = mcu_x * comp->h_samp_factor + ix;
+            if (bx >= comp->width_in_blocks || by >= comp->height_in_blocks) {
+              continue;
+            }
+            if (adaptive_quant) {
+              aq_strength = qf[iy * qf_stride + bx * m->h_factor[c]];
+            }
+            const float* pixels = imcu_start[c] + (iy * stride + bx) * DCTSIZE;
+            ComputeBlockWithoutDC(
+                pixels, stride, m->quant_mul[c], aq_strength,
+                m->zero_bias_offset[c], m->zero_bias_mul[c], dct_buffer,
+                &m->imcu_row_coeffs[block_idx * DCTSIZE2],
+                &m->imcu_row_dc[2 * block_idx],
+                &m->imcu_row_dc[2 * block_idx + 1]);
+          }
+        }
+      }
+    }
+  };
+  RunParallel(cinfo, m->parallel_runner, m->parallel_runner_opaque, 0,
+              DivCeil(xsize_mcus, kMCUsPerTask), compute_blocks,
+              "ComputeBlocksForiMCURow");
+}
+
 }  // namespace
 
 template <int kMode>
@@ -109,6 +172,7 @@ void ProcessiMCURow(j_compress_ptr cinfo) {
   int xsize_mcus = DivCeil(cinfo->image_width, 8 * cinfo->max_h_samp_factor);
   int ysize_mcus = DivCeil(cinfo->image_height, 8 * cinfo->max_v_samp_factor);
   int mcu_y = m->next_iMCU_row;
+  const bool parallel = m->parallel_runner != nullptr;
   int32_t* block = m->block_tmp;
   int32_t* symbols = m->block_tmp + DCTSIZE2;
   int32_t* nonzero_idx = m->block_tmp + 3 * DCTSIZE2;
@@ -151,6 +215,10 @@ void ProcessiMCURow(j_compress_ptr cinfo) {
   if (adaptive_quant) {
     qf = m->quant_field.Row(0);
   }
+  if (parallel) {
+    ComputeBlocksForiMCURow(cinfo);
+  }
+  size_t block_idx = 0;
   HuffmanCodeTable* dc_code = nullptr;
   HuffmanCodeTable* ac_code = nullptr;
   const size_t qf_stride = m->quant_field.stride();
@@ -168,7 +236,7 @@ void ProcessiMCURow(j_compress_ptr cinfo) {
       const float* zero_bias_mul = m->zero_bias_mul[c];
       float aq_strength = 0.0f;
       for (int iy = 0; iy < comp->v_samp_factor; ++iy) {
-        for (int ix = 0; ix < comp->h_samp_factor; ++ix) {
+        for (int ix = 0; ix < comp->h_samp_factor; ++ix, ++block_idx) {
           size_t by = mcu_y * comp->v_samp_factor + iy;
           size_t bx = mcu_x * comp->h_samp_factor + ix;
           if (bx >= comp->width_in_blocks || by >= comp->height_in_blocks) {
@@ -181,13 +249,19 @@ void ProcessiMCURow(j_compress_ptr cinfo) {
             }
             continue;
           }
-          if (adaptive_quant) {
-            aq_strength = qf[iy * qf_stride + bx * h_factor];
+          if (parallel) {
+            block = &m->imcu_row_coeffs[block_idx * DCTSIZE2];
+            const float* dc = &m->imcu_row_dc[2 * block_idx];
+            block[0] = QuantizeDC(dc[0], dc[1], last_dc_coeff[c]);
+          } else {
+            if (adaptive_quant) {
+              aq_strength = qf[iy * qf_stride + bx * h_factor];
+            }
+            const float* pixels = imcu_start[c] + (iy * stride + bx) * DCTSIZE;
+            ComputeCoefficientBlock(pixels, stride, qmc, last_dc_coeff[c],
+                                    aq_strength, zero_bias_offset,
+                                    zero_bias_mul, m->dct_buffer, block);
           }
-          const float* pixels = imcu_start[c] + (iy * stride + bx) * DCTSIZE;
-          ComputeCoefficientBlock(pixels, stride, qmc, last_dc_coeff[c],
-                                  aq_strength, zero_bias_offset, zero_bias_mul,
-                                  m->dct_buffer, block);
           if (kMode == kStreamingModeCoefficients) {
             JCOEF* cblock = &blocks[c][iy][bx][0];
             for (int k = 0; k < DCTSIZE2; ++k) {
@@ -5,11 +5,14 @@
 
 #include "lib/jpegli/entropy_coding.h"
 
+#include <algorithm>
+#include <cstring>
 #include <vector>
 
 #include "lib/jpegli/encode_internal.h"
 #include "lib/jpegli/error.h"
 #include "lib/jpegli/huffman.h"
+#include "lib/jpegli/parallel.h"
 #include "lib/jxl/base/bits.h"
 
 #undef HWY_TARGET_INCLUDE
@@ -80,6 +83,56 @@ void TokenizeProgressiveDC(const coeff_t* coeffs, int context, int Al,
   *(*next_token)++ = Token(context, nbits, bits);
 }
 
+void EmitEOBRun(int context, int* eob_run, Token** next_token) {
+  int nbits = jxl::FloorLog2Nonzero<uint32_t>(*eob_run);
+  int symbol = nbits << 4u;
+  *(*next_token)++ = Token(context, symbol, *eob_run & ((1 << nbits) - 1));
+  *eob_run = 0;
+}
+
+void TokenizeACProgressiveBlock(const coeff_t* block, int Ss, int Se, int Al,
+                                int context, int* eob_run, Token** next_token,
+                                size_t* num_nonzeros,
+                                size_t* num_future_nonzeros) {
+  coeff_t temp2;
+  coeff_t temp;
+  int r = 0;
+  for (int k = Ss; k <= Se; ++k) {
+    temp = block[k];
+    if (temp == 0) {
+      r++;
+      continue;
+    }
+    if (temp < 0) {
+      temp = -temp;
+      temp >>= Al;
+      temp2 = ~temp;
+    } else {
+      temp >>= Al;
+      temp2 = temp;
+    }
+    if (temp == 0) {
+      r++;
+      ++(*num_future_nonzeros);
+      continue;
+    }
+    if (*eob_run > 0) EmitEOBRun(context, eob_run, next_token);
+    while (r > 15) {
+      *(*next_token)++ = Token(context, 0xf0, 0);
+      r -= 16;
+    }
+    int nbits = jxl::FloorLog2Nonzero<uint32_t>(temp) + 1;
+    int symbol = (r << 4u) + nbits;
+    *(*next_token)++ = Token(context, symbol, temp2 & ((1 << nbits) - 1));
+    ++(*num_nonzeros);
+    r = 0;
+  }
+  if (r > 0) {
+    ++(*eob_run);
+    if (*eob_run == 0x7FFF) EmitEOBRun(context, eob_run, next_token);
+  }
+}
+
 void TokenizeACProgressiveScan(j_compress_ptr cinfo, int scan_index,
                                int context, ScanTokenInfo* sti) {
   jpeg_comp_master* m = cinfo->master;
@@ -99,12 +152,6 @@ void TokenizeACProgressiveScan(j_compress_ptr cinfo, int scan_index,
   TokenArray* ta = &m->token_arrays[m->cur_token_array];
   sti->token_offset = m->total_num_tokens + ta->num_tokens;
   sti->restarts = Allocate<size_t>(cinfo, num_restarts, JPOOL_IMAGE);
-  const auto emit_eob_run = [&]() {
-    int nbits = jxl::FloorLog2Nonzero<uint32_t>(eob_run);
-    int symbol = nbits << 4u;
-    *m->next_token++ = Token(context, symbol, eob_run & ((1 << nbits) - 1));
-    eob_run = 0;
-  };
   for (JDIMENSION by = 0; by < comp->height_in_blocks; ++by) {
     JBLOCKARRAY blocks = (*cinfo->mem->access_virt_barray)(
         reinterpret_cast<j_common_ptr>(cinfo), m->coeff_buffers[comp_idx], by,
@@ -127,59 +174,20 @@ void TokenizeACProgressiveScan(j_compress_ptr cinfo, int scan_index,
     }
     for (JDIMENSION bx = 0; bx < comp->width_in_blocks; ++bx) {
       if (restart_interval > 0 && restarts_to_go == 0) {
-        if (eob_run > 0) emit_eob_run();
+        if (eob_run > 0) EmitEOBRun(context, &eob_run, &m->next_token);
         ta->num_tokens = m->next_token - ta->tokens;
         sti->restarts[restart_idx++] = m->total_num_tokens + ta->num_tokens;
         restarts_to_go = restart_interval;
       }
-      const coeff_t* block = &blocks[0][bx][0];
-      coeff_t temp2;
-      coeff_t temp;
-      int r = 0;
-      int num_nzeros = 0;
-      int num_future_nzeros = 0;
-      for (int k = Ss; k <= Se; ++k) {
-        temp = block[k];
-        if (temp == 0) {
-          r++;
-          continue;
-        }
-        if (temp < 0) {
-          temp = -temp;
-          temp >>= Al;
-          temp2 = ~temp;
-        } else {
-          temp >>= Al;
-          temp2 = temp;
-        }
-        if (temp == 0) {
-          r++;
-          num_future_nzeros++;
-          continue;
-        }
-        if (eob_run > 0) emit_eob_run();
-        while (r > 15) {
-          *m->next_token++ = Token(context, 0xf0, 0);
-          r -= 16;
-        }
-        int nbits = jxl::FloorLog2Nonzero<uint32_t>(temp) + 1;
-        int symbol = (r << 4u) + nbits;
-        *m->next_token++ = Token(context, symbol, temp2 & ((1 << nbits) - 1));
-        ++num_nzeros;
-        r = 0;
-      }
-      if (r > 0) {
-        ++eob_run;
-        if (eob_run == 0x7FFF) emit_eob_run();
-      }
-      sti->num_nonzeros += num_nzeros;
-      sti->num_future_nonzeros += num_future_nzeros;
+      TokenizeACProgressiveBlock(&blocks[0][bx][0], Ss, Se, Al, context,
+                                 &eob_run, &m->next_token, &sti->num_nonzeros,
+                                 &sti->num_future_nonzeros);
       --restarts_to_go;
     }
     ta->num_tokens = m->next_token - ta->tokens;
   }
   if (eob_run > 0) {
-    emit_eob_run();
+    EmitEOBRun(context, &eob_run, &m->next_token);
     ++ta->num_tokens;
   }
   sti->num_tokens = m->total_num_tokens + ta->num_tokens - sti->token_offset;
@@ -303,9 +311,195 @@ void TokenizeACRefinementScan(j_compress_ptr cinfo, int scan_index,
   m->next_refinement_bit = next_ref_bit;
 }
 
+// Tokenizes one MCU of a DC or sequential scan, where blocks[i] is the first
+// block row of the MCU in the ith component of the scan.
+void TokenizeMCU(j_compress_ptr cinfo, const jpeg_scan_info* scan_info,
+                 int ac_ctx_offset, size_t mcu_y, size_t mcu_x,
+                 const JBLOCKARRAY* blocks, coeff_t* last_dc_coeff,
+                 uint8_t* refbits, size_t* block_idx, Token** next_token) {
+  const bool is_interleaved = (scan_info->comps_in_scan > 1);
+  const bool is_progressive = FROM_JXL_BOOL(cinfo->progressive_mode);
+  const int Ah = scan_info->Ah;
+  const int Al = scan_info->Al;
+  HWY_ALIGN constexpr coeff_t kSinkBlock[DCTSIZE2] = {0};
+  for (int i = 0; i < scan_info->comps_in_scan; ++i) {
+    int comp_idx = scan_info->component_index[i];
+    jpeg_component_info* comp = &cinfo->comp_info[comp_idx];
+    int n_blocks_y = is_interleaved ? comp->v_samp_factor : 1;
+    int n_blocks_x = is_interleaved ? comp->h_samp_factor : 1;
+    for (int iy = 0; iy < n_blocks_y; ++iy) {
+      for (int ix = 0; ix < n_blocks_x; ++ix) {
+        size_t block_y = mcu_y * n_blocks_y + iy;
+        size_t block_x = mcu_x * n_blocks_x + ix;
+        const coeff_t* block;
+        if (block_x >= comp->width_in_blocks ||
+            block_y >= comp->height_in_blocks) {
+          block = kSinkBlock;
+        } else {
+          block = &blocks[i][iy][block_x][0];
+        }
+        if (!is_progressive) {
+          HWY_DYNAMIC_DISPATCH(ComputeTokensSequential)
+          (block, last_dc_coeff[i], comp_idx, ac_ctx_offset + i, next_token);
+          last_dc_coeff[i] = block[0];
+        } else {
+          if (Ah == 0) {
+            TokenizeProgressiveDC(block, comp_idx, Al, last_dc_coeff + i,
+                                  next_token);
+          } else {
+            refbits[*block_idx] = (block[0] >> Al) & 1;
+          }
+        }
+        ++(*block_idx);
+      }
+    }
+  }
+}
+
+// Minimum number of blocks tokenized by one task of the parallel runner.
+constexpr size_t kMinBlocksPerTask = 1024;
+// Maximum number of tokens in the scratch buffer of the parallel tokenizer.
+constexpr size_t kMaxTokensInFlight = 1 << 20;
+
+// Tokenizes a DC, sequential or AC first scan with restart intervals on the
+// parallel runner. Each task tokenizes a range of restart intervals into its
+// part of a scratch buffer, which is then copied to a new token array, so the
+// resulting token stream is the same as that of the sequential tokenizer.
+// Returns false if the scan has to be tokenized sequentially.
+bool TokenizeScanInParallel(j_compress_ptr cinfo, size_t scan_index,
+                            int ac_ctx_offset, ScanTokenInfo* sti) {
+  jpeg_comp_master* m = cinfo->master;
+  const jpeg_scan_info* scan_info = &cinfo->scan_info[scan_index];
+  const size_t restart_interval = sti->restart_interval;
+  const size_t num_restarts = sti->num_restarts;
+  if (m->parallel_runner == nullptr || restart_interval == 0 ||
+      num_restarts < 2 || scan_info->Ah > 0) {
+    return false;
+  }
+  const bool is_ac_scan = scan_info->Ss > 0;
+  const bool is_interleaved = (scan_info->comps_in_scan > 1);
+  const int Ss = scan_info->Ss;
+  const int Se = scan_info->Se;
+  const int Al = scan_info->Al;
+  const size_t tokens_per_block = is_ac_scan                 ? Se - Ss + 1
+                                  : cinfo->progressive_mode ? 1
+                                                             : DCTSIZE2;
+  const size_t num_MCUs = sti->MCU_rows_in_scan * sti->MCUs_per_row;
+  const size_t blocks_per_segment = restart_interval * sti->blocks_in_MCU;
+  // We use one token array per task and have DivCeil(image_height, DCTSIZE)
+  // token arrays per scan.
+  const size_t max_tasks = DivCeil(cinfo->image_height, DCTSIZE);
+  const size_t segments_per_task =
+      std::max({static_cast<size_t>(1), kMinBlocksPerTask / blocks_per_segment,
+                DivCeil(num_restarts, max_tasks)});
+  // Reserve one extra token per restart interval for the flushed EOB run.
+  const size_t max_tokens_per_task =
+      segments_per_task * (blocks_per_segment * tokens_per_block + 1);
+  if (max_tokens_per_task > kMaxTokensInFlight) {
+    return false;
+  }
+  const size_t num_tasks = DivCeil(num_restarts, segments_per_task);
+  const size_t tasks_per_batch = kMaxTokensInFlight / max_tokens_per_task;
+
+  // Access to the virtual arrays is not thread-safe, so we collect the block
+  // rows of the scan here.
+  std::vector<JBLOCKROW> rows[MAX_COMPS_IN_SCAN];
+  for (int i = 0; i < scan_info->comps_in_scan; ++i) {
+    int comp_idx = scan_info->component_index[i];
+    jpeg_component_info* comp = &cinfo->comp_info[comp_idx];
+    rows[i].resize(comp->height_in_blocks);
+    for (JDIMENSION by = 0; by < comp->height_in_blocks; ++by) {
+      rows[i][by] = (*cinfo->mem->access_virt_barray)(
+          reinterpret_cast<j_common_ptr>(cinfo), m->coeff_buffers[comp_idx], by,
+          1, FALSE)[0];
+    }
+  }
+
+  std::vector<Token> scratch(std::min(num_tasks, tasks_per_batch) *
+                                 max_tokens_per_task,
+                             Token(0, 0, 0));
+  std::vector<size_t> segment_end(num_restarts);
+  std::vector<size_t> task_num_tokens(tasks_per_batch);
+  std::vector<size_t> num_nonzeros(tasks_per_batch);
+  std::vector<size_t> num_future_nonzeros(tasks_per_batch);
+  TokenArray* ta = &m->token_arrays[m->cur_token_array];
+  sti->token_offset = m->total_num_tokens + ta->num_tokens;
+  for (size_t batch_start = 0; batch_start < num_tasks;
+       batch_start += tasks_per_batch) {
+    const size_t batch_end = std::min(num_tasks, batch_start + tasks_per_batch);
+    const auto tokenize_task = [&](uint32_t task) {
+      const size_t slot = task - batch_start;
+      Token* tokens = &scratch[slot * max_tokens_per_task];
+      Token* next_token = tokens;
+      num_nonzeros[slot] = num_future_nonzeros[slot] = 0;
+      const size_t seg_begin = task * segments_per_task;
+      const size_t seg_end =
+          std::min(num_restarts, seg_begin + segments_per_task);
+      for (size_t s = seg_begin; s < seg_end; ++s) {
+        const size_t mcu_begin = s * restart_interval;
+        const size_t mcu_end = std::min(num_MCUs, mcu_begin + restart_interval);
+        int eob_run = 0;
+        coeff_t last_dc_coeff[MAX_COMPS_IN_SCAN] = {0};
+        size_t block_idx = 0;
+        for (size_t mcu = mcu_begin; mcu < mcu_end; ++mcu) {
+          const size_t mcu_y = mcu / sti->MCUs_per_row;
+          const size_t mcu_x = mcu % sti->MCUs_per_row;
+          if (is_ac_scan) {
+            TokenizeACProgressiveBlock(
+                &rows[0][mcu_y][mcu_x][0], Ss, Se, Al, ac_ctx_offset, &eob_run,
+                &next_token, &num_nonzeros[slot], &num_future_nonzeros[slot]);
+            continue;
+          }
+          JBLOCKARRAY blocks[MAX_COMPS_IN_SCAN];
+          for (int i = 0; i < scan_info->comps_in_scan; ++i) {
+            int comp_idx = scan_info->component_index[i];
+            jpeg_component_info* comp = &cinfo->comp_info[comp_idx];
+            int n_blocks_y = is_interleaved ? comp->v_samp_factor : 1;
+            blocks[i] = rows[i].data() + mcu_y * n_blocks_y;
+          }
+          TokenizeMCU(cinfo, scan_info, ac_ctx_offset, mcu_y, mcu_x, blocks,
+                      last_dc_coeff, nullptr, &block_idx, &next_token);
+        }
+        if (eob_run > 0) EmitEOBRun(ac_ctx_offset, &eob_run, &next_token);
+        segment_end[s] = next_token - tokens;
+      }
+      task_num_tokens[slot] = next_token - tokens;
+    };
+    RunParallel(cinfo, m->parallel_runner, m->parallel_runner_opaque,
+                batch_start, batch_end, tokenize_task, "TokenizeScan");
+    for (size_t task = batch_start; task < batch_end; ++task) {
+      const size_t slot = task - batch_start;
+      if (ta->tokens) {
+        m->total_num_tokens += ta->num_tokens;
+        ++m->cur_token_array;
+        ta = &m->token_arrays[m->cur_token_array];
+      }
+      ta->num_tokens = task_num_tokens[slot];
+      ta->tokens = Allocate<Token>(cinfo, ta->num_tokens, JPOOL_IMAGE);
+      memcpy(ta->tokens, &scratch[slot * max_tokens_per_task],
+             ta->num_tokens * sizeof(Token));
+      const size_t seg_begin = task * segments_per_task;
+      const size_t seg_end =
+          std::min(num_restarts, seg_begin + segments_per_task);
+      for (size_t s = seg_begin; s < seg_end; ++s) {
+        sti->restarts[s] = m->total_num_tokens + segment_end[s];
+      }
+      sti->num_nonzeros += num_nonzeros[slot];
+      sti->num_future_nonzeros += num_future_nonzeros[slot];
+    }
+  }
+  m->num_tokens = ta->num_tokens;
+  m->next_token = ta->tokens + ta->num_tokens;
+  sti->num_tokens = m->total_num_tokens + ta->num_tokens - sti->token_offset;
+  return true;
+}
+
 void TokenizeScan(j_compress_ptr cinfo, size_t scan_index, int ac_ctx_offset,
                   ScanTokenInfo* sti) {
   const jpeg_scan_info* scan_info = &cinfo->scan_info[scan_index];
+  if (TokenizeScanInParallel(cinfo, scan_index, ac_ctx_offset, sti)) {
+    return;
+  }
   if (scan_info->Ss > 0) {
     if (scan_info->Ah == 0) {
       TokenizeACProgressiveScan(cinfo, scan_index, ac_ctx_offset, sti);
@@ -323,10 +517,7 @@ void TokenizeScan(j_compress_ptr cinfo, size_t scan_index, int ac_ctx_offset,
   // "Non-interleaved" means color data comes in separate scans, in other words
   // each scan can contain only one color component.
   const bool is_interleaved = (scan_info->comps_in_scan > 1);
-  const bool is_progressive = FROM_JXL_BOOL(cinfo->progressive_mode);
   const int Ah = scan_info->Ah;
-  const int Al = scan_info->Al;
-  HWY_ALIGN constexpr coeff_t kSinkBlock[DCTSIZE2] = {0};
 
   size_t restart_idx = 0;
   TokenArray* ta = &m->token_arrays[m->cur_token_array];
@@ -385,40 +576,8 @@ void TokenizeScan(j_compress_ptr cinfo, size_t scan_index, int ac_ctx_offset,
         sti->restarts[restart_idx++] =
             Ah > 0 ? block_idx : m->total_num_tokens + ta->num_tokens;
       }
-      // Encode one MCU
-      for (int i = 0; i < scan_info->comps_in_scan; ++i) {
-        int comp_idx = scan_info->component_index[i];
-        jpeg_component_info* comp = &cinfo->comp_info[comp_idx];
-        int n_blocks_y = is_interleaved ? comp->v_samp_factor : 1;
-        int n_blocks_x = is_interleaved ? comp->h_samp_factor : 1;
-        for (int iy = 0; iy < n_blocks_y; ++iy) {
-          for (int ix = 0; ix < n_blocks_x; ++ix) {
-            size_t block_y = mcu_y * n_blocks_y + iy;
-            size_t block_x = mcu_x * n_blocks_x + ix;
-            const coeff_t* block;
-            if (block_x >= comp->width_in_blocks ||
-                block_y >= comp->height_in_blocks) {
-              block = kSinkBlock;
-            } else {
-              block = &blocks[i][iy][block_x][0];
-            }
-            if (!is_progressive) {
-              HWY_DYNAMIC_DISPATCH(ComputeTokensSequential)
-              (block, last_dc_coeff[i], comp_idx, ac_ctx_offset + i,
-               &m->next_token);
-              last_dc_coeff[i] = block[0];
-            } else {
-              if (Ah == 0) {
-                TokenizeProgressiveDC(block, comp_idx, Al, last_dc_coeff + i,
-                                      &m->next_token);
-              } else {
-                sti->refbits[block_idx] = (block[0] >> Al) & 1;
-              }
-            }
-            ++block_idx;
-          }
-        }
-      }
+      TokenizeMCU(cinfo, scan_info, ac_ctx_offset, mcu_y, mcu_x, blocks,
+                  last_dc_coeff, sti->refbits, &block_idx, &m->next_token);
       --restarts_to_go;
     }
     ta->num_tokens = m->next_token - ta->tokens;
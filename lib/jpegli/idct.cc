@@ -198,6 +198,99 @@ void InverseTransformBlock8x8(const int16_t* JXL_RESTRICT qblock,
   ComputeScaledIDCT(block0, block1, output, output_stride);
 }
 
+// Computes the average of the full 8x8 IDCT of the block, which only depends on
+// the DC coefficient, since the other basis functions sum to zero.
+void InverseTransformBlockDC(const int16_t* JXL_RESTRICT qblock,
+                             const float* JXL_RESTRICT dequant,
+                             const float* JXL_RESTRICT biases,
+                             float* JXL_RESTRICT scratch_space,
+                             float* JXL_RESTRICT output, size_t output_stride,
+                             size_t dctsize) {
+  const float quant = qblock[0];
+  if (quant == 0) {
+    *output = 0.0f;
+  } else {
+    *output = (quant - std::copysign(biases[0], quant)) * dequant[0];
+  }
+}
+
+// Rows of the matrix that maps the 8 coefficients of a 1D DCT to the averages
+// of the N groups of 8 / N consecutive samples of its 8-point IDCT. Generated
+// by the following snippet:
+// s = 8 // N
+// for i in range(N):
+//   for k in range(8):
+//     c = [math.cos((2 * x + 1) * k * math.pi / 16) for x in range(8)]
+//     w = 1.0 if k == 0 else math.sqrt(2)
+//     print(w * sum(c[i * s:(i + 1) * s]) / s, end=", ")
+template <size_t N>
+struct BoxIDCTMatrix;
+
+template <>
+struct BoxIDCTMatrix<2> {
+  static constexpr float kRows[] = {
+      1.0, 0.906127446353,  0.0, -0.318189645143,
+      0.0, 0.212607523692,  0.0, -0.180239955502,
+      1.0, -0.906127446353, 0.0, 0.318189645143,
+      0.0, -0.212607523692, 0.0, 0.180239955502,
+  };
+};
+
+template <>
+struct BoxIDCTMatrix<4> {
+  static constexpr float kRows[] = {
+      1.0, 1.281457723871,  0.923879532511,  0.449988111568,
+      0.0, -0.300672443468, -0.382683432365, -0.254897789552,
+      1.0, 0.530797168835,  -0.923879532511, -1.086367401855,
+      0.0, 0.725887490851,  0.382683432365,  -0.105582121451,
+      1.0, -0.530797168835, -0.923879532511, 1.086367401855,
+      0.0, -0.725887490851, 0.382683432365,  0.105582121451,
+      1.0, -1.281457723871, 0.923879532511,  -0.449988111568,
+      0.0, 0.300672443468,  -0.382683432365, 0.254897789552,
+  };
+};
+
+#if JXL_CXX_LANG < JXL_CXX_17
+constexpr float BoxIDCTMatrix<2>::kRows[];
+constexpr float BoxIDCTMatrix<4>::kRows[];
+#endif
+
+// Computes the NxN box downsampled output of the full 8x8 IDCT directly from
+// the dequantized coefficients, without computing the 8x8 samples.
+template <size_t N>
+void InverseTransformBlockBox(const int16_t* JXL_RESTRICT qblock,
+                              const float* JXL_RESTRICT dequant,
+                              const float* JXL_RESTRICT biases,
+                              float* JXL_RESTRICT scratch_space,
+                              float* JXL_RESTRICT output, size_t output_stride,
+                              size_t dctsize) {
+  float* JXL_RESTRICT block0 = scratch_space;
+  float* JXL_RESTRICT block1 = scratch_space + DCTSIZE2;
+  DequantBlock(qblock, dequant, biases, block0);
+  const float* JXL_RESTRICT rows = BoxIDCTMatrix<N>::kRows;
+  // Vertical pass, block1 has N rows of 8 horizontal coefficients.
+  for (size_t iy = 0; iy < N; ++iy) {
+    for (size_t k = 0; k < DCTSIZE; k += Lanes(d8)) {
+      auto sum = Zero(d8);
+      for (size_t ky = 0; ky < DCTSIZE; ++ky) {
+        const auto mul = Set(d8, rows[iy * DCTSIZE + ky]);
+        sum = MulAdd(mul, Load(d8, block0 + ky * DCTSIZE + k), sum);
+      }
+      Store(sum, d8, block1 + iy * DCTSIZE + k);
+    }
+  }
+  // Horizontal pass.
+  for (size_t iy = 0; iy < N; ++iy) {
+    for (size_t ix = 0; ix < N; ++ix) {
+      float sum = 0.0f;
+      for (size_t kx = 0; kx < DCTSIZE; ++kx) {
+        sum += rows[ix * DCTSIZE + kx] * block1[iy * DCTSIZE + kx];
+      }
+      output[iy * output_stride + ix] = sum;
+    }
+  }
+}
+
 // Computes the N-point IDCT of in[], and stores the result in out[]. The in[]
 // array is at most 8 values long, values in[8:N-1] are assumed to be 0.
 void Compute1dIDCT(const float* in, float* out, size_t N) {
@@ -626,49 +719,41 @@ void InverseTransformBlockGeneric(const int16_t* JXL_RESTRICT qblock,
   float* JXL_RESTRICT block0 = scratch_space;
   float* JXL_RESTRICT block1 = scratch_space + DCTSIZE2;
   DequantBlock(qblock, dequant, biases, block0);
-  if (dctsize == 1) {
-    *output = *block0;
-  } else if (dctsize == 2 || dctsize == 4) {
-    float* JXL_RESTRICT block2 = scratch_space + 2 * DCTSIZE2;
-    ComputeScaledIDCT(block0, block1, block2, 8);
-    if (dctsize == 4) {
-      for (size_t iy = 0; iy < 4; ++iy) {
-        for (size_t ix = 0; ix < 4; ++ix) {
-          float* block = &block2[16 * iy + 2 * ix];
-          output[iy * output_stride + ix] =
-              0.25f * (block[0] + block[1] + block[8] + block[9]);
-        }
-      }
-    } else {
-      for (size_t iy = 0; iy < 2; ++iy) {
-        for (size_t ix = 0; ix < 2; ++ix) {
-          float* block = &block2[32 * iy + 4 * ix];
-          output[iy * output_stride + ix] =
-              0.0625f *
-              (block[0] + block[1] + block[2] + block[3] + block[8] + block[9] +
-               block[10] + block[11] + block[16] + block[17] + block[18] +
-               block[19] + block[24] + block[25] + block[26] + block[27]);
-        }
-      }
-    }
-  } else {
-    float dctin[DCTSIZE];
-    float dctout[DCTSIZE * 2];
-    size_t insize = std::min<size_t>(dctsize, DCTSIZE);
-    for (size_t ix = 0; ix < insize; ++ix) {
-      for (size_t iy = 0; iy < insize; ++iy) {
-        dctin[iy] = block0[iy * DCTSIZE + ix];
-      }
-      Compute1dIDCT(dctin, dctout, dctsize);
-      for (size_t iy = 0; iy < dctsize; ++iy) {
-        block1[iy * dctsize + ix] = dctout[iy];
-      }
+  float dctin[DCTSIZE];
+  float dctout[DCTSIZE * 2];
+  size_t insize = std::min<size_t>(dctsize, DCTSIZE);
+  for (size_t ix = 0; ix < insize; ++ix) {
+    for (size_t iy = 0; iy < insize; ++iy) {
+      dctin[iy] = block0[iy * DCTSIZE + ix];
     }
+    Compute1dIDCT(dctin, dctout, dctsize);
     for (size_t iy = 0; iy < dctsize; ++iy) {
-      Compute1dIDCT(block1 + iy * dctsize, output + iy * output_stride,
-                    dctsize);
+      block1[iy * dctsize + ix] = dctout[iy];
     }
   }
+  for (size_t iy = 0; iy < dctsize; ++iy) {
+    Compute1dIDCT(block1 + iy * dctsize, output + iy * output_stride, dctsize);
+  }
+}
+
+void InverseTransformBlock4x4(const int16_t* JXL_RESTRICT qblock,
+                              const float* JXL_RESTRICT dequant,
+                              const float* JXL_RESTRICT biases,
+                              float* JXL_RESTRICT scratch_space,
+                              float* JXL_RESTRICT output, size_t output_stride,
+                              size_t dctsize) {
+  InverseTransformBlockBox<4>(qblock, dequant, biases, scratch_space, output,
+                              output_stride, dctsize);
+}
+
+void InverseTransformBlock2x2(const int16_t* JXL_RESTRICT qblock,
+                              const float* JXL_RESTRICT dequant,
+                              const float* JXL_RESTRICT biases,
+                              float* JXL_RESTRICT scratch_space,
+                              float* JXL_RESTRICT output, size_t output_stride,
+                              size_t dctsize) {
+  InverseTransformBlockBox<2>(qblock, dequant, biases, scratch_space, output,
+                              output_stride, dctsize);
 }
 
 // NOLINTNEXTLINE(google-readability-namespace-comments)
@@ -681,6 +766,9 @@ namespace jpegli {
 
 HWY_EXPORT(InverseTransformBlock8x8);
 HWY_EXPORT(InverseTransformBlockGeneric);
+HWY_EXPORT(InverseTransformBlock4x4);
+HWY_EXPORT(InverseTransformBlock2x2);
+HWY_EXPORT(InverseTransformBlockDC);
 
 jxl::Status ChooseInverseTransform(j_decompress_ptr cinfo) {
   jpeg_decomp_master* m = cinfo->master;
@@ -691,6 +779,12 @@ jxl::Status ChooseInverseTransform(j_decompress_ptr cinfo) {
     }
     if (dct_size == DCTSIZE) {
       m->inverse_transform[c] = HWY_DYNAMIC_DISPATCH(InverseTransformBlock8x8);
+    } else if (dct_size == 4) {
+      m->inverse_transform[c] = HWY_DYNAMIC_DISPATCH(InverseTransformBlock4x4);
+    } else if (dct_size == 2) {
+      m->inverse_transform[c] = HWY_DYNAMIC_DISPATCH(InverseTransformBlock2x2);
+    } else if (dct_size == 1) {
+      m->inverse_transform[c] = HWY_DYNAMIC_DISPATCH(InverseTransformBlockDC);
     } else {
       m->inverse_transform[c] =
           HWY_DYNAMIC_DISPATCH(InverseTransformBlockGeneric);
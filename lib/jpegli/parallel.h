@@ -0,0 +1,40 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef LIB_JPEGLI_PARALLEL_H_
+#define LIB_JPEGLI_PARALLEL_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "lib/jpegli/error.h"
+#include "lib/jpegli/types.h"
+#include "lib/jxl/base/data_parallel.h"
+#include "lib/jxl/base/status.h"
+
+namespace jpegli {
+
+// Calls func(task) for each task in [begin, end) on the parallel runner, or on
+// the calling thread if runner is nullptr. The tasks must not report errors
+// through cinfo->err, since error_exit() is not allowed to return and usually
+// longjmps to the caller's stack.
+template <typename CInfoPtr, typename Func>
+void RunParallel(CInfoPtr cinfo, JpegliParallelRunner runner,
+                 void* runner_opaque, uint32_t begin, uint32_t end,
+                 const Func& func, const char* caller) {
+  jxl::ThreadPool pool(runner, runner_opaque);
+  const auto process_task = [&](const uint32_t task,
+                                size_t /* thread */) -> jxl::Status {
+    func(task);
+    return true;
+  };
+  if (!pool.Run(begin, end, jxl::ThreadPool::NoInit, process_task, caller)) {
+    JPEGLI_ERROR("Parallel runner failed in %s", caller);
+  }
+}
+
+}  // namespace jpegli
+
+#endif  // LIB_JPEGLI_PARALLEL_H_
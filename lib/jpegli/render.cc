@@ -17,6 +17,7 @@
 #include "lib/jpegli/decode_internal.h"
 #include "lib/jpegli/error.h"
 #include "lib/jpegli/idct.h"
+#include "lib/jpegli/parallel.h"
 #include "lib/jpegli/upsample.h"
 #include "lib/jxl/base/byte_order.h"
 #include "lib/jxl/base/compiler_specific.h"
@@ -193,9 +194,9 @@ float LimitError(float error) {
 
 void WriteToOutput(j_decompress_ptr cinfo, float* JXL_RESTRICT rows[],
                    size_t xoffset, size_t len, size_t num_channels,
+                   uint8_t* JXL_RESTRICT scratch_space,
                    uint8_t* JXL_RESTRICT output) {
   jpeg_decomp_master* m = cinfo->master;
-  uint8_t* JXL_RESTRICT scratch_space = m->output_scratch_;
   if (cinfo->quantize_colors && m->quant_pass_ == 1) {
     float* error_row[kMaxComponents];
     float* next_error_row[kMaxComponents];
@@ -295,9 +296,10 @@ void GatherBlockStats(const int16_t* JXL_RESTRICT coeffs,
 
 void WriteToOutput(j_decompress_ptr cinfo, float* JXL_RESTRICT rows[],
                    size_t xoffset, size_t len, size_t num_channels,
+                   uint8_t* JXL_RESTRICT scratch_space,
                    uint8_t* JXL_RESTRICT output) {
   HWY_DYNAMIC_DISPATCH(WriteToOutput)
-  (cinfo, rows, xoffset, len, num_channels, output);
+  (cinfo, rows, xoffset, len, num_channels, scratch_space, output);
 }
 
 void DecenterRow(float* row, size_t xsize) {
@@ -387,9 +389,8 @@ bool do_smoothing(j_decompress_ptr cinfo) {
 }
 
 void PredictSmooth(j_decompress_ptr cinfo, JBLOCKARRAY blocks, int component,
-                   size_t bx, int iy) {
+                   size_t bx, int iy, int16_t* scratch) {
   const size_t imcu_row = cinfo->output_iMCU_row;
-  int16_t* scratch = cinfo->master->smoothing_scratch_;
   std::vector<int> Q_VAL(SAVED_COEFS);
   int* coef_bits;
 
@@ -570,6 +571,35 @@ void PrepareForOutput(j_decompress_ptr cinfo) {
   ChooseColorTransform(cinfo);
 }
 
+// Computes the inverse DCT of the blocks [bx0, bx1) of block row iy of the
+// current iMCU row of component c.
+void InverseTransformBlocks(j_decompress_ptr cinfo, JBLOCKARRAY blocks, int c,
+                            int iy, size_t bx0, size_t bx1,
+                            float* JXL_RESTRICT idct_scratch,
+                            int16_t* JXL_RESTRICT smoothing_scratch) {
+  jpeg_decomp_master* m = cinfo->master;
+  size_t k0 = c * DCTSIZE2;
+  size_t by = cinfo->output_iMCU_row * cinfo->comp_info[c].v_samp_factor + iy;
+  size_t dctsize = m->scaled_dct_size[c];
+  RowBuffer<float>* raw_out = &m->raw_output_[c];
+  int16_t* JXL_RESTRICT row_in = &blocks[iy][0][0];
+  float* JXL_RESTRICT row_out = raw_out->Row(by * dctsize);
+  for (size_t bx = bx0; bx < bx1; ++bx) {
+    if (m->apply_smoothing) {
+      PredictSmooth(cinfo, blocks, c, bx, iy, smoothing_scratch);
+      (*m->inverse_transform[c])(smoothing_scratch, &m->dequant_[k0],
+                                 &m->biases_[k0], idct_scratch,
+                                 &row_out[bx * dctsize], raw_out->stride(),
+                                 dctsize);
+    } else {
+      (*m->inverse_transform[c])(&row_in[bx * DCTSIZE2], &m->dequant_[k0],
+                                 &m->biases_[k0], idct_scratch,
+                                 &row_out[bx * dctsize], raw_out->stride(),
+                                 dctsize);
+    }
+  }
+}
+
 void DecodeCurrentiMCURow(j_decompress_ptr cinfo) {
   jpeg_decomp_master* m = cinfo->master;
   const size_t imcu_row = cinfo->output_iMCU_row;
@@ -607,30 +637,58 @@ void DecodeCurrentiMCURow(j_decompress_ptr cinfo) {
                                       &m->biases_[k0]);
       }
     }
-    RowBuffer<float>* raw_out = &m->raw_output_[c];
+  }
+  if (m->parallel_runner_ != nullptr) {
+    // Split the block rows of the iMCU row into tasks of at most
+    // kBlocksPerTask blocks.
+    constexpr size_t kBlocksPerTask = 128;
+    struct BlockRange {
+      int c;
+      int iy;
+      size_t bx0;
+      size_t bx1;
+    };
+    std::vector<BlockRange> tasks;
+    for (int c = 0; c < cinfo->num_components; ++c) {
+      auto& compinfo = cinfo->comp_info[c];
+      size_t block_row = imcu_row * compinfo.v_samp_factor;
+      for (int iy = 0; iy < compinfo.v_samp_factor; ++iy) {
+        if (block_row + iy >= compinfo.height_in_blocks) {
+          continue;
+        }
+        for (size_t bx0 = 0; bx0 < compinfo.width_in_blocks;
+             bx0 += kBlocksPerTask) {
+          size_t bx1 = std::min<size_t>(bx0 + kBlocksPerTask,
+                                        compinfo.width_in_blocks);
+          tasks.push_back({c, iy, bx0, bx1});
+        }
+      }
+    }
+    const auto inverse_transform = [&](uint32_t i) {
+      HWY_ALIGN_MAX float idct_scratch[5 * DCTSIZE2];
+      HWY_ALIGN_MAX int16_t smoothing_scratch[DCTSIZE2];
+      const BlockRange& t = tasks[i];
+      InverseTransformBlocks(cinfo, blocks[t.c], t.c, t.iy, t.bx0, t.bx1,
+                             idct_scratch, smoothing_scratch);
+    };
+    RunParallel(cinfo, m->parallel_runner_, m->parallel_runner_opaque_, 0,
+                tasks.size(), inverse_transform, "InverseTransform");
+  }
+  for (int c = 0; c < cinfo->num_components; ++c) {
+    auto& compinfo = cinfo->comp_info[c];
+    size_t block_row = imcu_row * compinfo.v_samp_factor;
     for (int iy = 0; iy < compinfo.v_samp_factor; ++iy) {
       size_t by = block_row + iy;
       if (by >= compinfo.height_in_blocks) {
         continue;
       }
-      size_t dctsize = m->scaled_dct_size[c];
-      int16_t* JXL_RESTRICT row_in = &blocks[c][iy][0][0];
-      float* JXL_RESTRICT row_out = raw_out->Row(by * dctsize);
-      for (size_t bx = 0; bx < compinfo.width_in_blocks; ++bx) {
-        if (m->apply_smoothing) {
-          PredictSmooth(cinfo, blocks[c], c, bx, iy);
-          (*m->inverse_transform[c])(m->smoothing_scratch_, &m->dequant_[k0],
-                                     &m->biases_[k0], m->idct_scratch_,
-                                     &row_out[bx * dctsize], raw_out->stride(),
-                                     dctsize);
-        } else {
-          (*m->inverse_transform[c])(&row_in[bx * DCTSIZE2], &m->dequant_[k0],
-                                     &m->biases_[k0], m->idct_scratch_,
-                                     &row_out[bx * dctsize], raw_out->stride(),
-                                     dctsize);
-        }
+      if (m->parallel_runner_ == nullptr) {
+        InverseTransformBlocks(cinfo, blocks[c], c, iy, 0,
+                               compinfo.width_in_blocks, m->idct_scratch_,
+                               m->smoothing_scratch_);
       }
       if (m->streaming_mode_) {
+        int16_t* JXL_RESTRICT row_in = &blocks[c][iy][0][0];
         memset(row_in, 0, compinfo.width_in_blocks * sizeof(JBLOCK));
       }
     }
@@ -651,7 +709,7 @@ void ProcessRawOutput(j_decompress_ptr cinfo, JSAMPIMAGE data) {
       float* rows[1] = {m->raw_output_[c].Row(y)};
       uint8_t* output = data[c][y - y0];
       DecenterRow(rows[0], comp_width);
-      WriteToOutput(cinfo, rows, 0, comp_width, 1, output);
+      WriteToOutput(cinfo, rows, 0, comp_width, 1, m->output_scratch_, output);
     }
   }
   ++cinfo->output_iMCU_row;
@@ -661,16 +719,90 @@ void ProcessRawOutput(j_decompress_ptr cinfo, JSAMPIMAGE data) {
   }
 }
 
+// Upsamples the components of the row group starting at output row y into
+// render_output.
+void UpsampleRowGroup(j_decompress_ptr cinfo, size_t y,
+                      RowBuffer<float>* render_output,
+                      float* JXL_RESTRICT upsample_scratch) {
+  jpeg_decomp_master* m = cinfo->master;
+  const int vfactor = cinfo->max_v_samp_factor;
+  const size_t imcu_width = cinfo->max_h_samp_factor * m->min_scaled_dct_size;
+  const size_t output_width = m->iMCU_cols_ * imcu_width;
+  for (int c = 0; c < cinfo->num_components; ++c) {
+    RowBuffer<float>* raw_out = &m->raw_output_[c];
+    RowBuffer<float>* render_out = &render_output[c];
+    int line_groups = vfactor / m->v_factor[c];
+    int downsampled_width = output_width / m->h_factor[c];
+    size_t yc = y / m->v_factor[c];
+    for (int dy = 0; dy < line_groups; ++dy) {
+      size_t ymid = yc + dy;
+      const float* JXL_RESTRICT row_mid = raw_out->Row(ymid);
+      if (cinfo->do_fancy_upsampling && m->v_factor[c] == 2) {
+        const float* JXL_RESTRICT row_top =
+            ymid == 0 ? row_mid : raw_out->Row(ymid - 1);
+        const float* JXL_RESTRICT row_bot = ymid + 1 == m->raw_height_[c]
+                                                ? row_mid
+                                                : raw_out->Row(ymid + 1);
+        Upsample2Vertical(row_top, row_mid, row_bot, render_out->Row(2 * dy),
+                          render_out->Row(2 * dy + 1), downsampled_width);
+      } else {
+        for (int yix = 0; yix < m->v_factor[c]; ++yix) {
+          memcpy(render_out->Row(m->v_factor[c] * dy + yix), row_mid,
+                 downsampled_width * sizeof(float));
+        }
+      }
+      if (m->h_factor[c] > 1) {
+        for (int yix = 0; yix < m->v_factor[c]; ++yix) {
+          int row_ix = m->v_factor[c] * dy + yix;
+          float* JXL_RESTRICT row = render_out->Row(row_ix);
+          float* JXL_RESTRICT tmp = upsample_scratch;
+          if (cinfo->do_fancy_upsampling && m->h_factor[c] == 2) {
+            Upsample2Horizontal(row, tmp, output_width);
+          } else {
+            // TODO(szabadka) SIMDify this.
+            for (size_t x = 0; x < output_width; ++x) {
+              tmp[x] = row[x / m->h_factor[c]];
+            }
+            memcpy(row, tmp, output_width * sizeof(tmp[0]));
+          }
+        }
+      }
+    }
+  }
+}
+
+// Applies the color transform to output row yix of render_output and writes
+// it to output, if it is not nullptr.
+void RenderOutputRow(j_decompress_ptr cinfo, RowBuffer<float>* render_output,
+                     int yix, uint8_t* JXL_RESTRICT output_scratch,
+                     uint8_t* JXL_RESTRICT output) {
+  jpeg_decomp_master* m = cinfo->master;
+  const size_t imcu_width = cinfo->max_h_samp_factor * m->min_scaled_dct_size;
+  const size_t output_width = m->iMCU_cols_ * imcu_width;
+  float* rows[kMaxComponents];
+  int num_all_components =
+      std::max(cinfo->out_color_components, cinfo->num_components);
+  for (int c = 0; c < num_all_components; ++c) {
+    rows[c] = render_output[c].Row(yix);
+  }
+  (*m->color_transform)(rows, output_width);
+  for (int c = 0; c < cinfo->out_color_components; ++c) {
+    // Undo the centering of the sample values around zero.
+    DecenterRow(rows[c], output_width);
+  }
+  if (output) {
+    WriteToOutput(cinfo, rows, m->xoffset_, cinfo->output_width,
+                  cinfo->out_color_components, output_scratch, output);
+  }
+}
+
 void ProcessOutput(j_decompress_ptr cinfo, size_t* num_output_rows,
                    JSAMPARRAY scanlines, size_t max_output_rows) {
   jpeg_decomp_master* m = cinfo->master;
   const int vfactor = cinfo->max_v_samp_factor;
-  const int hfactor = cinfo->max_h_samp_factor;
   const size_t context = m->need_context_rows_ ? 1 : 0;
   const size_t imcu_row = cinfo->output_iMCU_row;
   const size_t imcu_height = vfactor * m->min_scaled_dct_size;
-  const size_t imcu_width = hfactor * m->min_scaled_dct_size;
-  const size_t output_width = m->iMCU_cols_ * imcu_width;
   if (imcu_row == cinfo->total_iMCU_rows ||
       (imcu_row > context &&
        cinfo->output_scanline < (imcu_row - context) * imcu_height)) {
@@ -682,67 +814,46 @@ void ProcessOutput(j_decompress_ptr cinfo, size_t* num_output_rows,
     yend = std::min<size_t>(yend, ybegin + max_output_rows - *num_output_rows);
     size_t yb = (ybegin / vfactor) * vfactor;
     size_t ye = DivCeil(yend, vfactor) * vfactor;
-    for (size_t y = yb; y < ye; y += vfactor) {
-      for (int c = 0; c < cinfo->num_components; ++c) {
-        RowBuffer<float>* raw_out = &m->raw_output_[c];
-        RowBuffer<float>* render_out = &m->render_output_[c];
-        int line_groups = vfactor / m->v_factor[c];
-        int downsampled_width = output_width / m->h_factor[c];
-        size_t yc = y / m->v_factor[c];
-        for (int dy = 0; dy < line_groups; ++dy) {
-          size_t ymid = yc + dy;
-          const float* JXL_RESTRICT row_mid = raw_out->Row(ymid);
-          if (cinfo->do_fancy_upsampling && m->v_factor[c] == 2) {
-            const float* JXL_RESTRICT row_top =
-                ymid == 0 ? row_mid : raw_out->Row(ymid - 1);
-            const float* JXL_RESTRICT row_bot = ymid + 1 == m->raw_height_[c]
-                                                    ? row_mid
-                                                    : raw_out->Row(ymid + 1);
-            Upsample2Vertical(row_top, row_mid, row_bot,
-                              render_out->Row(2 * dy),
-                              render_out->Row(2 * dy + 1), downsampled_width);
-          } else {
-            for (int yix = 0; yix < m->v_factor[c]; ++yix) {
-              memcpy(render_out->Row(m->v_factor[c] * dy + yix), row_mid,
-                     downsampled_width * sizeof(float));
-            }
-          }
-          if (m->h_factor[c] > 1) {
-            for (int yix = 0; yix < m->v_factor[c]; ++yix) {
-              int row_ix = m->v_factor[c] * dy + yix;
-              float* JXL_RESTRICT row = render_out->Row(row_ix);
-              float* JXL_RESTRICT tmp = m->upsample_scratch_;
-              if (cinfo->do_fancy_upsampling && m->h_factor[c] == 2) {
-                Upsample2Horizontal(row, tmp, output_width);
-              } else {
-                // TODO(szabadka) SIMDify this.
-                for (size_t x = 0; x < output_width; ++x) {
-                  tmp[x] = row[x / m->h_factor[c]];
-                }
-                memcpy(row, tmp, output_width * sizeof(tmp[0]));
-              }
+    if (!m->render_scratch_.empty() && !cinfo->quantize_colors) {
+      // Render the row groups in batches, one row group per task. The rows are
+      // independent of each other, since color quantization is not enabled.
+      const size_t num_slots = m->render_scratch_.size();
+      for (size_t y0 = yb; y0 < ye; y0 += num_slots * vfactor) {
+        size_t num_groups = std::min(num_slots, (ye - y0) / vfactor);
+        const auto render_row_group = [&](uint32_t i) {
+          RenderScratch* scratch = &m->render_scratch_[i];
+          size_t y = y0 + i * vfactor;
+          UpsampleRowGroup(cinfo, y, scratch->render_output,
+                           scratch->upsample_scratch);
+          for (int yix = 0; yix < vfactor; ++yix) {
+            if (y + yix < ybegin || y + yix >= yend) continue;
+            uint8_t* output = nullptr;
+            if (scanlines) {
+              output = scanlines[*num_output_rows + (y + yix - ybegin)];
             }
+            RenderOutputRow(cinfo, scratch->render_output, yix,
+                            scratch->output_scratch, output);
           }
+        };
+        RunParallel(cinfo, m->parallel_runner_, m->parallel_runner_opaque_, 0,
+                    num_groups, render_row_group, "RenderOutput");
+      }
+      if (yend > ybegin) {
+        cinfo->output_scanline += yend - ybegin;
+        *num_output_rows += yend - ybegin;
+        if (cinfo->output_scanline == cinfo->output_height) {
+          ++m->output_passes_done_;
         }
       }
+      return;
+    }
+    for (size_t y = yb; y < ye; y += vfactor) {
+      UpsampleRowGroup(cinfo, y, m->render_output_, m->upsample_scratch_);
       for (int yix = 0; yix < vfactor; ++yix) {
         if (y + yix < ybegin || y + yix >= yend) continue;
-        float* rows[kMaxComponents];
-        int num_all_components =
-            std::max(cinfo->out_color_components, cinfo->num_components);
-        for (int c = 0; c < num_all_components; ++c) {
-          rows[c] = m->render_output_[c].Row(yix);
-        }
-        (*m->color_transform)(rows, output_width);
-        for (int c = 0; c < cinfo->out_color_components; ++c) {
-          // Undo the centering of the sample values around zero.
-          DecenterRow(rows[c], output_width);
-        }
-        if (scanlines) {
-          uint8_t* output = scanlines[*num_output_rows];
-          WriteToOutput(cinfo, rows, m->xoffset_, cinfo->output_width,
-                        cinfo->out_color_components, output);
-        }
+        uint8_t* output = scanlines ? scanlines[*num_output_rows] : nullptr;
+        RenderOutputRow(cinfo, m->render_output_, yix, m->output_scratch_,
+                        output);
         JPEGLI_CHECK(cinfo->output_scanline == y + yix);
         ++cinfo->output_scanline;
         ++(*num_output_rows);
@@ -10,6 +10,7 @@
 #include <cstring>
 #include <fstream>
 #include <sstream>
+#include <thread>
 
 #include "lib/jpegli/decode.h"
 #include "lib/jpegli/encode.h"
@@ -864,4 +865,25 @@ void VerifyOutputImage(const TestImage& input, const TestImage& output,
   }
 }
 
+// Runs the tasks on a fixed number of threads, where each thread takes every
+// kNumThreads-th task of the range.
+int TestParallelRunner(void* runner_opaque, void* jpegli_opaque,
+                       JpegliParallelRunInit init,
+                       JpegliParallelRunFunction func, uint32_t start_range,
+                       uint32_t end_range) {
+  constexpr size_t kNumThreads = 4;
+  int ret = init(jpegli_opaque, kNumThreads);
+  if (ret != 0) return ret;
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < kNumThreads; ++t) {
+    threads.emplace_back([=]() {
+      for (uint32_t i = start_range + t; i < end_range; i += kNumThreads) {
+        func(jpegli_opaque, i, t);
+      }
+    });
+  }
+  for (auto& thread : threads) thread.join();
+  return 0;
+}
+
 }  // namespace jpegli
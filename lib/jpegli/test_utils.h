@@ -118,6 +118,13 @@ void VerifyOutputImage(const TestImage& input, const TestImage& output,
 void VerifyOutputImage(const TestImage& input, const TestImage& output,
                        double max_rms, double max_diff = 255.0);
 
+// Runs the tasks on a fixed number of threads, where each thread takes every
+// kNumThreads-th task of the range.
+int TestParallelRunner(void* runner_opaque, void* jpegli_opaque,
+                       JpegliParallelRunInit init,
+                       JpegliParallelRunFunction func, uint32_t start_range,
+                       uint32_t end_range);
+
 }  // namespace jpegli
 
 #endif  // LIB_JPEGLI_TEST_UTILS_H_
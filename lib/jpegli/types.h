@@ -6,6 +6,9 @@
 #ifndef LIB_JPEGLI_TYPES_H_
 #define LIB_JPEGLI_TYPES_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -31,6 +34,29 @@ typedef enum {
 
 int jpegli_bytes_per_sample(JpegliDataType data_type);
 
+// Parallel runner interface of jpegli. The signatures are the same as those of
+// JxlParallelRunner and its callbacks, see jxl/parallel_runner.h, therefore the
+// parallel runners of the libjxl_threads library can be used directly.
+typedef int (*JpegliParallelRunInit)(void* jpegli_opaque, size_t num_threads);
+
+typedef void (*JpegliParallelRunFunction)(void* jpegli_opaque, uint32_t value,
+                                          size_t thread_id);
+
+typedef int (*JpegliParallelRunner)(void* runner_opaque, void* jpegli_opaque,
+                                    JpegliParallelRunInit init,
+                                    JpegliParallelRunFunction func,
+                                    uint32_t start_range, uint32_t end_range);
+
+// Output buffer callback of jpegli_buffer_ring_dest(). It is called with the
+// first filled_size bytes of the previous output buffer (nullptr and 0 on the
+// first call), which then belong to the application again. If next_buffer is
+// not nullptr, it must return the next output buffer in *next_buffer and its
+// nonzero size in *next_size, otherwise the compression is finished. Returns 0
+// on failure.
+typedef int (*JpegliOutputBufferFunc)(void* opaque, const uint8_t* filled,
+                                      size_t filled_size, uint8_t** next_buffer,
+                                      size_t* next_size);
+
 #ifdef __cplusplus
 }  // extern "C"
 #endif
@@ -5,6 +5,7 @@
 
 #include <jxl/memory_manager.h>
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
 #include <vector>
@@ -297,5 +298,67 @@ TEST(ANSTest, TestCheckpointingPrefixLZ77) {
   TestCheckpointing(/*ans=*/false, /*lz77=*/true);
 }
 
+void TestBatch(bool ans) {
+  JxlMemoryManager* memory_manager = jxl::test::MemoryManager();
+  Rng rng(0);
+  std::vector<std::vector<Token>> input_values(1);
+  for (size_t i = 0; i < 10000; i++) {
+    // Mostly small values, some of them with many extra bits.
+    uint32_t max_value = rng.UniformU(0, 16) == 0 ? (1u << 24) : 64;
+    input_values[0].emplace_back(0, rng.UniformU(0, max_value));
+  }
+
+  std::vector<uint8_t> context_map;
+  EntropyEncodingData codes;
+  HistogramParams params;
+  params.force_huffman = !ans;
+
+  BitWriter writer{memory_manager};
+  {
+    auto input_values_copy = input_values;
+    JXL_TEST_ASSIGN_OR_DIE(
+        size_t cost, BuildAndEncodeHistograms(
+                         memory_manager, params, 1, input_values_copy, &codes,
+                         &context_map, &writer, LayerType::Header, nullptr));
+    (void)cost;
+    ASSERT_TRUE(WriteTokens(input_values_copy[0], codes, context_map, 0,
+                            &writer, LayerType::Header, nullptr));
+    writer.ZeroPadToByte();
+  }
+
+  BitReader br(writer.GetSpan());
+  Status status = true;
+  {
+    BitReaderScopedCloser bc(br, status);
+
+    std::vector<uint8_t> dec_context_map;
+    ANSCode decoded_codes;
+    ASSERT_TRUE(DecodeHistograms(memory_manager, &br, 1, &decoded_codes,
+                                 &dec_context_map));
+    JXL_TEST_ASSIGN_OR_DIE(ANSSymbolReader reader,
+                           ANSSymbolReader::Create(&decoded_codes, &br));
+    ASSERT_FALSE(reader.UsesLZ77());
+
+    std::vector<uint32_t> values(input_values[0].size());
+    size_t pos = 0;
+    while (pos < values.size()) {
+      size_t count =
+          std::min<size_t>(rng.UniformU(0, 300), values.size() - pos);
+      reader.ReadHybridUintClusteredBatch(dec_context_map[0], &br,
+                                          values.data() + pos, count);
+      pos += count;
+    }
+    for (size_t i = 0; i < values.size(); i++) {
+      ASSERT_EQ(values[i], input_values[0][i].value) << "i = " << i;
+    }
+    ASSERT_TRUE(reader.CheckANSFinalState());
+  }
+  EXPECT_TRUE(status);
+}
+
+TEST(ANSTest, TestBatchANS) { TestBatch(/*ans=*/true); }
+
+TEST(ANSTest, TestBatchPrefix) { TestBatch(/*ans=*/false); }
+
 }  // namespace
 }  // namespace jxl
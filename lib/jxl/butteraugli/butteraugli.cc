@@ -39,6 +39,8 @@
 #define HWY_TARGET_INCLUDE "lib/jxl/butteraugli/butteraugli.cc"
 #include <hwy/foreach_target.h>
 
+#include "lib/jxl/base/common.h"
+#include "lib/jxl/base/data_parallel.h"
 #include "lib/jxl/base/fast_math-inl.h"
 #include "lib/jxl/base/rect.h"
 #include "lib/jxl/base/status.h"
@@ -1956,6 +1958,54 @@ Status ButteraugliComparator::DiffmapPsychoImage(const PsychoImage& pi1,
   return true;
 }
 
+namespace {
+
+// Reach of a pixel of the distorted image into the diffmap. At full
+// resolution the blurs of OpsinDynamicsImage (2), of the frequency separation
+// (16 + 7 + 3) and of the masking (6 + 3 for the erosion) add up to 37 pixels;
+// the half resolution pass doubles that and adds the subsampling. Even, so
+// that the crops keep the 2x2 grid of the subsampling.
+constexpr size_t kTileBorder = 80;
+// The borders are computed by both neighbours, so the tiles are large to keep
+// that overhead lower.
+constexpr size_t kParallelTileDim = 512;
+
+size_t NumTiles(size_t xsize, size_t ysize, size_t tile_dim) {
+  return DivCeil(xsize, tile_dim) * DivCeil(ysize, tile_dim);
+}
+
+Rect TileRect(size_t xsize, size_t ysize, size_t tile_dim, size_t tile) {
+  const size_t xsize_tiles = DivCeil(xsize, tile_dim);
+  return Rect((tile % xsize_tiles) * tile_dim, (tile / xsize_tiles) * tile_dim,
+              tile_dim, tile_dim, xsize, ysize);
+}
+
+StatusOr<Image3F> CropImage(const Image3F& image, const Rect& rect) {
+  JXL_ASSIGN_OR_RETURN(
+      Image3F crop,
+      Image3F::Create(image.memory_manager(), rect.xsize(), rect.ysize()));
+  JXL_RETURN_IF_ERROR(CopyImageTo(rect, image, Rect(crop), &crop));
+  return crop;
+}
+
+// Computes the diffmap of `rect` from the crops of `rect_with_border`;
+// `comparator` holds the crop of the reference image.
+Status DiffmapTile(const ButteraugliComparator& comparator, const Image3F& rgb1,
+                   const Rect& rect, const Rect& rect_with_border,
+                   ImageF* diffmap) {
+  JXL_ASSIGN_OR_RETURN(Image3F rgb1_tile, CropImage(rgb1, rect_with_border));
+  JXL_ASSIGN_OR_RETURN(ImageF diffmap_tile,
+                       ImageF::Create(rgb1.memory_manager(),
+                                      rgb1_tile.xsize(), rgb1_tile.ysize()));
+  JXL_RETURN_IF_ERROR(comparator.Diffmap(rgb1_tile, diffmap_tile));
+  const Rect inner(rect.x0() - rect_with_border.x0(),
+                   rect.y0() - rect_with_border.y0(), rect.xsize(),
+                   rect.ysize());
+  return CopyImageTo(inner, diffmap_tile, rect, diffmap);
+}
+
+}  // namespace
+
 double ButteraugliScoreFromDiffmap(const ImageF& diffmap,
                                    const ButteraugliParams* params) {
   float retval = 0.0f;
@@ -2035,6 +2085,33 @@ Status ButteraugliDiffmap(const Image3F& rgb0, const Image3F& rgb1,
   return true;
 }
 
+Status ButteraugliDiffmap(const Image3F& rgb0, const Image3F& rgb1,
+                          const ButteraugliParams& params, ImageF& diffmap,
+                          ThreadPool* pool) {
+  const size_t xsize = rgb0.xsize();
+  const size_t ysize = rgb0.ysize();
+  if (!SameSize(rgb0, rgb1)) {
+    return JXL_FAILURE("Size mismatch");
+  }
+  const size_t num_tiles = NumTiles(xsize, ysize, kParallelTileDim);
+  if (num_tiles == 1 || xsize < 8 || ysize < 8) {
+    return ButteraugliDiffmap(rgb0, rgb1, params, diffmap);
+  }
+  JXL_ASSIGN_OR_RETURN(diffmap,
+                       ImageF::Create(rgb0.memory_manager(), xsize, ysize));
+  const auto process_tile = [&](const uint32_t tile,
+                                size_t /* thread */) -> Status {
+    const Rect rect = TileRect(xsize, ysize, kParallelTileDim, tile);
+    const Rect rect_with_border = rect.Extend(kTileBorder, Rect(rgb0));
+    JXL_ASSIGN_OR_RETURN(Image3F rgb0_tile, CropImage(rgb0, rect_with_border));
+    JXL_ASSIGN_OR_RETURN(std::unique_ptr<ButteraugliComparator> comparator,
+                         ButteraugliComparator::Make(rgb0_tile, params));
+    return DiffmapTile(*comparator, rgb1, rect, rect_with_border, &diffmap);
+  };
+  return RunOnPool(pool, 0, num_tiles, ThreadPool::NoInit, process_tile,
+                   "ButteraugliDiffmap");
+}
+
 bool ButteraugliInterface(const Image3F& rgb0, const Image3F& rgb1,
                           float hf_asymmetry, float xmul, ImageF& diffmap,
                           double& diffvalue) {
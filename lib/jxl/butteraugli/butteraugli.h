@@ -17,6 +17,7 @@
 #include <memory>
 
 #include "lib/jxl/base/compiler_specific.h"
+#include "lib/jxl/base/data_parallel.h"
 #include "lib/jxl/base/status.h"
 #include "lib/jxl/image.h"
 
@@ -212,6 +213,15 @@ Status ButteraugliDiffmap(const Image3F &rgb0, const Image3F &rgb1,
 Status ButteraugliDiffmap(const Image3F &rgb0, const Image3F &rgb1,
                           const ButteraugliParams &params, ImageF &diffmap);
 
+// Same as above, but processes overlapping tiles of the images in parallel
+// on `pool`. The memory used on top of the images and the diffmap is
+// proportional to the tile size and the number of threads, instead of the
+// image size. The tiles overlap by the support of the blurs, so the result
+// matches the one above up to rounding.
+Status ButteraugliDiffmap(const Image3F &rgb0, const Image3F &rgb1,
+                          const ButteraugliParams &params, ImageF &diffmap,
+                          ThreadPool *pool);
+
 double ButteraugliScoreFromDiffmap(const ImageF &diffmap,
                                    const ButteraugliParams *params = nullptr);
 
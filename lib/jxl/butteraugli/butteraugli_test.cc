@@ -20,6 +20,7 @@
 #include "lib/jxl/enc_external_image.h"
 #include "lib/jxl/image.h"
 #include "lib/jxl/image_ops.h"
+#include "lib/jxl/image_test_utils.h"
 #include "lib/jxl/test_image.h"
 #include "lib/jxl/test_memory_manager.h"
 #include "lib/jxl/test_utils.h"
@@ -112,5 +113,31 @@ TEST(ButteraugliInPlaceTest, LargeImage) {
   EXPECT_NEAR(distp, distp2, 1e-7);
 }
 
+TEST(ButteraugliTiledTest, MatchesFullDiffmap) {
+  JxlMemoryManager* memory_manager = jxl::test::MemoryManager();
+  const size_t xsize = 1100;
+  const size_t ysize = 900;
+  TestImage img;
+  ASSERT_TRUE(img.SetDimensions(xsize, ysize));
+  JXL_TEST_ASSIGN_OR_DIE(auto frame, img.AddFrame());
+  frame.RandomFill(777);
+  JXL_TEST_ASSIGN_OR_DIE(Image3F rgb0, GetColorImage(img.ppf()));
+  JXL_TEST_ASSIGN_OR_DIE(Image3F rgb1,
+                         Image3F::Create(memory_manager, xsize, ysize));
+  ASSERT_TRUE(CopyImageTo(rgb0, &rgb1));
+  AddUniformNoise(&rgb1, 0.02f, 7777);
+  AddEdge(&rgb1, 0.1f, 510, 500);
+  ButteraugliParams butteraugli_params;
+  ImageF expected;
+  ASSERT_TRUE(ButteraugliDiffmap(rgb0, rgb1, butteraugli_params, expected));
+  test::ThreadPoolForTests pool(4);
+  ImageF diffmap;
+  ASSERT_TRUE(ButteraugliDiffmap(rgb0, rgb1, butteraugli_params, diffmap,
+                                 pool.get()));
+  JXL_TEST_ASSERT_OK(VerifyRelativeError(expected, diffmap, 1e-4, 1e-4, _));
+  EXPECT_NEAR(ButteraugliScoreFromDiffmap(expected),
+              ButteraugliScoreFromDiffmap(diffmap), 1e-4);
+}
+
 }  // namespace
 }  // namespace jxl
@@ -18,6 +18,8 @@
 #include <cstdint>
 #include <cstring>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 #undef HWY_TARGET_INCLUDE
 #define HWY_TARGET_INCLUDE "lib/jxl/cms/jxl_cms.cc"
@@ -51,12 +53,20 @@ namespace {
 
 using ::jxl::cms::ColorEncoding;
 
-struct JxlCms {
+// The part of a transform that only depends on the input and output profiles.
+// It is not modified once created, and is shared by all the JxlCms created for
+// the same pair of profiles.
+struct JxlCmsTransform {
+  JxlCmsTransform() = default;
+  JxlCmsTransform(const JxlCmsTransform&) = delete;
+  JxlCmsTransform& operator=(const JxlCmsTransform&) = delete;
+  ~JxlCmsTransform();
+
 #if JPEGXL_ENABLE_SKCMS
   IccBytes icc_src, icc_dst;
   skcms_ICCProfile profile_src, profile_dst;
 #else
-  void* lcms_transform;
+  void* lcms_transform = nullptr;
 #endif
 
   // These fields are used when the HLG OOTF or inverse OOTF must be applied.
@@ -68,15 +78,20 @@ struct JxlCms {
   size_t channels_src;
   size_t channels_dst;
 
+  bool skip_lcms = false;
+  ExtraTF preprocess = ExtraTF::kNone;
+  ExtraTF postprocess = ExtraTF::kNone;
+};
+
+struct JxlCms {
+  std::shared_ptr<const JxlCmsTransform> transform;
+
   std::vector<float> src_storage;
   std::vector<float*> buf_src;
   std::vector<float> dst_storage;
   std::vector<float*> buf_dst;
 
   float intensity_target;
-  bool skip_lcms = false;
-  ExtraTF preprocess = ExtraTF::kNone;
-  ExtraTF postprocess = ExtraTF::kNone;
 };
 
 Status ApplyHlgOotf(JxlCms* t, float* JXL_RESTRICT buf, size_t xsize,
@@ -97,7 +112,7 @@ const size_t kX = 0;  // pixel index, multiplied by 3 for RGB
 // xform_src = UndoGammaCompression(buf_src).
 Status BeforeTransform(JxlCms* t, const float* buf_src, float* xform_src,
                        size_t buf_size) {
-  switch (t->preprocess) {
+  switch (t->transform->preprocess) {
     case ExtraTF::kNone:
       JXL_ENSURE(false);  // unreachable
       break;
@@ -123,7 +138,7 @@ Status BeforeTransform(JxlCms* t, const float* buf_src, float* xform_src,
         xform_src[i] = static_cast<float>(
             TF_HLG_Base::DisplayFromEncoded(static_cast<double>(buf_src[i])));
       }
-      if (t->apply_hlg_ootf) {
+      if (t->transform->apply_hlg_ootf) {
         JXL_RETURN_IF_ERROR(
             ApplyHlgOotf(t, xform_src, buf_size, /*forward=*/true));
       }
@@ -153,7 +168,7 @@ Status BeforeTransform(JxlCms* t, const float* buf_src, float* xform_src,
 
 // Applies gamma compression in-place.
 Status AfterTransform(JxlCms* t, float* JXL_RESTRICT buf_dst, size_t buf_size) {
-  switch (t->postprocess) {
+  switch (t->transform->postprocess) {
     case ExtraTF::kNone:
       JXL_DEBUG_ABORT("Unreachable");
       break;
@@ -172,7 +187,7 @@ Status AfterTransform(JxlCms* t, float* JXL_RESTRICT buf_dst, size_t buf_size) {
       break;
     }
     case ExtraTF::kHLG:
-      if (t->apply_hlg_ootf) {
+      if (t->transform->apply_hlg_ootf) {
         JXL_RETURN_IF_ERROR(
             ApplyHlgOotf(t, buf_dst, buf_size, /*forward=*/false));
       }
@@ -206,17 +221,18 @@ Status DoColorSpaceTransform(void* cms_data, const size_t thread,
                              size_t xsize) {
   // No lock needed.
   JxlCms* t = reinterpret_cast<JxlCms*>(cms_data);
+  const JxlCmsTransform* transform = t->transform.get();
 
   const float* xform_src = buf_src;  // Read-only.
-  if (t->preprocess != ExtraTF::kNone) {
+  if (transform->preprocess != ExtraTF::kNone) {
     float* mutable_xform_src = t->buf_src[thread];  // Writable buffer.
     JXL_RETURN_IF_ERROR(BeforeTransform(t, buf_src, mutable_xform_src,
-                                        xsize * t->channels_src));
+                                        xsize * transform->channels_src));
     xform_src = mutable_xform_src;
   }
 
 #if JPEGXL_ENABLE_SKCMS
-  if (t->channels_src == 1 && !t->skip_lcms) {
+  if (transform->channels_src == 1 && !transform->skip_lcms) {
     // Expand from 1 to 3 channels, starting from the end in case
     // xform_src == t->buf_src[thread].
     float* mutable_xform_src = t->buf_src[thread];
@@ -228,7 +244,7 @@ Status DoColorSpaceTransform(void* cms_data, const size_t thread,
     xform_src = mutable_xform_src;
   }
 #else
-  if (t->channels_src == 4 && !t->skip_lcms) {
+  if (transform->channels_src == 4 && !transform->skip_lcms) {
     // LCMS does CMYK in a weird way: 0 = white, 100 = max ink
     float* mutable_xform_src = t->buf_src[thread];
     for (size_t x = 0; x < xsize * 4; ++x) {
@@ -245,32 +261,33 @@ Status DoColorSpaceTransform(void* cms_data, const size_t thread,
   const float in2 = xform_src[3 * kX + 2];
 #endif
 
-  if (t->skip_lcms) {
+  if (transform->skip_lcms) {
     if (buf_dst != xform_src) {
-      memcpy(buf_dst, xform_src, xsize * t->channels_src * sizeof(*buf_dst));
+      memcpy(buf_dst, xform_src,
+             xsize * transform->channels_src * sizeof(*buf_dst));
     }  // else: in-place, no need to copy
   } else {
 #if JPEGXL_ENABLE_SKCMS
-    JXL_ENSURE(
-        skcms_Transform(xform_src,
-                        (t->channels_src == 4 ? skcms_PixelFormat_RGBA_ffff
-                                              : skcms_PixelFormat_RGB_fff),
-                        skcms_AlphaFormat_Opaque, &t->profile_src, buf_dst,
-                        skcms_PixelFormat_RGB_fff, skcms_AlphaFormat_Opaque,
-                        &t->profile_dst, xsize));
+    JXL_ENSURE(skcms_Transform(
+        xform_src,
+        (transform->channels_src == 4 ? skcms_PixelFormat_RGBA_ffff
+                                      : skcms_PixelFormat_RGB_fff),
+        skcms_AlphaFormat_Opaque, &transform->profile_src, buf_dst,
+        skcms_PixelFormat_RGB_fff, skcms_AlphaFormat_Opaque,
+        &transform->profile_dst, xsize));
 #else   // JPEGXL_ENABLE_SKCMS
-    cmsDoTransform(t->lcms_transform, xform_src, buf_dst,
+    cmsDoTransform(transform->lcms_transform, xform_src, buf_dst,
                    static_cast<cmsUInt32Number>(xsize));
 #endif  // JPEGXL_ENABLE_SKCMS
   }
 #if JXL_CMS_VERBOSE >= 2
   printf("xform skip%d: %.4f %.4f %.4f (%p) -> (%p) %.4f %.4f %.4f\n",
-         t->skip_lcms, in0, in1, in2, xform_src, buf_dst, buf_dst[3 * kX],
-         buf_dst[3 * kX + 1], buf_dst[3 * kX + 2]);
+         transform->skip_lcms, in0, in1, in2, xform_src, buf_dst,
+         buf_dst[3 * kX], buf_dst[3 * kX + 1], buf_dst[3 * kX + 2]);
 #endif
 
 #if JPEGXL_ENABLE_SKCMS
-  if (t->channels_dst == 1 && !t->skip_lcms) {
+  if (transform->channels_dst == 1 && !transform->skip_lcms) {
     // Contract back from 3 to 1 channel, this time forward.
     float* grayscale_buf_dst = t->buf_dst[thread];
     for (size_t x = 0; x < xsize; ++x) {
@@ -280,8 +297,9 @@ Status DoColorSpaceTransform(void* cms_data, const size_t thread,
   }
 #endif
 
-  if (t->postprocess != ExtraTF::kNone) {
-    JXL_RETURN_IF_ERROR(AfterTransform(t, buf_dst, xsize * t->channels_dst));
+  if (transform->postprocess != ExtraTF::kNone) {
+    JXL_RETURN_IF_ERROR(
+        AfterTransform(t, buf_dst, xsize * transform->channels_dst));
   }
   return true;
 }
@@ -856,6 +874,7 @@ Status GetPrimariesLuminances(const ColorEncoding& encoding,
 
 Status ApplyHlgOotf(JxlCms* t, float* JXL_RESTRICT buf, size_t xsize,
                     bool forward) {
+  const JxlCmsTransform* transform = t->transform.get();
   if (295 <= t->intensity_target && t->intensity_target <= 305) {
     // The gamma is approximately 1 so this can essentially be skipped.
     return true;
@@ -863,7 +882,7 @@ Status ApplyHlgOotf(JxlCms* t, float* JXL_RESTRICT buf, size_t xsize,
   float gamma = 1.2f * std::pow(1.111f, std::log2(t->intensity_target * 1e-3f));
   if (!forward) gamma = 1.f / gamma;
 
-  switch (t->hlg_ootf_num_channels) {
+  switch (transform->hlg_ootf_num_channels) {
     case 1:
       for (size_t x = 0; x < xsize; ++x) {
         buf[x] = std::pow(buf[x], gamma);
@@ -872,9 +891,10 @@ Status ApplyHlgOotf(JxlCms* t, float* JXL_RESTRICT buf, size_t xsize,
 
     case 3:
       for (size_t x = 0; x < xsize; x += 3) {
-        const float luminance = buf[x] * t->hlg_ootf_luminances[0] +
-                                buf[x + 1] * t->hlg_ootf_luminances[1] +
-                                buf[x + 2] * t->hlg_ootf_luminances[2];
+        const float luminance =
+            buf[x] * transform->hlg_ootf_luminances[0] +
+            buf[x + 1] * transform->hlg_ootf_luminances[1] +
+            buf[x + 2] * transform->hlg_ootf_luminances[2];
         const float ratio = std::pow(luminance, gamma - 1);
         if (std::isfinite(ratio)) {
           buf[x] *= ratio;
@@ -903,7 +923,7 @@ Status ApplyHlgOotf(JxlCms* t, float* JXL_RESTRICT buf, size_t xsize,
 
     default:
       return JXL_FAILURE("HLG OOTF not implemented for %" PRIuS " channels",
-                         t->hlg_ootf_num_channels);
+                         transform->hlg_ootf_num_channels);
   }
   return true;
 }
@@ -1078,12 +1098,15 @@ JXL_BOOL JxlCmsSetFieldsFromICC(void* user_data, const uint8_t* icc_data,
 
 namespace {
 
+JxlCmsTransform::~JxlCmsTransform() {
+#if !JPEGXL_ENABLE_SKCMS
+  if (lcms_transform != nullptr) TransformDeleter()(lcms_transform);
+#endif
+}
+
 void JxlCmsDestroy(void* cms_data) {
   if (cms_data == nullptr) return;
   JxlCms* t = reinterpret_cast<JxlCms*>(cms_data);
-#if !JPEGXL_ENABLE_SKCMS
-  TransformDeleter()(t->lcms_transform);
-#endif
   delete t;
 }
 
@@ -1102,25 +1125,13 @@ void AllocateBuffer(size_t length, size_t num_threads,
   }
 }
 
-void* JxlCmsInit(void* init_data, size_t num_threads, size_t xsize,
-                 const JxlColorProfile* input, const JxlColorProfile* output,
-                 float intensity_target) {
-  if (init_data == nullptr) {
-    JXL_NOTIFY_ERROR("JxlCmsInit: init_data is nullptr");
-    return nullptr;
-  }
-  const auto* cms = static_cast<const JxlCmsInterface*>(init_data);
-  auto t = jxl::make_unique<JxlCms>();
+// Parses the profiles and builds the transform between them.
+std::unique_ptr<JxlCmsTransform> CreateTransform(
+    const JxlCmsInterface* cms, const JxlColorProfile* input,
+    const JxlColorProfile* output) {
+  auto t = jxl::make_unique<JxlCmsTransform>();
   IccBytes icc_src;
   IccBytes icc_dst;
-  if (input->icc.size == 0) {
-    JXL_NOTIFY_ERROR("JxlCmsInit: empty input ICC");
-    return nullptr;
-  }
-  if (output->icc.size == 0) {
-    JXL_NOTIFY_ERROR("JxlCmsInit: empty OUTPUT ICC");
-    return nullptr;
-  }
   icc_src.assign(input->icc.data, input->icc.data + input->icc.size);
   ColorEncoding c_src;
   if (!c_src.SetFieldsFromICC(std::move(icc_src), *cms)) {
@@ -1286,8 +1297,7 @@ void* JxlCmsInit(void* init_data, size_t num_threads, size_t xsize,
   const size_t channels_src = (c_src.cmyk ? 4 : c_src.Channels());
   const size_t channels_dst = c_dst.Channels();
 #if JXL_CMS_VERBOSE
-  printf("Channels: %" PRIuS "; Threads: %" PRIuS "\n", channels_src,
-         num_threads);
+  printf("Channels: %" PRIuS "\n", channels_src);
 #endif
 
 #if !JPEGXL_ENABLE_SKCMS
@@ -1308,6 +1318,108 @@ void* JxlCmsInit(void* init_data, size_t num_threads, size_t xsize,
   }
 #endif  // !JPEGXL_ENABLE_SKCMS
 
+  t->channels_src = channels_src;
+  t->channels_dst = channels_dst;
+  return t;
+}
+
+// Process-wide cache of the most recently used transforms, so that converting
+// many images between the same profiles, e.g. in the decoder output stage or
+// in ToXYB of the encoder, parses the profiles and builds the transform only
+// once. The transform does not depend on the intensity target, and the
+// rendering intent is part of the output profile, so the profiles are the key.
+class TransformCache {
+ public:
+  std::shared_ptr<const JxlCmsTransform> Get(const JxlCmsInterface* cms,
+                                             const JxlColorProfile* input,
+                                             const JxlColorProfile* output) {
+    const uint64_t hash =
+        HashBytes(input->icc.data, input->icc.size) * 0x9E3779B97F4A7C15ull ^
+        HashBytes(output->icc.data, output->icc.size);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (size_t i = 0; i < entries_.size(); ++i) {
+        if (!entries_[i].Matches(hash, input, output)) continue;
+        // Most recently used first.
+        std::rotate(entries_.begin(), entries_.begin() + i,
+                    entries_.begin() + i + 1);
+        return entries_[0].transform;
+      }
+    }
+    // Built without holding the lock, other threads may build the same
+    // transform meanwhile; the result is the same.
+    std::shared_ptr<const JxlCmsTransform> transform =
+        CreateTransform(cms, input, output);
+    if (!transform) return nullptr;
+    Entry entry;
+    entry.hash = hash;
+    entry.icc_src.assign(input->icc.data, input->icc.data + input->icc.size);
+    entry.icc_dst.assign(output->icc.data,
+                         output->icc.data + output->icc.size);
+    entry.transform = transform;
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.insert(entries_.begin(), std::move(entry));
+    if (entries_.size() > kMaxEntries) entries_.pop_back();
+    return transform;
+  }
+
+ private:
+  static constexpr size_t kMaxEntries = 16;
+
+  struct Entry {
+    bool Matches(uint64_t other_hash, const JxlColorProfile* input,
+                 const JxlColorProfile* output) const {
+      return hash == other_hash && icc_src.size() == input->icc.size &&
+             icc_dst.size() == output->icc.size &&
+             memcmp(icc_src.data(), input->icc.data, icc_src.size()) == 0 &&
+             memcmp(icc_dst.data(), output->icc.data, icc_dst.size()) == 0;
+    }
+
+    uint64_t hash;
+    IccBytes icc_src;
+    IccBytes icc_dst;
+    std::shared_ptr<const JxlCmsTransform> transform;
+  };
+
+  // FNV-1a.
+  static uint64_t HashBytes(const uint8_t* data, size_t size) {
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for (size_t i = 0; i < size; ++i) {
+      hash = (hash ^ data[i]) * 0x100000001B3ull;
+    }
+    return hash;
+  }
+
+  std::mutex mutex_;
+  std::vector<Entry> entries_;
+};
+
+TransformCache* GetTransformCache() {
+  // Never destroyed, transforms may still be in use at exit.
+  static TransformCache* cache = new TransformCache();
+  return cache;
+}
+
+void* JxlCmsInit(void* init_data, size_t num_threads, size_t xsize,
+                 const JxlColorProfile* input, const JxlColorProfile* output,
+                 float intensity_target) {
+  if (init_data == nullptr) {
+    JXL_NOTIFY_ERROR("JxlCmsInit: init_data is nullptr");
+    return nullptr;
+  }
+  const auto* cms = static_cast<const JxlCmsInterface*>(init_data);
+  if (input->icc.size == 0) {
+    JXL_NOTIFY_ERROR("JxlCmsInit: empty input ICC");
+    return nullptr;
+  }
+  if (output->icc.size == 0) {
+    JXL_NOTIFY_ERROR("JxlCmsInit: empty OUTPUT ICC");
+    return nullptr;
+  }
+  auto t = jxl::make_unique<JxlCms>();
+  t->transform = GetTransformCache()->Get(cms, input, output);
+  if (!t->transform) return nullptr;
+
   // Ideally LCMS would convert directly from External to Image3. However,
   // cmsDoTransformLineStride only accepts 32-bit BytesPerPlaneIn, whereas our
   // planes can be more than 4 GiB apart. Hence, transform inputs/outputs must
@@ -1316,15 +1428,13 @@ void* JxlCmsInit(void* init_data, size_t num_threads, size_t xsize,
   // buffers. To avoid separate allocations, we use the rows of an image.
   // Because LCMS apparently also cannot handle <= 16 bit inputs and 32-bit
   // outputs (or vice versa), we use floating point input/output.
-  t->channels_src = channels_src;
-  t->channels_dst = channels_dst;
 #if !JPEGXL_ENABLE_SKCMS
-  size_t actual_channels_src = channels_src;
-  size_t actual_channels_dst = channels_dst;
+  size_t actual_channels_src = t->transform->channels_src;
+  size_t actual_channels_dst = t->transform->channels_dst;
 #else
   // SkiaCMS doesn't support grayscale float buffers, so we create space for RGB
   // float buffers anyway.
-  size_t actual_channels_src = (channels_src == 4 ? 4 : 3);
+  size_t actual_channels_src = (t->transform->channels_src == 4 ? 4 : 3);
   size_t actual_channels_dst = 3;
 #endif
   AllocateBuffer(xsize * actual_channels_src, num_threads, &t->src_storage,
@@ -13,6 +13,7 @@
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <memory>
 #include <ostream>
 #include <string>
 #include <utility>
@@ -351,6 +352,46 @@ TEST_F(ColorManagementTest, HlgOotf) {
   EXPECT_NEAR(linear_grayscale_value, 0.203, 1e-3);
 }
 
+TEST_F(ColorManagementTest, CachedTransforms) {
+  ColorEncoding p3;
+  p3.SetColorSpace(ColorSpace::kRGB);
+  ASSERT_TRUE(p3.SetWhitePointType(WhitePoint::kD65));
+  ASSERT_TRUE(p3.SetPrimariesType(Primaries::kP3));
+  p3.Tf().SetTransferFunction(TransferFunction::kSRGB);
+  ASSERT_TRUE(p3.CreateICC());
+  const Color p3_values{0.9, 0.3, 0.1};
+
+  Color expected;
+  {
+    ColorSpaceTransform transform(*JxlGetDefaultCms());
+    ASSERT_TRUE(transform.Init(p3, ColorEncoding::SRGB(), 255, 1, 1));
+    ASSERT_TRUE(transform.Run(0, p3_values.data(), expected.data(), 1));
+  }
+  // Transforms between other profiles push the first one out of the cache.
+  for (int i = 0; i < 20; ++i) {
+    ColorEncoding gamma;
+    gamma.SetColorSpace(ColorSpace::kRGB);
+    ASSERT_TRUE(gamma.SetWhitePointType(WhitePoint::kD65));
+    ASSERT_TRUE(gamma.SetPrimariesType(Primaries::kSRGB));
+    ASSERT_TRUE(gamma.Tf().SetGamma(1.0 / (1.5 + 0.1 * i)));
+    ASSERT_TRUE(gamma.CreateICC());
+    ColorSpaceTransform transform(*JxlGetDefaultCms());
+    ASSERT_TRUE(transform.Init(p3, gamma, 255, 1, 1));
+    Color values;
+    ASSERT_TRUE(transform.Run(0, p3_values.data(), values.data(), 1));
+  }
+  // Transforms with the same profiles share their state, and stay usable
+  // after the others are destroyed.
+  auto first = jxl::make_unique<ColorSpaceTransform>(*JxlGetDefaultCms());
+  ColorSpaceTransform second(*JxlGetDefaultCms());
+  ASSERT_TRUE(first->Init(p3, ColorEncoding::SRGB(), 255, 1, 1));
+  ASSERT_TRUE(second.Init(p3, ColorEncoding::SRGB(), 255, 1, 1));
+  first.reset();
+  Color values;
+  ASSERT_TRUE(second.Run(0, p3_values.data(), values.data(), 1));
+  EXPECT_ARRAY_NEAR(values, expected, 1e-6);
+}
+
 TEST_F(ColorManagementTest, XYBProfile) {
   JxlMemoryManager* memory_manager = jxl::test::MemoryManager();
   ColorEncoding c_xyb;
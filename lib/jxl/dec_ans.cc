@@ -7,6 +7,8 @@
 
 #include <jxl/memory_manager.h>
 
+#include <algorithm>
+#include <cstddef>
 #include <cstdint>
 #include <vector>
 
@@ -401,6 +403,13 @@ ANSSymbolReader::ANSSymbolReader(const ANSCode* code,
   } else {
     state_ = (ANS_SIGNATURE << 16u);
   }
+  // A symbol takes at most 16 bits (ANS renormalization or prefix code), plus
+  // the extra bits of the hybrid uint, which are fewer than the bits of the
+  // largest value. Without LZ77, max_num_bits covers all symbols.
+  const size_t max_bits_per_symbol =
+      16 + std::min<size_t>(code->max_num_bits, 31);
+  symbols_per_refill_ =
+      std::max<size_t>(1, BitReader::kMaxBitsPerCall / max_bits_per_symbol);
   if (!code->lz77.enabled) return;
   lz77_window_ = lz77_window_storage_.address<uint32_t>();
   lz77_ctx_ = code->lz77.nonserialized_distance_context;
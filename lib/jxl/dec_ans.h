@@ -373,6 +373,23 @@ class ANSSymbolReader {
     return ReadHybridUintClustered</*uses_lz77=*/true>(context_map[ctx], br);
   }
 
+  // Decodes `count` values of the *clustered* context `ctx` into `values`.
+  // Same result as calling ReadHybridUintClustered `count` times, but the
+  // entropy coder type is checked once per call and the BitReader is refilled
+  // once per group of symbols that are guaranteed to fit in its buffer. Can
+  // only be used if UsesLZ77() is false.
+  JXL_INLINE void ReadHybridUintClusteredBatch(size_t ctx,
+                                               BitReader* JXL_RESTRICT br,
+                                               uint32_t* JXL_RESTRICT values,
+                                               size_t count) {
+    JXL_DASSERT(!UsesLZ77());
+    if (use_prefix_code_) {
+      ReadHybridUintBatch</*use_prefix_code=*/true>(ctx, br, values, count);
+    } else {
+      ReadHybridUintBatch</*use_prefix_code=*/false>(ctx, br, values, count);
+    }
+  }
+
   // ctx is a *clustered* context!
   // This function will modify the ANS state as if `count` symbols have been
   // decoded.
@@ -450,6 +467,23 @@ class ANSSymbolReader {
                   size_t distance_multiplier,
                   AlignedMemory&& lz77_window_storage);
 
+  template <bool use_prefix_code>
+  JXL_INLINE void ReadHybridUintBatch(size_t ctx, BitReader* JXL_RESTRICT br,
+                                      uint32_t* JXL_RESTRICT values,
+                                      size_t count) {
+    const HybridUintConfig config = configs[ctx];
+    size_t i = 0;
+    while (i < count) {
+      br->Refill();
+      const size_t end = std::min(count, i + symbols_per_refill_);
+      for (; i < end; i++) {
+        size_t token = use_prefix_code ? ReadSymbolHuffWithoutRefill(ctx, br)
+                                       : ReadSymbolANSWithoutRefill(ctx, br);
+        values[i] = ReadHybridUintConfig(config, token, br);
+      }
+    }
+  }
+
   const AliasTable::Entry* JXL_RESTRICT alias_tables_;  // not owned
   const HuffmanDecodingData* huffman_data_;
   bool use_prefix_code_;
@@ -458,6 +492,8 @@ class ANSSymbolReader {
   uint32_t log_alpha_size_{};
   uint32_t log_entry_size_{};
   uint32_t entry_size_minus_1_{};
+  // Number of symbols that can be read after a single BitReader::Refill.
+  size_t symbols_per_refill_ = 1;
 
   // LZ77 structures and constants.
   static constexpr size_t kWindowMask = kWindowSize - 1;
@@ -8,6 +8,7 @@
 #include <jxl/memory_manager.h>
 
 #include <algorithm>
+#include <utility>
 
 #include "lib/jxl/ac_strategy.h"
 #include "lib/jxl/base/status.h"
@@ -100,6 +101,53 @@ Status PassesDecoderState::InitForAC(size_t num_passes, ThreadPool* pool) {
   return true;
 }
 
+Rect PassesDecoderState::OutputRegionBeforeOrientation() const {
+  size_t x0 = output_region.x0();
+  size_t y0 = output_region.y0();
+  size_t xsize = output_region.xsize();
+  size_t ysize = output_region.ysize();
+  bool transpose = false;
+  bool flip_x = false;
+  bool flip_y = false;
+  switch (undo_orientation) {
+    case Orientation::kIdentity:
+      break;
+    case Orientation::kFlipHorizontal:
+      flip_x = true;
+      break;
+    case Orientation::kRotate180:
+      flip_x = flip_y = true;
+      break;
+    case Orientation::kFlipVertical:
+      flip_y = true;
+      break;
+    case Orientation::kTranspose:
+      transpose = true;
+      break;
+    case Orientation::kRotate90:
+      transpose = flip_y = true;
+      break;
+    case Orientation::kAntiTranspose:
+      transpose = flip_x = flip_y = true;
+      break;
+    case Orientation::kRotate270:
+      transpose = flip_x = true;
+      break;
+  }
+  if (transpose) {
+    std::swap(x0, y0);
+    std::swap(xsize, ysize);
+  }
+  if (flip_x) x0 = width - x0 - xsize;
+  if (flip_y) y0 = height - y0 - ysize;
+  return Rect(x0, y0, xsize, ysize);
+}
+
+bool PassesDecoderState::HasPartialOutputRegion() const {
+  return output_region.x0() != 0 || output_region.y0() != 0 ||
+         output_region.xsize() * output_region.ysize() != width * height;
+}
+
 Status PassesDecoderState::PreparePipeline(const FrameHeader& frame_header,
                                            const ImageMetadata* metadata,
                                            ImageBundle* decoded,
@@ -115,7 +163,15 @@ Status PassesDecoderState::PreparePipeline(const FrameHeader& frame_header,
     frame_storage_for_referencing = ImageBundle(memory_manager, metadata);
   }
 
+  if (render_pipeline) {
+    // Only keep the buffers of the last pipeline.
+    render_pipeline_images.Clear();
+    render_pipeline->ReleaseImages(&render_pipeline_images);
+    render_pipeline.reset();
+  }
+
   RenderPipeline::Builder builder(memory_manager, num_c + num_tmp_c);
+  builder.ReuseImages(&render_pipeline_images);
 
   if (options.use_slow_render_pipeline) {
     builder.UseSimpleImplementation();
@@ -224,6 +280,7 @@ Status PassesDecoderState::PreparePipeline(const FrameHeader& frame_header,
   if (fast_xyb_srgb8_conversion) {
 #if !JXL_HIGH_PRECISION
     JXL_ENSURE(!NeedsBlending(frame_header));
+    JXL_ENSURE(!HasPartialOutputRegion());
     JXL_ENSURE(!frame_header.CanBeReferenced() ||
                frame_header.save_before_color_transform);
     JXL_ENSURE(!options.render_spotcolors ||
@@ -335,7 +392,8 @@ Status PassesDecoderState::PreparePipeline(const FrameHeader& frame_header,
 
     if (main_output.callback.IsPresent() || main_output.buffer) {
       JXL_RETURN_IF_ERROR(builder.AddStage(GetWriteToOutputStage(
-          main_output, width, height, has_alpha, unpremul_alpha, alpha_c,
+          main_output, width, height, output_region,
+          OutputRegionBeforeOrientation(), has_alpha, unpremul_alpha, alpha_c,
           undo_orientation, extra_output, memory_manager)));
     } else {
       JXL_RETURN_IF_ERROR(builder.AddStage(
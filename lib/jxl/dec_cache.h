@@ -20,6 +20,7 @@
 #include "lib/jxl/base/common.h"  // kMaxNumPasses
 #include "lib/jxl/base/compiler_specific.h"
 #include "lib/jxl/base/data_parallel.h"
+#include "lib/jxl/base/rect.h"
 #include "lib/jxl/base/status.h"
 #include "lib/jxl/common.h"
 #include "lib/jxl/dct_util.h"
@@ -77,8 +78,15 @@ struct ImageOutput {
   // Pixel buffer for image output.
   void* buffer;
   size_t buffer_size;
-  // Length of a row of image_buffer in bytes (based on oriented width).
+  // Length of a row of image_buffer in bytes (based on oriented width), or of
+  // a row of each tile.
   size_t stride;
+  // If not null, the output is split into tiles of tile_xsize x tile_ysize
+  // pixels, stored in row-major order in this table, and buffer is unused.
+  // Owned by the caller.
+  void* const* tiles = nullptr;
+  size_t tile_xsize = 0;
+  size_t tile_ysize = 0;
 };
 
 // Per-frame decoder state. All the images here should be accessed through a
@@ -112,6 +120,11 @@ struct PassesDecoderState {
   ImageOutput main_output;
   std::vector<ImageOutput> extra_output;
 
+  // Area of the image (after applying undo_orientation) that is written to
+  // main_output and extra_output. Buffer offsets and callback coordinates are
+  // relative to its origin.
+  Rect output_region;
+
   // Whether to use int16 float-XYB-to-uint8-srgb conversion.
   bool fast_xyb_srgb8_conversion;
 
@@ -135,6 +148,8 @@ struct PassesDecoderState {
 
   // Rendering pipeline.
   std::unique_ptr<RenderPipeline> render_pipeline;
+  // Buffers of the previous pipeline, reused by the next one.
+  RenderPipelineImageCache render_pipeline_images;
 
   // Storage for the current frame if it can be referenced by future frames.
   ImageBundle frame_storage_for_referencing;
@@ -164,6 +179,7 @@ struct PassesDecoderState {
     main_output.callback = PixelCallback();
     main_output.buffer = nullptr;
     extra_output.clear();
+    output_region = Rect();
 
     fast_xyb_srgb8_conversion = false;
     unpremul_alpha = false;
@@ -184,6 +200,13 @@ struct PassesDecoderState {
 
   // Initialize the decoder state after all of DC is decoded.
   Status InitForAC(size_t num_passes, ThreadPool* pool);
+
+  // Returns output_region in the coordinates of the image before applying
+  // undo_orientation, i.e. the coordinates used by the render pipeline.
+  Rect OutputRegionBeforeOrientation() const;
+
+  // Returns true if only part of the image is written to the output.
+  bool HasPartialOutputRegion() const;
 };
 
 // Temp images required for decoding a single group. Reduces memory allocations
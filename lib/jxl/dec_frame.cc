@@ -259,6 +259,7 @@ Status FrameDecoder::InitFrameOutput() {
   decoded_passes_per_ac_group_.resize(frame_dim_.num_groups, 0);
   processed_section_.clear();
   processed_section_.resize(toc_.size());
+  skipped_ac_groups_.clear();
   allocated_ = false;
   return true;
 }
@@ -364,6 +365,63 @@ Status FrameDecoder::AllocateOutput() {
   return true;
 }
 
+void FrameDecoder::ComputeSkippedGroups() {
+  skipped_ac_groups_.clear();
+  if (!dec_state_->main_output.callback.IsPresent() &&
+      !dec_state_->main_output.buffer) {
+    return;
+  }
+  if (!dec_state_->HasPartialOutputRegion()) return;
+  // Only frames that are not needed in full by later frames, and that are
+  // rendered directly to the output without blending of a smaller frame, may
+  // skip the groups that do not contribute to the output region.
+  if (frame_header_.frame_type != FrameType::kRegularFrame &&
+      frame_header_.frame_type != FrameType::kSkipProgressive) {
+    return;
+  }
+  if (frame_header_.CanBeReferenced() ||
+      frame_header_.nonserialized_is_preview || !coalescing_ ||
+      frame_header_.custom_size_or_origin || decoded_->IsJPEG()) {
+    return;
+  }
+  // Global modular transforms need all the groups.
+  if (modular_frame_decoder_.UsesFullImage()) return;
+  std::pair<size_t, size_t> border;
+  if (!dec_state_->render_pipeline ||
+      !dec_state_->render_pipeline->SupportsSkippingGroups(&border)) {
+    return;
+  }
+  Rect region = dec_state_->OutputRegionBeforeOrientation();
+  size_t upsampling = frame_header_.upsampling;
+  size_t x0 = region.x0() / upsampling;
+  size_t y0 = region.y0() / upsampling;
+  size_t x1 = DivCeil(region.x1(), upsampling) + border.first;
+  size_t y1 = DivCeil(region.y1(), upsampling) + border.second;
+  x0 = x0 > border.first ? x0 - border.first : 0;
+  y0 = y0 > border.second ? y0 - border.second : 0;
+  size_t group_dim = frame_dim_.group_dim;
+  size_t gx0 = x0 / group_dim;
+  size_t gy0 = y0 / group_dim;
+  size_t gx1 = std::min(DivCeil(x1, group_dim), frame_dim_.xsize_groups);
+  size_t gy1 = std::min(DivCeil(y1, group_dim), frame_dim_.ysize_groups);
+  skipped_ac_groups_.resize(frame_dim_.num_groups);
+  for (size_t g = 0; g < frame_dim_.num_groups; g++) {
+    size_t gx = g % frame_dim_.xsize_groups;
+    size_t gy = g / frame_dim_.xsize_groups;
+    if (gx >= gx0 && gx < gx1 && gy >= gy0 && gy < gy1) continue;
+    skipped_ac_groups_[g] = 1;
+    decoded_passes_per_ac_group_[g] = frame_header_.passes.num_passes;
+  }
+}
+
+bool FrameDecoder::CanSkipSection(size_t id) const {
+  if (skipped_ac_groups_.empty()) return false;
+  size_t ac_global_index = frame_dim_.num_dc_groups + 1;
+  if (id <= ac_global_index) return false;
+  size_t ac_idx = id - ac_global_index - 1;
+  return skipped_ac_groups_[ac_idx % frame_dim_.num_groups] != 0;
+}
+
 Status FrameDecoder::ProcessACGlobal(BitReader* br) {
   JXL_ENSURE(finalized_dc_);
   JxlMemoryManager* memory_manager = dec_state_->memory_manager();
@@ -665,12 +723,25 @@ Status FrameDecoder::ProcessSections(const SectionInfo* sections, size_t num,
         pipeline_options));
     JXL_RETURN_IF_ERROR(FinalizeDC());
     JXL_RETURN_IF_ERROR(AllocateOutput());
+    ComputeSkippedGroups();
     if (progressive_detail_ >= JxlProgressiveDetail::kDC) {
       MarkSections(sections, num, section_status);
       return true;
     }
   }
 
+  if (!skipped_ac_groups_.empty()) {
+    // Groups outside of the output region are marked as done without decoding
+    // them.
+    for (size_t g = 0; g < ac_group_sec.size(); g++) {
+      if (!skipped_ac_groups_[g]) continue;
+      for (size_t sec : ac_group_sec[g]) {
+        if (sec != num) section_status[sec] = SectionStatus::kDone;
+      }
+      desired_num_ac_passes[g] = 0;
+    }
+  }
+
   if (finalized_dc_ && ac_global_sec != num && !decoded_ac_global_) {
     JXL_RETURN_IF_ERROR(ProcessACGlobal(sections[ac_global_sec].br));
     section_status[ac_global_sec] = SectionStatus::kDone;
@@ -19,6 +19,7 @@
 #include "lib/jxl/base/common.h"
 #include "lib/jxl/base/compiler_specific.h"
 #include "lib/jxl/base/data_parallel.h"
+#include "lib/jxl/base/rect.h"
 #include "lib/jxl/base/status.h"
 #include "lib/jxl/common.h"  // JXL_HIGH_PRECISION
 #include "lib/jxl/dec_bit_reader.h"
@@ -55,6 +56,16 @@ class FrameDecoder {
   void SetRenderSpotcolors(bool rsc) { render_spotcolors_ = rsc; }
   void SetCoalescing(bool c) { coalescing_ = c; }
 
+  // Moves the per-thread group decoding buffers out of / into the frame
+  // decoder, so that they can be reused by the decoder of the next frame.
+  void ReleaseGroupDecCaches(std::vector<GroupDecCache>* caches) {
+    *caches = std::move(group_dec_caches_);
+    group_dec_caches_.clear();
+  }
+  void UseGroupDecCaches(std::vector<GroupDecCache>&& caches) {
+    group_dec_caches_ = std::move(caches);
+  }
+
   // Read FrameHeader and table of contents from the given BitReader.
   Status InitFrame(BitReader* JXL_RESTRICT br, ImageBundle* decoded,
                    bool is_preview);
@@ -127,6 +138,11 @@ class FrameDecoder {
   bool HasDecodedDC() const { return finalized_dc_; }
   bool HasDecodedAll() const { return toc_.size() == num_sections_done_; }
 
+  // Returns true if the section with the given id does not contribute to the
+  // output region, in which case its BitReader passed to ProcessSections may
+  // be empty. Only returns true once DC has been decoded.
+  bool CanSkipSection(size_t id) const;
+
   size_t NumCompletePasses() const {
     return *std::min_element(decoded_passes_per_ac_group_.begin(),
                              decoded_passes_per_ac_group_.end());
@@ -189,18 +205,29 @@ class FrameDecoder {
   // @param undo_orientation: if true, indicates the frame decoder should apply
   // the exif orientation to bring the image to the intended display
   // orientation.
+  // @param output_region: area of the (oriented) xsize * ysize image that is
+  // written to the output.
+  // @param image_buffer_stride: distance in bytes between rows of
+  // image_buffer, or 0 to derive it from the format.
   void SetImageOutput(const PixelCallback& pixel_callback, void* image_buffer,
-                      size_t image_buffer_size, size_t xsize, size_t ysize,
+                      size_t image_buffer_size, size_t image_buffer_stride,
+                      size_t xsize, size_t ysize, const Rect& output_region,
                       JxlPixelFormat format, size_t bits_per_sample,
                       bool unpremul_alpha, bool undo_orientation) const {
     dec_state_->width = xsize;
     dec_state_->height = ysize;
+    dec_state_->output_region = output_region;
     dec_state_->main_output.format = format;
     dec_state_->main_output.bits_per_sample = bits_per_sample;
     dec_state_->main_output.callback = pixel_callback;
     dec_state_->main_output.buffer = image_buffer;
     dec_state_->main_output.buffer_size = image_buffer_size;
-    dec_state_->main_output.stride = GetStride(xsize, format);
+    dec_state_->main_output.stride =
+        image_buffer_stride != 0 ? image_buffer_stride
+                                 : GetStride(output_region.xsize(), format);
+    dec_state_->main_output.tiles = nullptr;
+    dec_state_->main_output.tile_xsize = 0;
+    dec_state_->main_output.tile_ysize = 0;
     const jxl::ExtraChannelInfo* alpha =
         decoded_->metadata()->Find(jxl::ExtraChannel::kAlpha);
     if (alpha && alpha->alpha_associated && unpremul_alpha) {
@@ -218,6 +245,7 @@ class FrameDecoder {
         (format.data_type == JXL_TYPE_UINT8) && (format.num_channels >= 3) &&
         !dec_state_->unpremul_alpha &&
         (dec_state_->undo_orientation == Orientation::kIdentity) &&
+        !dec_state_->HasPartialOutputRegion() &&
         decoded_->metadata()->xyb_encoded &&
         dec_state_->output_encoding_info.color_encoding.IsSRGB() &&
         dec_state_->output_encoding_info.all_default_opsin &&
@@ -229,6 +257,18 @@ class FrameDecoder {
 #endif
   }
 
+  // Makes the image output set by SetImageOutput go to a grid of tiles of
+  // `tile_xsize` x `tile_ysize` pixels instead of image_buffer. Rows of each
+  // tile are image_buffer_stride bytes apart.
+  void SetImageOutputTiles(size_t tile_xsize, size_t tile_ysize,
+                           void* const* tiles) const {
+    dec_state_->main_output.tiles = tiles;
+    dec_state_->main_output.tile_xsize = tile_xsize;
+    dec_state_->main_output.tile_ysize = tile_ysize;
+    // The fast path writes whole rows to a single buffer.
+    dec_state_->fast_xyb_srgb8_conversion = false;
+  }
+
   void AddExtraChannelOutput(void* buffer, size_t buffer_size, size_t xsize,
                              JxlPixelFormat format, size_t bits_per_sample) {
     ImageOutput out;
@@ -245,6 +285,8 @@ class FrameDecoder {
   Status ProcessDCGroup(size_t dc_group_id, BitReader* br);
   Status FinalizeDC();
   Status AllocateOutput();
+  // Finds the AC groups that are not needed to render the output region.
+  void ComputeSkippedGroups();
   Status ProcessACGlobal(BitReader* br);
   Status ProcessACGroup(size_t ac_group_id, BitReader* JXL_RESTRICT* br,
                         size_t num_passes, size_t thread, bool force_draw,
@@ -314,6 +356,8 @@ class FrameDecoder {
   std::vector<uint8_t> processed_section_;
   std::vector<uint8_t> decoded_passes_per_ac_group_;
   std::vector<uint8_t> decoded_dc_groups_;
+  // Empty if all the AC groups are decoded.
+  std::vector<uint8_t> skipped_ac_groups_;
   bool decoded_dc_global_;
   bool decoded_ac_global_;
   bool HasEverything() const;
@@ -67,6 +67,9 @@ struct OutputEncodingInfo {
   float desired_intensity_target;
   bool cms_set = false;
   JxlCmsInterface color_management_system;
+  // If positive, the CMS transform is replaced by a 3D lookup table when its
+  // maximum error on a set of sample colors is at most this value.
+  float cms_lut_max_error = 0.0f;
 
   Status SetFromMetadata(const CodecMetadata& metadata);
   Status MaybeSetColorEncoding(const ColorEncoding& c_desired);
@@ -10,6 +10,7 @@
 #include <algorithm>
 #include <array>
 #include <functional>
+#include <limits>
 #include <memory>
 #include <utility>
 #include <vector>
@@ -17,6 +18,8 @@
 #include "lib/jxl/base/byte_order.h"
 #include "lib/jxl/base/common.h"
 #include "lib/jxl/base/compiler_specific.h"
+#include "lib/jxl/base/data_parallel.h"
+#include "lib/jxl/base/rect.h"
 #include "lib/jxl/base/span.h"
 #include "lib/jxl/base/status.h"
 #include "lib/jxl/padded_bytes.h"
@@ -27,6 +30,7 @@
 #if JPEGXL_ENABLE_BOXES || JPEGXL_ENABLE_TRANSCODE_JPEG
 #include "lib/jxl/box_content_decoder.h"
 #endif
+#include "lib/jxl/dec_cache.h"
 #include "lib/jxl/dec_frame.h"
 #if JPEGXL_ENABLE_TRANSCODE_JPEG
 #include "lib/jxl/decode_to_jpeg.h"
@@ -38,6 +42,7 @@
 #include "lib/jxl/icc_codec.h"
 #include "lib/jxl/image_bundle.h"
 #include "lib/jxl/memory_manager_internal.h"
+#include "lib/jxl/render_pipeline/render_pipeline.h"
 
 namespace {
 
@@ -351,6 +356,17 @@ struct JxlDecoderStruct {
   JxlMemoryManager memory_manager;
   std::unique_ptr<jxl::ThreadPool> thread_pool;
 
+  // Single-threaded decoders used by JxlDecoderDecodeBatch, one per thread of
+  // the parallel runner, and the images of the last batch.
+  struct BatchOutput {
+    uint32_t xsize;
+    uint32_t ysize;
+    std::vector<uint8_t> pixels;
+  };
+  std::vector<std::unique_ptr<JxlDecoder, decltype(&JxlDecoderDestroy)>>
+      batch_workers;
+  std::vector<BatchOutput> batch_outputs;
+
   DecoderStage stage;
 
   // Status of progression, internal.
@@ -412,6 +428,11 @@ struct JxlDecoderStruct {
   bool render_spotcolors;
   bool coalescing;
   float desired_intensity_target;
+  float cms_lut_max_error;
+  // Area of the (oriented) image that is written to the image out buffer or
+  // callback, if image_out_region_set.
+  bool image_out_region_set;
+  jxl::Rect image_out_region;
 
   // Bitfield, for which informative events (JXL_DEC_BASIC_INFO, etc...) the
   // decoder returns a status. By default, do not return for any of the events,
@@ -448,6 +469,14 @@ struct JxlDecoderStruct {
   SimpleImageOutCallback simple_image_out_callback;
 
   size_t image_out_size;
+  // Distance in bytes between rows of image_out_buffer, or between rows of
+  // each of image_out_tiles. Zero if it follows from image_out_format.
+  size_t image_out_stride;
+  // Owned by the caller. If not empty, the full resolution image is written to
+  // these tiles, and image_out_buffer is the first of them.
+  std::vector<void*> image_out_tiles;
+  size_t image_out_tile_xsize;
+  size_t image_out_tile_ysize;
 
   JxlPixelFormat image_out_format;
   JxlBitDepth image_out_bit_depth;
@@ -463,6 +492,11 @@ struct JxlDecoderStruct {
   std::unique_ptr<jxl::ImageBundle> ib;
 
   std::unique_ptr<jxl::PassesDecoderState> passes_state;
+  // Render pipeline buffers kept across JxlDecoderReset and JxlDecoderRewind,
+  // for the next image if it has the same size.
+  jxl::RenderPipelineImageCache render_pipeline_images;
+  // Group decoding buffers of the last frame decoder, for the next one.
+  std::vector<jxl::GroupDecCache> group_dec_caches;
   std::unique_ptr<jxl::FrameDecoder> frame_dec;
   size_t next_section;
   std::vector<char> section_processed;
@@ -721,14 +755,28 @@ void JxlDecoderRewindDecodingState(JxlDecoder* dec) {
   dec->image_out_destroy_callback = nullptr;
   dec->image_out_init_opaque = nullptr;
   dec->image_out_size = 0;
+  dec->image_out_stride = 0;
+  dec->image_out_tiles.clear();
+  dec->image_out_tile_xsize = 0;
+  dec->image_out_tile_ysize = 0;
   dec->image_out_bit_depth.type = JXL_BIT_DEPTH_FROM_PIXEL_FORMAT;
   dec->extra_channel_output.clear();
   dec->next_in = nullptr;
   dec->avail_in = 0;
   dec->input_closed = false;
 
-  dec->passes_state.reset();
+  if (dec->frame_dec) {
+    dec->frame_dec->ReleaseGroupDecCaches(&dec->group_dec_caches);
+  }
   dec->frame_dec.reset();
+  if (dec->passes_state) {
+    dec->render_pipeline_images.Clear();
+    if (dec->passes_state->render_pipeline) {
+      dec->passes_state->render_pipeline->ReleaseImages(
+          &dec->render_pipeline_images);
+    }
+  }
+  dec->passes_state.reset();
   dec->next_section = 0;
   dec->section_processed.clear();
 
@@ -761,12 +809,16 @@ void JxlDecoderReset(JxlDecoder* dec) {
   dec->render_spotcolors = true;
   dec->coalescing = true;
   dec->desired_intensity_target = 0;
+  dec->cms_lut_max_error = 0;
+  dec->image_out_region_set = false;
+  dec->image_out_region = jxl::Rect();
   dec->orig_events_wanted = 0;
   dec->events_wanted = 0;
   dec->frame_refs.clear();
   dec->frame_external_to_internal.clear();
   dec->frame_required.clear();
   dec->decompress_boxes = false;
+  dec->batch_outputs.clear();
 }
 
 JxlDecoder* JxlDecoderCreate(const JxlMemoryManager* memory_manager) {
@@ -926,6 +978,19 @@ void GetCurrentDimensions(const JxlDecoder* dec, size_t& xsize, size_t& ysize) {
     }
   }
 }
+
+// helper function to get the area of the current image that is written to the
+// image buffer
+jxl::Rect GetCurrentOutputRegion(const JxlDecoder* dec) {
+  if (dec->image_out_region_set &&
+      !dec->frame_header->nonserialized_is_preview) {
+    return dec->image_out_region;
+  }
+  size_t xsize;
+  size_t ysize;
+  GetCurrentDimensions(dec, xsize, ysize);
+  return jxl::Rect(0, 0, xsize, ysize);
+}
 }  // namespace
 
 namespace jxl {
@@ -1067,6 +1132,11 @@ JxlDecoderStatus JxlDecoderReadAllHeaders(JxlDecoder* dec) {
     dec->passes_state =
         jxl::make_unique<jxl::PassesDecoderState>(&dec->memory_manager);
   }
+  if (!dec->render_pipeline_images.empty()) {
+    dec->passes_state->render_pipeline_images =
+        std::move(dec->render_pipeline_images);
+    dec->render_pipeline_images.Clear();
+  }
 
   JXL_API_RETURN_IF_ERROR(
       dec->passes_state->output_encoding_info.SetFromMetadata(dec->metadata));
@@ -1074,6 +1144,8 @@ JxlDecoderStatus JxlDecoderReadAllHeaders(JxlDecoder* dec) {
     dec->passes_state->output_encoding_info.desired_intensity_target =
         dec->desired_intensity_target;
   }
+  dec->passes_state->output_encoding_info.cms_lut_max_error =
+      dec->cms_lut_max_error;
   dec->image_metadata = dec->metadata.m;
 
   return JXL_DEC_SUCCESS;
@@ -1093,10 +1165,16 @@ JxlDecoderStatus JxlDecoderProcessSections(JxlDecoder* dec) {
     }
     size_t id = toc[i].id;
     size_t size = toc[i].size;
-    if (OutOfBounds(pos, size, span.size())) {
+    jxl::Bytes bytes(span.data() + std::min(pos, span.size()), 0);
+    if (dec->frame_dec->CanSkipSection(id)) {
+      // The section is outside of the output region: it is not needed, so
+      // neither is its data.
+    } else if (OutOfBounds(pos, size, span.size())) {
       break;
+    } else {
+      bytes = jxl::Bytes(span.data() + pos, size);
     }
-    auto* br = new jxl::BitReader(jxl::Bytes(span.data() + pos, size));
+    auto* br = new jxl::BitReader(bytes);
     section_info.emplace_back(jxl::FrameDecoder::SectionInfo{br, id, i});
     section_status.emplace_back();
     pos += size;
@@ -1228,9 +1306,14 @@ JxlDecoderStatus JxlDecoderProcessCodestream(JxlDecoder* dec) {
       if (!dec->jpeg_decoder.SetImageBundleJpegData(dec->ib.get()))
         return JXL_DEC_ERROR;
 #endif
+      if (dec->frame_dec) {
+        dec->frame_dec->ReleaseGroupDecCaches(&dec->group_dec_caches);
+      }
       dec->frame_dec = jxl::make_unique<FrameDecoder>(
           dec->passes_state.get(), dec->metadata, dec->thread_pool.get(),
           /*use_slow_rendering_pipeline=*/false);
+      dec->frame_dec->UseGroupDecCaches(std::move(dec->group_dec_caches));
+      dec->group_dec_caches.clear();
       dec->frame_header = jxl::make_unique<FrameHeader>(&dec->metadata);
       Span<const uint8_t> span;
       JXL_API_RETURN_IF_ERROR(dec->GetCodestreamInput(&span));
@@ -1393,6 +1476,7 @@ JxlDecoderStatus JxlDecoderProcessCodestream(JxlDecoder* dec) {
         size_t xsize;
         size_t ysize;
         GetCurrentDimensions(dec, xsize, ysize);
+        jxl::Rect region = GetCurrentOutputRegion(dec);
         size_t bits_per_sample = GetBitDepth(
             dec->image_out_bit_depth, dec->metadata.m, dec->image_out_format);
         dec->frame_dec->SetImageOutput(
@@ -1400,15 +1484,21 @@ JxlDecoderStatus JxlDecoderProcessCodestream(JxlDecoder* dec) {
                 dec->image_out_init_callback, dec->image_out_run_callback,
                 dec->image_out_destroy_callback, dec->image_out_init_opaque},
             reinterpret_cast<uint8_t*>(dec->image_out_buffer),
-            dec->image_out_size, xsize, ysize, dec->image_out_format,
-            bits_per_sample, dec->unpremul_alpha, !dec->keep_orientation);
+            dec->image_out_size, dec->image_out_stride, xsize, ysize, region,
+            dec->image_out_format, bits_per_sample, dec->unpremul_alpha,
+            !dec->keep_orientation);
+        if (!dec->image_out_tiles.empty()) {
+          dec->frame_dec->SetImageOutputTiles(dec->image_out_tile_xsize,
+                                              dec->image_out_tile_ysize,
+                                              dec->image_out_tiles.data());
+        }
         for (size_t i = 0; i < dec->extra_channel_output.size(); ++i) {
           const auto& extra = dec->extra_channel_output[i];
           size_t ec_bits_per_sample =
               GetBitDepth(dec->image_out_bit_depth,
                           dec->metadata.m.extra_channel_info[i], extra.format);
           dec->frame_dec->AddExtraChannelOutput(extra.buffer, extra.buffer_size,
-                                                xsize, extra.format,
+                                                region.xsize(), extra.format,
                                                 ec_bits_per_sample);
         }
       }
@@ -1688,7 +1778,8 @@ static JxlDecoderStatus HandleBoxes(JxlDecoder* dec) {
     if (dec->recon_output_jpeg == JpegReconStage::kOutputting &&
         !dec->JbrdNeedMoreBoxes()) {
       JxlDecoderStatus status =
-          dec->jpeg_decoder.WriteOutput(*dec->ib->jpeg_data);
+          dec->jpeg_decoder.WriteOutput(*dec->ib->jpeg_data,
+                                        dec->thread_pool.get());
       if (status != JXL_DEC_SUCCESS) return status;
       dec->recon_output_jpeg = JpegReconStage::kNone;
       dec->ib.reset();
@@ -2338,24 +2429,39 @@ JXL_EXPORT JxlDecoderStatus JxlDecoderSetCms(JxlDecoder* dec,
   return JXL_DEC_SUCCESS;
 }
 
-static JxlDecoderStatus GetMinSize(const JxlDecoder* dec,
-                                   const JxlPixelFormat* format,
-                                   size_t num_channels, size_t* min_size,
-                                   bool preview) {
+// Gets the dimensions of the output and the size in bytes of one of its rows,
+// without alignment.
+static JxlDecoderStatus GetOutputRowSize(const JxlDecoder* dec,
+                                         const JxlPixelFormat* format,
+                                         size_t num_channels, bool preview,
+                                         size_t* xsize, size_t* ysize,
+                                         size_t* row_size) {
   size_t bits;
   JxlDecoderStatus status = PrepareSizeCheck(dec, format, &bits);
   if (status != JXL_DEC_SUCCESS) return status;
-  size_t xsize;
-  size_t ysize;
   if (preview) {
-    xsize = dec->metadata.oriented_preview_xsize(dec->keep_orientation);
-    ysize = dec->metadata.oriented_preview_ysize(dec->keep_orientation);
+    *xsize = dec->metadata.oriented_preview_xsize(dec->keep_orientation);
+    *ysize = dec->metadata.oriented_preview_ysize(dec->keep_orientation);
   } else {
-    GetCurrentDimensions(dec, xsize, ysize);
+    jxl::Rect region = GetCurrentOutputRegion(dec);
+    *xsize = region.xsize();
+    *ysize = region.ysize();
   }
   if (num_channels == 0) num_channels = format->num_channels;
-  size_t row_size =
-      jxl::DivCeil(xsize * num_channels * bits, jxl::kBitsPerByte);
+  *row_size = jxl::DivCeil(*xsize * num_channels * bits, jxl::kBitsPerByte);
+  return JXL_DEC_SUCCESS;
+}
+
+static JxlDecoderStatus GetMinSize(const JxlDecoder* dec,
+                                   const JxlPixelFormat* format,
+                                   size_t num_channels, size_t* min_size,
+                                   bool preview) {
+  size_t xsize;
+  size_t ysize;
+  size_t row_size;
+  JxlDecoderStatus status = GetOutputRowSize(dec, format, num_channels, preview,
+                                             &xsize, &ysize, &row_size);
+  if (status != JXL_DEC_SUCCESS) return status;
   size_t last_row_size = row_size;
   if (format->align > 1) {
     row_size = jxl::DivCeil(row_size, format->align) * format->align;
@@ -2396,6 +2502,8 @@ JXL_EXPORT JxlDecoderStatus JxlDecoderSetPreviewOutBuffer(
   dec->image_out_buffer_set = true;
   dec->image_out_buffer = buffer;
   dec->image_out_size = size;
+  dec->image_out_stride = 0;
+  dec->image_out_tiles.clear();
   dec->image_out_format = *format;
 
   return JXL_DEC_SUCCESS;
@@ -2437,11 +2545,240 @@ JxlDecoderStatus JxlDecoderSetImageOutBuffer(JxlDecoder* dec,
   dec->image_out_buffer_set = true;
   dec->image_out_buffer = buffer;
   dec->image_out_size = size;
+  dec->image_out_stride = 0;
+  dec->image_out_tiles.clear();
   dec->image_out_format = *format;
 
   return JXL_DEC_SUCCESS;
 }
 
+namespace {
+
+// Checks whether a buffer or tiles for the full resolution image can be set.
+JxlDecoderStatus CheckCanSetImageOut(const JxlDecoder* dec,
+                                     const JxlPixelFormat* format) {
+  if (!dec->got_basic_info || !(dec->orig_events_wanted & JXL_DEC_FULL_IMAGE)) {
+    return JXL_API_ERROR("No image out buffer needed at this time");
+  }
+  if (dec->image_out_buffer_set && !!dec->image_out_run_callback) {
+    return JXL_API_ERROR(
+        "Cannot change from image out callback to image out buffer");
+  }
+  if (format->num_channels < 3 &&
+      !dec->image_metadata.color_encoding.IsGray()) {
+    return JXL_API_ERROR("Number of channels is too low for color output");
+  }
+  return JXL_DEC_SUCCESS;
+}
+
+}  // namespace
+
+JxlDecoderStatus JxlDecoderSetImageOutBufferWithStride(
+    JxlDecoder* dec, const JxlPixelFormat* format, void* buffer, size_t size,
+    size_t stride) {
+  JxlDecoderStatus status = CheckCanSetImageOut(dec, format);
+  if (status != JXL_DEC_SUCCESS) return status;
+  size_t xsize;
+  size_t ysize;
+  size_t row_size;
+  status = GetOutputRowSize(dec, format, 0, /*preview=*/false, &xsize, &ysize,
+                            &row_size);
+  if (status != JXL_DEC_SUCCESS) return status;
+  if (stride < row_size) {
+    return JXL_API_ERROR("Stride is smaller than a row of the image");
+  }
+  if (ysize > 1 && stride > (std::numeric_limits<size_t>::max() - row_size) /
+                                (ysize - 1)) {
+    return JXL_API_ERROR("Stride is too large");
+  }
+  if (size < stride * (ysize - 1) + row_size) return JXL_DEC_ERROR;
+
+  dec->image_out_buffer_set = true;
+  dec->image_out_buffer = buffer;
+  dec->image_out_size = size;
+  dec->image_out_stride = stride;
+  dec->image_out_tiles.clear();
+  dec->image_out_format = *format;
+
+  return JXL_DEC_SUCCESS;
+}
+
+JxlDecoderStatus JxlDecoderSetImageOutTiles(JxlDecoder* dec,
+                                            const JxlPixelFormat* format,
+                                            uint32_t tile_xsize,
+                                            uint32_t tile_ysize,
+                                            void* const* tiles,
+                                            size_t num_tiles,
+                                            size_t tile_stride) {
+  JxlDecoderStatus status = CheckCanSetImageOut(dec, format);
+  if (status != JXL_DEC_SUCCESS) return status;
+  if (tile_xsize == 0 || tile_ysize == 0) {
+    return JXL_API_ERROR("Tile dimensions must be non-zero");
+  }
+  size_t xsize;
+  size_t ysize;
+  size_t row_size;
+  status = GetOutputRowSize(dec, format, 0, /*preview=*/false, &xsize, &ysize,
+                            &row_size);
+  if (status != JXL_DEC_SUCCESS) return status;
+  const size_t tiles_per_row = jxl::DivCeil(xsize, tile_xsize);
+  const size_t tiles_per_column = jxl::DivCeil(ysize, tile_ysize);
+  if (!tiles || num_tiles < tiles_per_row * tiles_per_column) {
+    return JXL_API_ERROR("Not enough tiles for the image");
+  }
+  // Size of the widest row of a tile; rows are a whole number of bytes per
+  // pixel.
+  const size_t tile_row_size =
+      row_size / xsize * std::min<size_t>(tile_xsize, xsize);
+  if (tile_stride < tile_row_size) {
+    return JXL_API_ERROR("Stride is smaller than a row of a tile");
+  }
+  for (size_t i = 0; i < tiles_per_row * tiles_per_column; ++i) {
+    if (!tiles[i]) return JXL_API_ERROR("Tiles must not be NULL");
+  }
+
+  dec->image_out_buffer_set = true;
+  dec->image_out_buffer = tiles[0];
+  dec->image_out_size = 0;
+  dec->image_out_stride = tile_stride;
+  dec->image_out_tiles.assign(tiles, tiles + tiles_per_row * tiles_per_column);
+  dec->image_out_tile_xsize = tile_xsize;
+  dec->image_out_tile_ysize = tile_ysize;
+  dec->image_out_format = *format;
+
+  return JXL_DEC_SUCCESS;
+}
+
+JxlDecoderStatus JxlDecoderSetImageOutRegion(JxlDecoder* dec, uint32_t x0,
+                                             uint32_t y0, uint32_t xsize,
+                                             uint32_t ysize) {
+  if (!dec->got_basic_info) {
+    return JXL_API_ERROR("Basic info must be decoded to set the region");
+  }
+  if (!dec->coalescing) {
+    return JXL_API_ERROR("Image out region requires coalescing");
+  }
+  if (dec->frame_stage == FrameStage::kFull || dec->image_out_buffer_set) {
+    return JXL_API_ERROR(
+        "Must set the image out region before the image out buffer");
+  }
+  size_t image_xsize = dec->metadata.oriented_xsize(dec->keep_orientation);
+  size_t image_ysize = dec->metadata.oriented_ysize(dec->keep_orientation);
+  jxl::Rect region(x0, y0, xsize, ysize);
+  if (xsize == 0 || ysize == 0 ||
+      !region.IsInside(jxl::Rect(0, 0, image_xsize, image_ysize))) {
+    return JXL_API_ERROR("Invalid image out region");
+  }
+  dec->image_out_region_set = true;
+  dec->image_out_region = region;
+  return JXL_DEC_SUCCESS;
+}
+
+namespace {
+
+// Decodes the first frame of one file of a batch with the settings of `dec`
+// on the single-threaded decoder `worker`.
+jxl::Status DecodeBatchImage(const JxlDecoder* dec,
+                             const JxlPixelFormat* format,
+                             const JxlDecoderBatchInput& input,
+                             JxlDecoder* worker,
+                             JxlDecoderStruct::BatchOutput* output) {
+  // Keeps the decoding buffers of the previous file.
+  JxlDecoderReset(worker);
+  worker->keep_orientation = dec->keep_orientation;
+  worker->unpremul_alpha = dec->unpremul_alpha;
+  worker->render_spotcolors = dec->render_spotcolors;
+  worker->desired_intensity_target = dec->desired_intensity_target;
+  const int events = JXL_DEC_BASIC_INFO | JXL_DEC_FULL_IMAGE;
+  if (JxlDecoderSubscribeEvents(worker, events) != JXL_DEC_SUCCESS ||
+      JxlDecoderSetInput(worker, input.data, input.size) != JXL_DEC_SUCCESS) {
+    return JXL_FAILURE("Failed to set up the decoder");
+  }
+  JxlDecoderCloseInput(worker);
+  for (;;) {
+    const JxlDecoderStatus status = JxlDecoderProcessInput(worker);
+    if (status == JXL_DEC_BASIC_INFO) {
+      JxlBasicInfo info;
+      if (JxlDecoderGetBasicInfo(worker, &info) != JXL_DEC_SUCCESS) {
+        return JXL_FAILURE("Failed to get basic info");
+      }
+      output->xsize = info.xsize;
+      output->ysize = info.ysize;
+    } else if (status == JXL_DEC_NEED_IMAGE_OUT_BUFFER) {
+      size_t size;
+      if (JxlDecoderImageOutBufferSize(worker, format, &size) !=
+          JXL_DEC_SUCCESS) {
+        return JXL_FAILURE("Invalid pixel format");
+      }
+      output->pixels.resize(size);
+      if (JxlDecoderSetImageOutBuffer(worker, format, output->pixels.data(),
+                                      size) != JXL_DEC_SUCCESS) {
+        return JXL_FAILURE("Failed to set image out buffer");
+      }
+    } else if (status == JXL_DEC_FULL_IMAGE) {
+      return true;
+    } else {
+      return JXL_FAILURE("Failed to decode image");
+    }
+  }
+}
+
+}  // namespace
+
+JxlDecoderStatus JxlDecoderDecodeBatch(JxlDecoder* dec,
+                                       const JxlPixelFormat* format,
+                                       const JxlDecoderBatchInput* inputs,
+                                       size_t num_inputs) {
+  if (num_inputs > std::numeric_limits<uint32_t>::max()) {
+    return JXL_API_ERROR("Too many inputs");
+  }
+  dec->batch_outputs.resize(num_inputs);
+  for (JxlDecoderStruct::BatchOutput& output : dec->batch_outputs) {
+    output.xsize = 0;
+    output.ysize = 0;
+    output.pixels.clear();
+  }
+
+  const auto init_workers = [&](size_t num_threads) -> jxl::Status {
+    while (dec->batch_workers.size() < num_threads) {
+      dec->batch_workers.emplace_back(JxlDecoderCreate(&dec->memory_manager),
+                                      &JxlDecoderDestroy);
+      if (!dec->batch_workers.back()) {
+        dec->batch_workers.pop_back();
+        return JXL_FAILURE("Failed to create decoder");
+      }
+    }
+    return true;
+  };
+  const auto decode_image = [&](const uint32_t i,
+                                const size_t thread) -> jxl::Status {
+    return DecodeBatchImage(dec, format, inputs[i],
+                            dec->batch_workers[thread].get(),
+                            &dec->batch_outputs[i]);
+  };
+  if (!jxl::RunOnPool(dec->thread_pool.get(), 0,
+                      static_cast<uint32_t>(num_inputs), init_workers,
+                      decode_image, "DecodeBatch")) {
+    dec->batch_outputs.clear();
+    return JXL_API_ERROR("Failed to decode batch");
+  }
+  return JXL_DEC_SUCCESS;
+}
+
+JxlDecoderStatus JxlDecoderGetBatchOutput(const JxlDecoder* dec, size_t index,
+                                          uint32_t* xsize, uint32_t* ysize,
+                                          const void** pixels, size_t* size) {
+  if (index >= dec->batch_outputs.size()) {
+    return JXL_API_ERROR("No such image in the batch");
+  }
+  const JxlDecoderStruct::BatchOutput& output = dec->batch_outputs[index];
+  *xsize = output.xsize;
+  *ysize = output.ysize;
+  *pixels = output.pixels.data();
+  *size = output.pixels.size();
+  return JXL_DEC_SUCCESS;
+}
+
 JxlDecoderStatus JxlDecoderExtraChannelBufferSize(const JxlDecoder* dec,
                                                   const JxlPixelFormat* format,
                                                   size_t* size,
@@ -2534,6 +2871,8 @@ JxlDecoderStatus JxlDecoderSetMultithreadedImageOutCallback(
   dec->image_out_run_callback = run_callback;
   dec->image_out_destroy_callback = destroy_callback;
   dec->image_out_init_opaque = init_opaque;
+  dec->image_out_stride = 0;
+  dec->image_out_tiles.clear();
   dec->image_out_format = *format;
 
   return JXL_DEC_SUCCESS;
@@ -2708,6 +3047,18 @@ JxlDecoderStatus JxlDecoderSetDesiredIntensityTarget(
   return JXL_DEC_SUCCESS;
 }
 
+JxlDecoderStatus JxlDecoderSetCmsLutMaxError(JxlDecoder* dec,
+                                             float max_error) {
+  if (!(max_error >= 0)) {
+    return JXL_API_ERROR("negative CMS lookup table error requested");
+  }
+  if (dec->stage != DecoderStage::kInited) {
+    return JXL_API_ERROR("Must set CMS lookup table error before starting");
+  }
+  dec->cms_lut_max_error = max_error;
+  return JXL_DEC_SUCCESS;
+}
+
 JxlDecoderStatus JxlDecoderSetBoxBuffer(JxlDecoder* dec, uint8_t* data,
                                         size_t size) {
   if (dec->box_out_buffer_set) {
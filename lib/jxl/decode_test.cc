@@ -10,6 +10,8 @@
 #include <jxl/color_encoding.h>
 #include <jxl/decode.h>
 #include <jxl/decode_cxx.h>
+#include <jxl/memory_arena.h>
+#include <jxl/memory_arena_cxx.h>
 #include <jxl/memory_manager.h>
 #include <jxl/parallel_runner.h>
 #include <jxl/resizable_parallel_runner.h>
@@ -19,10 +21,12 @@
 #include <jxl/types.h>
 
 #include <algorithm>
+#include <cmath>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <functional>
 #include <ostream>
 #include <set>
 #include <sstream>
@@ -39,6 +43,7 @@
 #include "lib/jxl/base/common.h"
 #include "lib/jxl/base/compiler_specific.h"
 #include "lib/jxl/base/override.h"
+#include "lib/jxl/base/rect.h"
 #include "lib/jxl/base/span.h"
 #include "lib/jxl/butteraugli/butteraugli.h"
 #include "lib/jxl/cms/color_encoding_cms.h"
@@ -70,6 +75,7 @@
 #include "lib/jxl/test_utils.h"
 #include "lib/jxl/testing.h"
 #include "lib/jxl/toc.h"
+#include "tools/tracking_memory_manager.h"
 using ::jxl::test::GetIccTestProfile;
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -2027,6 +2033,67 @@ TEST_P(DecodeAllEncodingsWithCMSTest, DecodeWithCMS) {
   EXPECT_LT(dist, .1);
 }
 
+// Decodes `compressed` to float RGB in the ICC profile of `color_encoding`
+// with the default CMS, with a 3D lookup table if `lut_max_error` is positive.
+std::vector<float> DecodeWithCmsLut(const std::vector<uint8_t>& compressed,
+                                    const jxl::ColorEncoding& color_encoding,
+                                    float lut_max_error) {
+  JxlDecoderPtr dec = JxlDecoderMake(nullptr);
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSubscribeEvents(
+                dec.get(), JXL_DEC_COLOR_ENCODING | JXL_DEC_FULL_IMAGE));
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSetCmsLutMaxError(dec.get(), lut_max_error));
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetInput(dec.get(), compressed.data(),
+                                                compressed.size()));
+  EXPECT_EQ(JXL_DEC_COLOR_ENCODING, JxlDecoderProcessInput(dec.get()));
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetCms(dec.get(), *JxlGetDefaultCms()));
+  const std::vector<uint8_t>& icc = color_encoding.ICC();
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetOutputColorProfile(
+                                 dec.get(), nullptr, icc.data(), icc.size()));
+  EXPECT_EQ(JXL_DEC_NEED_IMAGE_OUT_BUFFER, JxlDecoderProcessInput(dec.get()));
+  JxlPixelFormat format = {3, JXL_TYPE_FLOAT, JXL_NATIVE_ENDIAN, 0};
+  size_t buffer_size;
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderImageOutBufferSize(dec.get(), &format, &buffer_size));
+  std::vector<float> out(buffer_size / sizeof(float));
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSetImageOutBuffer(dec.get(), &format, out.data(),
+                                        buffer_size));
+  EXPECT_EQ(JXL_DEC_FULL_IMAGE, JxlDecoderProcessInput(dec.get()));
+  return out;
+}
+
+TEST(DecodeTest, CmsLutTest) {
+  size_t xsize = 177;
+  size_t ysize = 123;
+  std::vector<uint8_t> pixels = jxl::test::GetSomeTestImage(xsize, ysize, 3, 0);
+  jxl::TestCodestreamParams params;
+  std::vector<uint8_t> compressed = jxl::CreateTestJXLCodestream(
+      jxl::Bytes(pixels.data(), pixels.size()), xsize, ysize, 3, params);
+
+  jxl::ColorEncoding p3;
+  ASSERT_TRUE(p3.SetPrimariesType(jxl::Primaries::kP3));
+  ASSERT_TRUE(p3.Tf().SetGamma(1 / 2.2));
+  ASSERT_TRUE(p3.CreateICC());
+
+  std::vector<float> expected = DecodeWithCmsLut(compressed, p3, 0.0f);
+  ASSERT_EQ(xsize * ysize * 3, expected.size());
+  for (float max_error : {1e-2f, 1e-3f}) {
+    std::vector<float> actual = DecodeWithCmsLut(compressed, p3, max_error);
+    ASSERT_EQ(expected.size(), actual.size());
+    float max_diff = 0.0f;
+    for (size_t i = 0; i < expected.size(); i++) {
+      max_diff = std::max(max_diff, std::abs(actual[i] - expected[i]));
+    }
+    // The bound is only checked on sample colors, not on every pixel.
+    EXPECT_LE(max_diff, 2 * max_error);
+  }
+
+  JxlDecoderPtr dec = JxlDecoderMake(nullptr);
+  EXPECT_EQ(JXL_DEC_ERROR, JxlDecoderSetCmsLutMaxError(dec.get(), -1.0f));
+}
+
 // Tests the case of lossy sRGB image without alpha channel, decoded to RGB8
 // and to RGBA8
 TEST(DecodeTest, PixelTestOpaqueSrgbLossy) {
@@ -2594,6 +2661,421 @@ TEST(DecodeTest, AlignTest) {
   }
 }
 
+TEST(DecodeTest, ImageOutRegionTest) {
+  JxlMemoryManager* memory_manager = jxl::test::MemoryManager();
+  size_t xsize = 600;
+  size_t ysize = 400;
+  JxlPixelFormat format = {3, JXL_TYPE_UINT16, JXL_BIG_ENDIAN, 0};
+  std::vector<uint8_t> pixels = jxl::test::GetSomeTestImage(xsize, ysize, 3, 0);
+  const size_t bytes_per_pixel = 6;
+
+  for (uint32_t orientation : {1u, 3u, 6u, 7u}) {
+    jxl::CodecInOut io{memory_manager};
+    io.metadata.m.SetUintSamples(16);
+    io.metadata.m.color_encoding = jxl::ColorEncoding::SRGB(false);
+    io.metadata.m.orientation = orientation;
+    ASSERT_TRUE(io.SetSize(xsize, ysize));
+    ASSERT_TRUE(ConvertFromExternal(jxl::Bytes(pixels.data(), pixels.size()),
+                                    xsize, ysize, io.metadata.m.color_encoding,
+                                    /*bits_per_sample=*/16, format,
+                                    /*pool=*/nullptr, &io.Main()));
+    jxl::CompressParams cparams;
+    cparams.speed_tier = jxl::SpeedTier::kFalcon;
+    std::vector<uint8_t> compressed;
+    ASSERT_TRUE(jxl::test::EncodeFile(cparams, &io, &compressed));
+
+    size_t oxsize = orientation > 4 ? ysize : xsize;
+    size_t oysize = orientation > 4 ? xsize : ysize;
+
+    const auto decode = [&](const jxl::Rect* region) {
+      JxlDecoderPtr dec = JxlDecoderMake(nullptr);
+      EXPECT_EQ(JXL_DEC_SUCCESS,
+                JxlDecoderSubscribeEvents(
+                    dec.get(), JXL_DEC_BASIC_INFO | JXL_DEC_FULL_IMAGE));
+      EXPECT_EQ(JXL_DEC_SUCCESS,
+                JxlDecoderSetInput(dec.get(), compressed.data(),
+                                   compressed.size()));
+      EXPECT_EQ(JXL_DEC_BASIC_INFO, JxlDecoderProcessInput(dec.get()));
+      if (region) {
+        // Outside of the image.
+        EXPECT_EQ(JXL_DEC_ERROR, JxlDecoderSetImageOutRegion(
+                                     dec.get(), oxsize - 10, 0, 20, 10));
+        EXPECT_EQ(JXL_DEC_SUCCESS,
+                  JxlDecoderSetImageOutRegion(dec.get(), region->x0(),
+                                              region->y0(), region->xsize(),
+                                              region->ysize()));
+      }
+      EXPECT_EQ(JXL_DEC_NEED_IMAGE_OUT_BUFFER,
+                JxlDecoderProcessInput(dec.get()));
+      size_t buffer_size;
+      EXPECT_EQ(JXL_DEC_SUCCESS,
+                JxlDecoderImageOutBufferSize(dec.get(), &format, &buffer_size));
+      std::vector<uint8_t> out(buffer_size);
+      EXPECT_EQ(JXL_DEC_SUCCESS,
+                JxlDecoderSetImageOutBuffer(dec.get(), &format, out.data(),
+                                            out.size()));
+      EXPECT_EQ(JXL_DEC_FULL_IMAGE, JxlDecoderProcessInput(dec.get()));
+      EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderProcessInput(dec.get()));
+      return out;
+    };
+
+    std::vector<uint8_t> full = decode(nullptr);
+    ASSERT_EQ(oxsize * oysize * bytes_per_pixel, full.size());
+    for (const jxl::Rect& region :
+         {jxl::Rect(0, 0, 17, 13), jxl::Rect(250, 100, 40, 70),
+          jxl::Rect(oxsize - 31, oysize - 45, 31, 45),
+          jxl::Rect(0, 0, oxsize, oysize)}) {
+      std::vector<uint8_t> cropped = decode(&region);
+      ASSERT_EQ(region.xsize() * region.ysize() * bytes_per_pixel,
+                cropped.size());
+      size_t row_size = region.xsize() * bytes_per_pixel;
+      for (size_t y = 0; y < region.ysize(); ++y) {
+        const uint8_t* expected =
+            full.data() +
+            ((region.y0() + y) * oxsize + region.x0()) * bytes_per_pixel;
+        ASSERT_EQ(0, memcmp(expected, cropped.data() + y * row_size, row_size))
+            << "orientation " << orientation << " row " << y;
+      }
+    }
+  }
+}
+
+TEST(DecodeTest, ImageOutStrideAndTilesTest) {
+  JxlMemoryManager* memory_manager = jxl::test::MemoryManager();
+  size_t xsize = 300;
+  size_t ysize = 200;
+  JxlPixelFormat in_format = {3, JXL_TYPE_UINT16, JXL_BIG_ENDIAN, 0};
+  std::vector<uint8_t> pixels = jxl::test::GetSomeTestImage(xsize, ysize, 3, 0);
+  const uint8_t kUnwritten = 0xA5;
+
+  for (uint32_t orientation : {1u, 6u}) {
+    jxl::CodecInOut io{memory_manager};
+    io.metadata.m.SetUintSamples(16);
+    io.metadata.m.color_encoding = jxl::ColorEncoding::SRGB(false);
+    io.metadata.m.orientation = orientation;
+    ASSERT_TRUE(io.SetSize(xsize, ysize));
+    ASSERT_TRUE(ConvertFromExternal(jxl::Bytes(pixels.data(), pixels.size()),
+                                    xsize, ysize, io.metadata.m.color_encoding,
+                                    /*bits_per_sample=*/16, in_format,
+                                    /*pool=*/nullptr, &io.Main()));
+    jxl::CompressParams cparams;
+    cparams.speed_tier = jxl::SpeedTier::kFalcon;
+    std::vector<uint8_t> compressed;
+    ASSERT_TRUE(jxl::test::EncodeFile(cparams, &io, &compressed));
+
+    size_t oxsize = orientation > 4 ? ysize : xsize;
+    size_t oysize = orientation > 4 ? xsize : ysize;
+
+    for (JxlPixelFormat format : {JxlPixelFormat{4, JXL_TYPE_UINT8,
+                                                 JXL_NATIVE_ENDIAN, 0},
+                                  JxlPixelFormat{3, JXL_TYPE_UINT16,
+                                                 JXL_BIG_ENDIAN, 0}}) {
+      const size_t bytes_per_pixel =
+          format.num_channels * (format.data_type == JXL_TYPE_UINT8 ? 1 : 2);
+      const size_t row_size = oxsize * bytes_per_pixel;
+
+      // `set_output` sets the output once the decoder needs it.
+      const auto decode = [&](const std::function<void(JxlDecoder*)>&
+                                  set_output) {
+        JxlDecoderPtr dec = JxlDecoderMake(nullptr);
+        EXPECT_EQ(JXL_DEC_SUCCESS,
+                  JxlDecoderSubscribeEvents(dec.get(), JXL_DEC_FULL_IMAGE));
+        EXPECT_EQ(JXL_DEC_SUCCESS,
+                  JxlDecoderSetInput(dec.get(), compressed.data(),
+                                     compressed.size()));
+        EXPECT_EQ(JXL_DEC_NEED_IMAGE_OUT_BUFFER,
+                  JxlDecoderProcessInput(dec.get()));
+        set_output(dec.get());
+        EXPECT_EQ(JXL_DEC_FULL_IMAGE, JxlDecoderProcessInput(dec.get()));
+        EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderProcessInput(dec.get()));
+      };
+
+      std::vector<uint8_t> packed(row_size * oysize);
+      decode([&](JxlDecoder* dec) {
+        EXPECT_EQ(JXL_DEC_SUCCESS,
+                  JxlDecoderSetImageOutBuffer(dec, &format, packed.data(),
+                                              packed.size()));
+      });
+
+      // Odd stride, the padding between rows must not be written.
+      const size_t stride = row_size + 37;
+      std::vector<uint8_t> strided(stride * (oysize - 1) + row_size,
+                                   kUnwritten);
+      decode([&](JxlDecoder* dec) {
+        EXPECT_EQ(JXL_DEC_ERROR, JxlDecoderSetImageOutBufferWithStride(
+                                     dec, &format, strided.data(),
+                                     strided.size(), row_size - 1));
+        EXPECT_EQ(JXL_DEC_ERROR, JxlDecoderSetImageOutBufferWithStride(
+                                     dec, &format, strided.data(),
+                                     strided.size() - 1, stride));
+        EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetImageOutBufferWithStride(
+                                       dec, &format, strided.data(),
+                                       strided.size(), stride));
+      });
+      for (size_t y = 0; y < oysize; ++y) {
+        ASSERT_EQ(0, memcmp(packed.data() + y * row_size,
+                            strided.data() + y * stride, row_size))
+            << "orientation " << orientation << " row " << y;
+        for (size_t i = row_size; i < stride && y + 1 < oysize; ++i) {
+          ASSERT_EQ(kUnwritten, strided[y * stride + i]);
+        }
+      }
+
+      // Tiles that do not divide the image, with some padding.
+      const size_t tile_xsize = 37;
+      const size_t tile_ysize = 29;
+      const size_t tile_stride = tile_xsize * bytes_per_pixel + 5;
+      const size_t tiles_per_row = jxl::DivCeil(oxsize, tile_xsize);
+      const size_t num_tiles =
+          tiles_per_row * jxl::DivCeil(oysize, tile_ysize);
+      std::vector<std::vector<uint8_t>> tiles(
+          num_tiles, std::vector<uint8_t>(tile_stride * tile_ysize));
+      std::vector<void*> tile_ptrs;
+      for (auto& tile : tiles) tile_ptrs.push_back(tile.data());
+      decode([&](JxlDecoder* dec) {
+        EXPECT_EQ(JXL_DEC_ERROR,
+                  JxlDecoderSetImageOutTiles(dec, &format, tile_xsize,
+                                             tile_ysize, tile_ptrs.data(),
+                                             num_tiles - 1, tile_stride));
+        EXPECT_EQ(JXL_DEC_SUCCESS,
+                  JxlDecoderSetImageOutTiles(dec, &format, tile_xsize,
+                                             tile_ysize, tile_ptrs.data(),
+                                             num_tiles, tile_stride));
+      });
+      for (size_t y = 0; y < oysize; ++y) {
+        for (size_t x = 0; x < oxsize; ++x) {
+          const uint8_t* tile =
+              tiles[(y / tile_ysize) * tiles_per_row + x / tile_xsize].data();
+          const uint8_t* actual = tile + (y % tile_ysize) * tile_stride +
+                                  (x % tile_xsize) * bytes_per_pixel;
+          ASSERT_EQ(0, memcmp(packed.data() + y * row_size +
+                                  x * bytes_per_pixel,
+                              actual, bytes_per_pixel))
+              << "orientation " << orientation << " x " << x << " y " << y;
+        }
+      }
+    }
+  }
+}
+
+TEST(DecodeTest, ImageOutTilesWideGroupsTest) {
+  // With groups of 1024 pixels, the output stage converts rows of 1024 pixels
+  // at once, so that some tile runs end at the last pixel of its input rows,
+  // including the opaque alpha row used for the RGB image.
+  size_t xsize = 1100;
+  size_t ysize = 40;
+  std::vector<uint8_t> pixels = jxl::test::GetSomeTestImage(xsize, ysize, 3, 0);
+  jxl::TestCodestreamParams params;
+  params.cparams.SetLossless();
+  params.cparams.speed_tier = jxl::SpeedTier::kThunder;
+  params.cparams.modular_group_size_shift = 3;
+  std::vector<uint8_t> compressed = jxl::CreateTestJXLCodestream(
+      jxl::Bytes(pixels.data(), pixels.size()), xsize, ysize, 3, params);
+
+  JxlPixelFormat format = {4, JXL_TYPE_UINT8, JXL_NATIVE_ENDIAN, 0};
+  const size_t row_size = xsize * 4;
+  std::vector<uint8_t> packed(row_size * ysize);
+  const auto decode = [&](const std::function<void(JxlDecoder*)>& set_output) {
+    JxlDecoderPtr dec = JxlDecoderMake(nullptr);
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSubscribeEvents(dec.get(), JXL_DEC_FULL_IMAGE));
+    EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetInput(dec.get(), compressed.data(),
+                                                  compressed.size()));
+    EXPECT_EQ(JXL_DEC_NEED_IMAGE_OUT_BUFFER, JxlDecoderProcessInput(dec.get()));
+    set_output(dec.get());
+    EXPECT_EQ(JXL_DEC_FULL_IMAGE, JxlDecoderProcessInput(dec.get()));
+    EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderProcessInput(dec.get()));
+  };
+  decode([&](JxlDecoder* dec) {
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSetImageOutBuffer(dec, &format, packed.data(),
+                                          packed.size()));
+  });
+
+  // Tile widths that are not a multiple of any vector size.
+  for (size_t tile_xsize : {37u, 1003u}) {
+    const size_t tile_ysize = 16;
+    const size_t tile_stride = tile_xsize * 4;
+    const size_t tiles_per_row = jxl::DivCeil(xsize, tile_xsize);
+    const size_t num_tiles = tiles_per_row * jxl::DivCeil(ysize, tile_ysize);
+    std::vector<std::vector<uint8_t>> tiles(
+        num_tiles, std::vector<uint8_t>(tile_stride * tile_ysize));
+    std::vector<void*> tile_ptrs;
+    for (auto& tile : tiles) tile_ptrs.push_back(tile.data());
+    decode([&](JxlDecoder* dec) {
+      EXPECT_EQ(JXL_DEC_SUCCESS,
+                JxlDecoderSetImageOutTiles(dec, &format, tile_xsize,
+                                           tile_ysize, tile_ptrs.data(),
+                                           num_tiles, tile_stride));
+    });
+    for (size_t y = 0; y < ysize; ++y) {
+      for (size_t x = 0; x < xsize; ++x) {
+        const uint8_t* tile =
+            tiles[(y / tile_ysize) * tiles_per_row + x / tile_xsize].data();
+        const uint8_t* actual =
+            tile + (y % tile_ysize) * tile_stride + (x % tile_xsize) * 4;
+        ASSERT_EQ(0, memcmp(packed.data() + y * row_size + x * 4, actual, 4))
+            << "tile_xsize " << tile_xsize << " x " << x << " y " << y;
+        ASSERT_EQ(255, actual[3]);
+      }
+    }
+  }
+}
+
+TEST(DecodeTest, MemoryArenaReuseTest) {
+  size_t xsize = 211;
+  size_t ysize = 123;
+  std::vector<uint8_t> pixels = jxl::test::GetSomeTestImage(xsize, ysize, 4, 0);
+  jxl::TestCodestreamParams params;
+  std::vector<uint8_t> compressed = jxl::CreateTestJXLCodestream(
+      jxl::Bytes(pixels.data(), pixels.size()), xsize, ysize, 4, params);
+  JxlPixelFormat format = {4, JXL_TYPE_UINT8, JXL_NATIVE_ENDIAN, 0};
+  std::vector<uint8_t> out(xsize * ysize * 4);
+
+  jpegxl::tools::TrackingMemoryManager tracking;
+  {
+    JxlMemoryArenaPtr arena = JxlMemoryArenaMake(tracking.get());
+    ASSERT_TRUE(arena);
+    JxlDecoderPtr dec =
+        JxlDecoderMake(JxlMemoryArenaGetMemoryManager(arena.get()));
+    ASSERT_TRUE(dec);
+    // Single-threaded, so that both decodes allocate in the same order.
+    const auto decode = [&]() {
+      EXPECT_EQ(JXL_DEC_SUCCESS,
+                JxlDecoderSubscribeEvents(dec.get(), JXL_DEC_FULL_IMAGE));
+      EXPECT_EQ(JXL_DEC_SUCCESS,
+                JxlDecoderSetInput(dec.get(), compressed.data(),
+                                   compressed.size()));
+      EXPECT_EQ(JXL_DEC_NEED_IMAGE_OUT_BUFFER,
+                JxlDecoderProcessInput(dec.get()));
+      EXPECT_EQ(JXL_DEC_SUCCESS,
+                JxlDecoderSetImageOutBuffer(dec.get(), &format, out.data(),
+                                            out.size()));
+      EXPECT_EQ(JXL_DEC_FULL_IMAGE, JxlDecoderProcessInput(dec.get()));
+      EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderProcessInput(dec.get()));
+      JxlDecoderReset(dec.get());
+    };
+    decode();
+    std::vector<uint8_t> first = out;
+    EXPECT_NE(0u, tracking.total_allocations);
+
+    // The arena serves the next decodes from the blocks of the first one.
+    tracking.ResetCounters();
+    for (int i = 0; i < 3; ++i) {
+      std::fill(out.begin(), out.end(), 0);
+      decode();
+      EXPECT_EQ(first, out);
+    }
+    EXPECT_EQ(0u, tracking.total_allocations);
+    EXPECT_EQ(0u, tracking.total_frees);
+  }
+  // Destroying the arena gives all the blocks back.
+  EXPECT_NE(0u, tracking.total_frees);
+  EXPECT_TRUE(tracking.Reset());
+}
+
+TEST(DecodeTest, ReuseRenderPipelineBuffersTest) {
+  size_t xsize = 600;
+  size_t ysize = 300;
+  std::vector<uint8_t> pixels = jxl::test::GetSomeTestImage(xsize, ysize, 3, 0);
+  jxl::TestCodestreamParams params;
+  std::vector<uint8_t> compressed = jxl::CreateTestJXLCodestream(
+      jxl::Bytes(pixels.data(), pixels.size()), xsize, ysize, 3, params);
+  JxlPixelFormat format = {3, JXL_TYPE_UINT8, JXL_NATIVE_ENDIAN, 0};
+  std::vector<uint8_t> out(xsize * ysize * 3);
+
+  jpegxl::tools::TrackingMemoryManager tracking;
+  JxlDecoderPtr dec = JxlDecoderMake(tracking.get());
+  // Returns the number of bytes allocated to decode the image.
+  const auto decode = [&]() {
+    tracking.ResetCounters();
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSubscribeEvents(dec.get(), JXL_DEC_FULL_IMAGE));
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSetInput(dec.get(), compressed.data(),
+                                 compressed.size()));
+    EXPECT_EQ(JXL_DEC_NEED_IMAGE_OUT_BUFFER,
+              JxlDecoderProcessInput(dec.get()));
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSetImageOutBuffer(dec.get(), &format, out.data(),
+                                          out.size()));
+    EXPECT_EQ(JXL_DEC_FULL_IMAGE, JxlDecoderProcessInput(dec.get()));
+    EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderProcessInput(dec.get()));
+    JxlDecoderReset(dec.get());
+    return tracking.total_bytes_allocated;
+  };
+  size_t first_bytes = decode();
+  std::vector<uint8_t> first = out;
+  std::fill(out.begin(), out.end(), 0);
+  size_t second_bytes = decode();
+  EXPECT_EQ(first, out);
+  // The second image reuses the render pipeline buffers of the first one.
+  EXPECT_LT(second_bytes, first_bytes);
+  EXPECT_EQ(second_bytes, decode());
+}
+
+TEST(DecodeTest, DecodeBatchTest) {
+  const std::vector<std::pair<size_t, size_t>> sizes = {
+      {64, 64}, {1, 1}, {300, 20}, {33, 65}, {64, 64}, {128, 7}};
+  std::vector<std::vector<uint8_t>> compressed;
+  std::vector<JxlDecoderBatchInput> inputs;
+  for (size_t i = 0; i < sizes.size(); ++i) {
+    const size_t xsize = sizes[i].first;
+    const size_t ysize = sizes[i].second;
+    std::vector<uint8_t> pixels =
+        jxl::test::GetSomeTestImage(xsize, ysize, 3, i);
+    jxl::TestCodestreamParams params;
+    compressed.push_back(jxl::CreateTestJXLCodestream(
+        jxl::Bytes(pixels.data(), pixels.size()), xsize, ysize, 3, params));
+  }
+  for (const std::vector<uint8_t>& file : compressed) {
+    inputs.push_back({file.data(), file.size()});
+  }
+  JxlPixelFormat format = {3, JXL_TYPE_UINT8, JXL_NATIVE_ENDIAN, 0};
+
+  JxlDecoderPtr dec = JxlDecoderMake(nullptr);
+  JxlThreadParallelRunnerPtr runner = JxlThreadParallelRunnerMake(nullptr, 4);
+  ASSERT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSetParallelRunner(dec.get(), JxlThreadParallelRunner,
+                                        runner.get()));
+  // The second batch reuses the decoders of the first one.
+  for (size_t num_inputs : {inputs.size(), inputs.size() - 3}) {
+    ASSERT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderDecodeBatch(dec.get(), &format, inputs.data(),
+                                    num_inputs));
+    for (size_t i = 0; i < num_inputs; ++i) {
+      std::vector<uint8_t> expected = jxl::DecodeWithAPI(
+          jxl::Bytes(compressed[i].data(), compressed[i].size()), format,
+          /*use_callback=*/false, /*set_buffer_early=*/false,
+          /*use_resizable_runner=*/false, /*require_boxes=*/false,
+          /*expect_success=*/true);
+      uint32_t xsize;
+      uint32_t ysize;
+      const void* pixels;
+      size_t size;
+      ASSERT_EQ(JXL_DEC_SUCCESS,
+                JxlDecoderGetBatchOutput(dec.get(), i, &xsize, &ysize, &pixels,
+                                         &size));
+      EXPECT_EQ(sizes[i].first, xsize);
+      EXPECT_EQ(sizes[i].second, ysize);
+      const uint8_t* bytes = static_cast<const uint8_t*>(pixels);
+      EXPECT_EQ(expected, std::vector<uint8_t>(bytes, bytes + size));
+    }
+    uint32_t xsize;
+    uint32_t ysize;
+    const void* pixels;
+    size_t size;
+    EXPECT_EQ(JXL_DEC_ERROR, JxlDecoderGetBatchOutput(dec.get(), num_inputs,
+                                                      &xsize, &ysize, &pixels,
+                                                      &size));
+  }
+
+  // A truncated file fails the batch.
+  inputs[2].size /= 2;
+  EXPECT_EQ(JXL_DEC_ERROR, JxlDecoderDecodeBatch(dec.get(), &format,
+                                                 inputs.data(), inputs.size()));
+}
+
 TEST(DecodeTest, AnimationTest) {
   JxlMemoryManager* memory_manager = jxl::test::MemoryManager();
   size_t xsize = 123;
@@ -952,7 +952,7 @@ Status FindBestQuantization(const FrameHeader& frame_header,
   const float original_butteraugli = cparams.original_butteraugli_distance;
   ButteraugliParams params;
   params.intensity_target = 80.f;
-  JxlButteraugliComparator comparator(params, cms);
+  JxlButteraugliComparator comparator(params, cms, pool);
   JXL_RETURN_IF_ERROR(comparator.SetLinearReferenceImage(linear));
   bool lower_is_better =
       (comparator.GoodQualityScore() < comparator.BadQualityScore());
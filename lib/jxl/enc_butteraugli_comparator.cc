@@ -7,12 +7,14 @@
 
 #include "lib/jxl/base/status.h"
 #include "lib/jxl/enc_image_bundle.h"
+#include "lib/jxl/image_ops.h"
 
 namespace jxl {
 
 JxlButteraugliComparator::JxlButteraugliComparator(
-    const ButteraugliParams& params, const JxlCmsInterface& cms)
-    : params_(params), cms_(cms) {}
+    const ButteraugliParams& params, const JxlCmsInterface& cms,
+    ThreadPool* pool)
+    : params_(params), cms_(cms), pool_(pool) {}
 
 Status JxlButteraugliComparator::SetReferenceImage(const ImageBundle& ref) {
   const ImageBundle* ref_linear_srgb;
@@ -23,17 +25,20 @@ Status JxlButteraugliComparator::SetReferenceImage(const ImageBundle& ref) {
                          /*pool=*/nullptr, &store, &ref_linear_srgb)) {
     return false;
   }
-  JXL_ASSIGN_OR_RETURN(comparator_, ButteraugliComparator::Make(
-                                        ref_linear_srgb->color(), params_));
-  xsize_ = ref.xsize();
-  ysize_ = ref.ysize();
-  return true;
+  return SetLinearReferenceImage(ref_linear_srgb->color());
 }
 
 Status JxlButteraugliComparator::SetLinearReferenceImage(
     const Image3F& linear) {
-  JXL_ASSIGN_OR_RETURN(comparator_,
-                       ButteraugliComparator::Make(linear, params_));
+  if (pool_ != nullptr) {
+    JXL_ASSIGN_OR_RETURN(reference_,
+                         Image3F::Create(linear.memory_manager(),
+                                         linear.xsize(), linear.ysize()));
+    JXL_RETURN_IF_ERROR(CopyImageTo(linear, &reference_));
+  } else {
+    JXL_ASSIGN_OR_RETURN(comparator_,
+                         ButteraugliComparator::Make(linear, params_));
+  }
   xsize_ = linear.xsize();
   ysize_ = linear.ysize();
   return true;
@@ -41,7 +46,7 @@ Status JxlButteraugliComparator::SetLinearReferenceImage(
 
 Status JxlButteraugliComparator::CompareWith(const ImageBundle& actual,
                                              ImageF* diffmap, float* score) {
-  if (!comparator_) {
+  if (!comparator_ && reference_.xsize() == 0) {
     return JXL_FAILURE("Must set reference image first");
   }
   if (xsize_ != actual.xsize() || ysize_ != actual.ysize()) {
@@ -60,8 +65,14 @@ Status JxlButteraugliComparator::CompareWith(const ImageBundle& actual,
 
   JXL_ASSIGN_OR_RETURN(ImageF temp_diffmap,
                        ImageF::Create(memory_manager, xsize_, ysize_));
-  JXL_RETURN_IF_ERROR(
-      comparator_->Diffmap(actual_linear_srgb->color(), temp_diffmap));
+  if (comparator_) {
+    JXL_RETURN_IF_ERROR(
+        comparator_->Diffmap(actual_linear_srgb->color(), temp_diffmap));
+  } else {
+    JXL_RETURN_IF_ERROR(ButteraugliDiffmap(reference_,
+                                           actual_linear_srgb->color(),
+                                           params_, temp_diffmap, pool_));
+  }
 
   if (score != nullptr) {
     *score = ButteraugliScoreFromDiffmap(temp_diffmap, &params_);
@@ -11,6 +11,7 @@
 
 #include <memory>
 
+#include "lib/jxl/base/data_parallel.h"
 #include "lib/jxl/base/status.h"
 #include "lib/jxl/butteraugli/butteraugli.h"
 #include "lib/jxl/enc_comparator.h"
@@ -21,8 +22,11 @@ namespace jxl {
 
 class JxlButteraugliComparator : public Comparator {
  public:
+  // With a `pool`, the diffmap is computed in parallel tiles, see
+  // ButteraugliDiffmap.
   explicit JxlButteraugliComparator(const ButteraugliParams& params,
-                                    const JxlCmsInterface& cms);
+                                    const JxlCmsInterface& cms,
+                                    ThreadPool* pool = nullptr);
 
   Status SetReferenceImage(const ImageBundle& ref) override;
   Status SetLinearReferenceImage(const Image3F& linear);
@@ -36,7 +40,10 @@ class JxlButteraugliComparator : public Comparator {
  private:
   ButteraugliParams params_;
   JxlCmsInterface cms_;
+  ThreadPool* pool_;
   std::unique_ptr<ButteraugliComparator> comparator_;
+  // Linear reference image of the tiled comparison with a pool.
+  Image3F reference_;
   size_t xsize_ = 0;
   size_t ysize_ = 0;
 };
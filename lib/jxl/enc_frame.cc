@@ -1485,8 +1485,12 @@ Status ComputeEncodingData(
 
   // Make the image patch bigger than the currently processed group in streaming
   // mode so that we can take into account border pixels around the group when
-  // computing inverse Gaborish and adaptive quantization map.
-  int max_border = enc_state.streaming_mode ? kBlockDim : 0;
+  // computing inverse Gaborish and adaptive quantization map. Modular frames
+  // only read the pixels of the group.
+  int max_border = enc_state.streaming_mode &&
+                           frame_header.encoding == FrameEncoding::kVarDCT
+                       ? kBlockDim
+                       : 0;
   Rect frame_rect(0, 0, frame_data.xsize, frame_data.ysize);
   Rect frame_area_rect = Rect(x0, y0, xsize, ysize);
   Rect patch_rect = frame_area_rect.Extend(max_border, frame_rect);
@@ -1736,8 +1740,17 @@ bool CanDoStreamingEncoding(const CompressParams& cparams,
     }
   }
 
-  // TODO(veluca): handle different values of `buffering`.
-  if (frame_data.xsize <= 2048 && frame_data.ysize <= 2048) {
+  // Lossless modular frames learn a tree per group anyway, so streaming them
+  // only gives up the frame-wide palettes and histograms; with `buffering` >= 2
+  // they are streamed as soon as there is more than one group.
+  // TODO(veluca): handle different values of `buffering` for other frames.
+  size_t min_streaming_size = 2048;
+  if (cparams.buffering >= 2 && cparams.modular_mode &&
+      cparams.ModularPartIsLossless() && cparams.responsive <= 0) {
+    min_streaming_size = kGroupDim;
+  }
+  if (frame_data.xsize <= min_streaming_size &&
+      frame_data.ysize <= min_streaming_size) {
     return false;
   }
   if (frame_data.IsJPEG()) {
@@ -813,6 +813,10 @@ Status ModularFrameEncoder::ComputeEncodingData(
                                   "float2int"));
   }
   JXL_ENSURE(c == nb_chans);
+  // The pixels now live in `gi`; free the float copy before the group images
+  // are made from it, so that at most two copies of the frame (or of the
+  // current DC group, when streaming) exist at any time.
+  if (do_color) *color = Image3F();
 
   int level_max_bitdepth = (cparams_.level == 5 ? 16 : 32);
   if (max_bitdepth > level_max_bitdepth) {
@@ -970,8 +974,8 @@ Status ModularFrameEncoder::ComputeEncodingData(
     const size_t rgy = group_id / patch_dim.xsize_dc_groups;
     const Rect rect(rgx * patch_dim.dc_group_dim, rgy * patch_dim.dc_group_dim,
                     patch_dim.dc_group_dim, patch_dim.dc_group_dim);
-    size_t gx = rgx + frame_area_rect.x0() / 2048;
-    size_t gy = rgy + frame_area_rect.y0() / 2048;
+    size_t gx = rgx + frame_area_rect.x0() / frame_dim_.dc_group_dim;
+    size_t gy = rgy + frame_area_rect.y0() / frame_dim_.dc_group_dim;
     size_t real_group_id = gy * frame_dim_.xsize_dc_groups + gx;
     // minShift==3 because (frame_dim.dc_group_dim >> 3) == frame_dim.group_dim
     // maxShift==1000 is infinity
@@ -1119,9 +1123,11 @@ Status ModularFrameEncoder::ComputeTree(ThreadPool* pool) {
     useful_splits.push_back(tree_splits_.back());
 
     std::vector<Tree> trees(useful_splits.size() - 1);
+    // With several chunks, the trees are learned in parallel; a single tree
+    // uses the pool for its own search instead.
+    const bool single_chunk = trees.size() == 1;
     const auto process_chunk = [&](const uint32_t chunk,
                                    size_t /* thread */) -> Status {
-      // TODO(veluca): parallelize more.
       size_t total_pixels = 0;
       uint32_t start = useful_splits[chunk];
       uint32_t stop = useful_splits[chunk + 1];
@@ -1172,16 +1178,19 @@ Status ModularFrameEncoder::ComputeTree(ThreadPool* pool) {
                                    &tree_samples, &total_pixels));
       }
 
-      // TODO(veluca): parallelize more.
       JXL_ASSIGN_OR_RETURN(
           trees[chunk],
           LearnTree(std::move(tree_samples), total_pixels,
-                    stream_options_[start], multiplier_info, range));
+                    stream_options_[start], multiplier_info, range,
+                    single_chunk ? pool : nullptr));
       return true;
     };
-    JXL_RETURN_IF_ERROR(RunOnPool(pool, 0, useful_splits.size() - 1,
-                                  ThreadPool::NoInit, process_chunk,
-                                  "LearnTrees"));
+    if (single_chunk) {
+      JXL_RETURN_IF_ERROR(process_chunk(0, 0));
+    } else {
+      JXL_RETURN_IF_ERROR(RunOnPool(pool, 0, trees.size(), ThreadPool::NoInit,
+                                    process_chunk, "LearnTrees"));
+    }
     tree_.clear();
     JXL_RETURN_IF_ERROR(
         MergeTrees(trees, useful_splits, 0, useful_splits.size() - 1, &tree_));
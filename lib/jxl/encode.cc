@@ -16,7 +16,9 @@
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
+#include <limits>
 #include <utility>
+#include <vector>
 
 #include "lib/jxl/base/byte_order.h"
 #include "lib/jxl/base/common.h"
@@ -1980,6 +1982,7 @@ void JxlEncoderReset(JxlEncoder* enc) {
   enc->use_boxes = false;
   enc->store_jpeg_metadata = false;
   enc->codestream_level = -1;
+  enc->batch_outputs.clear();
   enc->output_processor =
       JxlEncoderOutputProcessorWrapper(&enc->memory_manager);
   JxlEncoderInitBasicInfo(&enc->basic_info);
@@ -2080,25 +2083,13 @@ JxlEncoderStatus GetCurrentDimensions(
   }
   return JxlErrorOrStatus::Success();
 }
-}  // namespace
-
-JxlEncoderStatus JxlEncoderAddJPEGFrame(
-    const JxlEncoderFrameSettings* frame_settings, const uint8_t* buffer,
-    size_t size) {
-  if (frame_settings->enc->frames_closed) {
-    return JXL_API_ERROR(frame_settings->enc, JXL_ENC_ERR_API_USAGE,
-                         "Frame input is already closed");
-  }
-
-  jxl::CodecInOut io{&frame_settings->enc->memory_manager};
-  if (!jxl::jpeg::DecodeImageJPG(jxl::Bytes(buffer, size), &io)) {
-    return JXL_API_ERROR(frame_settings->enc, JXL_ENC_ERR_BAD_INPUT,
-                         "Error during decode of input JPEG");
-  }
 
+// Queues the frame of the parsed JPEG codestream in io.
+JxlEncoderStatus AddJPEGFrame(const JxlEncoderFrameSettings* frame_settings,
+                              jxl::CodecInOut* io) {
   if (!frame_settings->enc->color_encoding_set) {
     if (!SetColorEncodingFromJpegData(
-            *io.Main().jpeg_data,
+            *io->Main().jpeg_data,
             &frame_settings->enc->metadata.m.color_encoding)) {
       return JXL_API_ERROR(
           frame_settings->enc, JXL_ENC_ERR_BAD_INPUT,
@@ -2110,8 +2101,8 @@ JxlEncoderStatus JxlEncoderAddJPEGFrame(
   if (!frame_settings->enc->basic_info_set) {
     JxlBasicInfo basic_info;
     JxlEncoderInitBasicInfo(&basic_info);
-    basic_info.xsize = io.Main().jpeg_data->width;
-    basic_info.ysize = io.Main().jpeg_data->height;
+    basic_info.xsize = io->Main().jpeg_data->width;
+    basic_info.ysize = io->Main().jpeg_data->height;
     basic_info.uses_original_profile = JXL_TRUE;
     if (JxlEncoderSetBasicInfo(frame_settings->enc, &basic_info) !=
         JXL_ENC_SUCCESS) {
@@ -2126,8 +2117,8 @@ JxlEncoderStatus JxlEncoderAddJPEGFrame(
     return JXL_API_ERROR(frame_settings->enc, JXL_ENC_ERR_GENERIC,
                          "bad dimensions");
   }
-  if (xsize != static_cast<size_t>(io.Main().jpeg_data->width) ||
-      ysize != static_cast<size_t>(io.Main().jpeg_data->height)) {
+  if (xsize != static_cast<size_t>(io->Main().jpeg_data->width) ||
+      ysize != static_cast<size_t>(io->Main().jpeg_data->height)) {
     return JXL_API_ERROR(frame_settings->enc, JXL_ENC_ERR_GENERIC,
                          "JPEG dimensions don't match frame dimensions");
   }
@@ -2136,14 +2127,15 @@ JxlEncoderStatus JxlEncoderAddJPEGFrame(
     return JXL_API_ERROR(frame_settings->enc, JXL_ENC_ERR_API_USAGE,
                          "Can't XYB encode a lossless JPEG");
   }
-  if (!io.blobs.exif.empty()) {
+  if (!io->blobs.exif.empty()) {
     JxlOrientation orientation = static_cast<JxlOrientation>(
         frame_settings->enc->metadata.m.orientation);
-    jxl::InterpretExif(io.blobs.exif, &orientation);
+    jxl::InterpretExif(io->blobs.exif, &orientation);
     frame_settings->enc->metadata.m.orientation = orientation;
   }
-  if (!io.blobs.exif.empty() && frame_settings->values.cparams.jpeg_keep_exif) {
-    size_t exif_size = io.blobs.exif.size();
+  if (!io->blobs.exif.empty() &&
+      frame_settings->values.cparams.jpeg_keep_exif) {
+    size_t exif_size = io->blobs.exif.size();
     // Exif data in JPEG is limited to 64k
     if (exif_size > 0xFFFF) {
       return JXL_API_ERROR(frame_settings->enc, JXL_ENC_ERR_GENERIC,
@@ -2151,24 +2143,24 @@ JxlEncoderStatus JxlEncoderAddJPEGFrame(
     }
     exif_size += 4;  // prefix 4 zero bytes for tiff offset
     std::vector<uint8_t> exif(exif_size);
-    memcpy(exif.data() + 4, io.blobs.exif.data(), io.blobs.exif.size());
+    memcpy(exif.data() + 4, io->blobs.exif.data(), io->blobs.exif.size());
     JxlEncoderUseBoxes(frame_settings->enc);
     JxlEncoderAddBox(
         frame_settings->enc, "Exif", exif.data(), exif_size,
         TO_JXL_BOOL(frame_settings->values.cparams.jpeg_compress_boxes));
   }
-  if (!io.blobs.xmp.empty() && frame_settings->values.cparams.jpeg_keep_xmp) {
+  if (!io->blobs.xmp.empty() && frame_settings->values.cparams.jpeg_keep_xmp) {
     JxlEncoderUseBoxes(frame_settings->enc);
     JxlEncoderAddBox(
-        frame_settings->enc, "xml ", io.blobs.xmp.data(), io.blobs.xmp.size(),
+        frame_settings->enc, "xml ", io->blobs.xmp.data(), io->blobs.xmp.size(),
         TO_JXL_BOOL(frame_settings->values.cparams.jpeg_compress_boxes));
   }
-  if (!io.blobs.jumbf.empty() &&
+  if (!io->blobs.jumbf.empty() &&
       frame_settings->values.cparams.jpeg_keep_jumbf) {
     JxlEncoderUseBoxes(frame_settings->enc);
     JxlEncoderAddBox(
-        frame_settings->enc, "jumb", io.blobs.jumbf.data(),
-        io.blobs.jumbf.size(),
+        frame_settings->enc, "jumb", io->blobs.jumbf.data(),
+        io->blobs.jumbf.size(),
         TO_JXL_BOOL(frame_settings->values.cparams.jpeg_compress_boxes));
   }
   if (frame_settings->enc->store_jpeg_metadata) {
@@ -2178,7 +2170,7 @@ JxlEncoderStatus JxlEncoderAddJPEGFrame(
                            "Need to preserve EXIF and XMP to allow JPEG "
                            "bitstream reconstruction");
     }
-    jxl::jpeg::JPEGData data_in = *io.Main().jpeg_data;
+    jxl::jpeg::JPEGData data_in = *io->Main().jpeg_data;
     std::vector<uint8_t> jpeg_data;
     if (!jxl::jpeg::EncodeJPEGData(&frame_settings->enc->memory_manager,
                                    data_in, &jpeg_data,
@@ -2192,7 +2184,7 @@ JxlEncoderStatus JxlEncoderAddJPEGFrame(
 
   jxl::JxlEncoderChunkedFrameAdapter frame_data(
       xsize, ysize, frame_settings->enc->metadata.m.num_extra_channels);
-  frame_data.SetJPEGData(std::move(io.Main().jpeg_data));
+  frame_data.SetJPEGData(std::move(io->Main().jpeg_data));
 
   auto queued_frame = jxl::MemoryManagerMakeUnique<jxl::JxlEncoderQueuedFrame>(
       &frame_settings->enc->memory_manager,
@@ -2211,6 +2203,41 @@ JxlEncoderStatus JxlEncoderAddJPEGFrame(
   QueueFrame(frame_settings, queued_frame);
   return JxlErrorOrStatus::Success();
 }
+}  // namespace
+
+JxlEncoderStatus JxlEncoderAddJPEGFrame(
+    const JxlEncoderFrameSettings* frame_settings, const uint8_t* buffer,
+    size_t size) {
+  if (frame_settings->enc->frames_closed) {
+    return JXL_API_ERROR(frame_settings->enc, JXL_ENC_ERR_API_USAGE,
+                         "Frame input is already closed");
+  }
+
+  jxl::CodecInOut io{&frame_settings->enc->memory_manager};
+  if (!jxl::jpeg::DecodeImageJPG(jxl::Bytes(buffer, size), &io,
+                                 frame_settings->enc->thread_pool.get())) {
+    return JXL_API_ERROR(frame_settings->enc, JXL_ENC_ERR_BAD_INPUT,
+                         "Error during decode of input JPEG");
+  }
+  return AddJPEGFrame(frame_settings, &io);
+}
+
+namespace jxl {
+JxlEncoderStatus AddJPEGFrame(const JxlEncoderFrameSettings* frame_settings,
+                              std::unique_ptr<jpeg::JPEGData> jpeg_data) {
+  if (frame_settings->enc->frames_closed) {
+    return JXL_API_ERROR(frame_settings->enc, JXL_ENC_ERR_API_USAGE,
+                         "Frame input is already closed");
+  }
+
+  CodecInOut io{&frame_settings->enc->memory_manager};
+  if (!jpeg::SetImageFromJPEGData(std::move(jpeg_data), &io)) {
+    return JXL_API_ERROR(frame_settings->enc, JXL_ENC_ERR_BAD_INPUT,
+                         "Error reading the input JPEG data");
+  }
+  return ::AddJPEGFrame(frame_settings, &io);
+}
+}  // namespace jxl
 
 static bool CanDoFastLossless(const JxlEncoderFrameSettings* frame_settings,
                               const JxlPixelFormat* pixel_format,
@@ -2612,6 +2639,124 @@ JxlEncoderStatus JxlEncoderProcessOutput(JxlEncoder* enc, uint8_t** next_out,
   return JxlErrorOrStatus::Success();
 }
 
+namespace {
+
+// Encodes one image of a batch with the settings of `frame_settings` on the
+// single-threaded encoder `worker`.
+jxl::Status EncodeBatchImage(const JxlEncoderFrameSettings* frame_settings,
+                             const JxlPixelFormat* pixel_format,
+                             const JxlEncoderBatchImage& image,
+                             JxlEncoder* worker, std::vector<uint8_t>* output) {
+  const JxlEncoder* enc = frame_settings->enc;
+  JxlEncoderReset(worker);
+  worker->error = JXL_ENC_ERR_OK;
+  worker->cms = enc->cms;
+  worker->cms_set = enc->cms_set;
+  worker->use_container = enc->use_container;
+  worker->codestream_level = enc->codestream_level;
+  worker->allow_expert_options = enc->allow_expert_options;
+  worker->brotli_effort = enc->brotli_effort;
+  worker->color_encoding_set = enc->color_encoding_set;
+
+  JxlBasicInfo basic_info = enc->basic_info;
+  basic_info.xsize = image.xsize;
+  basic_info.ysize = image.ysize;
+  if (JxlEncoderSetBasicInfo(worker, &basic_info) != JXL_ENC_SUCCESS) {
+    return JXL_FAILURE("Invalid basic info for batch image");
+  }
+  // The color encoding, the extra channel info and the other metadata are
+  // those of the batch, only the size differs.
+  const jxl::SizeHeader size = worker->metadata.size;
+  worker->metadata = enc->metadata;
+  worker->metadata.size = size;
+  worker->intensity_target_set = enc->intensity_target_set;
+
+  JxlEncoderFrameSettings* worker_settings =
+      JxlEncoderFrameSettingsCreate(worker, nullptr);
+  if (!worker_settings) return JXL_FAILURE("Failed to create frame settings");
+  worker_settings->values = frame_settings->values;
+  worker_settings->values.aux_out = nullptr;
+  if (JxlEncoderAddImageFrame(worker_settings, pixel_format, image.buffer,
+                              image.size) != JXL_ENC_SUCCESS) {
+    return JXL_FAILURE("Failed to add batch image");
+  }
+  JxlEncoderCloseInput(worker);
+
+  // Keeps the capacity of the output of the previous batch.
+  output->resize(std::max<size_t>(output->capacity(), 4096));
+  uint8_t* next_out = output->data();
+  size_t avail_out = output->size();
+  JxlEncoderStatus status;
+  while ((status = JxlEncoderProcessOutput(worker, &next_out, &avail_out)) ==
+         JXL_ENC_NEED_MORE_OUTPUT) {
+    const size_t offset = next_out - output->data();
+    output->resize(output->size() * 2);
+    next_out = output->data() + offset;
+    avail_out = output->size() - offset;
+  }
+  if (status != JXL_ENC_SUCCESS) return JXL_FAILURE("Failed to encode image");
+  output->resize(next_out - output->data());
+  return true;
+}
+
+}  // namespace
+
+JxlEncoderStatus JxlEncoderEncodeBatch(
+    const JxlEncoderFrameSettings* frame_settings,
+    const JxlPixelFormat* pixel_format, const JxlEncoderBatchImage* images,
+    size_t num_images) {
+  JxlEncoder* enc = frame_settings->enc;
+  if (!enc->basic_info_set) {
+    return JXL_API_ERROR(enc, JXL_ENC_ERR_API_USAGE, "Basic info not set yet");
+  }
+  if (num_images > std::numeric_limits<uint32_t>::max()) {
+    return JXL_API_ERROR(enc, JXL_ENC_ERR_API_USAGE, "Too many images");
+  }
+  enc->batch_outputs.resize(num_images);
+  for (std::vector<uint8_t>& output : enc->batch_outputs) output.clear();
+
+  const auto init_workers = [&](size_t num_threads) -> jxl::Status {
+    while (enc->batch_workers.size() < num_threads) {
+      enc->batch_workers.emplace_back(JxlEncoderCreate(&enc->memory_manager),
+                                      &JxlEncoderDestroy);
+      if (!enc->batch_workers.back()) {
+        enc->batch_workers.pop_back();
+        return JXL_FAILURE("Failed to create encoder");
+      }
+    }
+    return true;
+  };
+  const auto encode_image = [&](const uint32_t i,
+                                const size_t thread) -> jxl::Status {
+    return EncodeBatchImage(frame_settings, pixel_format, images[i],
+                            enc->batch_workers[thread].get(),
+                            &enc->batch_outputs[i]);
+  };
+  if (!jxl::RunOnPool(enc->thread_pool.get(), 0,
+                      static_cast<uint32_t>(num_images), init_workers,
+                      encode_image, "EncodeBatch")) {
+    // Report the error of the image that failed, if any.
+    JxlEncoderError error = JXL_ENC_ERR_GENERIC;
+    for (const auto& worker : enc->batch_workers) {
+      if (worker->error != JXL_ENC_ERR_OK) error = worker->error;
+    }
+    enc->batch_outputs.clear();
+    return JXL_API_ERROR(enc, error, "Failed to encode batch");
+  }
+  return JxlErrorOrStatus::Success();
+}
+
+JxlEncoderStatus JxlEncoderGetBatchOutput(JxlEncoder* enc, size_t index,
+                                          const uint8_t** data, size_t* size) {
+  if (index >= enc->batch_outputs.size()) {
+    return JXL_API_ERROR(enc, JXL_ENC_ERR_API_USAGE,
+                         "No such image in the batch");
+  }
+  *data = enc->batch_outputs[index].data();
+  *size = enc->batch_outputs[index].size();
+  return JxlErrorOrStatus::Success();
+}
+
 JxlEncoderStatus JxlEncoderSetFrameHeader(
     JxlEncoderFrameSettings* frame_settings,
     const JxlFrameHeader* frame_header) {
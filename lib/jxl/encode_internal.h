@@ -655,6 +655,12 @@ struct JxlEncoderStruct {
   bool allow_expert_options = false;
   int brotli_effort = -1;
 
+  // Single-threaded encoders used by JxlEncoderEncodeBatch, one per thread of
+  // the parallel runner, and the codestreams of the last batch.
+  std::vector<std::unique_ptr<JxlEncoder, decltype(&JxlEncoderDestroy)>>
+      batch_workers;
+  std::vector<std::vector<uint8_t>> batch_outputs;
+
   // Takes the first frame in the input_queue, encodes it, and appends
   // the bytes to the output_byte_queue.
   jxl::Status ProcessOneEnqueuedInput();
@@ -685,4 +691,15 @@ struct JxlEncoderStatsStruct {
   std::unique_ptr<jxl::AuxOut> aux_out;
 };
 
+namespace jxl {
+
+// Adds a frame from an already parsed JPEG codestream, like
+// JxlEncoderAddJPEGFrame() does from its bytes, but without entropy decoding
+// it again. This lets an encoder that produced the coefficients of the JPEG
+// hand them over directly.
+JxlEncoderStatus AddJPEGFrame(const JxlEncoderFrameSettings* frame_settings,
+                              std::unique_ptr<jpeg::JPEGData> jpeg_data);
+
+}  // namespace jxl
+
 #endif  // LIB_JXL_ENCODE_INTERNAL_H_
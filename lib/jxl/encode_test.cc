@@ -12,6 +12,8 @@
 #include <jxl/encode.h>
 #include <jxl/encode_cxx.h>
 #include <jxl/memory_manager.h>
+#include <jxl/thread_parallel_runner.h>
+#include <jxl/thread_parallel_runner_cxx.h>
 #include <jxl/types.h>
 
 #include <cstddef>
@@ -270,6 +272,92 @@ TEST(EncodeTest, EncoderResetTest) {
                       false);
 }
 
+namespace {
+// Sets the settings shared by the images of EncodeBatchTest.
+JxlEncoderFrameSettings* SetBatchSettings(JxlEncoder* enc,
+                                          const JxlPixelFormat& pixel_format,
+                                          size_t xsize, size_t ysize) {
+  JxlBasicInfo basic_info;
+  jxl::test::JxlBasicInfoSetFromPixelFormat(&basic_info, &pixel_format);
+  basic_info.xsize = xsize;
+  basic_info.ysize = ysize;
+  EXPECT_EQ(JXL_ENC_SUCCESS, JxlEncoderSetBasicInfo(enc, &basic_info));
+  JxlColorEncoding color_encoding;
+  JxlColorEncodingSetToSRGB(&color_encoding, JXL_FALSE);
+  EXPECT_EQ(JXL_ENC_SUCCESS, JxlEncoderSetColorEncoding(enc, &color_encoding));
+  JxlEncoderFrameSettings* frame_settings =
+      JxlEncoderFrameSettingsCreate(enc, nullptr);
+  EXPECT_EQ(JXL_ENC_SUCCESS,
+            JxlEncoderFrameSettingsSetOption(
+                frame_settings, JXL_ENC_FRAME_SETTING_EFFORT, 3));
+  return frame_settings;
+}
+}  // namespace
+
+TEST(EncodeTest, EncodeBatchTest) {
+  const JxlPixelFormat pixel_format = {4, JXL_TYPE_UINT8, JXL_NATIVE_ENDIAN, 0};
+  const std::vector<std::pair<uint32_t, uint32_t>> sizes = {
+      {16, 16}, {63, 31}, {1, 1}, {200, 17}, {128, 100}, {37, 64}};
+  std::vector<std::vector<uint8_t>> pixels;
+  std::vector<JxlEncoderBatchImage> images;
+  for (const auto& size : sizes) {
+    // Uses the bytes of the 16-bit test image as 8-bit samples.
+    pixels.push_back(
+        jxl::test::GetSomeTestImage(size.first, size.second, 4, size.first));
+    pixels.back().resize(size.first * size.second * 4);
+  }
+  for (size_t i = 0; i < sizes.size(); ++i) {
+    images.push_back({sizes[i].first, sizes[i].second, pixels[i].data(),
+                      pixels[i].size()});
+  }
+
+  JxlEncoderPtr enc = JxlEncoderMake(nullptr);
+  ASSERT_NE(nullptr, enc.get());
+  JxlThreadParallelRunnerPtr runner = JxlThreadParallelRunnerMake(nullptr, 4);
+  ASSERT_EQ(JXL_ENC_SUCCESS,
+            JxlEncoderSetParallelRunner(enc.get(), JxlThreadParallelRunner,
+                                        runner.get()));
+  JxlEncoderFrameSettings* frame_settings =
+      SetBatchSettings(enc.get(), pixel_format, 1, 1);
+  // The second batch reuses the encoders of the first one.
+  for (size_t num_images : {sizes.size(), sizes.size() - 2}) {
+    ASSERT_EQ(JXL_ENC_SUCCESS,
+              JxlEncoderEncodeBatch(frame_settings, &pixel_format,
+                                    images.data(), num_images));
+    for (size_t i = 0; i < num_images; ++i) {
+      JxlEncoderPtr single_enc = JxlEncoderMake(nullptr);
+      JxlEncoderFrameSettings* single_settings = SetBatchSettings(
+          single_enc.get(), pixel_format, sizes[i].first, sizes[i].second);
+      EXPECT_EQ(JXL_ENC_SUCCESS,
+                JxlEncoderAddImageFrame(single_settings, &pixel_format,
+                                        pixels[i].data(), pixels[i].size()));
+      JxlEncoderCloseInput(single_enc.get());
+      std::vector<uint8_t> expected(1 << 20);
+      uint8_t* next_out = expected.data();
+      size_t avail_out = expected.size();
+      EXPECT_EQ(JXL_ENC_SUCCESS, JxlEncoderProcessOutput(
+                                     single_enc.get(), &next_out, &avail_out));
+      expected.resize(next_out - expected.data());
+
+      const uint8_t* data;
+      size_t size;
+      ASSERT_EQ(JXL_ENC_SUCCESS,
+                JxlEncoderGetBatchOutput(enc.get(), i, &data, &size));
+      EXPECT_EQ(expected, std::vector<uint8_t>(data, data + size));
+    }
+    const uint8_t* data;
+    size_t size;
+    EXPECT_EQ(JXL_ENC_ERROR,
+              JxlEncoderGetBatchOutput(enc.get(), num_images, &data, &size));
+  }
+
+  // A buffer that is too small fails the batch.
+  images[1].size = 10;
+  EXPECT_EQ(JXL_ENC_ERROR, JxlEncoderEncodeBatch(frame_settings, &pixel_format,
+                                                 images.data(), images.size()));
+  EXPECT_EQ(JXL_ENC_ERR_API_USAGE, JxlEncoderGetError(enc.get()));
+}
+
 TEST(EncodeTest, CmsTest) {
   JxlEncoderPtr enc = JxlEncoderMake(nullptr);
   EXPECT_NE(nullptr, enc.get());
@@ -17,16 +17,52 @@
 #include "lib/jxl/base/bits.h"
 #include "lib/jxl/base/byte_order.h"
 #include "lib/jxl/base/common.h"
+#include "lib/jxl/base/data_parallel.h"
 #include "lib/jxl/base/status.h"
 #include "lib/jxl/frame_dimensions.h"
 #include "lib/jxl/jpeg/dec_jpeg_serialization_state.h"
 #include "lib/jxl/jpeg/jpeg_data.h"
 
+#undef HWY_TARGET_INCLUDE
+#define HWY_TARGET_INCLUDE "lib/jxl/jpeg/dec_jpeg_data_writer.cc"
+#include <hwy/foreach_target.h>
+#include <hwy/highway.h>
+
+HWY_BEFORE_NAMESPACE();
+namespace jxl {
+namespace jpeg {
+namespace HWY_NAMESPACE {
+
+// These templates are not found via ADL.
+using hwy::HWY_NAMESPACE::Ne;
+
+// Returns a mask with bit i set if and only if block[i] is not zero.
+uint64_t NonzeroMask(const coeff_t* JXL_RESTRICT block) {
+  const HWY_CAPPED(coeff_t, kDCTBlockSize) d;
+  const auto zero = Zero(d);
+  uint64_t mask = 0;
+  for (size_t i = 0; i < kDCTBlockSize; i += Lanes(d)) {
+    uint8_t bits[8] = {};
+    StoreMaskBits(d, Ne(Load(d, block + i), zero), bits);
+    mask |= LoadLE64(bits) << i;
+  }
+  return mask;
+}
+
+// NOLINTNEXTLINE(google-readability-namespace-comments)
+}  // namespace HWY_NAMESPACE
+}  // namespace jpeg
+}  // namespace jxl
+HWY_AFTER_NAMESPACE();
+
+#if HWY_ONCE
 namespace jxl {
 namespace jpeg {
 
 namespace {
 
+HWY_EXPORT(NonzeroMask);
+
 enum struct SerializationStatus {
   NEEDS_MORE_INPUT,
   NEEDS_MORE_OUTPUT,
@@ -39,6 +75,9 @@ const int kJpegPrecision = 8;
 // JpegBitWriter: buffer size
 const size_t kJpegBitWriterChunkSize = 16384;
 
+// Minimum number of MCUs encoded by one task of a parallel scan.
+const size_t kMinMCUsPerTask = 256;
+
 // Returns non-zero if and only if x has a zero byte, i.e. one of
 // x & 0xff, x & 0xff00, ..., x & 0xff00000000000000 is zero.
 JXL_INLINE uint64_t HasZeroByte(uint64_t x) {
@@ -518,10 +557,17 @@ bool EncodeInterMarkerData(const JPEGData& jpg, SerializationState* state) {
 bool EncodeDCTBlockSequential(const coeff_t* coeffs, HuffmanCodeTable* dc_huff,
                               HuffmanCodeTable* ac_huff, int num_zero_runs,
                               coeff_t* last_dc_coeff, JpegBitWriter* bw) {
+  // With the coefficients in zig-zag order, the runs of zeros are the runs of
+  // cleared bits in the nonzero mask.
+  HWY_ALIGN coeff_t zigzag[kDCTBlockSize];
+  for (size_t i = 0; i < kDCTBlockSize; i++) {
+    zigzag[i] = coeffs[kJPEGNaturalOrder[i]];
+  }
+  uint64_t nonzero = HWY_DYNAMIC_DISPATCH(NonzeroMask)(zigzag);
   coeff_t temp2;
   coeff_t temp;
   coeff_t litmus = 0;
-  temp2 = coeffs[0];
+  temp2 = zigzag[0];
   temp = temp2 - *last_dc_coeff;
   *last_dc_coeff = temp2;
   temp2 = temp >> (8 * sizeof(coeff_t) - 1);
@@ -540,38 +586,39 @@ bool EncodeDCTBlockSequential(const coeff_t* coeffs, HuffmanCodeTable* dc_huff,
   if (dc_nbits) {
     WriteBits(bw, dc_nbits, temp & ((1u << dc_nbits) - 1));
   }
-  int16_t r = 0;
 
-  for (size_t i = 1; i < 64; i++) {
-    temp = coeffs[kJPEGNaturalOrder[i]];
-    if (temp == 0) {
-      r++;
-    } else {
-      temp2 = temp >> (8 * sizeof(coeff_t) - 1);
-      temp += temp2;
-      temp2 ^= temp;
-      if (JXL_UNLIKELY(r > 15)) {
+  // Skip the DC coefficient.
+  nonzero &= ~uint64_t{1};
+  int last = 0;
+  while (nonzero != 0) {
+    const int i = Num0BitsBelowLS1Bit_Nonzero(nonzero);
+    nonzero &= nonzero - 1;
+    int16_t r = i - last - 1;
+    last = i;
+    temp = zigzag[i];
+    temp2 = temp >> (8 * sizeof(coeff_t) - 1);
+    temp += temp2;
+    temp2 ^= temp;
+    if (JXL_UNLIKELY(r > 15)) {
+      WriteSymbol(0xf0, ac_huff, bw);
+      r -= 16;
+      if (r > 15) {
+        WriteSymbol(0xf0, ac_huff, bw);
+        r -= 16;
+      }
+      if (r > 15) {
         WriteSymbol(0xf0, ac_huff, bw);
         r -= 16;
-        if (r > 15) {
-          WriteSymbol(0xf0, ac_huff, bw);
-          r -= 16;
-        }
-        if (r > 15) {
-          WriteSymbol(0xf0, ac_huff, bw);
-          r -= 16;
-        }
       }
-      litmus |= temp2;
-      int ac_nbits =
-          FloorLog2Nonzero<uint32_t>(static_cast<uint16_t>(temp2)) + 1;
-      int symbol = (r << 4u) + ac_nbits;
-      WriteSymbolBits(symbol, ac_huff, bw, ac_nbits,
-                      temp & ((1 << ac_nbits) - 1));
-      r = 0;
     }
+    litmus |= temp2;
+    int ac_nbits = FloorLog2Nonzero<uint32_t>(static_cast<uint16_t>(temp2)) + 1;
+    int symbol = (r << 4u) + ac_nbits;
+    WriteSymbolBits(symbol, ac_huff, bw, ac_nbits,
+                    temp & ((1 << ac_nbits) - 1));
   }
 
+  int16_t r = kDCTBlockSize - 1 - last;
   for (int i = 0; i < num_zero_runs; ++i) {
     WriteSymbol(0xf0, ac_huff, bw);
     r -= 16;
@@ -720,6 +767,127 @@ bool EncodeRefinementBits(const coeff_t* coeffs, HuffmanCodeTable* ac_huff,
   return true;
 }
 
+// Returns whether the restart intervals of the sequential scan can be encoded
+// independently of each other by EncodeSequentialScanInParallel.
+bool CanEncodeSequentialScanInParallel(const JPEGScanInfo& scan_info,
+                                       const SerializationState& state,
+                                       int restart_interval, int num_mcus) {
+  if (state.pool == nullptr || restart_interval <= 0 ||
+      static_cast<size_t>(num_mcus) < 2 * kMinMCUsPerTask) {
+    return false;
+  }
+  // The number of padding bits of an interval depends on all the previous
+  // ones.
+  if (state.pad_bits != nullptr) return false;
+  // Each interval looks up its first extra zero run by block index.
+  const auto& runs = scan_info.extra_zero_runs;
+  for (size_t i = 1; i < runs.size(); ++i) {
+    if (runs[i].block_idx <= runs[i - 1].block_idx) return false;
+  }
+  return true;
+}
+
+// Encodes a sequential scan with restart markers in parallel. The restart
+// intervals start on a byte boundary and do not share any coding state, so
+// groups of them are encoded into separate output queues by the tasks of
+// `state->pool`, which are then concatenated.
+Status EncodeSequentialScanInParallel(const JPEGData& jpg,
+                                      const JPEGScanInfo& scan_info,
+                                      int restart_interval, int MCUs_per_row,
+                                      int num_mcus,
+                                      SerializationState* state) {
+  const bool is_interleaved = (scan_info.num_components > 1);
+  size_t blocks_per_mcu = 0;
+  for (size_t i = 0; i < scan_info.num_components; ++i) {
+    const JPEGComponentScanInfo& si = scan_info.components[i];
+    const JPEGComponent& c = jpg.components[si.comp_idx];
+    blocks_per_mcu += is_interleaved ? c.h_samp_factor * c.v_samp_factor : 1;
+    if (!state->dc_huff_table[si.dc_tbl_idx].initialized ||
+        !state->ac_huff_table[si.ac_tbl_idx].initialized) {
+      return JXL_FAILURE("Missing Huffman table");
+    }
+  }
+  const size_t num_intervals = DivCeil(num_mcus, restart_interval);
+  const size_t intervals_per_task =
+      DivCeil(kMinMCUsPerTask, static_cast<size_t>(restart_interval));
+  const size_t num_tasks = DivCeil(num_intervals, intervals_per_task);
+  const auto& extra_zero_runs = scan_info.extra_zero_runs;
+  std::vector<std::deque<OutputChunk>> queues(num_tasks);
+
+  const auto encode_task = [&](const uint32_t task,
+                               size_t /* thread */) -> Status {
+    JpegBitWriter bw;
+    JpegBitWriterInit(&bw, &queues[task]);
+    const size_t interval_end =
+        std::min(num_intervals, (task + 1) * intervals_per_task);
+    for (size_t interval = task * intervals_per_task; interval < interval_end;
+         ++interval) {
+      const size_t mcu_begin = interval * restart_interval;
+      const size_t mcu_end =
+          std::min<size_t>(num_mcus, mcu_begin + restart_interval);
+      uint32_t block_scan_index = mcu_begin * blocks_per_mcu;
+      auto next_extra_zero_run = std::lower_bound(
+          extra_zero_runs.begin(), extra_zero_runs.end(), block_scan_index,
+          [](const JPEGScanInfo::ExtraZeroRunInfo& info, uint32_t index) {
+            return info.block_idx < index;
+          });
+      coeff_t last_dc_coeff[kMaxComponents] = {0};
+      for (size_t mcu = mcu_begin; mcu < mcu_end; ++mcu) {
+        const size_t mcu_y = mcu / MCUs_per_row;
+        const size_t mcu_x = mcu % MCUs_per_row;
+        for (size_t i = 0; i < scan_info.num_components; ++i) {
+          const JPEGComponentScanInfo& si = scan_info.components[i];
+          const JPEGComponent& c = jpg.components[si.comp_idx];
+          HuffmanCodeTable* dc_huff = &state->dc_huff_table[si.dc_tbl_idx];
+          HuffmanCodeTable* ac_huff = &state->ac_huff_table[si.ac_tbl_idx];
+          size_t n_blocks_y = is_interleaved ? c.v_samp_factor : 1;
+          size_t n_blocks_x = is_interleaved ? c.h_samp_factor : 1;
+          for (size_t iy = 0; iy < n_blocks_y; ++iy) {
+            for (size_t ix = 0; ix < n_blocks_x; ++ix) {
+              size_t block_y = mcu_y * n_blocks_y + iy;
+              size_t block_x = mcu_x * n_blocks_x + ix;
+              size_t block_idx = block_y * c.width_in_blocks + block_x;
+              int num_zero_runs = 0;
+              if (next_extra_zero_run != extra_zero_runs.end() &&
+                  next_extra_zero_run->block_idx == block_scan_index) {
+                num_zero_runs = next_extra_zero_run->num_extra_zero_runs;
+                ++next_extra_zero_run;
+              }
+              // compressed size per block cannot be more than 512 bytes
+              Reserve(&bw, 512);
+              if (!EncodeDCTBlockSequential(&c.coeffs[block_idx << 6],
+                                            dc_huff, ac_huff, num_zero_runs,
+                                            last_dc_coeff + si.comp_idx,
+                                            &bw)) {
+                return JXL_FAILURE("Invalid coefficients");
+              }
+              ++block_scan_index;
+            }
+          }
+        }
+      }
+      const uint8_t* pad_bits = nullptr;
+      if (!JumpToByteBoundary(&bw, &pad_bits, nullptr)) {
+        return JXL_FAILURE("Failed to pad restart interval");
+      }
+      if (interval + 1 < num_intervals) {
+        EmitMarker(&bw, 0xD0 + (interval & 0x7));
+      }
+    }
+    JpegBitWriterFinish(&bw);
+    if (!bw.healthy) return JXL_FAILURE("Failed to write restart interval");
+    return true;
+  };
+  JXL_RETURN_IF_ERROR(RunOnPool(state->pool, 0, num_tasks, ThreadPool::NoInit,
+                                encode_task, "EncodeScan"));
+  for (std::deque<OutputChunk>& queue : queues) {
+    for (OutputChunk& chunk : queue) {
+      state->output_queue.emplace_back(std::move(chunk));
+    }
+  }
+  return true;
+}
+
 template <int kMode>
 SerializationStatus JXL_NOINLINE DoEncodeScan(const JPEGData& jpg,
                                               SerializationState* state) {
@@ -799,6 +967,23 @@ SerializationStatus JXL_NOINLINE DoEncodeScan(const JPEGData& jpg,
   (void)complete;
   const int last_mcu_y = complete ? MCU_rows : 0;
 
+  if (kMode == 0 && ss.mcu_y == 0 && last_mcu_y == MCU_rows &&
+      CanEncodeSequentialScanInParallel(scan_info, *state, restart_interval,
+                                        MCUs_per_row * MCU_rows)) {
+    if (!EncodeSequentialScanInParallel(jpg, scan_info, restart_interval,
+                                        MCUs_per_row, MCUs_per_row * MCU_rows,
+                                        state)) {
+      return SerializationStatus::ERROR;
+    }
+    // Drops the unused output chunk of the scan state's bit writer.
+    bw->pos = 0;
+    JpegBitWriterFinish(bw);
+    ss.stage = EncodeScanState::HEAD;
+    state->scan_index++;
+    state->num_parallel_scans++;
+    return SerializationStatus::DONE;
+  }
+
   for (; ss.mcu_y < last_mcu_y; ++ss.mcu_y) {
     for (int mcu_x = 0; mcu_x < MCUs_per_row; ++mcu_x) {
       // Possibly emit a restart marker.
@@ -1056,10 +1241,17 @@ Status WriteJpegInternal(const JPEGData& jpg, const JPEGOutput& out,
 
 }  // namespace
 
-Status WriteJpeg(const JPEGData& jpg, const JPEGOutput& out) {
+Status WriteJpeg(const JPEGData& jpg, const JPEGOutput& out,
+                 ThreadPool* pool, size_t* num_parallel_scans) {
   auto ss = jxl::make_unique<SerializationState>();
-  return WriteJpegInternal(jpg, out, ss.get());
+  ss->pool = pool;
+  JXL_RETURN_IF_ERROR(WriteJpegInternal(jpg, out, ss.get()));
+  if (num_parallel_scans != nullptr) {
+    *num_parallel_scans = ss->num_parallel_scans;
+  }
+  return true;
 }
 
 }  // namespace jpeg
 }  // namespace jxl
+#endif  // HWY_ONCE
@@ -13,6 +13,7 @@
 
 #include <functional>
 
+#include "lib/jxl/base/data_parallel.h"
 #include "lib/jxl/jpeg/dec_jpeg_serialization_state.h"
 #include "lib/jxl/jpeg/jpeg_data.h"
 
@@ -23,7 +24,12 @@ namespace jpeg {
 // written.
 using JPEGOutput = std::function<size_t(const uint8_t* buf, size_t len)>;
 
-Status WriteJpeg(const JPEGData& jpg, const JPEGOutput& out);
+// If `pool` is not null, the restart intervals of sequential scans are written
+// in parallel, if each of them can be written independently of the others.
+// If `num_parallel_scans` is not null, it is set to the number of such scans.
+Status WriteJpeg(const JPEGData& jpg, const JPEGOutput& out,
+                 ThreadPool* pool = nullptr,
+                 size_t* num_parallel_scans = nullptr);
 
 }  // namespace jpeg
 }  // namespace jxl
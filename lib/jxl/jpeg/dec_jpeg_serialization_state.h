@@ -10,6 +10,7 @@
 #include <deque>
 #include <vector>
 
+#include "lib/jxl/base/data_parallel.h"
 #include "lib/jxl/jpeg/dec_jpeg_output_chunk.h"
 #include "lib/jxl/jpeg/jpeg_data.h"
 
@@ -91,6 +92,10 @@ struct SerializationState {
   const uint8_t* pad_bits_end = nullptr;
   bool seen_dri_marker = false;
   bool is_progressive = false;
+  // Used to write the restart intervals of sequential scans in parallel.
+  ThreadPool* pool = nullptr;
+  // Number of scans that were written in parallel.
+  size_t num_parallel_scans = 0;
 
   EncodeScanState scan_state;
 };
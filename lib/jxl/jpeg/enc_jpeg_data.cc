@@ -11,6 +11,8 @@
 #include <jxl/types.h>
 
 #include <cstdint>
+#include <memory>
+#include <utility>
 
 #include "lib/jxl/base/sanitizers.h"
 #include "lib/jxl/base/status.h"
@@ -389,31 +391,37 @@ Status EncodeJPEGData(JxlMemoryManager* memory_manager, JPEGData& jpeg_data,
   return true;
 }
 
-Status DecodeImageJPG(const Span<const uint8_t> bytes, CodecInOut* io) {
+Status DecodeImageJPG(const Span<const uint8_t> bytes, CodecInOut* io,
+                      ThreadPool* pool) {
   if (!IsJPG(bytes)) return false;
+  std::unique_ptr<JPEGData> jpeg_data = make_unique<JPEGData>();
+  if (!jpeg::ReadJpeg(bytes.data(), bytes.size(), jpeg::JpegReadMode::kReadAll,
+                      jpeg_data.get(), pool)) {
+    return JXL_FAILURE("Error reading JPEG");
+  }
+  return SetImageFromJPEGData(std::move(jpeg_data), io);
+}
+
+Status SetImageFromJPEGData(std::unique_ptr<JPEGData> jpeg_data,
+                            CodecInOut* io) {
   JxlMemoryManager* memory_manager = io->memory_manager;
   io->frames.clear();
   io->frames.reserve(1);
   io->frames.emplace_back(memory_manager, &io->metadata.m);
-  io->Main().jpeg_data = make_unique<jpeg::JPEGData>();
-  jpeg::JPEGData* jpeg_data = io->Main().jpeg_data.get();
-  if (!jpeg::ReadJpeg(bytes.data(), bytes.size(), jpeg::JpegReadMode::kReadAll,
-                      jpeg_data)) {
-    return JXL_FAILURE("Error reading JPEG");
-  }
+  io->Main().jpeg_data = std::move(jpeg_data);
+  const JPEGData& jpg = *io->Main().jpeg_data;
   JXL_RETURN_IF_ERROR(
-      SetColorEncodingFromJpegData(*jpeg_data, &io->metadata.m.color_encoding));
-  JXL_RETURN_IF_ERROR(SetBlobsFromJpegData(*jpeg_data, &io->blobs));
+      SetColorEncodingFromJpegData(jpg, &io->metadata.m.color_encoding));
+  JXL_RETURN_IF_ERROR(SetBlobsFromJpegData(jpg, &io->blobs));
   JXL_RETURN_IF_ERROR(SetChromaSubsamplingFromJpegData(
-      *jpeg_data, &io->Main().chroma_subsampling));
+      jpg, &io->Main().chroma_subsampling));
   JXL_RETURN_IF_ERROR(
-      SetColorTransformFromJpegData(*jpeg_data, &io->Main().color_transform));
+      SetColorTransformFromJpegData(jpg, &io->Main().color_transform));
 
   io->metadata.m.SetIntensityTarget(kDefaultIntensityTarget);
   io->metadata.m.SetUintSamples(BITS_IN_JSAMPLE);
-  JXL_ASSIGN_OR_RETURN(
-      Image3F tmp,
-      Image3F::Create(memory_manager, jpeg_data->width, jpeg_data->height));
+  JXL_ASSIGN_OR_RETURN(Image3F tmp,
+                       Image3F::Create(memory_manager, jpg.width, jpg.height));
   JXL_RETURN_IF_ERROR(
       io->SetFromImage(std::move(tmp), io->metadata.m.color_encoding));
   SetIntensityTarget(&io->metadata.m);
@@ -9,8 +9,10 @@
 #include <jxl/memory_manager.h>
 
 #include <cstdint>
+#include <memory>
 #include <vector>
 
+#include "lib/jxl/base/data_parallel.h"
 #include "lib/jxl/base/span.h"
 #include "lib/jxl/base/status.h"
 #include "lib/jxl/color_encoding_internal.h"
@@ -36,9 +38,17 @@ Status SetColorTransformFromJpegData(const JPEGData& jpg,
 
 /**
  * Decodes bytes containing JPEG codestream into a CodecInOut as coefficients
- * only, for lossless JPEG transcoding.
+ * only, for lossless JPEG transcoding. If `pool` is not null, the restart
+ * intervals of the scans are decoded in parallel.
  */
-Status DecodeImageJPG(Span<const uint8_t> bytes, CodecInOut* io);
+Status DecodeImageJPG(Span<const uint8_t> bytes, CodecInOut* io,
+                      ThreadPool* pool = nullptr);
+
+/**
+ * Like DecodeImageJPG, but takes an already parsed JPEG codestream.
+ */
+Status SetImageFromJPEGData(std::unique_ptr<JPEGData> jpeg_data,
+                            CodecInOut* io);
 
 }  // namespace jpeg
 }  // namespace jxl
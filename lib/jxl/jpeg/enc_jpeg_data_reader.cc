@@ -13,6 +13,7 @@
 #include <vector>
 
 #include "lib/jxl/base/common.h"
+#include "lib/jxl/base/data_parallel.h"
 #include "lib/jxl/base/printf_macros.h"
 #include "lib/jxl/base/status.h"
 #include "lib/jxl/frame_dimensions.h"
@@ -25,6 +26,9 @@ namespace jpeg {
 namespace {
 const int kBrunsliMaxSampling = 15;
 
+// Minimum number of MCUs decoded by one task of a parallel scan.
+const size_t kMinMCUsPerTask = 256;
+
 // Macros for commonly used error conditions.
 
 #define JXL_JPEG_VERIFY_LEN(n)                                \
@@ -125,7 +129,8 @@ bool ProcessSOF(const uint8_t* data, const size_t len, JpegReadMode mode,
     c.height_in_blocks = MCU_rows * c.v_samp_factor;
     const uint64_t num_blocks =
         static_cast<uint64_t>(c.width_in_blocks) * c.height_in_blocks;
-    if (mode == JpegReadMode::kReadAll) {
+    if (mode == JpegReadMode::kReadAll ||
+        mode == JpegReadMode::kReadAllButScanData) {
       c.coeffs.resize(num_blocks * kDCTBlockSize);
     }
   }
@@ -436,15 +441,20 @@ struct BitReaderState {
   // Returns false if there is inconsistent or invalid padding or the stream
   // ended too early.
   bool FinishStream(JPEGData* jpg, size_t* pos) {
+    return FinishStream(&jpg->padding_bits, &jpg->has_zero_padding_bit, pos);
+  }
+
+  bool FinishStream(std::vector<uint8_t>* padding_bits,
+                    bool* has_zero_padding_bit, size_t* pos) {
     int npadbits = bits_left_ & 7;
     if (npadbits > 0) {
       uint64_t padmask = (1ULL << npadbits) - 1;
       uint64_t padbits = (val_ >> (bits_left_ - npadbits)) & padmask;
       if (padbits != padmask) {
-        jpg->has_zero_padding_bit = true;
+        *has_zero_padding_bit = true;
       }
       for (int i = npadbits - 1; i >= 0; --i) {
-        jpg->padding_bits.push_back((padbits >> i) & 1);
+        padding_bits->push_back((padbits >> i) & 1);
       }
     }
     // Give back some bytes that we did not use.
@@ -744,11 +754,185 @@ bool ProcessRestart(const uint8_t* data, const size_t len,
   return true;
 }
 
+// Decodes the blocks of the MCU at (mcu_x, mcu_y) and appends their reset
+// points and extra zero runs to the given vectors.
+bool DecodeMCU(const std::vector<HuffmanTableEntry>& dc_huff_lut,
+               const std::vector<HuffmanTableEntry>& ac_huff_lut,
+               const JPEGScanInfo& scan_info, int mcu_x, int mcu_y, int Ss,
+               int Se, int Al, int Ah, int* eobrun, coeff_t* last_dc_coeff,
+               int* block_scan_index, BitReaderState* br, JPEGData* jpg,
+               std::vector<uint32_t>* reset_points,
+               std::vector<JPEGScanInfo::ExtraZeroRunInfo>* extra_zero_runs) {
+  bool is_interleaved = (scan_info.num_components > 1);
+  for (size_t i = 0; i < scan_info.num_components; ++i) {
+    const JPEGComponentScanInfo* si = &scan_info.components[i];
+    JPEGComponent* c = &jpg->components[si->comp_idx];
+    const HuffmanTableEntry* dc_lut =
+        &dc_huff_lut[si->dc_tbl_idx * kJpegHuffmanLutSize];
+    const HuffmanTableEntry* ac_lut =
+        &ac_huff_lut[si->ac_tbl_idx * kJpegHuffmanLutSize];
+    int nblocks_y = is_interleaved ? c->v_samp_factor : 1;
+    int nblocks_x = is_interleaved ? c->h_samp_factor : 1;
+    for (int iy = 0; iy < nblocks_y; ++iy) {
+      for (int ix = 0; ix < nblocks_x; ++ix) {
+        int block_y = mcu_y * nblocks_y + iy;
+        int block_x = mcu_x * nblocks_x + ix;
+        int block_idx = block_y * c->width_in_blocks + block_x;
+        bool reset_state = false;
+        int num_zero_runs = 0;
+        coeff_t* coeffs = &c->coeffs[block_idx * kDCTBlockSize];
+        if (Ah == 0) {
+          if (!DecodeDCTBlock(dc_lut, ac_lut, Ss, Se, Al, eobrun,
+                              &reset_state, &num_zero_runs, br, jpg,
+                              &last_dc_coeff[si->comp_idx], coeffs)) {
+            return false;
+          }
+        } else {
+          if (!RefineDCTBlock(ac_lut, Ss, Se, Al, eobrun, &reset_state, br,
+                              jpg, coeffs)) {
+            return false;
+          }
+        }
+        if (reset_state) {
+          reset_points->emplace_back(*block_scan_index);
+        }
+        if (num_zero_runs > 0) {
+          JPEGScanInfo::ExtraZeroRunInfo info;
+          info.block_idx = *block_scan_index;
+          info.num_extra_zero_runs = num_zero_runs;
+          extra_zero_runs->push_back(info);
+        }
+        ++(*block_scan_index);
+      }
+    }
+  }
+  return true;
+}
+
+// Appends to *markers the positions of the restart markers in the entropy
+// coded data starting at pos, up to the first other marker.
+void FindRestartMarkers(const uint8_t* data, const size_t len, size_t pos,
+                        std::vector<size_t>* markers) {
+  while (pos + 1 < len) {
+    const void* next = memchr(data + pos, 0xff, len - 1 - pos);
+    if (next == nullptr) return;
+    pos = static_cast<const uint8_t*>(next) - data;
+    const uint8_t marker = data[pos + 1];
+    if (marker == 0) {
+      pos += 2;
+    } else if (marker >= 0xd0 && marker <= 0xd7) {
+      markers->push_back(pos);
+      pos += 2;
+    } else {
+      return;
+    }
+  }
+}
+
+// Decodes the restart intervals of the scan in parallel. Each interval starts
+// after a restart marker with a fresh coding state, so only the positions of
+// the markers are needed to decode them independently. The reset points,
+// extra zero runs and padding bits of groups of intervals are collected
+// separately and then appended in order. Returns true and leaves *pos
+// unchanged without decoding anything if there are too few restart markers.
+bool ProcessScanInParallel(const uint8_t* data, const size_t len,
+                           const std::vector<HuffmanTableEntry>& dc_huff_lut,
+                           const std::vector<HuffmanTableEntry>& ac_huff_lut,
+                           int MCUs_per_row, int MCU_rows, int Ss, int Se,
+                           int Al, int Ah, ThreadPool* pool, size_t* pos,
+                           JPEGData* jpg, bool* decoded) {
+  *decoded = false;
+  JPEGScanInfo* scan_info = &jpg->scan_info.back();
+  const size_t restart_interval = jpg->restart_interval;
+  const size_t num_mcus = MCUs_per_row * MCU_rows;
+  const size_t num_intervals = DivCeil(num_mcus, restart_interval);
+  std::vector<size_t> markers;
+  FindRestartMarkers(data, len, *pos, &markers);
+  if (markers.size() + 1 < num_intervals) return true;
+  int blocks_per_mcu = 0;
+  for (size_t i = 0; i < scan_info->num_components; ++i) {
+    const JPEGComponent& c = jpg->components[scan_info->components[i].comp_idx];
+    blocks_per_mcu += scan_info->num_components > 1
+                          ? c.h_samp_factor * c.v_samp_factor
+                          : 1;
+  }
+
+  struct TaskOutput {
+    std::vector<uint32_t> reset_points;
+    std::vector<JPEGScanInfo::ExtraZeroRunInfo> extra_zero_runs;
+    std::vector<uint8_t> padding_bits;
+    bool has_zero_padding_bit = false;
+    size_t end_pos = 0;
+  };
+  const size_t intervals_per_task = DivCeil(kMinMCUsPerTask, restart_interval);
+  const size_t num_tasks = DivCeil(num_intervals, intervals_per_task);
+  std::vector<TaskOutput> outputs(num_tasks);
+  const auto decode_task = [&](const uint32_t task,
+                               size_t /* thread */) -> Status {
+    TaskOutput& out = outputs[task];
+    const size_t interval_end =
+        std::min(num_intervals, (task + 1) * intervals_per_task);
+    for (size_t interval = task * intervals_per_task; interval < interval_end;
+         ++interval) {
+      BitReaderState br(data, len,
+                        interval == 0 ? *pos : markers[interval - 1] + 2);
+      coeff_t last_dc_coeff[kMaxComponents] = {0};
+      int eobrun = -1;
+      const size_t mcu_begin = interval * restart_interval;
+      const size_t mcu_end = std::min(num_mcus, mcu_begin + restart_interval);
+      int block_scan_index = mcu_begin * blocks_per_mcu;
+      for (size_t mcu = mcu_begin; mcu < mcu_end; ++mcu) {
+        if (!DecodeMCU(dc_huff_lut, ac_huff_lut, *scan_info,
+                       mcu % MCUs_per_row, mcu / MCUs_per_row, Ss, Se, Al, Ah,
+                       &eobrun, last_dc_coeff, &block_scan_index, &br, jpg,
+                       &out.reset_points, &out.extra_zero_runs)) {
+          return JXL_FAILURE("Invalid restart interval %" PRIuS, interval);
+        }
+      }
+      if (eobrun > 0) {
+        return JXL_FAILURE("End-of-block run too long.");
+      }
+      if (!br.FinishStream(&out.padding_bits, &out.has_zero_padding_bit,
+                           &out.end_pos)) {
+        return JXL_FAILURE("Invalid scan.");
+      }
+      if (interval + 1 < num_intervals) {
+        const int expected_marker = 0xd0 + (interval & 0x7);
+        if (out.end_pos != markers[interval] ||
+            data[out.end_pos + 1] != expected_marker) {
+          return JXL_FAILURE("Did not find expected restart marker %d",
+                             expected_marker);
+        }
+      }
+    }
+    return true;
+  };
+  if (!RunOnPool(pool, 0, num_tasks, ThreadPool::NoInit, decode_task,
+                 "ProcessScan")) {
+    return false;
+  }
+  for (TaskOutput& out : outputs) {
+    scan_info->reset_points.insert(scan_info->reset_points.end(),
+                                   out.reset_points.begin(),
+                                   out.reset_points.end());
+    scan_info->extra_zero_runs.insert(scan_info->extra_zero_runs.end(),
+                                      out.extra_zero_runs.begin(),
+                                      out.extra_zero_runs.end());
+    jpg->padding_bits.insert(jpg->padding_bits.end(), out.padding_bits.begin(),
+                             out.padding_bits.end());
+    jpg->has_zero_padding_bit |= out.has_zero_padding_bit;
+  }
+  *pos = outputs.back().end_pos;
+  *decoded = true;
+  return true;
+}
+
 bool ProcessScan(const uint8_t* data, const size_t len,
                  const std::vector<HuffmanTableEntry>& dc_huff_lut,
                  const std::vector<HuffmanTableEntry>& ac_huff_lut,
                  uint16_t scan_progression[kMaxComponents][kDCTBlockSize],
-                 bool is_progressive, size_t* pos, JPEGData* jpg) {
+                 bool is_progressive, ThreadPool* pool, size_t* pos,
+                 JPEGData* jpg) {
   if (!ProcessSOS(data, len, pos, jpg)) {
     return false;
   }
@@ -800,6 +984,23 @@ bool ProcessScan(const uint8_t* data, const size_t len,
   if (Al > 10) {
     return JXL_FAILURE("Scan parameter Al=%d is not supported.", Al);
   }
+  if (pool != nullptr && jpg->restart_interval > 0 &&
+      static_cast<size_t>(MCUs_per_row * MCU_rows) >= 2 * kMinMCUsPerTask) {
+    bool decoded;
+    if (!ProcessScanInParallel(data, len, dc_huff_lut, ac_huff_lut,
+                               MCUs_per_row, MCU_rows, Ss, Se, Al, Ah, pool,
+                               pos, jpg, &decoded)) {
+      return false;
+    }
+    if (decoded) {
+      if (*pos > len) {
+        return JXL_FAILURE("Unexpected end of file during scan. pos=%" PRIuS
+                           " len=%" PRIuS,
+                           *pos, len);
+      }
+      return true;
+    }
+  }
   for (int mcu_y = 0; mcu_y < MCU_rows; ++mcu_y) {
     for (int mcu_x = 0; mcu_x < MCUs_per_row; ++mcu_x) {
       // Handle the restart intervals.
@@ -819,47 +1020,11 @@ bool ProcessScan(const uint8_t* data, const size_t len,
         --restarts_to_go;
       }
       // Decode one MCU.
-      for (size_t i = 0; i < scan_info->num_components; ++i) {
-        JPEGComponentScanInfo* si = &scan_info->components[i];
-        JPEGComponent* c = &jpg->components[si->comp_idx];
-        const HuffmanTableEntry* dc_lut =
-            &dc_huff_lut[si->dc_tbl_idx * kJpegHuffmanLutSize];
-        const HuffmanTableEntry* ac_lut =
-            &ac_huff_lut[si->ac_tbl_idx * kJpegHuffmanLutSize];
-        int nblocks_y = is_interleaved ? c->v_samp_factor : 1;
-        int nblocks_x = is_interleaved ? c->h_samp_factor : 1;
-        for (int iy = 0; iy < nblocks_y; ++iy) {
-          for (int ix = 0; ix < nblocks_x; ++ix) {
-            int block_y = mcu_y * nblocks_y + iy;
-            int block_x = mcu_x * nblocks_x + ix;
-            int block_idx = block_y * c->width_in_blocks + block_x;
-            bool reset_state = false;
-            int num_zero_runs = 0;
-            coeff_t* coeffs = &c->coeffs[block_idx * kDCTBlockSize];
-            if (Ah == 0) {
-              if (!DecodeDCTBlock(dc_lut, ac_lut, Ss, Se, Al, &eobrun,
-                                  &reset_state, &num_zero_runs, &br, jpg,
-                                  &last_dc_coeff[si->comp_idx], coeffs)) {
-                return false;
-              }
-            } else {
-              if (!RefineDCTBlock(ac_lut, Ss, Se, Al, &eobrun, &reset_state,
-                                  &br, jpg, coeffs)) {
-                return false;
-              }
-            }
-            if (reset_state) {
-              scan_info->reset_points.emplace_back(block_scan_index);
-            }
-            if (num_zero_runs > 0) {
-              JPEGScanInfo::ExtraZeroRunInfo info;
-              info.block_idx = block_scan_index;
-              info.num_extra_zero_runs = num_zero_runs;
-              scan_info->extra_zero_runs.push_back(info);
-            }
-            ++block_scan_index;
-          }
-        }
+      if (!DecodeMCU(dc_huff_lut, ac_huff_lut, *scan_info, mcu_x, mcu_y, Ss,
+                     Se, Al, Ah, &eobrun, last_dc_coeff, &block_scan_index,
+                     &br, jpg, &scan_info->reset_points,
+                     &scan_info->extra_zero_runs)) {
+        return false;
       }
     }
   }
@@ -877,6 +1042,20 @@ bool ProcessScan(const uint8_t* data, const size_t len,
   return true;
 }
 
+// Returns the position of the first marker other than a restart marker in the
+// entropy coded data starting at pos, or len if there is none.
+size_t SkipScanData(const uint8_t* data, const size_t len, size_t pos) {
+  while (pos + 1 < len) {
+    const void* next = memchr(data + pos, 0xff, len - 1 - pos);
+    if (next == nullptr) return len;
+    pos = static_cast<const uint8_t*>(next) - data;
+    const uint8_t marker = data[pos + 1];
+    if (marker != 0 && (marker < 0xd0 || marker > 0xd7)) return pos;
+    pos += 2;
+  }
+  return len;
+}
+
 // Changes the quant_idx field of the components to refer to the index of the
 // quant table in the jpg->quant array.
 bool FixupIndexes(JPEGData* jpg) {
@@ -917,7 +1096,7 @@ size_t FindNextMarker(const uint8_t* data, const size_t len, size_t pos) {
 }  // namespace
 
 bool ReadJpeg(const uint8_t* data, const size_t len, JpegReadMode mode,
-              JPEGData* jpg) {
+              JPEGData* jpg, ThreadPool* pool) {
   size_t pos = 0;
   // Check SOI marker.
   JXL_JPEG_EXPECT_MARKER();
@@ -975,7 +1154,10 @@ bool ReadJpeg(const uint8_t* data, const size_t len, JpegReadMode mode,
       case 0xda:
         if (mode == JpegReadMode::kReadAll) {
           ok = ProcessScan(data, len, dc_huff_lut, ac_huff_lut,
-                           scan_progression, is_progressive, &pos, jpg);
+                           scan_progression, is_progressive, pool, &pos, jpg);
+        } else if (mode == JpegReadMode::kReadAllButScanData) {
+          ok = ProcessSOS(data, len, &pos, jpg);
+          pos = SkipScanData(data, len, pos);
         }
         break;
       case 0xdb:
@@ -1027,7 +1209,8 @@ bool ReadJpeg(const uint8_t* data, const size_t len, JpegReadMode mode,
   }
 
   // Supplemental checks.
-  if (mode == JpegReadMode::kReadAll) {
+  if (mode == JpegReadMode::kReadAll ||
+      mode == JpegReadMode::kReadAllButScanData) {
     if (pos < len) {
       jpg->tail_data = std::vector<uint8_t>(data + pos, data + len);
     }
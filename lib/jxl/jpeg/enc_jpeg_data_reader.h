@@ -11,6 +11,7 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "lib/jxl/base/data_parallel.h"
 #include "lib/jxl/jpeg/jpeg_data.h"
 
 namespace jxl {
@@ -20,15 +21,21 @@ enum class JpegReadMode {
   kReadHeader,  // only basic headers
   kReadTables,  // headers and tables (quant, Huffman, ...)
   kReadAll,     // everything
+  kReadAllButScanData,  // everything but the entropy coded data of the scans
 };
 
 // Parses the JPEG stream contained in data[*pos ... len) and fills in *jpg with
 // the parsed information.
 // If mode is kReadHeader, it fills in only the image dimensions in *jpg.
+// If mode is kReadAllButScanData, the coefficients are allocated but left zero,
+// and the scans have no reset points, extra zero runs or padding bits; the
+// caller must fill these in from the encoder that produced the stream.
 // Returns false if the data is not valid JPEG, or if it contains an unsupported
 // JPEG feature.
+// If `pool` is not null, the restart intervals of scans are decoded in
+// parallel.
 bool ReadJpeg(const uint8_t* data, size_t len, JpegReadMode mode,
-              JPEGData* jpg);
+              JPEGData* jpg, ThreadPool* pool = nullptr);
 
 }  // namespace jpeg
 }  // namespace jxl
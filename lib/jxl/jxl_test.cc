@@ -1856,6 +1856,27 @@ JXL_GTEST_INSTANTIATE_TEST_SUITE_P(
     JxlStreamingTest, JxlStreamingTest,
     testing::ValuesIn(StreamingTestParam::All()));
 
+TEST(JxlTest, StreamingLosslessModularSmallImage) {
+  // Less than one DC group, but more than one group: with buffering 2 this is
+  // encoded through the streaming path.
+  TestImage image;
+  ASSERT_TRUE(image.SetDimensions(517, 357));
+  image.SetDataType(JXL_TYPE_UINT16);
+  ASSERT_TRUE(image.SetChannels(4));
+  image.SetAllBitDepths(12);
+  JXL_TEST_ASSIGN_OR_DIE(auto frame, image.AddFrame());
+  frame.RandomFill();
+  JXLCompressParams cparams;
+  cparams.distance = 0.0f;
+  cparams.AddOption(JXL_ENC_FRAME_SETTING_EFFORT, 3);
+  cparams.AddOption(JXL_ENC_FRAME_SETTING_BUFFERING, 2);
+
+  ThreadPoolForTests pool(8);
+  PackedPixelFile ppf_out;
+  Roundtrip(image.ppf(), cparams, {}, pool.get(), &ppf_out);
+  EXPECT_EQ(ComputeDistance2(image.ppf(), ppf_out), 0.0);
+}
+
 struct StreamingEncodingTestParam {
   std::string file;
   int effort;
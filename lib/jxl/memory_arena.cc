@@ -0,0 +1,153 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include <jxl/memory_arena.h>
+#include <jxl/memory_manager.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+
+#include "lib/jxl/memory_manager_internal.h"
+
+namespace {
+
+// Placed in front of every block handed out by the arena. The size of the
+// header keeps the alignment of the underlying allocations.
+struct BlockHeader {
+  size_t size;
+  BlockHeader* next_free;
+};
+constexpr size_t kHeaderSize = 16;
+static_assert(sizeof(BlockHeader) <= kHeaderSize, "BlockHeader too large");
+
+// Unused blocks of one size.
+struct Bin {
+  size_t size;
+  BlockHeader* free_blocks;
+  Bin* next;
+};
+
+constexpr size_t kNumBuckets = 256;
+
+}  // namespace
+
+struct JxlMemoryArenaStruct {
+  explicit JxlMemoryArenaStruct(const JxlMemoryManager& inner)
+      : inner(inner) {
+    memory_manager.opaque = this;
+    memory_manager.alloc = &Alloc;
+    memory_manager.free = &Free;
+  }
+
+  static void* Alloc(void* opaque, size_t size) {
+    JxlMemoryArenaStruct* self = static_cast<JxlMemoryArenaStruct*>(opaque);
+    {
+      std::lock_guard<std::mutex> lock(self->mutex);
+      Bin* bin = self->FindBin(size);
+      if (bin && bin->free_blocks) {
+        BlockHeader* block = bin->free_blocks;
+        bin->free_blocks = block->next_free;
+        return reinterpret_cast<uint8_t*>(block) + kHeaderSize;
+      }
+    }
+    if (size > SIZE_MAX - kHeaderSize) return nullptr;
+    void* allocation =
+        jxl::MemoryManagerAlloc(&self->inner, size + kHeaderSize);
+    if (!allocation) return nullptr;
+    BlockHeader* block = static_cast<BlockHeader*>(allocation);
+    block->size = size;
+    block->next_free = nullptr;
+    return static_cast<uint8_t*>(allocation) + kHeaderSize;
+  }
+
+  static void Free(void* opaque, void* address) {
+    if (!address) return;
+    JxlMemoryArenaStruct* self = static_cast<JxlMemoryArenaStruct*>(opaque);
+    BlockHeader* block = reinterpret_cast<BlockHeader*>(
+        static_cast<uint8_t*>(address) - kHeaderSize);
+    std::lock_guard<std::mutex> lock(self->mutex);
+    Bin* bin = self->FindBin(block->size);
+    if (!bin) {
+      bin = static_cast<Bin*>(
+          jxl::MemoryManagerAlloc(&self->inner, sizeof(Bin)));
+      if (!bin) {
+        // Can not keep the block, give it back.
+        jxl::MemoryManagerFree(&self->inner, block);
+        return;
+      }
+      Bin*& bucket = self->buckets[Bucket(block->size)];
+      bin->size = block->size;
+      bin->free_blocks = nullptr;
+      bin->next = bucket;
+      bucket = bin;
+    }
+    block->next_free = bin->free_blocks;
+    bin->free_blocks = block;
+  }
+
+  void Trim() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (Bin*& bucket : buckets) {
+      while (bucket) {
+        Bin* bin = bucket;
+        bucket = bin->next;
+        while (bin->free_blocks) {
+          BlockHeader* block = bin->free_blocks;
+          bin->free_blocks = block->next_free;
+          jxl::MemoryManagerFree(&inner, block);
+        }
+        jxl::MemoryManagerFree(&inner, bin);
+      }
+    }
+  }
+
+  static size_t Bucket(size_t size) {
+    // Sizes of the library's allocations are mostly multiples of the
+    // alignment, so mix the high bits in.
+    return (size ^ (size >> 8) ^ (size >> 16)) % kNumBuckets;
+  }
+
+  // Requires mutex.
+  Bin* FindBin(size_t size) const {
+    for (Bin* bin = buckets[Bucket(size)]; bin; bin = bin->next) {
+      if (bin->size == size) return bin;
+    }
+    return nullptr;
+  }
+
+  JxlMemoryManager inner;
+  JxlMemoryManager memory_manager;
+  std::mutex mutex;
+  Bin* buckets[kNumBuckets] = {};
+};
+
+JxlMemoryArena* JxlMemoryArenaCreate(const JxlMemoryManager* memory_manager) {
+  JxlMemoryManager local_memory_manager;
+  if (!jxl::MemoryManagerInit(&local_memory_manager, memory_manager)) {
+    return nullptr;
+  }
+  void* alloc = jxl::MemoryManagerAlloc(&local_memory_manager,
+                                        sizeof(JxlMemoryArena));
+  if (!alloc) return nullptr;
+  // Placement new constructor on allocated memory
+  return new (alloc) JxlMemoryArena(local_memory_manager);
+}
+
+void JxlMemoryArenaDestroy(JxlMemoryArena* arena) {
+  if (!arena) return;
+  arena->Trim();
+  JxlMemoryManager local_memory_manager = arena->inner;
+  // Call destructor directly since custom free function is used.
+  arena->~JxlMemoryArena();
+  jxl::MemoryManagerFree(&local_memory_manager, arena);
+}
+
+const JxlMemoryManager* JxlMemoryArenaGetMemoryManager(JxlMemoryArena* arena) {
+  return &arena->memory_manager;
+}
+
+void JxlMemoryArenaTrim(JxlMemoryArena* arena) { arena->Trim(); }
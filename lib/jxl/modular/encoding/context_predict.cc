@@ -0,0 +1,119 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "lib/jxl/modular/encoding/context_predict.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "lib/jxl/modular/options.h"
+
+namespace jxl {
+
+namespace {
+
+// Upper bound on the size of the table of a compiled tree.
+constexpr size_t kMaxCompiledCells = 1 << 12;
+// A compiled lookup scans the split values of each property linearly; binary
+// searching them was measured to be slower for the sizes that are worth
+// compiling.
+constexpr size_t kMaxSplitsPerProperty = 8;
+// A traversal does one dependent load and three comparisons per level of the
+// flat tree. Past about two scanned splits per level, the compiled lookup is
+// no longer faster.
+constexpr size_t kMaxSplitsPerLevel = 2;
+// Compiling costs about one traversal per cell; only do it if there are
+// enough lookups to pay for it.
+constexpr size_t kMinLookupsPerCell = 4;
+
+}  // namespace
+
+MATreeLookup::MATreeLookup(const FlatTree &tree, size_t num_lookups)
+    : nodes_(tree) {
+  if (num_lookups < kMinLookupsPerCell) return;
+  // Split values of each property used by the tree.
+  std::vector<std::vector<PropertyVal>> property_splits;
+  const auto add_split = [&](int32_t property, PropertyVal splitval) {
+    // Static properties were resolved by FilterTree, they only remain in
+    // placeholder decisions that lead to the same leaf on both sides.
+    if (property < kNumStaticProperties) return;
+    if (property_splits.size() <= static_cast<size_t>(property)) {
+      property_splits.resize(property + 1);
+    }
+    property_splits[property].push_back(splitval);
+  };
+  // Children always come after their parent in the flat tree.
+  std::vector<uint32_t> depth(tree.size());
+  size_t max_depth = 0;
+  for (size_t pos = 0; pos < tree.size(); pos++) {
+    const FlatDecisionNode &node = tree[pos];
+    if (node.property0 < 0) continue;
+    for (size_t i = 0; i < 4; i++) depth[node.childID + i] = depth[pos] + 1;
+    max_depth = std::max<size_t>(max_depth, depth[pos] + 1);
+    add_split(node.property0, node.splitval0);
+    add_split(node.properties[0], node.splitvals[0]);
+    add_split(node.properties[1], node.splitvals[1]);
+  }
+  size_t num_cells = 1;
+  size_t total_splits = 0;
+  for (std::vector<PropertyVal> &splits : property_splits) {
+    if (splits.empty()) continue;
+    std::sort(splits.begin(), splits.end());
+    splits.erase(std::unique(splits.begin(), splits.end()), splits.end());
+    num_cells *= splits.size() + 1;
+    total_splits += splits.size();
+    if (splits.size() > kMaxSplitsPerProperty ||
+        total_splits > kMaxSplitsPerLevel * max_depth ||
+        num_cells > kMaxCompiledCells ||
+        num_cells * kMinLookupsPerCell > num_lookups) {
+      return;
+    }
+  }
+  // A single leaf is already as fast as it gets.
+  if (num_cells == 1) return;
+
+  size_t stride = 1;
+  for (size_t property = 0; property < property_splits.size(); property++) {
+    const std::vector<PropertyVal> &splits = property_splits[property];
+    if (splits.empty()) continue;
+    CompiledProperty compiled;
+    compiled.property = property;
+    compiled.splits_begin = splits_.size();
+    splits_.insert(splits_.end(), splits.begin(), splits.end());
+    compiled.splits_end = splits_.size();
+    compiled.stride = stride;
+    compiled_properties_.push_back(compiled);
+    stride *= splits.size() + 1;
+  }
+
+  // The decisions of the tree only depend on the interval of each property,
+  // so evaluating it once for a value of each interval gives the leaf of the
+  // whole cell.
+  Properties properties(std::max<size_t>(property_splits.size(),
+                                         kNumStaticProperties));
+  std::vector<uint32_t> leaf_table(num_cells);
+  for (size_t cell = 0; cell < num_cells; cell++) {
+    for (const CompiledProperty &compiled : compiled_properties_) {
+      const size_t num_splits = compiled.splits_end - compiled.splits_begin;
+      const size_t interval = (cell / compiled.stride) % (num_splits + 1);
+      const PropertyVal *splits = splits_.data() + compiled.splits_begin;
+      PropertyVal value = splits[0];
+      if (interval > 0) {
+        value = splits[interval - 1];
+        // The last interval is empty if the split is the largest value.
+        if (value < std::numeric_limits<PropertyVal>::max()) value++;
+      }
+      properties[compiled.property] = value;
+    }
+    leaf_table[cell] = FindLeaf(properties);
+  }
+  leaf_table_ = std::move(leaf_table);
+}
+
+}  // namespace jxl
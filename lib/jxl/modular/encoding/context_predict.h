@@ -312,7 +312,13 @@ using FlatTree = std::vector<FlatDecisionNode>;
 
 class MATreeLookup {
  public:
-  explicit MATreeLookup(const FlatTree &tree) : nodes_(tree) {}
+  // If `num_lookups` is large enough to amortize it and the tree splits on few
+  // distinct values compared to its depth, the tree is compiled into a table
+  // indexed by the interval of each used property between its split values. A
+  // lookup is then a few branchless comparisons and one load, instead of a
+  // traversal with a dependent load per level. Other trees are traversed.
+  explicit MATreeLookup(const FlatTree &tree, size_t num_lookups = 0);
+
   struct LookupResult {
     uint32_t context;
     Predictor predictor;
@@ -320,15 +326,24 @@ class MATreeLookup {
     int32_t multiplier;
   };
   JXL_INLINE LookupResult Lookup(const Properties &properties) const {
+    const FlatDecisionNode &leaf =
+        nodes_[leaf_table_.empty() ? FindLeaf(properties)
+                                   : CompiledFindLeaf(properties)];
+    return {leaf.childID, leaf.predictor, leaf.predictor_offset,
+            leaf.multiplier};
+  }
+
+  bool IsCompiled() const { return !leaf_table_.empty(); }
+
+ private:
+  // Returns the position of the leaf selected by `properties`.
+  JXL_INLINE uint32_t FindLeaf(const Properties &properties) const {
     uint32_t pos = 0;
     while (true) {
 #define TRAVERSE_THE_TREE                                                      \
   {                                                                            \
     const FlatDecisionNode &node = nodes_[pos];                                \
-    if (node.property0 < 0) {                                                  \
-      return {node.childID, node.predictor, node.predictor_offset,             \
-              node.multiplier};                                                \
-    }                                                                          \
+    if (node.property0 < 0) return pos;                                        \
     bool p0 = properties[node.property0] <= node.splitval0;                    \
     uint32_t off0 = properties[node.properties[0]] <= node.splitvals[0];       \
     uint32_t off1 = 2 | (properties[node.properties[1]] <= node.splitvals[1]); \
@@ -338,10 +353,36 @@ class MATreeLookup {
       TRAVERSE_THE_TREE;
       TRAVERSE_THE_TREE;
     }
+#undef TRAVERSE_THE_TREE
   }
 
- private:
+  JXL_INLINE uint32_t CompiledFindLeaf(const Properties &properties) const {
+    size_t cell = 0;
+    for (const CompiledProperty &compiled : compiled_properties_) {
+      const PropertyVal value = properties[compiled.property];
+      size_t interval = 0;
+      for (uint32_t i = compiled.splits_begin; i < compiled.splits_end; i++) {
+        interval += value > splits_[i];
+      }
+      cell += interval * compiled.stride;
+    }
+    return leaf_table_[cell];
+  }
+
+  struct CompiledProperty {
+    uint32_t property;
+    // Sorted split values of the property are splits_[begin, end).
+    uint32_t splits_begin;
+    uint32_t splits_end;
+    uint32_t stride;
+  };
+
   const FlatTree &nodes_;
+  std::vector<CompiledProperty> compiled_properties_;
+  std::vector<PropertyVal> splits_;
+  // Leaf position for each combination of property intervals, or empty if the
+  // tree is not compiled.
+  std::vector<uint32_t> leaf_table_;
 };
 
 static constexpr size_t kExtraPropsPerChannel = 4;
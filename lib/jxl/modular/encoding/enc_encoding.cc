@@ -294,7 +294,7 @@ StatusOr<Tree> LearnTree(
     TreeSamples &&tree_samples, size_t total_pixels,
     const ModularOptions &options,
     const std::vector<ModularMultiplierInfo> &multiplier_info = {},
-    StaticPropRange static_prop_range = {}) {
+    StaticPropRange static_prop_range = {}, ThreadPool *pool = nullptr) {
   Tree tree;
   for (size_t i = 0; i < kNumStaticProperties; i++) {
     if (static_prop_range[i][1] == 0) {
@@ -315,7 +315,7 @@ StatusOr<Tree> LearnTree(
   JXL_RETURN_IF_ERROR(ComputeBestTree(
       tree_samples, options.splitting_heuristics_node_threshold * required_cost,
       multiplier_info, static_prop_range, options.fast_decode_multiplier,
-      &tree));
+      &tree, pool));
   return tree;
 }
 
@@ -350,7 +350,7 @@ Status EncodeModularChannelMAANS(const Image &image, pixel_type chan,
   FlatTree tree = FilterTree(global_tree, static_props, &num_props, &use_wp,
                              &is_wp_only, &is_gradient_only);
   Properties properties(num_props);
-  MATreeLookup tree_lookup(tree);
+  MATreeLookup tree_lookup(tree, channel.w * channel.h);
   JXL_DEBUG_V(3, "Encoding using a MA tree with %" PRIuS " nodes", tree.size());
 
   // Check if this tree is a WP-only tree with a small enough property value
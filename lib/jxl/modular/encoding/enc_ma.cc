@@ -10,6 +10,7 @@
 #include <limits>
 #include <numeric>
 #include <queue>
+#include <utility>
 #include <vector>
 
 #include "lib/jxl/modular/encoding/ma_common.h"
@@ -19,6 +20,7 @@
 #include <hwy/foreach_target.h>
 #include <hwy/highway.h>
 
+#include "lib/jxl/base/data_parallel.h"
 #include "lib/jxl/base/fast_math-inl.h"
 #include "lib/jxl/base/random.h"
 #include "lib/jxl/enc_ans.h"
@@ -160,311 +162,492 @@ void SplitTreeSamples(TreeSamples &tree_samples, size_t begin, size_t pos,
   }
 }
 
-void FindBestSplit(TreeSamples &tree_samples, float threshold,
-                   const std::vector<ModularMultiplierInfo> &mul_info,
-                   StaticPropRange initial_static_prop_range,
-                   float fast_decode_multiplier, Tree *tree) {
-  struct NodeInfo {
-    size_t pos;
-    size_t begin;
-    size_t end;
-    uint64_t used_properties;
-    StaticPropRange static_prop_range;
-  };
-  std::vector<NodeInfo> nodes;
-  nodes.push_back(NodeInfo{0, 0, tree_samples.NumDistinctSamples(), 0,
-                           initial_static_prop_range});
+struct SplitInfo {
+  size_t prop = 0;
+  uint32_t val = 0;
+  size_t pos = 0;
+  float lcost = std::numeric_limits<float>::max();
+  float rcost = std::numeric_limits<float>::max();
+  Predictor lpred = Predictor::Zero;
+  Predictor rpred = Predictor::Zero;
+  float Cost() const { return lcost + rcost; }
+};
 
-  size_t num_predictors = tree_samples.NumPredictors();
-  size_t num_properties = tree_samples.NumProperties();
+// The best split of each kind is tracked separately, and the final choice
+// between them is made once all properties have been tried.
+enum SplitKind : size_t {
+  kSplitStaticConstant,
+  kSplitStatic,
+  kSplitNonstatic,
+  kSplitNowp,
+  kNumSplitKinds
+};
 
-  // TODO(veluca): consider parallelizing the search (processing multiple nodes
-  // at a time).
-  while (!nodes.empty()) {
-    size_t pos = nodes.back().pos;
-    size_t begin = nodes.back().begin;
-    size_t end = nodes.back().end;
-    uint64_t used_properties = nodes.back().used_properties;
-    StaticPropRange static_prop_range = nodes.back().static_prop_range;
-    nodes.pop_back();
-    if (begin == end) continue;
-
-    struct SplitInfo {
-      size_t prop = 0;
-      uint32_t val = 0;
-      size_t pos = 0;
-      float lcost = std::numeric_limits<float>::max();
-      float rcost = std::numeric_limits<float>::max();
-      Predictor lpred = Predictor::Zero;
-      Predictor rpred = Predictor::Zero;
-      float Cost() const { return lcost + rcost; }
-    };
+struct CostInfo {
+  float cost = std::numeric_limits<float>::max();
+  float extra_cost = 0;
+  float Cost() const { return cost + extra_cost; }
+  Predictor pred;  // will be uninitialized in some cases, but never used.
+};
 
-    SplitInfo best_split_static_constant;
-    SplitInfo best_split_static;
-    SplitInfo best_split_nonstatic;
-    SplitInfo best_split_nowp;
+// A node of the tree being learned. Its samples are [begin, end).
+struct LearnNode {
+  size_t begin;
+  size_t end;
+  uint64_t used_properties;
+  StaticPropRange static_prop_range;
+  Predictor predictor;
+  bool has_multiplier = false;
+  uint32_t multiplier = 1;
+  // Set if the node is split on `property` > `splitval`.
+  bool split = false;
+  int property = 0;
+  int splitval = 0;
+  Predictor lpred = Predictor::Zero;
+  Predictor rpred = Predictor::Zero;
+  // Children with the samples whose property is at most / greater than
+  // `splitval`.
+  size_t below = 0;
+  size_t above = 0;
+};
 
-    JXL_DASSERT(begin <= end);
-    JXL_DASSERT(end <= tree_samples.NumDistinctSamples());
+// Histograms of the samples of a node.
+struct NodeHistograms {
+  size_t max_symbols = 0;
+  std::vector<int32_t> counts;
+  std::vector<uint32_t> tot_extra_bits;
+  float base_bits = 0;
+  bool has_forced_split = false;
+  SplitInfo forced_split;
+  // Whether the properties have to be searched for a split.
+  bool search = false;
+};
 
-    // Compute the maximum token in the range.
-    size_t max_symbols = 0;
-    for (size_t pred = 0; pred < num_predictors; pred++) {
-      for (size_t i = begin; i < end; i++) {
-        uint32_t tok = tree_samples.Token(pred, i);
-        max_symbols = max_symbols > tok + 1 ? max_symbols : tok + 1;
-      }
+// Buffers of the search along one property, one set per thread.
+// `count_increase` and `extra_bits_increase` are all zeros between searches.
+struct PropertySearchBuffers {
+  std::vector<int> prop_value_used_count;
+  std::vector<int> count_increase;
+  std::vector<size_t> extra_bits_increase;
+  std::vector<CostInfo> costs_l;
+  std::vector<CostInfo> costs_r;
+  std::vector<int32_t> counts_above;
+  std::vector<int32_t> counts_below;
+};
+
+// A range of samples to reorder according to the winning property.
+struct SamplesSplit {
+  size_t begin;
+  size_t pos;
+  size_t end;
+  size_t prop;
+};
+
+void ComputeNodeHistograms(const TreeSamples &tree_samples, float threshold,
+                           const std::vector<ModularMultiplierInfo> &mul_info,
+                           LearnNode *node, NodeHistograms *histograms) {
+  const size_t begin = node->begin;
+  const size_t end = node->end;
+  if (begin == end) return;
+  JXL_DASSERT(begin <= end);
+  JXL_DASSERT(end <= tree_samples.NumDistinctSamples());
+  size_t num_predictors = tree_samples.NumPredictors();
+
+  // Compute the maximum token in the range.
+  size_t max_symbols = 0;
+  for (size_t pred = 0; pred < num_predictors; pred++) {
+    for (size_t i = begin; i < end; i++) {
+      uint32_t tok = tree_samples.Token(pred, i);
+      max_symbols = max_symbols > tok + 1 ? max_symbols : tok + 1;
     }
-    max_symbols = Padded(max_symbols);
-    std::vector<int32_t> counts(max_symbols * num_predictors);
-    std::vector<uint32_t> tot_extra_bits(num_predictors);
-    for (size_t pred = 0; pred < num_predictors; pred++) {
-      for (size_t i = begin; i < end; i++) {
-        counts[pred * max_symbols + tree_samples.Token(pred, i)] +=
-            tree_samples.Count(i);
-        tot_extra_bits[pred] +=
-            tree_samples.NBits(pred, i) * tree_samples.Count(i);
+  }
+  max_symbols = Padded(max_symbols);
+  std::vector<int32_t> &counts = histograms->counts;
+  std::vector<uint32_t> &tot_extra_bits = histograms->tot_extra_bits;
+  counts.resize(max_symbols * num_predictors);
+  tot_extra_bits.resize(num_predictors);
+  for (size_t pred = 0; pred < num_predictors; pred++) {
+    for (size_t i = begin; i < end; i++) {
+      counts[pred * max_symbols + tree_samples.Token(pred, i)] +=
+          tree_samples.Count(i);
+      tot_extra_bits[pred] +=
+          tree_samples.NBits(pred, i) * tree_samples.Count(i);
+    }
+  }
+  histograms->max_symbols = max_symbols;
+
+  float base_bits;
+  {
+    size_t pred = tree_samples.PredictorIndex(node->predictor);
+    base_bits = EstimateBits(counts.data() + pred * max_symbols, max_symbols) +
+                tot_extra_bits[pred];
+  }
+  histograms->base_bits = base_bits;
+
+  // The multiplier ranges cut halfway through the current ranges of static
+  // properties. We do this even if the current node is not a leaf, to
+  // minimize the number of nodes in the resulting tree.
+  for (const auto &mmi : mul_info) {
+    uint32_t axis;
+    uint32_t val;
+    IntersectionType t =
+        BoxIntersects(node->static_prop_range, mmi.range, axis, val);
+    if (t == IntersectionType::kNone) continue;
+    if (t == IntersectionType::kInside) {
+      node->has_multiplier = true;
+      node->multiplier = mmi.multiplier;
+      break;
+    }
+    if (t == IntersectionType::kPartial) {
+      SplitInfo *best = &histograms->forced_split;
+      best->val = tree_samples.QuantizeProperty(axis, val);
+      best->prop = axis;
+      best->lcost = best->rcost = base_bits / 2 - threshold;
+      best->lpred = best->rpred = node->predictor;
+      best->pos = begin;
+      JXL_DASSERT(best->prop == tree_samples.PropertyFromIndex(best->prop));
+      for (size_t x = begin; x < end; x++) {
+        if (tree_samples.Property(best->prop, x) <= best->val) {
+          best->pos++;
+        }
       }
+      histograms->has_forced_split = true;
+      break;
     }
+  }
+  histograms->search = !histograms->has_forced_split && base_bits > threshold;
+}
 
-    float base_bits;
-    {
-      size_t pred = tree_samples.PredictorIndex((*tree)[pos].predictor);
-      base_bits =
-          EstimateBits(counts.data() + pred * max_symbols, max_symbols) +
-          tot_extra_bits[pred];
-    }
-
-    SplitInfo *best = &best_split_nonstatic;
-
-    SplitInfo forced_split;
-    // The multiplier ranges cut halfway through the current ranges of static
-    // properties. We do this even if the current node is not a leaf, to
-    // minimize the number of nodes in the resulting tree.
-    for (const auto &mmi : mul_info) {
-      uint32_t axis;
-      uint32_t val;
-      IntersectionType t =
-          BoxIntersects(static_prop_range, mmi.range, axis, val);
-      if (t == IntersectionType::kNone) continue;
-      if (t == IntersectionType::kInside) {
-        (*tree)[pos].multiplier = mmi.multiplier;
-        break;
+// Finds the best split of each kind along property `prop`.
+void FindPropertySplits(const TreeSamples &tree_samples, float threshold,
+                        const LearnNode &node,
+                        const NodeHistograms &histograms, size_t prop,
+                        PropertySearchBuffers *buffers, SplitInfo *best_splits) {
+  const size_t begin = node.begin;
+  const size_t end = node.end;
+  const size_t max_symbols = histograms.max_symbols;
+  const std::vector<int32_t> &counts = histograms.counts;
+  const std::vector<uint32_t> &tot_extra_bits = histograms.tot_extra_bits;
+  size_t num_predictors = tree_samples.NumPredictors();
+  std::vector<int> &prop_value_used_count = buffers->prop_value_used_count;
+  std::vector<int> &count_increase = buffers->count_increase;
+  std::vector<size_t> &extra_bits_increase = buffers->extra_bits_increase;
+  std::vector<CostInfo> &costs_l = buffers->costs_l;
+  std::vector<CostInfo> &costs_r = buffers->costs_r;
+  std::vector<int32_t> &counts_above = buffers->counts_above;
+  std::vector<int32_t> &counts_below = buffers->counts_below;
+  // For the property, compute which of its values are used, and what
+  // tokens correspond to those usages. Then, iterate through the values,
+  // and compute the entropy of each side of the split (of the form `prop >
+  // threshold`). Finally, find the split that minimizes the cost.
+
+  // The lower the threshold, the higher the expected noisiness of the
+  // estimate. Thus, discourage changing predictors.
+  float change_pred_penalty = 800.0f / (100.0f + threshold);
+  costs_l.clear();
+  costs_r.clear();
+  if (counts_above.size() < max_symbols) {
+    counts_above.resize(max_symbols);
+    counts_below.resize(max_symbols);
+  }
+  size_t prop_size = tree_samples.NumPropertyValues(prop);
+  if (count_increase.size() < prop_size * max_symbols) {
+    count_increase.resize(prop_size * max_symbols);
+  }
+  if (extra_bits_increase.size() < prop_size) {
+    extra_bits_increase.resize(prop_size);
+  }
+  // Clear prop_value_used_count (which cannot be cleared "on the go")
+  prop_value_used_count.clear();
+  prop_value_used_count.resize(prop_size);
+
+  size_t first_used = prop_size;
+  size_t last_used = 0;
+
+  // TODO(veluca): consider finding multiple splits along a single
+  // property at the same time, possibly with a bottom-up approach.
+  for (size_t i = begin; i < end; i++) {
+    size_t p = tree_samples.Property(prop, i);
+    prop_value_used_count[p]++;
+    last_used = std::max(last_used, p);
+    first_used = std::min(first_used, p);
+  }
+  costs_l.resize(last_used - first_used);
+  costs_r.resize(last_used - first_used);
+  // For all predictors, compute the right and left costs of each split.
+  for (size_t pred = 0; pred < num_predictors; pred++) {
+    // Compute cost and histogram increments for each property value.
+    for (size_t i = begin; i < end; i++) {
+      size_t p = tree_samples.Property(prop, i);
+      size_t cnt = tree_samples.Count(i);
+      size_t sym = tree_samples.Token(pred, i);
+      count_increase[p * max_symbols + sym] += cnt;
+      extra_bits_increase[p] += tree_samples.NBits(pred, i) * cnt;
+    }
+    memcpy(counts_above.data(), counts.data() + pred * max_symbols,
+           max_symbols * sizeof counts_above[0]);
+    memset(counts_below.data(), 0, max_symbols * sizeof counts_below[0]);
+    size_t extra_bits_below = 0;
+    // Exclude last used: this ensures neither counts_above nor
+    // counts_below is empty.
+    for (size_t i = first_used; i < last_used; i++) {
+      if (!prop_value_used_count[i]) continue;
+      extra_bits_below += extra_bits_increase[i];
+      // The increase for this property value has been used, and will not
+      // be used again: clear it. Also below.
+      extra_bits_increase[i] = 0;
+      for (size_t sym = 0; sym < max_symbols; sym++) {
+        counts_above[sym] -= count_increase[i * max_symbols + sym];
+        counts_below[sym] += count_increase[i * max_symbols + sym];
+        count_increase[i * max_symbols + sym] = 0;
       }
-      if (t == IntersectionType::kPartial) {
-        forced_split.val = tree_samples.QuantizeProperty(axis, val);
-        forced_split.prop = axis;
-        forced_split.lcost = forced_split.rcost = base_bits / 2 - threshold;
-        forced_split.lpred = forced_split.rpred = (*tree)[pos].predictor;
-        best = &forced_split;
-        best->pos = begin;
-        JXL_DASSERT(best->prop == tree_samples.PropertyFromIndex(best->prop));
-        for (size_t x = begin; x < end; x++) {
-          if (tree_samples.Property(best->prop, x) <= best->val) {
-            best->pos++;
-          }
-        }
-        break;
+      float rcost = EstimateBits(counts_above.data(), max_symbols) +
+                    tot_extra_bits[pred] - extra_bits_below;
+      float lcost =
+          EstimateBits(counts_below.data(), max_symbols) + extra_bits_below;
+      JXL_DASSERT(extra_bits_below <= tot_extra_bits[pred]);
+      float penalty = 0;
+      // Never discourage moving away from the Weighted predictor.
+      if (tree_samples.PredictorFromIndex(pred) != node.predictor &&
+          node.predictor != Predictor::Weighted) {
+        penalty = change_pred_penalty;
+      }
+      // If everything else is equal, disfavour Weighted (slower) and
+      // favour Zero (faster if it's the only predictor used in a
+      // group+channel combination)
+      if (tree_samples.PredictorFromIndex(pred) == Predictor::Weighted) {
+        penalty += 1e-8;
+      }
+      if (tree_samples.PredictorFromIndex(pred) == Predictor::Zero) {
+        penalty -= 1e-8;
+      }
+      if (rcost + penalty < costs_r[i - first_used].Cost()) {
+        costs_r[i - first_used].cost = rcost;
+        costs_r[i - first_used].extra_cost = penalty;
+        costs_r[i - first_used].pred = tree_samples.PredictorFromIndex(pred);
+      }
+      if (lcost + penalty < costs_l[i - first_used].Cost()) {
+        costs_l[i - first_used].cost = lcost;
+        costs_l[i - first_used].extra_cost = penalty;
+        costs_l[i - first_used].pred = tree_samples.PredictorFromIndex(pred);
       }
     }
+  }
+  // Iterate through the possible splits and find the one with minimum sum
+  // of costs of the two sides.
+  size_t split = begin;
+  for (size_t i = first_used; i < last_used; i++) {
+    if (!prop_value_used_count[i]) continue;
+    split += prop_value_used_count[i];
+    float rcost = costs_r[i - first_used].cost;
+    float lcost = costs_l[i - first_used].cost;
+    // WP was not used + we would use the WP property or predictor
+    bool adds_wp =
+        (tree_samples.PropertyFromIndex(prop) == kWPProp &&
+         (node.used_properties & (1LU << prop)) == 0) ||
+        ((costs_l[i - first_used].pred == Predictor::Weighted ||
+          costs_r[i - first_used].pred == Predictor::Weighted) &&
+         node.predictor != Predictor::Weighted);
+    bool zero_entropy_side = rcost == 0 || lcost == 0;
 
-    if (best != &forced_split) {
-      std::vector<int> prop_value_used_count;
-      std::vector<int> count_increase;
-      std::vector<size_t> extra_bits_increase;
-      // For each property, compute which of its values are used, and what
-      // tokens correspond to those usages. Then, iterate through the values,
-      // and compute the entropy of each side of the split (of the form `prop >
-      // threshold`). Finally, find the split that minimizes the cost.
-      struct CostInfo {
-        float cost = std::numeric_limits<float>::max();
-        float extra_cost = 0;
-        float Cost() const { return cost + extra_cost; }
-        Predictor pred;  // will be uninitialized in some cases, but never used.
-      };
-      std::vector<CostInfo> costs_l;
-      std::vector<CostInfo> costs_r;
-
-      std::vector<int32_t> counts_above(max_symbols);
-      std::vector<int32_t> counts_below(max_symbols);
-
-      // The lower the threshold, the higher the expected noisiness of the
-      // estimate. Thus, discourage changing predictors.
-      float change_pred_penalty = 800.0f / (100.0f + threshold);
-      for (size_t prop = 0; prop < num_properties && base_bits > threshold;
-           prop++) {
-        costs_l.clear();
-        costs_r.clear();
-        size_t prop_size = tree_samples.NumPropertyValues(prop);
-        if (extra_bits_increase.size() < prop_size) {
-          count_increase.resize(prop_size * max_symbols);
-          extra_bits_increase.resize(prop_size);
-        }
-        // Clear prop_value_used_count (which cannot be cleared "on the go")
-        prop_value_used_count.clear();
-        prop_value_used_count.resize(prop_size);
-
-        size_t first_used = prop_size;
-        size_t last_used = 0;
-
-        // TODO(veluca): consider finding multiple splits along a single
-        // property at the same time, possibly with a bottom-up approach.
-        for (size_t i = begin; i < end; i++) {
-          size_t p = tree_samples.Property(prop, i);
-          prop_value_used_count[p]++;
-          last_used = std::max(last_used, p);
-          first_used = std::min(first_used, p);
-        }
-        costs_l.resize(last_used - first_used);
-        costs_r.resize(last_used - first_used);
-        // For all predictors, compute the right and left costs of each split.
-        for (size_t pred = 0; pred < num_predictors; pred++) {
-          // Compute cost and histogram increments for each property value.
-          for (size_t i = begin; i < end; i++) {
-            size_t p = tree_samples.Property(prop, i);
-            size_t cnt = tree_samples.Count(i);
-            size_t sym = tree_samples.Token(pred, i);
-            count_increase[p * max_symbols + sym] += cnt;
-            extra_bits_increase[p] += tree_samples.NBits(pred, i) * cnt;
-          }
-          memcpy(counts_above.data(), counts.data() + pred * max_symbols,
-                 max_symbols * sizeof counts_above[0]);
-          memset(counts_below.data(), 0, max_symbols * sizeof counts_below[0]);
-          size_t extra_bits_below = 0;
-          // Exclude last used: this ensures neither counts_above nor
-          // counts_below is empty.
-          for (size_t i = first_used; i < last_used; i++) {
-            if (!prop_value_used_count[i]) continue;
-            extra_bits_below += extra_bits_increase[i];
-            // The increase for this property value has been used, and will not
-            // be used again: clear it. Also below.
-            extra_bits_increase[i] = 0;
-            for (size_t sym = 0; sym < max_symbols; sym++) {
-              counts_above[sym] -= count_increase[i * max_symbols + sym];
-              counts_below[sym] += count_increase[i * max_symbols + sym];
-              count_increase[i * max_symbols + sym] = 0;
-            }
-            float rcost = EstimateBits(counts_above.data(), max_symbols) +
-                          tot_extra_bits[pred] - extra_bits_below;
-            float lcost = EstimateBits(counts_below.data(), max_symbols) +
-                          extra_bits_below;
-            JXL_DASSERT(extra_bits_below <= tot_extra_bits[pred]);
-            float penalty = 0;
-            // Never discourage moving away from the Weighted predictor.
-            if (tree_samples.PredictorFromIndex(pred) !=
-                    (*tree)[pos].predictor &&
-                (*tree)[pos].predictor != Predictor::Weighted) {
-              penalty = change_pred_penalty;
-            }
-            // If everything else is equal, disfavour Weighted (slower) and
-            // favour Zero (faster if it's the only predictor used in a
-            // group+channel combination)
-            if (tree_samples.PredictorFromIndex(pred) == Predictor::Weighted) {
-              penalty += 1e-8;
-            }
-            if (tree_samples.PredictorFromIndex(pred) == Predictor::Zero) {
-              penalty -= 1e-8;
-            }
-            if (rcost + penalty < costs_r[i - first_used].Cost()) {
-              costs_r[i - first_used].cost = rcost;
-              costs_r[i - first_used].extra_cost = penalty;
-              costs_r[i - first_used].pred =
-                  tree_samples.PredictorFromIndex(pred);
-            }
-            if (lcost + penalty < costs_l[i - first_used].Cost()) {
-              costs_l[i - first_used].cost = lcost;
-              costs_l[i - first_used].extra_cost = penalty;
-              costs_l[i - first_used].pred =
-                  tree_samples.PredictorFromIndex(pred);
+    SplitInfo &best =
+        best_splits[prop < kNumStaticProperties
+                        ? (zero_entropy_side ? kSplitStaticConstant
+                                             : kSplitStatic)
+                        : (adds_wp ? kSplitNonstatic : kSplitNowp)];
+    if (lcost + rcost < best.Cost()) {
+      best.prop = prop;
+      best.val = i;
+      best.pos = split;
+      best.lcost = lcost;
+      best.lpred = costs_l[i - first_used].pred;
+      best.rcost = rcost;
+      best.rpred = costs_r[i - first_used].pred;
+    }
+  }
+  // Clear extra_bits_increase and cost_increase for last_used.
+  extra_bits_increase[last_used] = 0;
+  for (size_t sym = 0; sym < max_symbols; sym++) {
+    count_increase[last_used * max_symbols + sym] = 0;
+  }
+}
+
+// The nodes are searched one level of the tree at a time, in parallel across
+// nodes and properties: the search of a node only reads its own samples, and
+// the nodes of a level own disjoint ranges of samples. The candidates of the
+// properties are then compared in property order, as a serial search would,
+// and the tree is emitted in depth-first order at the end, so the result does
+// not depend on the number of threads.
+Status FindBestSplit(TreeSamples &tree_samples, float threshold,
+                     const std::vector<ModularMultiplierInfo> &mul_info,
+                     StaticPropRange initial_static_prop_range,
+                     float fast_decode_multiplier, Tree *tree,
+                     ThreadPool *pool) {
+  std::vector<LearnNode> nodes(1);
+  nodes[0].begin = 0;
+  nodes[0].end = tree_samples.NumDistinctSamples();
+  nodes[0].used_properties = 0;
+  nodes[0].static_prop_range = initial_static_prop_range;
+  nodes[0].predictor = (*tree)[0].predictor;
+
+  size_t num_properties = tree_samples.NumProperties();
+
+  std::vector<size_t> level = {0};
+  std::vector<size_t> next_level;
+  std::vector<NodeHistograms> histograms;
+  std::vector<SplitInfo> candidates;
+  std::vector<PropertySearchBuffers> buffers;
+  std::vector<SamplesSplit> samples_splits;
+  while (!level.empty()) {
+    histograms.clear();
+    histograms.resize(level.size());
+    const auto compute_histograms = [&](const uint32_t i,
+                                        size_t /* thread */) -> Status {
+      ComputeNodeHistograms(tree_samples, threshold, mul_info,
+                            &nodes[level[i]], &histograms[i]);
+      return true;
+    };
+    JXL_RETURN_IF_ERROR(RunOnPool(pool, 0, level.size(), ThreadPool::NoInit,
+                                  compute_histograms, "MAHistograms"));
+
+    candidates.assign(level.size() * num_properties * kNumSplitKinds,
+                      SplitInfo());
+    const auto init_buffers = [&](size_t num_threads) -> Status {
+      if (buffers.size() < num_threads) buffers.resize(num_threads);
+      return true;
+    };
+    const auto find_splits = [&](const uint32_t task,
+                                 size_t thread) -> Status {
+      size_t i = task / num_properties;
+      if (!histograms[i].search) return true;
+      FindPropertySplits(tree_samples, threshold, nodes[level[i]],
+                         histograms[i], task % num_properties,
+                         &buffers[thread], &candidates[task * kNumSplitKinds]);
+      return true;
+    };
+    JXL_RETURN_IF_ERROR(RunOnPool(pool, 0, level.size() * num_properties,
+                                  init_buffers, find_splits, "MASplits"));
+
+    next_level.clear();
+    samples_splits.clear();
+    for (size_t i = 0; i < level.size(); i++) {
+      const size_t id = level[i];
+      if (nodes[id].begin == nodes[id].end) continue;
+      const NodeHistograms &node_histograms = histograms[i];
+      float base_bits = node_histograms.base_bits;
+      SplitInfo best_splits[kNumSplitKinds];
+      const SplitInfo *best = &best_splits[kSplitNonstatic];
+      if (node_histograms.has_forced_split) {
+        best = &node_histograms.forced_split;
+      } else {
+        const SplitInfo *node_candidates =
+            &candidates[i * num_properties * kNumSplitKinds];
+        for (size_t prop = 0; prop < num_properties; prop++) {
+          for (size_t kind = 0; kind < kNumSplitKinds; kind++) {
+            const SplitInfo &candidate =
+                node_candidates[prop * kNumSplitKinds + kind];
+            if (candidate.Cost() < best_splits[kind].Cost()) {
+              best_splits[kind] = candidate;
             }
           }
         }
-        // Iterate through the possible splits and find the one with minimum sum
-        // of costs of the two sides.
-        size_t split = begin;
-        for (size_t i = first_used; i < last_used; i++) {
-          if (!prop_value_used_count[i]) continue;
-          split += prop_value_used_count[i];
-          float rcost = costs_r[i - first_used].cost;
-          float lcost = costs_l[i - first_used].cost;
-          // WP was not used + we would use the WP property or predictor
-          bool adds_wp =
-              (tree_samples.PropertyFromIndex(prop) == kWPProp &&
-               (used_properties & (1LU << prop)) == 0) ||
-              ((costs_l[i - first_used].pred == Predictor::Weighted ||
-                costs_r[i - first_used].pred == Predictor::Weighted) &&
-               (*tree)[pos].predictor != Predictor::Weighted);
-          bool zero_entropy_side = rcost == 0 || lcost == 0;
-
-          SplitInfo &best =
-              prop < kNumStaticProperties
-                  ? (zero_entropy_side ? best_split_static_constant
-                                       : best_split_static)
-                  : (adds_wp ? best_split_nonstatic : best_split_nowp);
-          if (lcost + rcost < best.Cost()) {
-            best.prop = prop;
-            best.val = i;
-            best.pos = split;
-            best.lcost = lcost;
-            best.lpred = costs_l[i - first_used].pred;
-            best.rcost = rcost;
-            best.rpred = costs_r[i - first_used].pred;
-          }
+        // Try to avoid introducing WP.
+        if (best_splits[kSplitNowp].Cost() + threshold < base_bits &&
+            best_splits[kSplitNowp].Cost() <=
+                fast_decode_multiplier * best->Cost()) {
+          best = &best_splits[kSplitNowp];
         }
-        // Clear extra_bits_increase and cost_increase for last_used.
-        extra_bits_increase[last_used] = 0;
-        for (size_t sym = 0; sym < max_symbols; sym++) {
-          count_increase[last_used * max_symbols + sym] = 0;
+        // Split along static props if possible and not significantly more
+        // expensive.
+        if (best_splits[kSplitStatic].Cost() + threshold < base_bits &&
+            best_splits[kSplitStatic].Cost() <=
+                fast_decode_multiplier * best->Cost()) {
+          best = &best_splits[kSplitStatic];
+        }
+        // Split along static props to create constant nodes if possible.
+        if (best_splits[kSplitStaticConstant].Cost() + threshold < base_bits) {
+          best = &best_splits[kSplitStaticConstant];
         }
       }
 
-      // Try to avoid introducing WP.
-      if (best_split_nowp.Cost() + threshold < base_bits &&
-          best_split_nowp.Cost() <= fast_decode_multiplier * best->Cost()) {
-        best = &best_split_nowp;
-      }
-      // Split along static props if possible and not significantly more
-      // expensive.
-      if (best_split_static.Cost() + threshold < base_bits &&
-          best_split_static.Cost() <= fast_decode_multiplier * best->Cost()) {
-        best = &best_split_static;
-      }
-      // Split along static props to create constant nodes if possible.
-      if (best_split_static_constant.Cost() + threshold < base_bits) {
-        best = &best_split_static_constant;
+      if (best->Cost() + threshold < base_bits) {
+        uint32_t p = tree_samples.PropertyFromIndex(best->prop);
+        pixel_type dequant =
+            tree_samples.UnquantizeProperty(best->prop, best->val);
+        LearnNode node = nodes[id];
+        node.split = true;
+        node.property = p;
+        node.splitval = dequant;
+        node.lpred = best->lpred;
+        node.rpred = best->rpred;
+        // "Sort" according to winning property
+        samples_splits.push_back(
+            SamplesSplit{node.begin, best->pos, node.end, best->prop});
+        uint64_t used_properties = node.used_properties;
+        if (p >= kNumStaticProperties) {
+          used_properties |= 1 << best->prop;
+        }
+        LearnNode child;
+        child.used_properties = used_properties;
+        child.begin = node.begin;
+        child.end = best->pos;
+        child.predictor = best->lpred;
+        child.static_prop_range = node.static_prop_range;
+        if (p < kNumStaticProperties) {
+          JXL_DASSERT(static_cast<uint32_t>(dequant + 1) <=
+                      child.static_prop_range[p][1]);
+          child.static_prop_range[p][1] = dequant + 1;
+          JXL_DASSERT(child.static_prop_range[p][0] <
+                      child.static_prop_range[p][1]);
+        }
+        node.below = nodes.size();
+        next_level.push_back(nodes.size());
+        nodes.push_back(child);
+        child.begin = best->pos;
+        child.end = node.end;
+        child.predictor = best->rpred;
+        child.static_prop_range = node.static_prop_range;
+        if (p < kNumStaticProperties) {
+          JXL_DASSERT(child.static_prop_range[p][0] <=
+                      static_cast<uint32_t>(dequant + 1));
+          child.static_prop_range[p][0] = dequant + 1;
+          JXL_DASSERT(child.static_prop_range[p][0] <
+                      child.static_prop_range[p][1]);
+        }
+        node.above = nodes.size();
+        next_level.push_back(nodes.size());
+        nodes.push_back(child);
+        nodes[id] = node;
       }
     }
 
-    if (best->Cost() + threshold < base_bits) {
-      uint32_t p = tree_samples.PropertyFromIndex(best->prop);
-      pixel_type dequant =
-          tree_samples.UnquantizeProperty(best->prop, best->val);
-      // Split node and try to split children.
-      MakeSplitNode(pos, p, dequant, best->lpred, 0, best->rpred, 0, tree);
-      // "Sort" according to winning property
-      SplitTreeSamples(tree_samples, begin, best->pos, end, best->prop);
-      if (p >= kNumStaticProperties) {
-        used_properties |= 1 << best->prop;
-      }
-      auto new_sp_range = static_prop_range;
-      if (p < kNumStaticProperties) {
-        JXL_DASSERT(static_cast<uint32_t>(dequant + 1) <= new_sp_range[p][1]);
-        new_sp_range[p][1] = dequant + 1;
-        JXL_DASSERT(new_sp_range[p][0] < new_sp_range[p][1]);
-      }
-      nodes.push_back(NodeInfo{(*tree)[pos].rchild, begin, best->pos,
-                               used_properties, new_sp_range});
-      new_sp_range = static_prop_range;
-      if (p < kNumStaticProperties) {
-        JXL_DASSERT(new_sp_range[p][0] <= static_cast<uint32_t>(dequant + 1));
-        new_sp_range[p][0] = dequant + 1;
-        JXL_DASSERT(new_sp_range[p][0] < new_sp_range[p][1]);
-      }
-      nodes.push_back(NodeInfo{(*tree)[pos].lchild, best->pos, end,
-                               used_properties, new_sp_range});
-    }
+    const auto split_samples = [&](const uint32_t i,
+                                   size_t /* thread */) -> Status {
+      const SamplesSplit &split = samples_splits[i];
+      SplitTreeSamples(tree_samples, split.begin, split.pos, split.end,
+                       split.prop);
+      return true;
+    };
+    JXL_RETURN_IF_ERROR(RunOnPool(pool, 0, samples_splits.size(),
+                                  ThreadPool::NoInit, split_samples,
+                                  "MASplitSamples"));
+    level.swap(next_level);
   }
+
+  // Emit the nodes in the order of a depth-first search.
+  std::vector<std::pair<size_t, size_t>> stack = {{0, 0}};
+  while (!stack.empty()) {
+    const LearnNode &node = nodes[stack.back().first];
+    size_t pos = stack.back().second;
+    stack.pop_back();
+    if (node.has_multiplier) (*tree)[pos].multiplier = node.multiplier;
+    if (!node.split) continue;
+    MakeSplitNode(pos, node.property, node.splitval, node.lpred, 0, node.rpred,
+                  0, tree);
+    stack.emplace_back(node.below, (*tree)[pos].rchild);
+    stack.emplace_back(node.above, (*tree)[pos].lchild);
+  }
+  return true;
 }
 
 // NOLINTNEXTLINE(google-readability-namespace-comments)
@@ -480,7 +663,8 @@ HWY_EXPORT(FindBestSplit);  // Local function.
 Status ComputeBestTree(TreeSamples &tree_samples, float threshold,
                        const std::vector<ModularMultiplierInfo> &mul_info,
                        StaticPropRange static_prop_range,
-                       float fast_decode_multiplier, Tree *tree) {
+                       float fast_decode_multiplier, Tree *tree,
+                       ThreadPool *pool) {
   // TODO(veluca): take into account that different contexts can have different
   // uint configs.
   //
@@ -494,10 +678,9 @@ Status ComputeBestTree(TreeSamples &tree_samples, float threshold,
 
   JXL_ENSURE(tree_samples.NumDistinctSamples() <=
              std::numeric_limits<uint32_t>::max());
-  HWY_DYNAMIC_DISPATCH(FindBestSplit)
-  (tree_samples, threshold, mul_info, static_prop_range, fast_decode_multiplier,
-   tree);
-  return true;
+  return HWY_DYNAMIC_DISPATCH(FindBestSplit)(tree_samples, threshold, mul_info,
+                                            static_prop_range,
+                                            fast_decode_multiplier, tree, pool);
 }
 
 #if JXL_CXX_LANG < JXL_CXX_17
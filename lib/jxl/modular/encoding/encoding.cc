@@ -206,7 +206,18 @@ Status DecodeModularChannelMAANS(BitReader *br, ANSSymbolReader *reader,
         }
       } else {
         JXL_DEBUG_V(8, "Fast track.");
-        if (multiplier == 1 && offset == 0) {
+        if (!uses_lz77) {
+          // The context is fixed: decode whole rows at once, in place.
+          for (size_t y = 0; y < channel.h; y++) {
+            pixel_type *JXL_RESTRICT r = channel.Row(y);
+            reader->ReadHybridUintClusteredBatch(
+                ctx_id, br, reinterpret_cast<uint32_t *>(r), channel.w);
+            for (size_t x = 0; x < channel.w; x++) {
+              r[x] = make_pixel(static_cast<uint32_t>(r[x]), multiplier,
+                                offset);
+            }
+          }
+        } else if (multiplier == 1 && offset == 0) {
           for (size_t y = 0; y < channel.h; y++) {
             pixel_type *JXL_RESTRICT r = channel.Row(y);
             for (size_t x = 0; x < channel.w; x++) {
@@ -266,6 +277,23 @@ Status DecodeModularChannelMAANS(BitReader *br, ANSSymbolReader *reader,
                multiplier == 1) {
       JXL_DEBUG_V(8, "Gradient very fast track.");
       const intptr_t onerow = channel.plane.PixelsPerRow();
+      if (!uses_lz77) {
+        // The context is fixed: decode the residuals of whole rows at once, in
+        // place, then add the predictions.
+        for (size_t y = 0; y < channel.h; y++) {
+          pixel_type *JXL_RESTRICT r = channel.Row(y);
+          reader->ReadHybridUintClusteredBatch(
+              ctx_id, br, reinterpret_cast<uint32_t *>(r), channel.w);
+          for (size_t x = 0; x < channel.w; x++) {
+            pixel_type left = (x ? r[x - 1] : y ? *(r + x - onerow) : 0);
+            pixel_type top = (y ? *(r + x - onerow) : left);
+            pixel_type topleft = (x && y ? *(r + x - 1 - onerow) : left);
+            pixel_type guess = ClampedGradient(top, left, topleft);
+            r[x] = make_pixel(static_cast<uint32_t>(r[x]), 1, guess);
+          }
+        }
+        return true;
+      }
       for (size_t y = 0; y < channel.h; y++) {
         pixel_type *JXL_RESTRICT r = channel.Row(y);
         for (size_t x = 0; x < channel.w; x++) {
@@ -376,7 +404,7 @@ Status DecodeModularChannelMAANS(BitReader *br, ANSSymbolReader *reader,
     // special optimized case: the weighted predictor and its properties are not
     // used, so no need to compute weights and properties.
     JXL_DEBUG_V(8, "Slow track.");
-    MATreeLookup tree_lookup(tree);
+    MATreeLookup tree_lookup(tree, channel.w * channel.h);
     Properties properties = Properties(num_props);
     const intptr_t onerow = channel.plane.PixelsPerRow();
     JXL_ASSIGN_OR_RETURN(
@@ -425,7 +453,7 @@ Status DecodeModularChannelMAANS(BitReader *br, ANSSymbolReader *reader,
     }
   } else {
     JXL_DEBUG_V(8, "Slowest track.");
-    MATreeLookup tree_lookup(tree);
+    MATreeLookup tree_lookup(tree, channel.w * channel.h);
     Properties properties = Properties(num_props);
     const intptr_t onerow = channel.plane.PixelsPerRow();
     JXL_ASSIGN_OR_RETURN(
@@ -8,10 +8,13 @@
 #include <jxl/memory_manager.h>
 #include <jxl/types.h>
 
+#include <array>
 #include <cmath>
 #include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <memory>
+#include <numeric>
 #include <sstream>
 #include <string>
 #include <utility>
@@ -45,7 +48,10 @@
 #include "lib/jxl/image_metadata.h"
 #include "lib/jxl/image_ops.h"
 #include "lib/jxl/image_test_utils.h"
+#include "lib/jxl/modular/encoding/context_predict.h"
+#include "lib/jxl/modular/encoding/dec_ma.h"
 #include "lib/jxl/modular/encoding/enc_encoding.h"
+#include "lib/jxl/modular/encoding/enc_ma.h"
 #include "lib/jxl/modular/encoding/encoding.h"
 #include "lib/jxl/modular/modular_image.h"
 #include "lib/jxl/modular/options.h"
@@ -560,5 +566,174 @@ TEST(ModularTest, UnsqueezeIntegerOverflow) {
   }
 }
 
+TEST(ModularTest, CompiledTreeLookupMatchesTraversal) {
+  Rng rng(0);
+  size_t num_compiled = 0;
+  for (size_t iter = 0; iter < 50; iter++) {
+    // Random tree over a few properties, including a static one. Trees that
+    // split on few distinct values are compiled, the others are not.
+    const int num_properties = 1 + iter % 5;
+    const int num_splitvals = 2 + iter % 9;
+    Tree tree;
+    const std::function<void(size_t)> build = [&](size_t depth) {
+      size_t pos = tree.size();
+      tree.emplace_back();
+      if (depth == 0 || rng.Bernoulli(0.2f)) {
+        tree[pos] = PropertyDecisionNode::Leaf(Predictor::Zero,
+                                               /*offset=*/pos);
+        tree[pos].lchild = pos;  // context
+        return;
+      }
+      int property =
+          rng.Bernoulli(0.1f) ? 0 : rng.UniformI(2, 2 + num_properties);
+      int splitval = rng.UniformI(-4, -4 + num_splitvals);
+      size_t lchild = tree.size();
+      build(depth - 1);
+      size_t rchild = tree.size();
+      build(depth - 1);
+      tree[pos] = PropertyDecisionNode::Split(property, splitval, lchild,
+                                              rchild);
+    };
+    build(/*depth=*/5);
+
+    std::array<pixel_type, kNumStaticProperties> static_props = {{1, 0}};
+    size_t num_props;
+    bool use_wp;
+    bool wp_only;
+    bool gradient_only;
+    FlatTree flat_tree = FilterTree(tree, static_props, &num_props, &use_wp,
+                                    &wp_only, &gradient_only);
+    MATreeLookup traversal(flat_tree);
+    MATreeLookup compiled(flat_tree, /*num_lookups=*/1 << 20);
+    EXPECT_FALSE(traversal.IsCompiled());
+    if (compiled.IsCompiled()) num_compiled++;
+
+    Properties properties(num_props);
+    properties[0] = static_props[0];
+    properties[1] = static_props[1];
+    for (size_t i = 0; i < 1000; i++) {
+      for (size_t p = kNumStaticProperties; p < properties.size(); p++) {
+        properties[p] = rng.UniformI(-6, 7);
+      }
+      MATreeLookup::LookupResult expected = traversal.Lookup(properties);
+      MATreeLookup::LookupResult actual = compiled.Lookup(properties);
+      ASSERT_EQ(expected.context, actual.context);
+      ASSERT_EQ(expected.offset, actual.offset);
+      ASSERT_EQ(expected.multiplier, actual.multiplier);
+      ASSERT_EQ(expected.predictor, actual.predictor);
+    }
+  }
+  EXPECT_GT(num_compiled, 0);
+  EXPECT_LT(num_compiled, 50);
+}
+
+TEST(ModularTest, TreeWithManySplitsIsNotCompiled) {
+  // A chain of decisions on one property with distinct split values; the
+  // traversal is shorter than a scan of all the split values.
+  const auto chain_tree = [](int num_splits) {
+    Tree tree;
+    for (int i = 0; i < num_splits; i++) {
+      // Larger values go on to the next split, the others to a leaf.
+      const int pos = 2 * i;
+      tree.push_back(PropertyDecisionNode::Split(/*p=*/2, /*split_val=*/i,
+                                                 /*lchild=*/pos + 2,
+                                                 /*rchild=*/pos + 1));
+      tree.push_back(PropertyDecisionNode::Leaf(Predictor::Zero));
+      tree.back().lchild = i;  // context
+    }
+    tree.push_back(PropertyDecisionNode::Leaf(Predictor::Zero));
+    tree.back().lchild = num_splits;  // context
+    return tree;
+  };
+  std::array<pixel_type, kNumStaticProperties> static_props = {{0, 0}};
+  size_t num_props;
+  bool use_wp;
+  bool wp_only;
+  bool gradient_only;
+  FlatTree short_chain = FilterTree(chain_tree(2), static_props, &num_props,
+                                    &use_wp, &wp_only, &gradient_only);
+  EXPECT_TRUE(MATreeLookup(short_chain, 1 << 20).IsCompiled());
+  FlatTree long_chain = FilterTree(chain_tree(40), static_props, &num_props,
+                                   &use_wp, &wp_only, &gradient_only);
+  EXPECT_FALSE(MATreeLookup(long_chain, 1 << 20).IsCompiled());
+}
+
+TEST(ModularTest, LearnedTreeIndependentOfThreadCount) {
+  const auto learn_tree = [](ThreadPool* pool) -> Tree {
+    Rng rng(0);
+    TreeSamples tree_samples;
+    EXPECT_TRUE(tree_samples.SetPredictor(Predictor::Variable,
+                                          ModularOptions::TreeMode::kDefault));
+    std::vector<uint32_t> properties(kNumNonrefProperties);
+    std::iota(properties.begin(), properties.end(), 0);
+    EXPECT_TRUE(tree_samples.SetProperties(
+        properties, ModularOptions::TreeMode::kDefault));
+    constexpr size_t kNumChannels = 3;
+    constexpr size_t kNumGroups = 4;
+    constexpr size_t kSize = 32;
+    StaticPropRange range;
+    range[0] = {{0, kNumChannels}};
+    range[1] = {{0, kNumGroups}};
+    std::vector<uint32_t> group_pixel_count(kNumGroups, kSize * kSize);
+    std::vector<uint32_t> channel_pixel_count(kNumChannels, kSize * kSize);
+    std::vector<pixel_type> pixel_samples;
+    std::vector<pixel_type> diff_samples;
+    for (size_t i = 0; i < 1000; i++) {
+      pixel_samples.push_back(rng.UniformI(-300, 300));
+      diff_samples.push_back(rng.UniformI(-50, 50));
+    }
+    tree_samples.PreQuantizeProperties(range, {}, group_pixel_count,
+                                       channel_pixel_count, pixel_samples,
+                                       diff_samples, 32);
+    tree_samples.PrepareForSamples(kNumChannels * kNumGroups * kSize * kSize);
+    Properties props(kNumNonrefProperties);
+    pixel_type_w predictions[kNumModularPredictors];
+    for (size_t c = 0; c < kNumChannels; c++) {
+      for (size_t g = 0; g < kNumGroups; g++) {
+        for (size_t y = 0; y < kSize; y++) {
+          for (size_t x = 0; x < kSize; x++) {
+            int32_t value = c * 37 + g * 11 + (x > kSize / 2 ? 50 : 0);
+            props[0] = c;
+            props[1] = g;
+            props[2] = y;
+            props[3] = x;
+            for (size_t p = 4; p < props.size(); p++) {
+              props[p] = rng.UniformI(-20, 20) + (p == 9 ? value : 0);
+            }
+            for (size_t pred = 0; pred < kNumModularPredictors; pred++) {
+              int32_t error = static_cast<int32_t>(pred) + 1;
+              predictions[pred] = value + rng.UniformI(-error, error + 1);
+            }
+            tree_samples.AddSample(value + rng.UniformI(-4, 5) * (c + 1),
+                                   props, predictions);
+          }
+        }
+      }
+    }
+    size_t total_pixels = tree_samples.NumSamples();
+    ModularOptions options;
+    JXL_TEST_ASSIGN_OR_DIE(Tree tree,
+                           LearnTree(std::move(tree_samples), total_pixels,
+                                     options, {}, range, pool));
+    return tree;
+  };
+
+  const Tree expected = learn_tree(nullptr);
+  EXPECT_GT(expected.size(), 1u);
+  for (size_t num_threads : {1, 2, 8}) {
+    test::ThreadPoolForTests pool(num_threads);
+    const Tree tree = learn_tree(pool.get());
+    ASSERT_EQ(expected.size(), tree.size());
+    for (size_t i = 0; i < tree.size(); i++) {
+      EXPECT_EQ(expected[i].property, tree[i].property);
+      EXPECT_EQ(expected[i].splitval, tree[i].splitval);
+      EXPECT_EQ(expected[i].lchild, tree[i].lchild);
+      EXPECT_EQ(expected[i].rchild, tree[i].rchild);
+      EXPECT_EQ(expected[i].predictor, tree[i].predictor);
+      EXPECT_EQ(expected[i].multiplier, tree[i].multiplier);
+    }
+  }
+}
+
 }  // namespace
 }  // namespace jxl
@@ -203,14 +203,12 @@ Status LowMemoryRenderPipeline::EnsureBordersStorage() {
     Rect horizontal = Rect(0, 0, downsampled_xsize, bordery * num_yborders);
     if (!SameSize(horizontal, borders_horizontal_[c])) {
       JXL_ASSIGN_OR_RETURN(borders_horizontal_[c],
-                           ImageF::Create(memory_manager_, horizontal.xsize(),
-                                          horizontal.ysize()));
+                           CreateImage(horizontal.xsize(), horizontal.ysize()));
     }
     Rect vertical = Rect(0, 0, borderx * num_xborders, downsampled_ysize);
     if (!SameSize(vertical, borders_vertical_[c])) {
-      JXL_ASSIGN_OR_RETURN(
-          borders_vertical_[c],
-          ImageF::Create(memory_manager_, vertical.xsize(), vertical.ysize()));
+      JXL_ASSIGN_OR_RETURN(borders_vertical_[c],
+                           CreateImage(vertical.xsize(), vertical.ysize()));
     }
   }
   return true;
@@ -383,13 +381,11 @@ Status LowMemoryRenderPipeline::PrepareForThreadsInternal(size_t num,
     for (size_t c = 0; c < shifts.size(); c++) {
       JXL_ASSIGN_OR_RETURN(
           group_data_[t][c],
-          ImageF::Create(memory_manager_,
-                         GroupInputXSize(c) + group_data_x_border_ * 2,
-                         GroupInputYSize(c) + group_data_y_border_ * 2,
-                         kRenderPipelineXOffset));
+          CreateImage(GroupInputXSize(c) + group_data_x_border_ * 2,
+                      GroupInputYSize(c) + group_data_y_border_ * 2,
+                      kRenderPipelineXOffset));
     }
   }
-  // TODO(veluca): avoid reallocating buffers if not needed.
   stage_data_.resize(num);
   size_t upsampling = 1u << base_color_shift_;
   size_t group_dim = frame_dimensions_.group_dim * upsampling;
@@ -409,10 +405,13 @@ Status LowMemoryRenderPipeline::PrepareForThreadsInternal(size_t num,
               2 * next_y_border + (1 << stages_[i]->settings_.shift_y);
           stage_buffer_ysize = 1 << CeilLog2Nonzero(stage_buffer_ysize);
           next_y_border = stages_[i]->settings_.border_y;
+          ImageF& buffer = stage_data_[t][c][i];
+          if (buffer.xsize() == stage_buffer_xsize &&
+              buffer.ysize() == stage_buffer_ysize) {
+            continue;
+          }
           JXL_ASSIGN_OR_RETURN(
-              stage_data_[t][c][i],
-              ImageF::Create(memory_manager_, stage_buffer_xsize,
-                             stage_buffer_ysize));
+              buffer, CreateImage(stage_buffer_xsize, stage_buffer_ysize));
         }
       }
     }
@@ -434,14 +433,38 @@ Status LowMemoryRenderPipeline::PrepareForThreadsInternal(size_t num,
         std::max(left_padding, std::max(middle_padding, right_padding));
     out_of_frame_data_.resize(num);
     for (size_t t = 0; t < num; t++) {
-      JXL_ASSIGN_OR_RETURN(
-          out_of_frame_data_[t],
-          ImageF::Create(memory_manager_, out_of_frame_xsize, shifts.size()));
+      if (out_of_frame_data_[t].xsize() == out_of_frame_xsize &&
+          out_of_frame_data_[t].ysize() == shifts.size()) {
+        continue;
+      }
+      JXL_ASSIGN_OR_RETURN(out_of_frame_data_[t],
+                           CreateImage(out_of_frame_xsize, shifts.size()));
     }
   }
   return true;
 }
 
+void LowMemoryRenderPipeline::ReleaseImages(RenderPipelineImageCache* cache) {
+  for (ImageF& image : borders_horizontal_) cache->Add(std::move(image), 0);
+  for (ImageF& image : borders_vertical_) cache->Add(std::move(image), 0);
+  for (auto& images : group_data_) {
+    for (ImageF& image : images) {
+      cache->Add(std::move(image), kRenderPipelineXOffset);
+    }
+  }
+  for (auto& thread_data : stage_data_) {
+    for (auto& images : thread_data) {
+      for (ImageF& image : images) cache->Add(std::move(image), 0);
+    }
+  }
+  for (ImageF& image : out_of_frame_data_) cache->Add(std::move(image), 0);
+  borders_horizontal_.clear();
+  borders_vertical_.clear();
+  group_data_.clear();
+  stage_data_.clear();
+  out_of_frame_data_.clear();
+}
+
 std::vector<std::pair<ImageF*, Rect>> LowMemoryRenderPipeline::PrepareBuffers(
     size_t group_id, size_t thread_id) {
   std::vector<std::pair<ImageF*, Rect>> ret(channel_shifts_[0].size());
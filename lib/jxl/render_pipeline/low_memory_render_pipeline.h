@@ -29,6 +29,12 @@ class LowMemoryRenderPipeline final : public RenderPipeline {
   explicit LowMemoryRenderPipeline(JxlMemoryManager* memory_manager)
       : RenderPipeline(memory_manager) {}
 
+  bool SupportsSkippingGroups(
+      std::pair<size_t, size_t>* border) const override {
+    *border = group_border_;
+    return true;
+  }
+
  private:
   std::vector<std::pair<ImageF*, Rect>> PrepareBuffers(
       size_t group_id, size_t thread_id) override;
@@ -39,6 +45,8 @@ class LowMemoryRenderPipeline final : public RenderPipeline {
 
   void ClearDone(size_t i) override { group_border_assigner_.ClearDone(i); }
 
+  void ReleaseImages(RenderPipelineImageCache* cache) override;
+
   Status Init() override;
 
   Status EnsureBordersStorage();
@@ -18,6 +18,29 @@
 
 namespace jxl {
 
+void RenderPipelineImageCache::Add(ImageF&& image, size_t pre_padding) {
+  if (image.xsize() == 0 || image.ysize() == 0) return;
+  entries_.push_back({std::move(image), pre_padding});
+}
+
+StatusOr<ImageF> RenderPipelineImageCache::Get(JxlMemoryManager* memory_manager,
+                                               size_t xsize, size_t ysize,
+                                               size_t pre_padding) {
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    Entry& entry = entries_[i];
+    if (entry.image.xsize() != xsize || entry.image.ysize() != ysize ||
+        entry.pre_padding != pre_padding ||
+        entry.image.memory_manager() != memory_manager) {
+      continue;
+    }
+    ImageF image = std::move(entry.image);
+    entries_[i] = std::move(entries_.back());
+    entries_.pop_back();
+    return image;
+  }
+  return ImageF::Create(memory_manager, xsize, ysize, pre_padding);
+}
+
 Status RenderPipeline::Builder::AddStage(
     std::unique_ptr<RenderPipelineStage> stage) {
   if (!stage) return JXL_FAILURE("internal: no stage to add");
@@ -63,6 +86,7 @@ StatusOr<std::unique_ptr<RenderPipeline>> RenderPipeline::Builder::Finalize(
     }
   }
 
+  res->image_cache_ = image_cache_;
   res->frame_dimensions_ = frame_dimensions;
   res->group_completed_passes_.resize(frame_dimensions.num_groups);
   res->channel_shifts_.resize(stages_.size());
@@ -57,6 +57,28 @@ class RenderPipelineInput {
   friend class RenderPipeline;
 };
 
+// Buffers released by a previous pipeline. A new pipeline takes the ones with
+// the geometry it needs instead of allocating them, so that decoding frames or
+// images of the same size does not reallocate the pipeline storage.
+class RenderPipelineImageCache {
+ public:
+  void Add(ImageF&& image, size_t pre_padding);
+
+  // Returns a cached image with the given geometry, or allocates a new one.
+  StatusOr<ImageF> Get(JxlMemoryManager* memory_manager, size_t xsize,
+                       size_t ysize, size_t pre_padding = 0);
+
+  void Clear() { entries_.clear(); }
+  bool empty() const { return entries_.empty(); }
+
+ private:
+  struct Entry {
+    ImageF image;
+    size_t pre_padding;
+  };
+  std::vector<Entry> entries_;
+};
+
 class RenderPipeline {
  public:
   class Builder {
@@ -74,6 +96,10 @@ class RenderPipeline {
     // the pipeline.
     void UseSimpleImplementation() { use_simple_implementation_ = true; }
 
+    // Lets the pipeline take its buffers from `cache`, which must outlive the
+    // calls to Finalize() and PrepareForThreads().
+    void ReuseImages(RenderPipelineImageCache* cache) { image_cache_ = cache; }
+
     // Finalizes setup of the pipeline. Shifts for all channels should be 0 at
     // this point.
     StatusOr<std::unique_ptr<RenderPipeline>> Finalize(
@@ -84,6 +110,7 @@ class RenderPipeline {
     std::vector<std::unique_ptr<RenderPipelineStage>> stages_;
     size_t num_c_;
     bool use_simple_implementation_ = false;
+    RenderPipelineImageCache* image_cache_ = nullptr;
   };
 
   friend class Builder;
@@ -116,10 +143,34 @@ class RenderPipeline {
 
   virtual void ClearDone(size_t i) {}
 
+  // Moves the buffers of the pipeline, which must not be used anymore, to
+  // `cache`.
+  virtual void ReleaseImages(RenderPipelineImageCache* cache) {}
+
+  // Returns true if a group can be rendered as soon as the groups around it
+  // have input, i.e. if groups far from the area of interest can be skipped.
+  // In that case, `border` is set to the size (in frame pixels) of the area
+  // around a pixel that must have input for that pixel to be rendered.
+  virtual bool SupportsSkippingGroups(std::pair<size_t, size_t>* border) const {
+    return false;
+  }
+
  protected:
   explicit RenderPipeline(JxlMemoryManager* memory_manager)
       : memory_manager_(memory_manager) {}
+
+  // Allocates a buffer, taking it from image_cache_ if possible.
+  StatusOr<ImageF> CreateImage(size_t xsize, size_t ysize,
+                               size_t pre_padding = 0) {
+    if (image_cache_) {
+      return image_cache_->Get(memory_manager_, xsize, ysize, pre_padding);
+    }
+    return ImageF::Create(memory_manager_, xsize, ysize, pre_padding);
+  }
+
   JxlMemoryManager* memory_manager_;
+  // Source of reusable buffers, or nullptr.
+  RenderPipelineImageCache* image_cache_ = nullptr;
 
   std::vector<std::unique_ptr<RenderPipelineStage>> stages_;
   // Shifts for every channel at the input of each stage.
@@ -5,8 +5,13 @@
 
 #include "lib/jxl/render_pipeline/stage_cms.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <memory>
+#include <vector>
 
+#include "lib/jxl/base/random.h"
 #include "lib/jxl/base/status.h"
 #include "lib/jxl/color_encoding_internal.h"
 #include "lib/jxl/dec_xyb.h"
@@ -22,6 +27,122 @@ HWY_BEFORE_NAMESPACE();
 namespace jxl {
 namespace HWY_NAMESPACE {
 
+// These templates are not found via ADL.
+using hwy::HWY_NAMESPACE::Add;
+using hwy::HWY_NAMESPACE::AllFalse;
+using hwy::HWY_NAMESPACE::And;
+using hwy::HWY_NAMESPACE::ConvertTo;
+using hwy::HWY_NAMESPACE::GatherIndex;
+using hwy::HWY_NAMESPACE::Ge;
+using hwy::HWY_NAMESPACE::Gt;
+using hwy::HWY_NAMESPACE::IfThenElse;
+using hwy::HWY_NAMESPACE::Le;
+using hwy::HWY_NAMESPACE::Lt;
+using hwy::HWY_NAMESPACE::Max;
+using hwy::HWY_NAMESPACE::Min;
+using hwy::HWY_NAMESPACE::Mul;
+using hwy::HWY_NAMESPACE::MulAdd;
+using hwy::HWY_NAMESPACE::Or;
+using hwy::HWY_NAMESPACE::RebindToSigned;
+using hwy::HWY_NAMESPACE::Sqrt;
+using hwy::HWY_NAMESPACE::Sub;
+
+// CMS transform sampled on a grid of size^3 nodes, which are uniformly spaced
+// in the square root of the linear input to give more nodes to dark colors.
+struct CmsLut {
+  size_t size = 0;
+  // Interleaved output colors, the first input channel varies slowest.
+  std::vector<float> table;
+};
+
+// Converts the first `xsize` pixels of the rows in-place with tetrahedral
+// interpolation in `lut`. Pixels with inputs outside of [0, 1] are clamped;
+// their original values are also appended to `buf_src` (interleaved) and their
+// positions to `outside`, so that they can be converted exactly afterwards.
+// Returns the number of such pixels.
+size_t ApplyCmsLut(const CmsLut& lut, size_t xsize, float* JXL_RESTRICT row0,
+                   float* JXL_RESTRICT row1, float* JXL_RESTRICT row2,
+                   float* JXL_RESTRICT buf_src, uint32_t* outside) {
+  const HWY_FULL(float) d;
+  const RebindToSigned<decltype(d)> di;
+  const size_t n = lut.size;
+  const float* table = lut.table.data();
+  const auto zero = Zero(d);
+  const auto one = Set(d, 1.0f);
+  const auto scale = Set(d, static_cast<float>(n - 1));
+  const auto max_node = Set(di, static_cast<int32_t>(n - 2));
+  // Offsets of the neighbouring nodes along each axis.
+  const auto step0 = Set(d, static_cast<float>(3 * n * n));
+  const auto step1 = Set(d, static_cast<float>(3 * n));
+  const auto step2 = Set(d, 3.0f);
+  const auto step_all = Add(step0, Add(step1, step2));
+  size_t num_outside = 0;
+  for (size_t x = 0; x < xsize; x += Lanes(d)) {
+    const auto in0 = Load(d, row0 + x);
+    const auto in1 = Load(d, row1 + x);
+    const auto in2 = Load(d, row2 + x);
+    const auto is_outside =
+        Or(Or(Or(Lt(in0, zero), Gt(in0, one)), Or(Lt(in1, zero), Gt(in1, one))),
+           Or(Lt(in2, zero), Gt(in2, one)));
+    if (!AllFalse(d, is_outside)) {
+      for (size_t i = x; i < std::min(x + Lanes(d), xsize); ++i) {
+        if (row0[i] < 0 || row0[i] > 1 || row1[i] < 0 || row1[i] > 1 ||
+            row2[i] < 0 || row2[i] > 1) {
+          buf_src[3 * num_outside + 0] = row0[i];
+          buf_src[3 * num_outside + 1] = row1[i];
+          buf_src[3 * num_outside + 2] = row2[i];
+          outside[num_outside++] = static_cast<uint32_t>(i);
+        }
+      }
+    }
+    const auto pos0 = Mul(Sqrt(Min(Max(in0, zero), one)), scale);
+    const auto pos1 = Mul(Sqrt(Min(Max(in1, zero), one)), scale);
+    const auto pos2 = Mul(Sqrt(Min(Max(in2, zero), one)), scale);
+    // Clamping the integer node also keeps the lookups in bounds for NaN.
+    const auto node0 =
+        ConvertTo(d, Min(Max(ConvertTo(di, pos0), Zero(di)), max_node));
+    const auto node1 =
+        ConvertTo(d, Min(Max(ConvertTo(di, pos1), Zero(di)), max_node));
+    const auto node2 =
+        ConvertTo(d, Min(Max(ConvertTo(di, pos2), Zero(di)), max_node));
+    const auto f0 = Sub(pos0, node0);
+    const auto f1 = Sub(pos1, node1);
+    const auto f2 = Sub(pos2, node2);
+    // The tetrahedron containing the pixel goes from the base node along the
+    // axis of the largest fraction, then of the middle one, then of the
+    // smallest one. Ties are broken so that the first and last axis differ.
+    const auto largest0 = And(Ge(f0, f1), Ge(f0, f2));
+    const auto largest1 = Ge(f1, f2);
+    const auto smallest2 = And(Le(f2, f0), Le(f2, f1));
+    const auto smallest1 = Le(f1, f0);
+    const auto first_step =
+        IfThenElse(largest0, step0, IfThenElse(largest1, step1, step2));
+    const auto last_step =
+        IfThenElse(smallest2, step2, IfThenElse(smallest1, step1, step0));
+    const auto f_max = Max(f0, Max(f1, f2));
+    const auto f_min = Min(f0, Min(f1, f2));
+    const auto f_mid = Sub(Sub(Add(f0, Add(f1, f2)), f_max), f_min);
+    const auto base = MulAdd(node0, step0, MulAdd(node1, step1,
+                                                  Mul(node2, step2)));
+    const auto idx0 = ConvertTo(di, base);
+    const auto idx1 = ConvertTo(di, Add(base, first_step));
+    const auto idx2 = ConvertTo(di, Sub(Add(base, step_all), last_step));
+    const auto idx3 = ConvertTo(di, Add(base, step_all));
+    float* JXL_RESTRICT rows[3] = {row0, row1, row2};
+    for (size_t c = 0; c < 3; c++) {
+      const auto v0 = GatherIndex(d, table + c, idx0);
+      const auto v1 = GatherIndex(d, table + c, idx1);
+      const auto v2 = GatherIndex(d, table + c, idx2);
+      const auto v3 = GatherIndex(d, table + c, idx3);
+      auto out = MulAdd(Sub(v1, v0), f_max, v0);
+      out = MulAdd(Sub(v2, v1), f_mid, out);
+      out = MulAdd(Sub(v3, v2), f_min, out);
+      Store(out, d, rows[c] + x);
+    }
+  }
+  return num_outside;
+}
+
 class CmsStage : public RenderPipelineStage {
  public:
   explicit CmsStage(OutputEncodingInfo output_encoding_info)
@@ -43,7 +164,7 @@ class CmsStage : public RenderPipelineStage {
 
   Status ProcessRow(const RowInfo& input_rows, const RowInfo& output_rows,
                     size_t xextra, size_t xsize, size_t xpos, size_t ypos,
-                    size_t thread_id) const final {
+                    size_t thread_id) const override {
     JXL_ENSURE(xsize <= xsize_);
     // TODO(firsching): handle grey case separately
     //  interleave
@@ -76,7 +197,7 @@ class CmsStage : public RenderPipelineStage {
 
   const char* GetName() const override { return "Cms"; }
 
- private:
+ protected:
   OutputEncodingInfo output_encoding_info_;
   size_t xsize_;
   std::unique_ptr<jxl::ColorSpaceTransform> color_space_transform;
@@ -103,10 +224,146 @@ class CmsStage : public RenderPipelineStage {
   }
 };
 
+// Replaces the CMS transform by a CmsLut if one of the grid sizes is accurate
+// enough, falls back to the CMS otherwise.
+class CmsLutStage : public CmsStage {
+ public:
+  explicit CmsLutStage(OutputEncodingInfo output_encoding_info)
+      : CmsStage(std::move(output_encoding_info)) {}
+
+  Status ProcessRow(const RowInfo& input_rows, const RowInfo& output_rows,
+                    size_t xextra, size_t xsize, size_t xpos, size_t ypos,
+                    size_t thread_id) const final {
+    if (lut_.size == 0) {
+      return CmsStage::ProcessRow(input_rows, output_rows, xextra, xsize, xpos,
+                                  ypos, thread_id);
+    }
+    JXL_ENSURE(xsize <= xsize_);
+    float* JXL_RESTRICT row0 = GetInputRow(input_rows, 0, 0);
+    float* JXL_RESTRICT row1 = GetInputRow(input_rows, 1, 0);
+    float* JXL_RESTRICT row2 = GetInputRow(input_rows, 2, 0);
+    float* buf_src = color_space_transform->BufSrc(thread_id);
+    uint32_t* outside = outside_[thread_id].get();
+    const size_t num_outside =
+        ApplyCmsLut(lut_, xsize, row0, row1, row2, buf_src, outside);
+    if (num_outside == 0) return true;
+    float* JXL_RESTRICT buf_dst = color_space_transform->BufDst(thread_id);
+    JXL_RETURN_IF_ERROR(
+        color_space_transform->Run(thread_id, buf_src, buf_dst, num_outside));
+    for (size_t i = 0; i < num_outside; i++) {
+      row0[outside[i]] = buf_dst[3 * i + 0];
+      row1[outside[i]] = buf_dst[3 * i + 1];
+      row2[outside[i]] = buf_dst[3 * i + 2];
+    }
+    return true;
+  }
+
+  const char* GetName() const override { return "CmsLut"; }
+
+ private:
+  // Number of pixels converted by one call of the CMS to build the table.
+  static constexpr size_t kChunkSize = 4096;
+  // Number of sample colors on which the table is checked.
+  static constexpr size_t kNumSamples = 4096;
+
+  CmsLut lut_;
+  // Per-thread positions of the pixels that are converted by the CMS.
+  std::vector<std::unique_ptr<uint32_t[]>> outside_;
+
+  Status PrepareForThreads(size_t num_threads) override {
+    JXL_RETURN_IF_ERROR(CmsStage::PrepareForThreads(num_threads));
+    outside_.clear();
+    for (size_t i = 0; i < num_threads; i++) {
+      outside_.emplace_back(new uint32_t[xsize_]);
+    }
+    lut_ = CmsLut();
+
+    ColorSpaceTransform transform(
+        output_encoding_info_.color_management_system);
+    JXL_RETURN_IF_ERROR(transform.Init(
+        c_src_, output_encoding_info_.color_encoding,
+        output_encoding_info_.desired_intensity_target, kChunkSize, 1));
+
+    // Exact output for the sample colors, half of them uniform in the linear
+    // input and half uniform in its square root, like the grid nodes.
+    std::vector<float> samples(3 * kNumSamples);
+    std::vector<float> expected(3 * kNumSamples);
+    Rng rng(0);
+    for (size_t i = 0; i < samples.size(); i++) {
+      const float v = rng.UniformF(0.0f, 1.0f);
+      samples[i] = (i / 3) % 2 == 0 ? v : v * v;
+    }
+    JXL_RETURN_IF_ERROR(RunCms(&transform, samples, &expected));
+
+    std::vector<float> nodes;
+    std::vector<float> planes(3 * kNumSamples);
+    std::vector<uint32_t> unused(kNumSamples);
+    for (size_t size : {17, 33, 65}) {
+      CmsLut lut;
+      lut.size = size;
+      nodes.resize(3 * size * size * size);
+      for (size_t i = 0; i < size * size * size; i++) {
+        const size_t node[3] = {i / (size * size), i / size % size, i % size};
+        for (size_t c = 0; c < 3; c++) {
+          const float v = static_cast<float>(node[c]) / (size - 1);
+          nodes[3 * i + c] = v * v;
+        }
+      }
+      JXL_RETURN_IF_ERROR(RunCms(&transform, nodes, &lut.table));
+
+      for (size_t i = 0; i < kNumSamples; i++) {
+        for (size_t c = 0; c < 3; c++) {
+          planes[c * kNumSamples + i] = samples[3 * i + c];
+        }
+      }
+      ApplyCmsLut(lut, kNumSamples, planes.data(), planes.data() + kNumSamples,
+                  planes.data() + 2 * kNumSamples, nodes.data(),
+                  unused.data());
+      float max_error = 0.0f;
+      for (size_t i = 0; i < kNumSamples; i++) {
+        for (size_t c = 0; c < 3; c++) {
+          max_error =
+              std::max(max_error, std::abs(planes[c * kNumSamples + i] -
+                                           expected[3 * i + c]));
+        }
+      }
+      if (max_error <= output_encoding_info_.cms_lut_max_error) {
+        lut_ = std::move(lut);
+        break;
+      }
+    }
+    return true;
+  }
+
+  // Converts the interleaved colors of `in` to `out` with `transform`.
+  static Status RunCms(ColorSpaceTransform* transform,
+                       const std::vector<float>& in, std::vector<float>* out) {
+    out->resize(in.size());
+    const size_t num_pixels = in.size() / 3;
+    float* buf_src = transform->BufSrc(0);
+    float* buf_dst = transform->BufDst(0);
+    for (size_t begin = 0; begin < num_pixels; begin += kChunkSize) {
+      const size_t count = std::min(kChunkSize, num_pixels - begin);
+      std::copy(in.begin() + 3 * begin, in.begin() + 3 * (begin + count),
+                buf_src);
+      JXL_RETURN_IF_ERROR(transform->Run(0, buf_src, buf_dst, count));
+      std::copy(buf_dst, buf_dst + 3 * count, out->begin() + 3 * begin);
+    }
+    return true;
+  }
+};
+
 std::unique_ptr<RenderPipelineStage> GetCmsStage(
     const OutputEncodingInfo& output_encoding_info) {
   auto stage = jxl::make_unique<CmsStage>(output_encoding_info);
   if (!stage->IsNeeded()) return nullptr;
+  const bool rgb_to_rgb =
+      output_encoding_info.linear_color_encoding.Channels() == 3 &&
+      !output_encoding_info.linear_color_encoding.IsCMYK() &&
+      output_encoding_info.color_encoding.Channels() == 3;
+  if (output_encoding_info.cms_lut_max_error > 0 && rgb_to_rgb) {
+    return jxl::make_unique<CmsLutStage>(output_encoding_info);
+  }
   return stage;
 }
 
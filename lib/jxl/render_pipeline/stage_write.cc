@@ -13,6 +13,7 @@
 #include "lib/jxl/alpha.h"
 #include "lib/jxl/base/common.h"
 #include "lib/jxl/base/compiler_specific.h"
+#include "lib/jxl/base/rect.h"
 #include "lib/jxl/base/sanitizers.h"
 #include "lib/jxl/base/status.h"
 #include "lib/jxl/dec_cache.h"
@@ -117,13 +118,17 @@ VFromD<Rebind<T, DF>> MakeUnsigned(VFromD<DF> v, size_t x0, size_t y0,
 class WriteToOutputStage : public RenderPipelineStage {
  public:
   WriteToOutputStage(const ImageOutput& main_output, size_t width,
-                     size_t height, bool has_alpha, bool unpremul_alpha,
-                     size_t alpha_c, Orientation undo_orientation,
+                     size_t height, const Rect& output_region,
+                     const Rect& image_region, bool has_alpha,
+                     bool unpremul_alpha, size_t alpha_c,
+                     Orientation undo_orientation,
                      const std::vector<ImageOutput>& extra_output,
                      JxlMemoryManager* memory_manager)
       : RenderPipelineStage(RenderPipelineStage::Settings()),
         width_(width),
         height_(height),
+        output_region_(output_region),
+        image_region_(image_region),
         main_(main_output),
         num_color_(main_.num_channels_ < 3 ? 1 : 3),
         want_alpha_(main_.num_channels_ == 2 || main_.num_channels_ == 4),
@@ -133,8 +138,11 @@ class WriteToOutputStage : public RenderPipelineStage {
         flip_x_(ShouldFlipX(undo_orientation)),
         flip_y_(ShouldFlipY(undo_orientation)),
         transpose_(ShouldTranspose(undo_orientation)),
-        opaque_alpha_(kMaxPixelsPerCall, 1.0f),
+        opaque_alpha_(PaddedRowLength(), 1.0f),
         memory_manager_(memory_manager) {
+    if (main_.tiles_) {
+      main_.tiles_per_row_ = DivCeil(output_region_.xsize(), main_.tile_xsize_);
+    }
     for (size_t ec = 0; ec < extra_output.size(); ++ec) {
       if (extra_output[ec].callback.IsPresent() || extra_output[ec].buffer) {
         Output extra(extra_output[ec]);
@@ -167,11 +175,16 @@ class WriteToOutputStage : public RenderPipelineStage {
     JXL_ENSURE(main_.run_opaque_ || main_.buffer_);
     if (ypos >= height_) return true;
     if (xpos >= width_) return true;
+    if (ypos < image_region_.y0() || ypos >= image_region_.y1()) return true;
+    if (xpos + xsize <= image_region_.x0()) return true;
+    if (xpos >= image_region_.x1()) return true;
     if (flip_y_) {
       ypos = height_ - 1u - ypos;
     }
-    size_t limit = std::min(xsize, width_ - xpos);
-    for (size_t x0 = 0; x0 < limit; x0 += kMaxPixelsPerCall) {
+    size_t begin =
+        image_region_.x0() > xpos ? image_region_.x0() - xpos : 0;
+    size_t limit = std::min(xsize, image_region_.x1() - xpos);
+    for (size_t x0 = begin; x0 < limit; x0 += kMaxPixelsPerCall) {
       size_t xstart = xpos + x0;
       size_t len = std::min<size_t>(kMaxPixelsPerCall, limit - x0);
 
@@ -218,6 +231,9 @@ class WriteToOutputStage : public RenderPipelineStage {
           buffer_(image_out.buffer),
           buffer_size_(image_out.buffer_size),
           stride_(image_out.stride),
+          tiles_(image_out.tiles),
+          tile_xsize_(image_out.tile_xsize),
+          tile_ysize_(image_out.tile_ysize),
           num_channels_(image_out.format.num_channels),
           swap_endianness_(SwapEndianness(image_out.format.endianness)),
           data_type_(image_out.format.data_type),
@@ -234,11 +250,41 @@ class WriteToOutputStage : public RenderPipelineStage {
       return true;
     }
 
+    // Returns the address of pixel (x, y) of the output, relative to the
+    // output region, and the number of pixels that follow it in the same row
+    // of the same buffer, up to `len`.
+    uint8_t* PixelAddress(size_t x, size_t y, size_t len,
+                          size_t* run_len) const {
+      const size_t pixel_stride = num_channels_ * BytesPerSample();
+      if (!tiles_) {
+        *run_len = len;
+        return reinterpret_cast<uint8_t*>(buffer_) + y * stride_ +
+               x * pixel_stride;
+      }
+      const size_t tx = x / tile_xsize_;
+      const size_t ty = y / tile_ysize_;
+      x -= tx * tile_xsize_;
+      y -= ty * tile_ysize_;
+      *run_len = std::min(len, tile_xsize_ - x);
+      return reinterpret_cast<uint8_t*>(tiles_[ty * tiles_per_row_ + tx]) +
+             y * stride_ + x * pixel_stride;
+    }
+
+    size_t BytesPerSample() const {
+      return data_type_ == JXL_TYPE_UINT8 ? 1
+             : data_type_ == JXL_TYPE_FLOAT ? 4
+                                            : 2;
+    }
+
     PixelCallback pixel_callback_;
     void* run_opaque_ = nullptr;
     void* buffer_ = nullptr;
     size_t buffer_size_;
     size_t stride_;
+    void* const* tiles_;
+    size_t tile_xsize_;
+    size_t tile_ysize_;
+    size_t tiles_per_row_ = 0;
     size_t num_channels_;
     bool swap_endianness_;
     JxlDataType data_type_;
@@ -261,13 +307,21 @@ class WriteToOutputStage : public RenderPipelineStage {
     if ((has_alpha_ && want_alpha_ && unpremul_alpha_) || flip_x_) {
       temp_in_.resize(num_threads * main_.num_channels_);
       for (AlignedMemory& temp : temp_in_) {
-        size_t alloc_size = sizeof(float) * kMaxPixelsPerCall;
+        size_t alloc_size = sizeof(float) * PaddedRowLength();
         JXL_ASSIGN_OR_RETURN(
             temp, AlignedMemory::Create(memory_manager_, alloc_size));
       }
     }
     return true;
   }
+  // Length of the input rows owned by this stage. The remainder of a tile run
+  // that ends at the last pixel is converted with whole-vector loads, which
+  // read up to one vector past kMaxPixelsPerCall.
+  static size_t PaddedRowLength() {
+    const HWY_FULL(float) d;
+    return kMaxPixelsPerCall + MaxLanes(d);
+  }
+
   static bool ShouldFlipX(Orientation undo_orientation) {
     return (undo_orientation == Orientation::kFlipHorizontal ||
             undo_orientation == Orientation::kRotate180 ||
@@ -317,37 +371,98 @@ class WriteToOutputStage : public RenderPipelineStage {
       FlipX(out, thread_id, len, &xstart, input);
     }
     if (out.data_type_ == JXL_TYPE_UINT8) {
-      uint8_t* JXL_RESTRICT temp = temp_out_[thread_id].address<uint8_t>();
-      StoreUnsignedRow(out, input, len, temp, xstart, ypos);
-      WriteToOutput(out, thread_id, ypos, xstart, len, temp);
+      OutputRow<uint8_t>(out, thread_id, ypos, xstart, len, input);
     } else if (out.data_type_ == JXL_TYPE_UINT16 ||
                out.data_type_ == JXL_TYPE_FLOAT16) {
-      uint16_t* JXL_RESTRICT temp = temp_out_[thread_id].address<uint16_t>();
-      if (out.data_type_ == JXL_TYPE_UINT16) {
-        StoreUnsignedRow(out, input, len, temp, xstart, ypos);
-      } else {
-        StoreFloat16Row(out, input, len, temp);
-      }
-      if (out.swap_endianness_) {
-        const HWY_FULL(uint16_t) du;
-        size_t output_len = len * out.num_channels_;
-        for (size_t j = 0; j < output_len; j += Lanes(du)) {
-          auto v = LoadU(du, temp + j);
-          auto vswap = Or(ShiftRightSame(v, 8), ShiftLeftSame(v, 8));
-          StoreU(vswap, du, temp + j);
-        }
-      }
-      WriteToOutput(out, thread_id, ypos, xstart, len, temp);
+      OutputRow<uint16_t>(out, thread_id, ypos, xstart, len, input);
     } else if (out.data_type_ == JXL_TYPE_FLOAT) {
-      float* JXL_RESTRICT temp = temp_out_[thread_id].address<float>();
-      StoreFloatRow(out, input, len, temp);
-      if (out.swap_endianness_) {
-        size_t output_len = len * out.num_channels_;
-        for (size_t j = 0; j < output_len; ++j) {
-          temp[j] = BSwapFloat(temp[j]);
+      OutputRow<float>(out, thread_id, ypos, xstart, len, input);
+    }
+  }
+
+  template <typename T>
+  void OutputRow(const Output& out, size_t thread_id, size_t ypos,
+                 size_t xstart, size_t len, const float* input[4]) const {
+    T* JXL_RESTRICT temp = temp_out_[thread_id].address<T>();
+    if (transpose_ || out.run_opaque_) {
+      ConvertRow(out, input, len, temp, xstart, ypos);
+      WriteToOutput(out, thread_id, ypos, xstart, len, temp);
+      return;
+    }
+    // Convert whole vectors of pixels directly into the output buffer; only
+    // the remainder of each run goes through `temp`, since the conversion
+    // stores whole vectors.
+    const HWY_FULL(float) d;
+    const size_t x0 = xstart - output_region_.x0();
+    const size_t y = ypos - output_region_.y0();
+    size_t run_len;
+    for (size_t x = 0; x < len; x += run_len) {
+      uint8_t* dst = out.PixelAddress(x0 + x, y, len - x, &run_len);
+      const size_t run_size = run_len * out.num_channels_ * sizeof(T);
+      JXL_DASSERT(out.tiles_ ||
+                  dst + run_size <= reinterpret_cast<uint8_t*>(out.buffer_) +
+                                        out.buffer_size_);
+      size_t direct_len = run_len - run_len % Lanes(d);
+      if (reinterpret_cast<uintptr_t>(dst) % sizeof(T) != 0) direct_len = 0;
+      const float* run_input[4];
+      for (size_t c = 0; c < out.num_channels_; ++c) {
+        run_input[c] = input[c] + x;
+      }
+      if (direct_len > 0) {
+        ConvertRow(out, run_input, direct_len, reinterpret_cast<T*>(dst),
+                   xstart + x, ypos);
+      }
+      if (direct_len < run_len) {
+        for (size_t c = 0; c < out.num_channels_; ++c) {
+          run_input[c] += direct_len;
         }
+        const size_t rest = run_len - direct_len;
+        ConvertRow(out, run_input, rest, temp, xstart + x + direct_len, ypos);
+        memcpy(dst + direct_len * out.num_channels_ * sizeof(T), temp,
+               rest * out.num_channels_ * sizeof(T));
+      }
+    }
+  }
+
+  // Converts `len` pixels to the output format, including the byte order.
+  void ConvertRow(const Output& out, const float* input[4], size_t len,
+                  uint8_t* JXL_RESTRICT output, size_t xstart,
+                  size_t ypos) const {
+    StoreUnsignedRow(out, input, len, output, xstart, ypos);
+  }
+
+  void ConvertRow(const Output& out, const float* input[4], size_t len,
+                  uint16_t* JXL_RESTRICT output, size_t xstart,
+                  size_t ypos) const {
+    if (out.data_type_ == JXL_TYPE_UINT16) {
+      StoreUnsignedRow(out, input, len, output, xstart, ypos);
+    } else {
+      StoreFloat16Row(out, input, len, output);
+    }
+    if (out.swap_endianness_) {
+      const HWY_FULL(uint16_t) du;
+      const size_t output_len = len * out.num_channels_;
+      size_t j = 0;
+      for (; j + Lanes(du) <= output_len; j += Lanes(du)) {
+        auto v = LoadU(du, output + j);
+        auto vswap = Or(ShiftRightSame(v, 8), ShiftLeftSame(v, 8));
+        StoreU(vswap, du, output + j);
+      }
+      for (; j < output_len; ++j) {
+        output[j] = static_cast<uint16_t>((output[j] >> 8) | (output[j] << 8));
+      }
+    }
+  }
+
+  void ConvertRow(const Output& out, const float* input[4], size_t len,
+                  float* JXL_RESTRICT output, size_t /*xstart*/,
+                  size_t /*ypos*/) const {
+    StoreFloatRow(out, input, len, output);
+    if (out.swap_endianness_) {
+      const size_t output_len = len * out.num_channels_;
+      for (size_t j = 0; j < output_len; ++j) {
+        output[j] = BSwapFloat(output[j]);
       }
-      WriteToOutput(out, thread_id, ypos, xstart, len, temp);
     }
   }
 
@@ -491,7 +606,11 @@ class WriteToOutputStage : public RenderPipelineStage {
   template <typename T>
   void WriteToOutput(const Output& out, size_t thread_id, size_t ypos,
                      size_t xstart, size_t len, T* output) const {
+    // Make coordinates relative to the output region. Dithering uses image
+    // coordinates, so a region matches the same area of a full decode.
     if (transpose_) {
+      xstart -= output_region_.y0();
+      ypos -= output_region_.x0();
       // TODO(szabadka) Buffer 8x8 chunks and transpose with SIMD.
       if (out.run_opaque_) {
         for (size_t i = 0, j = 0; i < len; ++i, j += out.num_channels_) {
@@ -500,24 +619,25 @@ class WriteToOutputStage : public RenderPipelineStage {
         }
       } else {
         const size_t pixel_stride = out.num_channels_ * sizeof(T);
-        const size_t offset = xstart * out.stride_ + ypos * pixel_stride;
+        size_t run_len;
         for (size_t i = 0, j = 0; i < len; ++i, j += out.num_channels_) {
-          const size_t ix = offset + i * out.stride_;
-          JXL_DASSERT(ix + pixel_stride <= out.buffer_size_);
-          memcpy(reinterpret_cast<uint8_t*>(out.buffer_) + ix, output + j,
-                 pixel_stride);
+          uint8_t* dst = out.PixelAddress(ypos, xstart + i, 1, &run_len);
+          JXL_DASSERT(out.tiles_ ||
+                      dst + pixel_stride <=
+                          reinterpret_cast<uint8_t*>(out.buffer_) +
+                              out.buffer_size_);
+          memcpy(dst, output + j, pixel_stride);
         }
       }
     } else {
+      xstart -= output_region_.x0();
+      ypos -= output_region_.y0();
       if (out.run_opaque_) {
         out.pixel_callback_.run(out.run_opaque_, thread_id, xstart, ypos, len,
                                 output);
       } else {
-        const size_t pixel_stride = out.num_channels_ * sizeof(T);
-        const size_t offset = ypos * out.stride_ + xstart * pixel_stride;
-        JXL_DASSERT(offset + len * pixel_stride <= out.buffer_size_);
-        memcpy(reinterpret_cast<uint8_t*>(out.buffer_) + offset, output,
-               len * pixel_stride);
+        // Buffer output without transposing is written by OutputRow.
+        JXL_DASSERT(false);
       }
     }
   }
@@ -525,6 +645,10 @@ class WriteToOutputStage : public RenderPipelineStage {
   static constexpr size_t kMaxPixelsPerCall = 1024;
   size_t width_;
   size_t height_;
+  // In output (oriented) coordinates.
+  Rect output_region_;
+  // In image coordinates, i.e. before undoing the orientation.
+  Rect image_region_;
   Output main_;  // color + alpha
   size_t num_color_;
   bool want_alpha_;
@@ -546,12 +670,13 @@ constexpr size_t WriteToOutputStage::kMaxPixelsPerCall;
 #endif
 
 std::unique_ptr<RenderPipelineStage> GetWriteToOutputStage(
-    const ImageOutput& main_output, size_t width, size_t height, bool has_alpha,
+    const ImageOutput& main_output, size_t width, size_t height,
+    const Rect& output_region, const Rect& image_region, bool has_alpha,
     bool unpremul_alpha, size_t alpha_c, Orientation undo_orientation,
     std::vector<ImageOutput>& extra_output, JxlMemoryManager* memory_manager) {
   return jxl::make_unique<WriteToOutputStage>(
-      main_output, width, height, has_alpha, unpremul_alpha, alpha_c,
-      undo_orientation, extra_output, memory_manager);
+      main_output, width, height, output_region, image_region, has_alpha,
+      unpremul_alpha, alpha_c, undo_orientation, extra_output, memory_manager);
 }
 
 // NOLINTNEXTLINE(google-readability-namespace-comments)
@@ -685,12 +810,13 @@ std::unique_ptr<RenderPipelineStage> GetWriteToImage3FStage(
 }
 
 std::unique_ptr<RenderPipelineStage> GetWriteToOutputStage(
-    const ImageOutput& main_output, size_t width, size_t height, bool has_alpha,
+    const ImageOutput& main_output, size_t width, size_t height,
+    const Rect& output_region, const Rect& image_region, bool has_alpha,
     bool unpremul_alpha, size_t alpha_c, Orientation undo_orientation,
     std::vector<ImageOutput>& extra_output, JxlMemoryManager* memory_manager) {
   return HWY_DYNAMIC_DISPATCH(GetWriteToOutputStage)(
-      main_output, width, height, has_alpha, unpremul_alpha, alpha_c,
-      undo_orientation, extra_output, memory_manager);
+      main_output, width, height, output_region, image_region, has_alpha,
+      unpremul_alpha, alpha_c, undo_orientation, extra_output, memory_manager);
 }
 
 }  // namespace jxl
@@ -12,6 +12,7 @@
 #include <memory>
 #include <vector>
 
+#include "lib/jxl/base/rect.h"
 #include "lib/jxl/dec_cache.h"
 #include "lib/jxl/dec_xyb.h"
 #include "lib/jxl/image.h"
@@ -28,9 +29,12 @@ std::unique_ptr<RenderPipelineStage> GetWriteToImageBundleStage(
 std::unique_ptr<RenderPipelineStage> GetWriteToImage3FStage(
     JxlMemoryManager* memory_manager, Image3F* image);
 
-// Gets a stage to write to a pixel callback or image buffer.
+// Gets a stage to write to a pixel callback or image buffer. Only the pixels
+// inside image_region (in image coordinates) are written, at positions relative
+// to output_region (the same area, after undoing the orientation).
 std::unique_ptr<RenderPipelineStage> GetWriteToOutputStage(
-    const ImageOutput& main_output, size_t width, size_t height, bool has_alpha,
+    const ImageOutput& main_output, size_t width, size_t height,
+    const Rect& output_region, const Rect& image_region, bool has_alpha,
     bool unpremul_alpha, size_t alpha_c, Orientation undo_orientation,
     std::vector<ImageOutput>& extra_output, JxlMemoryManager* memory_manager);
 
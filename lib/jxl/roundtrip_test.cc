@@ -10,6 +10,8 @@
 #include <jxl/decode_cxx.h>
 #include <jxl/encode.h>
 #include <jxl/encode_cxx.h>
+#include <jxl/thread_parallel_runner.h>
+#include <jxl/thread_parallel_runner_cxx.h>
 #include <jxl/types.h>
 
 #include <cstddef>
@@ -947,12 +949,17 @@ TEST(RoundtripTest, TestICCProfile) {
   JxlDecoderDestroy(dec);
 }
 
-JXL_TRANSCODE_JPEG_TEST(RoundtripTest, TestJPEGReconstruction) {
-  TEST_LIBJPEG_SUPPORT();
-  const std::string jpeg_path = "jxl/flower/flower.png.im_q85_420.jpg";
+// Transcodes the JPEG file at `jpeg_path` and checks that it is reconstructed
+// exactly, with the parallel runner `runner` if not null.
+void TestJPEGReconstruction(const std::string& jpeg_path, void* runner) {
   const std::vector<uint8_t> orig = jxl::test::ReadTestData(jpeg_path);
 
   JxlEncoderPtr enc = JxlEncoderMake(nullptr);
+  if (runner != nullptr) {
+    EXPECT_EQ(JXL_ENC_SUCCESS,
+              JxlEncoderSetParallelRunner(enc.get(), JxlThreadParallelRunner,
+                                          runner));
+  }
   JxlEncoderFrameSettings* frame_settings =
       JxlEncoderFrameSettingsCreate(enc.get(), nullptr);
 
@@ -966,6 +973,11 @@ JXL_TRANSCODE_JPEG_TEST(RoundtripTest, TestJPEGReconstruction) {
   EncodeWithEncoder(enc.get(), &compressed);
 
   JxlDecoderPtr dec = JxlDecoderMake(nullptr);
+  if (runner != nullptr) {
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSetParallelRunner(dec.get(), JxlThreadParallelRunner,
+                                          runner));
+  }
   EXPECT_EQ(JXL_DEC_SUCCESS,
             JxlDecoderSubscribeEvents(
                 dec.get(), JXL_DEC_JPEG_RECONSTRUCTION | JXL_DEC_FULL_IMAGE));
@@ -992,6 +1004,19 @@ JXL_TRANSCODE_JPEG_TEST(RoundtripTest, TestJPEGReconstruction) {
   EXPECT_EQ(0, memcmp(reconstructed_buffer.data(), orig.data(), used));
 }
 
+JXL_TRANSCODE_JPEG_TEST(RoundtripTest, TestJPEGReconstruction) {
+  TEST_LIBJPEG_SUPPORT();
+  TestJPEGReconstruction("jxl/flower/flower.png.im_q85_420.jpg", nullptr);
+}
+
+JXL_TRANSCODE_JPEG_TEST(RoundtripTest, TestJPEGReconstructionWithRestarts) {
+  TEST_LIBJPEG_SUPPORT();
+  // The restart intervals are read and written in parallel.
+  JxlThreadParallelRunnerPtr runner = JxlThreadParallelRunnerMake(nullptr, 4);
+  TestJPEGReconstruction("jxl/jpeg_reconstruction/bicycles_restarts.jpg",
+                         runner.get());
+}
+
 JXL_TRANSCODE_JPEG_TEST(RoundtripTest,
                         TestJPEGReconstructionWithIncompleteHuffmanCode) {
   TEST_LIBJPEG_SUPPORT();
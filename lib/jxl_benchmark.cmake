@@ -37,6 +37,7 @@ if(benchmark_FOUND)
     jxl_extras-internal
     jxl-internal
     jxl_tool
+    jxl_threads
     benchmark::benchmark
   )
 else()
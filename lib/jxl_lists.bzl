@@ -216,8 +216,10 @@ libjxl_dec_sources = [
     "jxl/loop_filter.h",
     "jxl/luminance.cc",
     "jxl/luminance.h",
+    "jxl/memory_arena.cc",
     "jxl/memory_manager_internal.cc",
     "jxl/memory_manager_internal.h",
+    "jxl/modular/encoding/context_predict.cc",
     "jxl/modular/encoding/context_predict.h",
     "jxl/modular/encoding/dec_ma.cc",
     "jxl/modular/encoding/dec_ma.h",
@@ -450,6 +452,7 @@ libjxl_gbench_sources = [
     "jxl/enc_external_image_gbench.cc",
     "jxl/splines_gbench.cc",
     "jxl/tf_gbench.cc",
+    "threads/work_stealing_parallel_runner_gbench.cc",
 ]
 
 libjxl_jpegli_lib_version = 62
@@ -504,6 +507,7 @@ libjxl_jpegli_sources = [
     "jpegli/input.h",
     "jpegli/memory_manager.cc",
     "jpegli/memory_manager.h",
+    "jpegli/parallel.h",
     "jpegli/quant.cc",
     "jpegli/quant.h",
     "jpegli/render.cc",
@@ -557,6 +561,8 @@ libjxl_public_headers = [
     "include/jxl/encode.h",
     "include/jxl/encode_cxx.h",
     "include/jxl/gain_map.h",
+    "include/jxl/memory_arena.h",
+    "include/jxl/memory_arena_cxx.h",
     "include/jxl/memory_manager.h",
     "include/jxl/parallel_runner.h",
     "include/jxl/stats.h",
@@ -638,19 +644,32 @@ libjxl_tests = [
     "jxl/splines_test.cc",
     "jxl/toc_test.cc",
     "jxl/xorshift128plus_test.cc",
+    "threads/shared_parallel_runner_test.cc",
     "threads/thread_parallel_runner_test.cc",
+    "threads/work_stealing_parallel_runner_test.cc",
 ]
 
 libjxl_threads_public_headers = [
     "include/jxl/resizable_parallel_runner.h",
     "include/jxl/resizable_parallel_runner_cxx.h",
+    "include/jxl/shared_parallel_runner.h",
+    "include/jxl/shared_parallel_runner_cxx.h",
     "include/jxl/thread_parallel_runner.h",
     "include/jxl/thread_parallel_runner_cxx.h",
+    "include/jxl/work_stealing_parallel_runner.h",
+    "include/jxl/work_stealing_parallel_runner_cxx.h",
 ]
 
 libjxl_threads_sources = [
+    "threads/memory_manager_internal.h",
     "threads/resizable_parallel_runner.cc",
+    "threads/shared_parallel_runner.cc",
+    "threads/shared_parallel_runner_internal.cc",
+    "threads/shared_parallel_runner_internal.h",
     "threads/thread_parallel_runner.cc",
     "threads/thread_parallel_runner_internal.cc",
     "threads/thread_parallel_runner_internal.h",
+    "threads/work_stealing_parallel_runner.cc",
+    "threads/work_stealing_parallel_runner_internal.cc",
+    "threads/work_stealing_parallel_runner_internal.h",
 ]
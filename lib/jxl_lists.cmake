@@ -213,8 +213,10 @@ set(JPEGXL_INTERNAL_DEC_SOURCES
   jxl/loop_filter.h
   jxl/luminance.cc
   jxl/luminance.h
+  jxl/memory_arena.cc
   jxl/memory_manager_internal.cc
   jxl/memory_manager_internal.h
+  jxl/modular/encoding/context_predict.cc
   jxl/modular/encoding/context_predict.h
   jxl/modular/encoding/dec_ma.cc
   jxl/modular/encoding/dec_ma.h
@@ -447,6 +449,7 @@ set(JPEGXL_INTERNAL_GBENCH_SOURCES
   jxl/enc_external_image_gbench.cc
   jxl/splines_gbench.cc
   jxl/tf_gbench.cc
+  threads/work_stealing_parallel_runner_gbench.cc
 )
 
 set(JPEGXL_INTERNAL_JPEGLI_LIBJPEG_HELPER_FILES
@@ -499,6 +502,7 @@ set(JPEGXL_INTERNAL_JPEGLI_SOURCES
   jpegli/input.h
   jpegli/memory_manager.cc
   jpegli/memory_manager.h
+  jpegli/parallel.h
   jpegli/quant.cc
   jpegli/quant.h
   jpegli/render.cc
@@ -546,6 +550,8 @@ set(JPEGXL_INTERNAL_PUBLIC_HEADERS
   include/jxl/encode.h
   include/jxl/encode_cxx.h
   include/jxl/gain_map.h
+  include/jxl/memory_arena.h
+  include/jxl/memory_arena_cxx.h
   include/jxl/memory_manager.h
   include/jxl/parallel_runner.h
   include/jxl/stats.h
@@ -627,19 +633,32 @@ set(JPEGXL_INTERNAL_TESTS
   jxl/splines_test.cc
   jxl/toc_test.cc
   jxl/xorshift128plus_test.cc
+  threads/shared_parallel_runner_test.cc
   threads/thread_parallel_runner_test.cc
+  threads/work_stealing_parallel_runner_test.cc
 )
 
 set(JPEGXL_INTERNAL_THREADS_PUBLIC_HEADERS
   include/jxl/resizable_parallel_runner.h
   include/jxl/resizable_parallel_runner_cxx.h
+  include/jxl/shared_parallel_runner.h
+  include/jxl/shared_parallel_runner_cxx.h
   include/jxl/thread_parallel_runner.h
   include/jxl/thread_parallel_runner_cxx.h
+  include/jxl/work_stealing_parallel_runner.h
+  include/jxl/work_stealing_parallel_runner_cxx.h
 )
 
 set(JPEGXL_INTERNAL_THREADS_SOURCES
+  threads/memory_manager_internal.h
   threads/resizable_parallel_runner.cc
+  threads/shared_parallel_runner.cc
+  threads/shared_parallel_runner_internal.cc
+  threads/shared_parallel_runner_internal.h
   threads/thread_parallel_runner.cc
   threads/thread_parallel_runner_internal.cc
   threads/thread_parallel_runner_internal.h
+  threads/work_stealing_parallel_runner.cc
+  threads/work_stealing_parallel_runner_internal.cc
+  threads/work_stealing_parallel_runner_internal.h
 )
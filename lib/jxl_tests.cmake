@@ -30,6 +30,7 @@ list(APPEND JPEGXL_INTERNAL_TESTS
   # TODO(deymo): Move this to tools/
   ../tools/djxl_fuzzer_test.cc
   ../tools/gauss_blur_test.cc
+  ../tools/ssimulacra2_test.cc
 )
 
 find_package(GTest)
@@ -62,6 +63,12 @@ foreach (TESTFILE IN LISTS JPEGXL_INTERNAL_TESTS)
   if(TESTFILE STREQUAL ../tools/djxl_fuzzer_test.cc)
     add_executable(${TESTNAME} ${TESTFILE} ../tools/djxl_fuzzer.cc)
     target_link_libraries(${TESTNAME} jxl_tool)
+  elseif(TESTFILE STREQUAL ../tools/ssimulacra2_test.cc)
+    add_executable(${TESTNAME} ${TESTFILE} ../tools/ssimulacra2.cc)
+    target_link_libraries(${TESTNAME} jxl_tool)
+  elseif(TESTFILE STREQUAL jxl/decode_test.cc)
+    add_executable(${TESTNAME} ${TESTFILE})
+    target_link_libraries(${TESTNAME} jxl_tool)
   else()
     add_executable(${TESTNAME} ${TESTFILE})
   endif()
@@ -82,7 +89,8 @@ foreach (TESTFILE IN LISTS JPEGXL_INTERNAL_TESTS)
     jxl_testlib-internal
     jxl_extras-internal
   )
-  if(TESTFILE STREQUAL ../tools/gauss_blur_test.cc)
+  if(TESTFILE STREQUAL ../tools/gauss_blur_test.cc OR
+     TESTFILE STREQUAL ../tools/ssimulacra2_test.cc)
     target_link_libraries(${TESTNAME} jxl_gauss_blur)
   endif()
 
@@ -0,0 +1,65 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#ifndef LIB_THREADS_MEMORY_MANAGER_INTERNAL_H_
+#define LIB_THREADS_MEMORY_MANAGER_INTERNAL_H_
+
+// Memory management helpers for the jpegxl_threads library, which does not
+// depend on the jpegxl library itself.
+
+#include <jxl/memory_manager.h>
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+
+namespace jpegxl {
+
+// Default alloc and free functions, using malloc and free. Same as the default
+// JxlMemoryManager for the jpegxl library itself.
+inline void* ThreadMemoryManagerDefaultAlloc(void* opaque, size_t size) {
+  return malloc(size);
+}
+
+inline void ThreadMemoryManagerDefaultFree(void* opaque, void* address) {
+  free(address);
+}
+
+// Initializes the memory manager instance with the passed one. The
+// MemoryManager passed in |memory_manager| may be NULL or contain NULL
+// functions which will be initialized with the default ones. If either alloc
+// or free are NULL, then both must be NULL, otherwise this function returns an
+// error.
+inline bool ThreadMemoryManagerInit(JxlMemoryManager* self,
+                                    const JxlMemoryManager* memory_manager) {
+  if (memory_manager) {
+    *self = *memory_manager;
+  } else {
+    memset(self, 0, sizeof(*self));
+  }
+  bool is_default_alloc = (self->alloc == nullptr);
+  bool is_default_free = (self->free == nullptr);
+  if (is_default_alloc != is_default_free) {
+    return false;
+  }
+  if (is_default_alloc) self->alloc = ThreadMemoryManagerDefaultAlloc;
+  if (is_default_free) self->free = ThreadMemoryManagerDefaultFree;
+
+  return true;
+}
+
+inline void* ThreadMemoryManagerAlloc(const JxlMemoryManager* memory_manager,
+                                      size_t size) {
+  return memory_manager->alloc(memory_manager->opaque, size);
+}
+
+inline void ThreadMemoryManagerFree(const JxlMemoryManager* memory_manager,
+                                    void* address) {
+  memory_manager->free(memory_manager->opaque, address);
+}
+
+}  // namespace jpegxl
+
+#endif  // LIB_THREADS_MEMORY_MANAGER_INTERNAL_H_
@@ -0,0 +1,73 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include <jxl/memory_manager.h>
+#include <jxl/parallel_runner.h>
+#include <jxl/shared_parallel_runner.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <thread>
+
+#include "lib/threads/memory_manager_internal.h"
+#include "lib/threads/shared_parallel_runner_internal.h"
+
+JxlParallelRetCode JxlSharedParallelRunner(
+    void* runner_opaque, void* jpegxl_opaque, JxlParallelRunInit init,
+    JxlParallelRunFunction func, uint32_t start_range, uint32_t end_range) {
+  return jpegxl::SharedParallelRunner::Runner(
+      runner_opaque, jpegxl_opaque, init, func, start_range, end_range);
+}
+
+void* JxlSharedParallelRunnerCreate(const JxlMemoryManager* memory_manager,
+                                    size_t num_worker_threads) {
+  JxlMemoryManager local_memory_manager;
+  if (!jpegxl::ThreadMemoryManagerInit(&local_memory_manager, memory_manager))
+    return nullptr;
+
+  void* alloc = jpegxl::ThreadMemoryManagerAlloc(
+      &local_memory_manager, sizeof(jpegxl::SharedParallelRunner));
+  if (!alloc) return nullptr;
+  // Placement new constructor on allocated memory
+  jpegxl::SharedParallelRunner* pool =
+      new (alloc) jpegxl::SharedParallelRunner(num_worker_threads);
+  pool->memory_manager = local_memory_manager;
+
+  return pool;
+}
+
+void JxlSharedParallelRunnerDestroy(void* pool_opaque) {
+  jpegxl::SharedParallelRunner* pool =
+      reinterpret_cast<jpegxl::SharedParallelRunner*>(pool_opaque);
+  if (pool) {
+    JxlMemoryManager local_memory_manager = pool->memory_manager;
+    // Call destructor directly since custom free function is used.
+    pool->~SharedParallelRunner();
+    jpegxl::ThreadMemoryManagerFree(&local_memory_manager, pool);
+  }
+}
+
+void* JxlSharedParallelRunnerCreateClient(void* pool_opaque,
+                                          int32_t priority) {
+  jpegxl::SharedParallelRunner* pool =
+      reinterpret_cast<jpegxl::SharedParallelRunner*>(pool_opaque);
+  if (!pool) return nullptr;
+  void* alloc = jpegxl::ThreadMemoryManagerAlloc(
+      &pool->memory_manager, sizeof(jpegxl::SharedParallelRunner::Client));
+  if (!alloc) return nullptr;
+  return new (alloc) jpegxl::SharedParallelRunner::Client{pool, priority};
+}
+
+void JxlSharedParallelRunnerDestroyClient(void* runner_opaque) {
+  jpegxl::SharedParallelRunner::Client* client =
+      reinterpret_cast<jpegxl::SharedParallelRunner::Client*>(runner_opaque);
+  if (client) {
+    jpegxl::ThreadMemoryManagerFree(&client->pool->memory_manager, client);
+  }
+}
+
+size_t JxlSharedParallelRunnerDefaultNumWorkerThreads() {
+  return std::thread::hardware_concurrency();
+}
@@ -0,0 +1,194 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "lib/threads/shared_parallel_runner_internal.h"
+
+#include <jxl/parallel_runner.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "lib/jxl/base/compiler_specific.h"
+
+namespace jpegxl {
+
+// static
+JxlParallelRetCode SharedParallelRunner::Runner(
+    void* runner_opaque, void* jpegxl_opaque, JxlParallelRunInit init,
+    JxlParallelRunFunction func, uint32_t start_range, uint32_t end_range) {
+  const Client* client = static_cast<const Client*>(runner_opaque);
+  if (!client || !client->pool) return JXL_PARALLEL_RET_RUNNER_ERROR;
+  return client->pool->Run(client->priority, jpegxl_opaque, init, func,
+                           start_range, end_range);
+}
+
+JxlParallelRetCode SharedParallelRunner::Run(int32_t priority,
+                                             void* jpegxl_opaque,
+                                             JxlParallelRunInit init,
+                                             JxlParallelRunFunction func,
+                                             uint32_t start_range,
+                                             uint32_t end_range) {
+  if (start_range > end_range) return JXL_PARALLEL_RET_RUNNER_ERROR;
+  if (start_range == end_range) return JXL_PARALLEL_RET_SUCCESS;
+  const uint32_t num_tasks = end_range - start_range;
+  // The caller plus every worker; there is no point in more threads than
+  // tasks.
+  const uint32_t num_threads = static_cast<uint32_t>(
+      std::min<size_t>(threads_.size() + 1, num_tasks));
+
+  int ret = init(jpegxl_opaque, num_threads);
+  if (ret != JXL_PARALLEL_RET_SUCCESS) return ret;
+
+  if (num_threads == 1) {
+    const size_t thread = 0;
+    for (uint32_t task = start_range; task < end_range; ++task) {
+      func(jpegxl_opaque, task, thread);
+    }
+    return JXL_PARALLEL_RET_SUCCESS;
+  }
+
+  Job job;
+  job.func = func;
+  job.jpegxl_opaque = jpegxl_opaque;
+  job.priority = priority;
+  job.end = end_range;
+  job.next.store(start_range, std::memory_order_relaxed);
+  job.num_pending.store(num_tasks, std::memory_order_relaxed);
+  // Thread 0 is the caller.
+  for (uint32_t thread = num_threads - 1; thread > 0; --thread) {
+    job.free_thread_ids.push_back(thread);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    job.sequence = num_jobs_added_.load(std::memory_order_relaxed);
+    num_jobs_added_.store(job.sequence + 1, std::memory_order_relaxed);
+    jobs_.push_back(&job);
+  }
+  if (num_threads - 1 >= threads_.size()) {
+    work_cv_.notify_all();
+  } else {
+    for (uint32_t i = 1; i < num_threads; ++i) work_cv_.notify_one();
+  }
+
+  RunTasks(&job, 0, /*preemptible=*/false);
+
+  // The job lives on our stack: make sure no worker joins it anymore, and wait
+  // for those that did to leave.
+  std::unique_lock<std::mutex> lock(mutex_);
+  RemoveJob(&job);
+  job.done_cv.wait(lock, [&job] {
+    return job.num_pending.load(std::memory_order_acquire) == 0 &&
+           job.num_workers == 0;
+  });
+  return JXL_PARALLEL_RET_SUCCESS;
+}
+
+void SharedParallelRunner::RunTasks(Job* job, const uint32_t thread,
+                                    const bool preemptible) {
+  const uint64_t num_jobs_seen =
+      num_jobs_added_.load(std::memory_order_relaxed);
+  for (;;) {
+    const uint64_t task = job->next.fetch_add(1, std::memory_order_relaxed);
+    if (task >= job->end) return;
+    job->func(job->jpegxl_opaque, static_cast<uint32_t>(task), thread);
+    if (job->num_pending.fetch_sub(1, std::memory_order_acq_rel) == 1) return;
+    if (preemptible &&
+        num_jobs_added_.load(std::memory_order_relaxed) != num_jobs_seen) {
+      return;
+    }
+  }
+}
+
+SharedParallelRunner::Job* SharedParallelRunner::PickJob() {
+  Job* best = nullptr;
+  size_t i = 0;
+  while (i < jobs_.size()) {
+    Job* job = jobs_[i];
+    if (job->next.load(std::memory_order_relaxed) >= job->end) {
+      jobs_[i] = jobs_.back();
+      jobs_.pop_back();
+      continue;
+    }
+    ++i;
+    if (job->free_thread_ids.empty()) continue;
+    if (!best || job->priority > best->priority ||
+        (job->priority == best->priority &&
+         (job->num_workers < best->num_workers ||
+          (job->num_workers == best->num_workers &&
+           job->sequence < best->sequence)))) {
+      best = job;
+    }
+  }
+  return best;
+}
+
+void SharedParallelRunner::RemoveJob(Job* job) {
+  auto it = std::find(jobs_.begin(), jobs_.end(), job);
+  if (it != jobs_.end()) {
+    *it = jobs_.back();
+    jobs_.pop_back();
+  }
+}
+
+void SharedParallelRunner::ThreadFunc() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    if (exit_) return;
+    Job* job = PickJob();
+    if (!job) {
+      work_cv_.wait(lock);
+      continue;
+    }
+    const uint32_t thread = job->free_thread_ids.back();
+    job->free_thread_ids.pop_back();
+    ++job->num_workers;
+    lock.unlock();
+
+    RunTasks(job, thread, /*preemptible=*/true);
+
+    lock.lock();
+    job->free_thread_ids.push_back(thread);
+    --job->num_workers;
+    // Notify while holding the lock: the caller may destroy the job as soon as
+    // it can observe the condition.
+    if (job->num_workers == 0 &&
+        job->num_pending.load(std::memory_order_acquire) == 0) {
+      job->done_cv.notify_one();
+    }
+  }
+}
+
+SharedParallelRunner::SharedParallelRunner(const size_t num_worker_threads) {
+  threads_.reserve(num_worker_threads);
+  for (size_t i = 0; i < num_worker_threads; ++i) {
+    threads_.emplace_back(&SharedParallelRunner::ThreadFunc, this);
+  }
+}
+
+SharedParallelRunner::~SharedParallelRunner() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    exit_ = true;
+  }
+  work_cv_.notify_all();
+  for (std::thread& thread : threads_) {
+    if (thread.joinable()) {
+      thread.join();
+    } else {
+#if JXL_IS_DEBUG_BUILD
+      JXL_PRINT_STACK_TRACE();
+      JXL_CRASH();
+#endif
+    }
+  }
+}
+
+}  // namespace jpegxl
@@ -0,0 +1,114 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+//
+
+// C++ implementation using std::thread of a ::JxlParallelRunner that
+// multiplexes concurrent calls onto one set of worker threads.
+//
+// Each call is a Job living on the stack of its calling thread. The caller
+// publishes the job, runs its tasks together with the workers that join it,
+// and waits until every worker has left before returning. Tasks are reserved
+// one at a time from an atomic counter of the job, so joining and leaving a
+// job only needs the mutex, not the tasks themselves.
+//
+// Usage:
+//   SharedParallelRunner pool(num_worker_threads);
+//   SharedParallelRunner::Client client{&pool, priority};
+//   JxlDecode(
+//       ... , &SharedParallelRunner::Runner,
+//       static_cast<void*>(&client));
+
+#ifndef LIB_THREADS_SHARED_PARALLEL_RUNNER_INTERNAL_H_
+#define LIB_THREADS_SHARED_PARALLEL_RUNNER_INTERNAL_H_
+
+#include <jxl/memory_manager.h>
+#include <jxl/parallel_runner.h>
+
+#include <atomic>
+#include <condition_variable>  //NOLINT
+#include <cstddef>
+#include <cstdint>
+#include <mutex>   //NOLINT
+#include <thread>  //NOLINT
+#include <vector>
+
+namespace jpegxl {
+
+class SharedParallelRunner {
+ public:
+  // Opaque runner passed to Runner.
+  struct Client {
+    SharedParallelRunner* pool;
+    int32_t priority;
+  };
+
+  // ::JxlParallelRunner interface; `runner_opaque` is a Client.
+  static JxlParallelRetCode Runner(void* runner_opaque, void* jpegxl_opaque,
+                                   JxlParallelRunInit init,
+                                   JxlParallelRunFunction func,
+                                   uint32_t start_range, uint32_t end_range);
+
+  // Starts the given number of worker threads.
+  explicit SharedParallelRunner(size_t num_worker_threads);
+
+  // Waits for all threads to exit. No call may be running.
+  ~SharedParallelRunner();
+
+  size_t NumWorkerThreads() const { return threads_.size(); }
+
+  JxlMemoryManager memory_manager;
+
+ private:
+  struct Job {
+    JxlParallelRunFunction func;
+    void* jpegxl_opaque;
+    int32_t priority;
+    uint64_t sequence;  // order of arrival, for ties.
+    uint32_t end;
+
+    // Next task to run; the job is exhausted once it reaches `end`. 64-bit so
+    // that reservations past the end do not wrap around.
+    std::atomic<uint64_t> next;
+    // Number of tasks that did not finish yet.
+    std::atomic<uint32_t> num_pending;
+
+    // Guarded by mutex_.
+    std::vector<uint32_t> free_thread_ids;
+    uint32_t num_workers = 0;  // workers currently running tasks of the job.
+    std::condition_variable done_cv;
+  };
+
+  JxlParallelRetCode Run(int32_t priority, void* jpegxl_opaque,
+                         JxlParallelRunInit init, JxlParallelRunFunction func,
+                         uint32_t start_range, uint32_t end_range);
+
+  // Runs tasks of `job` as `thread` until it is exhausted or, if
+  // `preemptible`, another job was added, so that the worker can be assigned
+  // again.
+  void RunTasks(Job* job, uint32_t thread, bool preemptible);
+
+  // Returns the job for an idle worker to join, or nullptr: the one with the
+  // highest priority, then the fewest workers, then the oldest. Also drops
+  // exhausted jobs. Requires mutex_.
+  Job* PickJob();
+  // Removes `job` from jobs_ if it is still there. Requires mutex_.
+  void RemoveJob(Job* job);
+
+  void ThreadFunc();
+
+  std::mutex mutex_;
+  std::condition_variable work_cv_;  // signaled when a job is added.
+  bool exit_ = false;
+  // Jobs that may still have tasks to reserve. Guarded by mutex_.
+  std::vector<Job*> jobs_;
+  // Written with mutex_, read without it by running workers.
+  std::atomic<uint64_t> num_jobs_added_{0};
+
+  std::vector<std::thread> threads_;
+};
+
+}  // namespace jpegxl
+
+#endif  // LIB_THREADS_SHARED_PARALLEL_RUNNER_INTERNAL_H_
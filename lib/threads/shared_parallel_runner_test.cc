@@ -0,0 +1,94 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include <jxl/shared_parallel_runner.h>
+#include <jxl/shared_parallel_runner_cxx.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "lib/jxl/base/data_parallel.h"
+#include "lib/jxl/base/status.h"
+#include "lib/jxl/testing.h"
+
+namespace jpegxl {
+namespace {
+
+// Runs `num_tasks` tasks through `client` and checks that each task runs
+// exactly once with a thread index below the number passed to init.
+void RunAndCheck(void* client, uint32_t begin, uint32_t num_tasks) {
+  jxl::ThreadPool pool(JxlSharedParallelRunner, client);
+  std::vector<std::atomic<int>> counts(num_tasks);
+  for (auto& count : counts) count.store(0);
+  size_t num_init_threads = 0;
+  const auto init = [&num_init_threads](size_t num_threads) {
+    num_init_threads = num_threads;
+    return true;
+  };
+  const auto do_task = [&](const uint32_t task,
+                           const size_t thread) -> jxl::Status {
+    EXPECT_GE(task, begin);
+    EXPECT_LT(task, begin + num_tasks);
+    EXPECT_LT(thread, num_init_threads);
+    counts.at(task - begin).fetch_add(1);
+    return true;
+  };
+  EXPECT_TRUE(RunOnPool(&pool, begin, begin + num_tasks, init, do_task,
+                        "RunAndCheck"));
+  for (const auto& count : counts) EXPECT_EQ(1, count.load());
+}
+
+TEST(SharedParallelRunnerTest, TestSingleClient) {
+  for (size_t num_workers = 0; num_workers <= 5; ++num_workers) {
+    auto pool = JxlSharedParallelRunnerMake(nullptr, num_workers);
+    ASSERT_TRUE(pool);
+    auto client = JxlSharedParallelRunnerMakeClient(pool.get(), 0);
+    ASSERT_TRUE(client);
+    for (uint32_t num_tasks : {0, 1, 2, 5, 100}) {
+      RunAndCheck(client.get(), 3, num_tasks);
+    }
+  }
+}
+
+// Many threads use the pool at the same time, with different priorities.
+TEST(SharedParallelRunnerTest, TestConcurrentClients) {
+  auto pool = JxlSharedParallelRunnerMake(nullptr, 4);
+  ASSERT_TRUE(pool);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 16; ++i) {
+    threads.emplace_back([&pool, i] {
+      auto client = JxlSharedParallelRunnerMakeClient(pool.get(), i % 3);
+      for (uint32_t iteration = 0; iteration < 50; ++iteration) {
+        RunAndCheck(client.get(), iteration, 1 + (iteration * 7 + i) % 64);
+      }
+    });
+  }
+  for (std::thread& thread : threads) thread.join();
+}
+
+// Calls made from the tasks of another call are supported.
+TEST(SharedParallelRunnerTest, TestNestedCalls) {
+  auto pool = JxlSharedParallelRunnerMake(nullptr, 3);
+  ASSERT_TRUE(pool);
+  auto client = JxlSharedParallelRunnerMakeClient(pool.get(), 1);
+  jxl::ThreadPool outer_pool(JxlSharedParallelRunner, client.get());
+  std::atomic<int> num_calls{0};
+  const auto do_task = [&](const uint32_t task,
+                           size_t /*thread*/) -> jxl::Status {
+    auto nested_client = JxlSharedParallelRunnerMakeClient(pool.get(), 2);
+    RunAndCheck(nested_client.get(), 0, 20 + task);
+    num_calls.fetch_add(1);
+    return true;
+  };
+  EXPECT_TRUE(RunOnPool(&outer_pool, 0, 10, jxl::ThreadPool::NoInit, do_task,
+                        "TestNestedCalls"));
+  EXPECT_EQ(10, num_calls.load());
+}
+
+}  // namespace
+}  // namespace jpegxl
@@ -0,0 +1,71 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include <jxl/memory_manager.h>
+#include <jxl/parallel_runner.h>
+#include <jxl/types.h>
+#include <jxl/work_stealing_parallel_runner.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <thread>
+
+#include "lib/threads/memory_manager_internal.h"
+#include "lib/threads/work_stealing_parallel_runner_internal.h"
+
+JxlParallelRetCode JxlWorkStealingParallelRunner(
+    void* runner_opaque, void* jpegxl_opaque, JxlParallelRunInit init,
+    JxlParallelRunFunction func, uint32_t start_range, uint32_t end_range) {
+  return jpegxl::WorkStealingParallelRunner::Runner(
+      runner_opaque, jpegxl_opaque, init, func, start_range, end_range);
+}
+
+void JxlWorkStealingParallelRunnerDefaultOptions(
+    JxlWorkStealingParallelRunnerOptions* options) {
+  const unsigned num_cpus = std::thread::hardware_concurrency();
+  // The calling thread runs tasks too.
+  options->num_worker_threads = num_cpus > 0 ? num_cpus - 1 : 0;
+  options->pin_threads = JXL_FALSE;
+  options->numa_aware = JXL_TRUE;
+  options->spin_iterations = 2000;
+}
+
+void* JxlWorkStealingParallelRunnerCreate(
+    const JxlMemoryManager* memory_manager,
+    const JxlWorkStealingParallelRunnerOptions* options) {
+  JxlMemoryManager local_memory_manager;
+  if (!jpegxl::ThreadMemoryManagerInit(&local_memory_manager, memory_manager))
+    return nullptr;
+
+  JxlWorkStealingParallelRunnerOptions local_options;
+  if (options) {
+    local_options = *options;
+  } else {
+    JxlWorkStealingParallelRunnerDefaultOptions(&local_options);
+  }
+  // Tasks are distributed by 32-bit index.
+  if (local_options.num_worker_threads >= UINT32_MAX) return nullptr;
+
+  void* alloc = jpegxl::ThreadMemoryManagerAlloc(
+      &local_memory_manager, sizeof(jpegxl::WorkStealingParallelRunner));
+  if (!alloc) return nullptr;
+  // Placement new constructor on allocated memory
+  jpegxl::WorkStealingParallelRunner* runner =
+      new (alloc) jpegxl::WorkStealingParallelRunner(local_options);
+  runner->memory_manager = local_memory_manager;
+
+  return runner;
+}
+
+void JxlWorkStealingParallelRunnerDestroy(void* runner_opaque) {
+  jpegxl::WorkStealingParallelRunner* runner =
+      reinterpret_cast<jpegxl::WorkStealingParallelRunner*>(runner_opaque);
+  if (runner) {
+    JxlMemoryManager local_memory_manager = runner->memory_manager;
+    // Call destructor directly since custom free function is used.
+    runner->~WorkStealingParallelRunner();
+    jpegxl::ThreadMemoryManagerFree(&local_memory_manager, runner);
+  }
+}
@@ -0,0 +1,223 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+// Compares the parallel runners on the group-parallel parts of the codec:
+// encoding and decoding a synthetic image with many groups.
+
+#include <jxl/codestream_header.h>
+#include <jxl/decode.h>
+#include <jxl/decode_cxx.h>
+#include <jxl/encode.h>
+#include <jxl/encode_cxx.h>
+#include <jxl/parallel_runner.h>
+#include <jxl/thread_parallel_runner.h>
+#include <jxl/thread_parallel_runner_cxx.h>
+#include <jxl/types.h>
+#include <jxl/work_stealing_parallel_runner.h>
+#include <jxl/work_stealing_parallel_runner_cxx.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+
+namespace jpegxl {
+namespace {
+
+#define QUIT(M)           \
+  state.SkipWithError(M); \
+  return;
+
+#define BM_CHECK(C) \
+  if (!(C)) {       \
+    QUIT(#C)        \
+  }
+
+constexpr size_t kXSize = 2048;
+constexpr size_t kYSize = 2048;
+constexpr JxlPixelFormat kFormat = {3, JXL_TYPE_UINT8, JXL_NATIVE_ENDIAN, 0};
+
+// Owns either kind of runner.
+struct Runner {
+  JxlParallelRunner runner;
+  JxlThreadParallelRunnerPtr thread_runner;
+  JxlWorkStealingParallelRunnerPtr work_stealing_runner;
+  void* opaque;
+};
+
+Runner MakeRunner(bool work_stealing, size_t num_threads) {
+  Runner result;
+  if (work_stealing) {
+    JxlWorkStealingParallelRunnerOptions options;
+    JxlWorkStealingParallelRunnerDefaultOptions(&options);
+    // The calling thread participates.
+    options.num_worker_threads = num_threads - 1;
+    result.work_stealing_runner =
+        JxlWorkStealingParallelRunnerMake(nullptr, &options);
+    result.runner = JxlWorkStealingParallelRunner;
+    result.opaque = result.work_stealing_runner.get();
+  } else {
+    // The calling thread only waits.
+    result.thread_runner = JxlThreadParallelRunnerMake(nullptr, num_threads);
+    result.runner = JxlThreadParallelRunner;
+    result.opaque = result.thread_runner.get();
+  }
+  return result;
+}
+
+// Smooth gradients with some noise, so that the encoder does not take
+// shortcuts for flat areas.
+std::vector<uint8_t> MakePixels() {
+  std::vector<uint8_t> pixels(kXSize * kYSize * 3);
+  uint32_t rng = 12345;
+  for (size_t y = 0; y < kYSize; ++y) {
+    for (size_t x = 0; x < kXSize; ++x) {
+      rng = rng * 1103515245 + 12345;
+      const uint8_t noise = (rng >> 16) & 15;
+      uint8_t* pixel = &pixels[(y * kXSize + x) * 3];
+      pixel[0] = static_cast<uint8_t>((x / 8) + noise);
+      pixel[1] = static_cast<uint8_t>((y / 8) + noise);
+      pixel[2] = static_cast<uint8_t>(((x + y) / 16) + noise);
+    }
+  }
+  return pixels;
+}
+
+bool Encode(const std::vector<uint8_t>& pixels, const Runner& runner,
+            std::vector<uint8_t>* compressed) {
+  JxlEncoderPtr enc = JxlEncoderMake(nullptr);
+  if (JXL_ENC_SUCCESS !=
+      JxlEncoderSetParallelRunner(enc.get(), runner.runner, runner.opaque)) {
+    return false;
+  }
+  JxlBasicInfo info;
+  JxlEncoderInitBasicInfo(&info);
+  info.xsize = kXSize;
+  info.ysize = kYSize;
+  info.bits_per_sample = 8;
+  info.uses_original_profile = JXL_FALSE;
+  if (JXL_ENC_SUCCESS != JxlEncoderSetBasicInfo(enc.get(), &info)) {
+    return false;
+  }
+  JxlColorEncoding color_encoding;
+  JxlColorEncodingSetToSRGB(&color_encoding, /*is_gray=*/JXL_FALSE);
+  if (JXL_ENC_SUCCESS !=
+      JxlEncoderSetColorEncoding(enc.get(), &color_encoding)) {
+    return false;
+  }
+  JxlEncoderFrameSettings* settings =
+      JxlEncoderFrameSettingsCreate(enc.get(), nullptr);
+  if (JXL_ENC_SUCCESS !=
+      JxlEncoderFrameSettingsSetOption(settings, JXL_ENC_FRAME_SETTING_EFFORT,
+                                       3)) {
+    return false;
+  }
+  if (JXL_ENC_SUCCESS != JxlEncoderAddImageFrame(settings, &kFormat,
+                                                 pixels.data(),
+                                                 pixels.size())) {
+    return false;
+  }
+  JxlEncoderCloseInput(enc.get());
+
+  compressed->resize(64 << 10);
+  uint8_t* next_out = compressed->data();
+  size_t avail_out = compressed->size();
+  for (;;) {
+    JxlEncoderStatus status =
+        JxlEncoderProcessOutput(enc.get(), &next_out, &avail_out);
+    if (status == JXL_ENC_SUCCESS) break;
+    if (status != JXL_ENC_NEED_MORE_OUTPUT) return false;
+    const size_t offset = next_out - compressed->data();
+    compressed->resize(compressed->size() * 2);
+    next_out = compressed->data() + offset;
+    avail_out = compressed->size() - offset;
+  }
+  compressed->resize(next_out - compressed->data());
+  return true;
+}
+
+bool Decode(const std::vector<uint8_t>& compressed, const Runner& runner,
+            std::vector<uint8_t>* pixels) {
+  JxlDecoderPtr dec = JxlDecoderMake(nullptr);
+  if (JXL_DEC_SUCCESS !=
+      JxlDecoderSetParallelRunner(dec.get(), runner.runner, runner.opaque)) {
+    return false;
+  }
+  if (JXL_DEC_SUCCESS !=
+      JxlDecoderSubscribeEvents(dec.get(), JXL_DEC_FULL_IMAGE)) {
+    return false;
+  }
+  JxlDecoderSetInput(dec.get(), compressed.data(), compressed.size());
+  JxlDecoderCloseInput(dec.get());
+  for (;;) {
+    JxlDecoderStatus status = JxlDecoderProcessInput(dec.get());
+    if (status == JXL_DEC_NEED_IMAGE_OUT_BUFFER) {
+      if (JXL_DEC_SUCCESS != JxlDecoderSetImageOutBuffer(dec.get(), &kFormat,
+                                                         pixels->data(),
+                                                         pixels->size())) {
+        return false;
+      }
+    } else if (status == JXL_DEC_FULL_IMAGE) {
+      continue;
+    } else {
+      return status == JXL_DEC_SUCCESS;
+    }
+  }
+}
+
+void BM_Encode(benchmark::State& state, bool work_stealing) {
+  const size_t num_threads = state.range();
+  Runner runner = MakeRunner(work_stealing, num_threads);
+  BM_CHECK(runner.opaque);
+  std::vector<uint8_t> pixels = MakePixels();
+  std::vector<uint8_t> compressed;
+
+  for (auto _ : state) {
+    (void)_;
+    BM_CHECK(Encode(pixels, runner, &compressed));
+  }
+
+  // Pixels per second.
+  state.SetItemsProcessed(state.iterations() * kXSize * kYSize);
+}
+
+void BM_Decode(benchmark::State& state, bool work_stealing) {
+  const size_t num_threads = state.range();
+  Runner runner = MakeRunner(work_stealing, num_threads);
+  BM_CHECK(runner.opaque);
+  std::vector<uint8_t> pixels = MakePixels();
+  std::vector<uint8_t> compressed;
+  BM_CHECK(Encode(pixels, runner, &compressed));
+
+  for (auto _ : state) {
+    (void)_;
+    BM_CHECK(Decode(compressed, runner, &pixels));
+  }
+
+  // Pixels per second.
+  state.SetItemsProcessed(state.iterations() * kXSize * kYSize);
+}
+
+BENCHMARK_CAPTURE(BM_Encode, ThreadParallelRunner, false)
+    ->RangeMultiplier(2)
+    ->Range(1, 64)
+    ->UseRealTime();
+BENCHMARK_CAPTURE(BM_Encode, WorkStealingParallelRunner, true)
+    ->RangeMultiplier(2)
+    ->Range(1, 64)
+    ->UseRealTime();
+BENCHMARK_CAPTURE(BM_Decode, ThreadParallelRunner, false)
+    ->RangeMultiplier(2)
+    ->Range(1, 64)
+    ->UseRealTime();
+BENCHMARK_CAPTURE(BM_Decode, WorkStealingParallelRunner, true)
+    ->RangeMultiplier(2)
+    ->Range(1, 64)
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace jpegxl
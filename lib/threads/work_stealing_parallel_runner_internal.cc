@@ -0,0 +1,404 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "lib/threads/work_stealing_parallel_runner_internal.h"
+
+#include <jxl/parallel_runner.h>
+#include <jxl/types.h>
+#include <jxl/work_stealing_parallel_runner.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "lib/jxl/base/compiler_specific.h"
+
+namespace jpegxl {
+namespace {
+
+// Hint to the CPU that we are busy-waiting.
+void CpuRelax() {
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+  __builtin_ia32_pause();
+#elif defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__))
+  asm volatile("yield" ::: "memory");
+#else
+  std::this_thread::yield();
+#endif
+}
+
+#if defined(__linux__)
+// Parses a Linux CPU list such as "0-3,8,10-11".
+std::vector<int> ParseCpuList(const char* list) {
+  std::vector<int> cpus;
+  const char* pos = list;
+  while (*pos >= '0' && *pos <= '9') {
+    char* next;
+    long first = strtol(pos, &next, 10);
+    long last = first;
+    if (*next == '-') {
+      pos = next + 1;
+      last = strtol(pos, &next, 10);
+    }
+    for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu) {
+      cpus.push_back(static_cast<int>(cpu));
+    }
+    pos = (*next == ',') ? next + 1 : next;
+  }
+  return cpus;
+}
+
+std::vector<int> ReadCpuList(const char* path) {
+  std::vector<int> cpus;
+  FILE* file = fopen(path, "r");
+  if (!file) return cpus;
+  char line[4096];
+  if (fgets(line, sizeof(line), file)) cpus = ParseCpuList(line);
+  fclose(file);
+  return cpus;
+}
+#endif
+
+// Returns the CPUs of each NUMA node that this process may run on, or a single
+// node if the topology is unknown.
+std::vector<std::vector<int>> GetNumaNodes() {
+  std::vector<int> allowed;
+  std::vector<std::vector<int>> nodes;
+#if defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &set)) allowed.push_back(cpu);
+    }
+  }
+  for (int node : ReadCpuList("/sys/devices/system/node/online")) {
+    char path[80];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist",
+             node);
+    std::vector<int> cpus;
+    for (int cpu : ReadCpuList(path)) {
+      if (std::find(allowed.begin(), allowed.end(), cpu) != allowed.end()) {
+        cpus.push_back(cpu);
+      }
+    }
+    if (!cpus.empty()) nodes.push_back(cpus);
+  }
+#endif
+  if (nodes.empty()) {
+    if (allowed.empty()) {
+      for (unsigned cpu = 0; cpu < std::thread::hardware_concurrency(); ++cpu) {
+        allowed.push_back(cpu);
+      }
+    }
+    nodes.push_back(allowed);
+  }
+  return nodes;
+}
+
+void PinThread(std::thread* thread, int cpu) {
+#if defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  // Pinning is an optimization; failures are ignored.
+  (void)pthread_setaffinity_np(thread->native_handle(), sizeof(set), &set);
+#else
+  (void)thread;
+  (void)cpu;
+#endif
+}
+
+}  // namespace
+
+// static
+JxlParallelRetCode WorkStealingParallelRunner::Runner(
+    void* runner_opaque, void* jpegxl_opaque, JxlParallelRunInit init,
+    JxlParallelRunFunction func, uint32_t start_range, uint32_t end_range) {
+  WorkStealingParallelRunner* self =
+      static_cast<WorkStealingParallelRunner*>(runner_opaque);
+  return self->Run(jpegxl_opaque, init, func, start_range, end_range);
+}
+
+JxlParallelRetCode WorkStealingParallelRunner::Run(void* jpegxl_opaque,
+                                                   JxlParallelRunInit init,
+                                                   JxlParallelRunFunction func,
+                                                   uint32_t start_range,
+                                                   uint32_t end_range) {
+  if (start_range > end_range) return JXL_PARALLEL_RET_RUNNER_ERROR;
+  if (start_range == end_range) return JXL_PARALLEL_RET_SUCCESS;
+  const uint32_t num_tasks = end_range - start_range;
+  // Do not involve more threads than there are tasks.
+  const uint32_t num_job_threads = std::min(num_threads_, num_tasks);
+
+  int ret = init(jpegxl_opaque, num_job_threads);
+  if (ret != JXL_PARALLEL_RET_SUCCESS) return ret;
+
+  if (num_job_threads == 1) {
+    const size_t thread = 0;
+    for (uint32_t task = start_range; task < end_range; ++task) {
+      func(jpegxl_opaque, task, thread);
+    }
+    return JXL_PARALLEL_RET_SUCCESS;
+  }
+
+  if (depth_.fetch_add(1, std::memory_order_acq_rel) != 0) {
+    depth_.fetch_sub(1, std::memory_order_acq_rel);
+    return JXL_PARALLEL_RET_RUNNER_ERROR;  // Must not re-enter.
+  }
+
+  // No worker looks at these until generation_ becomes odd.
+  data_func_ = func;
+  jpegxl_opaque_ = jpegxl_opaque;
+  num_job_threads_ = num_job_threads;
+  pending_.store(num_tasks, std::memory_order_relaxed);
+  for (uint32_t t = 0; t < num_threads_; ++t) {
+    uint32_t begin = 0;
+    uint32_t end = 0;
+    if (t < num_job_threads) {
+      begin = start_range + static_cast<uint64_t>(num_tasks) * t /
+                                num_job_threads;
+      end = start_range + static_cast<uint64_t>(num_tasks) * (t + 1) /
+                              num_job_threads;
+    }
+    slots_[t].range.store(Pack(begin, end), std::memory_order_relaxed);
+  }
+
+  // Start the call; sequentially consistent so that sleeping workers are
+  // either notified below or see the new generation before sleeping.
+  generation_.fetch_add(1);
+  if (num_sleeping_.load() != 0) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    wake_cv_.notify_all();
+  }
+
+  RunTasks(0);
+  WaitForCompletion(/*wait_for_tasks=*/true);
+
+  // End the call, then wait for the workers that might still be looking at
+  // the slots, so that the next call can safely reset them.
+  generation_.fetch_add(1);
+  WaitForCompletion(/*wait_for_tasks=*/false);
+
+  depth_.fetch_sub(1, std::memory_order_acq_rel);
+  return JXL_PARALLEL_RET_SUCCESS;
+}
+
+bool WorkStealingParallelRunner::TakeFront(uint32_t slot, uint32_t* begin,
+                                           uint32_t* end) {
+  std::atomic<uint64_t>& range = slots_[slot].range;
+  uint64_t current = range.load(std::memory_order_acquire);
+  for (;;) {
+    const uint32_t first = current >> 32;
+    const uint32_t last = current & 0xFFFFFFFF;
+    if (first >= last) return false;
+    // Guided: take a fraction of the remaining tasks, so that the owner rarely
+    // touches its slot while there is still something left to steal.
+    const uint32_t size = std::max<uint32_t>((last - first) / 8, 1u);
+    if (range.compare_exchange_weak(current, Pack(first + size, last),
+                                    std::memory_order_acq_rel,
+                                    std::memory_order_acquire)) {
+      *begin = first;
+      *end = first + size;
+      return true;
+    }
+  }
+}
+
+bool WorkStealingParallelRunner::StealBack(uint32_t victim, uint32_t thief) {
+  std::atomic<uint64_t>& range = slots_[victim].range;
+  uint64_t current = range.load(std::memory_order_acquire);
+  for (;;) {
+    const uint32_t first = current >> 32;
+    const uint32_t last = current & 0xFFFFFFFF;
+    if (first >= last) return false;
+    const uint32_t middle = first + (last - first) / 2;
+    if (range.compare_exchange_weak(current, Pack(first, middle),
+                                    std::memory_order_acq_rel,
+                                    std::memory_order_acquire)) {
+      // The slot of the thief is empty, so nobody else writes it now.
+      slots_[thief].range.store(Pack(middle, last), std::memory_order_release);
+      return true;
+    }
+  }
+}
+
+void WorkStealingParallelRunner::RunTasks(const uint32_t thread) {
+  for (;;) {
+    uint32_t begin;
+    uint32_t end;
+    while (TakeFront(thread, &begin, &end)) {
+      for (uint32_t task = begin; task < end; ++task) {
+        data_func_(jpegxl_opaque_, task, thread);
+      }
+      const uint32_t num_done = end - begin;
+      if (pending_.fetch_sub(num_done, std::memory_order_acq_rel) ==
+          num_done) {
+        NotifyCaller();
+      }
+    }
+    bool stolen = false;
+    for (uint32_t victim : steal_order_[thread]) {
+      if (victim < num_job_threads_ && StealBack(victim, thread)) {
+        stolen = true;
+        break;
+      }
+    }
+    // All the remaining tasks, if any, are being run by other threads.
+    if (!stolen) return;
+  }
+}
+
+uint64_t WorkStealingParallelRunner::WaitForGeneration(const uint64_t seen) {
+  for (uint32_t i = 0; i < spin_iterations_; ++i) {
+    const uint64_t generation = generation_.load(std::memory_order_acquire);
+    if (generation != seen) return generation;
+    CpuRelax();
+  }
+  std::unique_lock<std::mutex> lock(mutex_);
+  num_sleeping_.fetch_add(1);
+  wake_cv_.wait(lock, [this, seen] { return generation_.load() != seen; });
+  num_sleeping_.fetch_sub(1);
+  return generation_.load();
+}
+
+void WorkStealingParallelRunner::WaitForCompletion(const bool wait_for_tasks) {
+  const auto done = [this, wait_for_tasks] {
+    return wait_for_tasks ? pending_.load() == 0 : num_active_.load() == 0;
+  };
+  for (uint32_t i = 0; i < spin_iterations_; ++i) {
+    if (done()) return;
+    CpuRelax();
+  }
+  std::unique_lock<std::mutex> lock(mutex_);
+  caller_sleeping_.store(true);
+  done_cv_.wait(lock, done);
+  caller_sleeping_.store(false);
+}
+
+void WorkStealingParallelRunner::NotifyCaller() {
+  if (caller_sleeping_.load()) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    done_cv_.notify_one();
+  }
+}
+
+void WorkStealingParallelRunner::ThreadFunc(const uint32_t worker) {
+  const uint32_t thread = worker + 1;
+  uint64_t seen = 0;
+  for (;;) {
+    WaitForGeneration(seen);
+    if (exit_.load(std::memory_order_acquire)) return;
+    // Announce ourselves before looking at the generation, so that the calling
+    // thread does not reset the slots of a call we are still working on.
+    num_active_.fetch_add(1);
+    const uint64_t generation = generation_.load();
+    if ((generation & 1) && thread < num_job_threads_) {
+      RunTasks(thread);
+    }
+    seen = generation;
+    if (num_active_.fetch_sub(1) == 1) NotifyCaller();
+  }
+}
+
+std::vector<int> WorkStealingParallelRunner::AssignWorkers(
+    const bool numa_aware, const bool pin_threads) {
+  std::vector<std::vector<int>> nodes = GetNumaNodes();
+  if (!numa_aware && nodes.size() > 1) {
+    std::vector<int> all;
+    for (const auto& node : nodes) {
+      all.insert(all.end(), node.begin(), node.end());
+    }
+    nodes.assign(1, all);
+  }
+  // Spread workers evenly over the nodes.
+  const size_t num_nodes = nodes.size();
+  std::vector<size_t> node_of_worker(num_worker_threads_);
+  std::vector<int> cpus;
+  for (uint32_t w = 0; w < num_worker_threads_; ++w) {
+    const size_t node = w % num_nodes;
+    node_of_worker[w] = node;
+    if (pin_threads && !nodes[node].empty()) {
+      cpus.push_back(nodes[node][(w / num_nodes) % nodes[node].size()]);
+    }
+  }
+  if (cpus.size() != num_worker_threads_) cpus.clear();
+
+  // The calling thread may run anywhere; it steals from all workers in order,
+  // and is stolen from last.
+  steal_order_.assign(num_threads_, std::vector<uint32_t>());
+  for (uint32_t w = 0; w < num_worker_threads_; ++w) {
+    steal_order_[0].push_back(w + 1);
+  }
+  for (uint32_t w = 0; w < num_worker_threads_; ++w) {
+    std::vector<uint32_t>& order = steal_order_[w + 1];
+    for (int same_node = 1; same_node >= 0; --same_node) {
+      for (uint32_t i = 1; i < num_worker_threads_; ++i) {
+        const uint32_t other = (w + i) % num_worker_threads_;
+        if ((node_of_worker[other] == node_of_worker[w]) == (same_node != 0)) {
+          order.push_back(other + 1);
+        }
+      }
+    }
+    order.push_back(0);
+  }
+  return cpus;
+}
+
+WorkStealingParallelRunner::WorkStealingParallelRunner(
+    const JxlWorkStealingParallelRunnerOptions& options)
+    : num_worker_threads_(static_cast<uint32_t>(options.num_worker_threads)),
+      num_threads_(num_worker_threads_ + 1),
+      spin_iterations_(options.spin_iterations),
+      slots_(new Slot[num_threads_]) {
+  // Suppress "unused-private-field" warning.
+  (void)padding1;
+  (void)padding2;
+  (void)padding3;
+  for (uint32_t t = 0; t < num_threads_; ++t) {
+    slots_[t].range.store(0, std::memory_order_relaxed);
+  }
+  std::vector<int> cpus = AssignWorkers(FROM_JXL_BOOL(options.numa_aware),
+                                        FROM_JXL_BOOL(options.pin_threads));
+
+  threads_.reserve(num_worker_threads_);
+  for (uint32_t w = 0; w < num_worker_threads_; ++w) {
+    threads_.emplace_back(&WorkStealingParallelRunner::ThreadFunc, this, w);
+    if (!cpus.empty()) PinThread(&threads_.back(), cpus[w]);
+  }
+}
+
+WorkStealingParallelRunner::~WorkStealingParallelRunner() {
+  exit_.store(true, std::memory_order_release);
+  generation_.fetch_add(1);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    wake_cv_.notify_all();
+  }
+  for (std::thread& thread : threads_) {
+    if (thread.joinable()) {
+      thread.join();
+    } else {
+#if JXL_IS_DEBUG_BUILD
+      JXL_PRINT_STACK_TRACE();
+      JXL_CRASH();
+#endif
+    }
+  }
+}
+
+}  // namespace jpegxl
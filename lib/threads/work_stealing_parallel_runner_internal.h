@@ -0,0 +1,139 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+//
+
+// C++ implementation using std::thread of a work-stealing ::JxlParallelRunner.
+//
+// Unlike ThreadParallelRunner, tasks are not reserved from a single shared
+// counter: each thread (the workers and the calling thread) owns a range of
+// tasks, packed into a single atomic word on its own cache line. The owner
+// takes tasks from the front of its range, and threads that run out of tasks
+// steal the back half of the range of another thread, looking at threads on
+// the same NUMA node first. Workers are woken by bumping a generation counter;
+// idle workers poll it for a while before sleeping on a condition variable, so
+// that the sequences of short RunOnPool calls made by the codec do not pay for
+// a futex wake-up each.
+//
+// Usage:
+//   WorkStealingParallelRunner runner(options);
+//   JxlDecode(
+//       ... , &WorkStealingParallelRunner::Runner,
+//       static_cast<void*>(&runner));
+
+#ifndef LIB_THREADS_WORK_STEALING_PARALLEL_RUNNER_INTERNAL_H_
+#define LIB_THREADS_WORK_STEALING_PARALLEL_RUNNER_INTERNAL_H_
+
+#include <jxl/memory_manager.h>
+#include <jxl/parallel_runner.h>
+#include <jxl/work_stealing_parallel_runner.h>
+
+#include <atomic>
+#include <condition_variable>  //NOLINT
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>   //NOLINT
+#include <thread>  //NOLINT
+#include <vector>
+
+namespace jpegxl {
+
+class WorkStealingParallelRunner {
+ public:
+  // ::JxlParallelRunner interface.
+  static JxlParallelRetCode Runner(void* runner_opaque, void* jpegxl_opaque,
+                                   JxlParallelRunInit init,
+                                   JxlParallelRunFunction func,
+                                   uint32_t start_range, uint32_t end_range);
+
+  // Starts the worker threads described by `options`.
+  explicit WorkStealingParallelRunner(
+      const JxlWorkStealingParallelRunnerOptions& options);
+
+  // Waits for all threads to exit.
+  ~WorkStealingParallelRunner();
+
+  // Returns maximum number of main/worker threads that may call Func.
+  size_t NumThreads() const { return num_threads_; }
+
+  JxlMemoryManager memory_manager;
+
+ private:
+  // Range of tasks [begin, end) owned by one thread, packed as
+  // (begin << 32) | end. Padded to avoid false sharing between threads.
+  struct Slot {
+    std::atomic<uint64_t> range;
+    uint8_t padding[128 - sizeof(std::atomic<uint64_t>)];
+  };
+
+  static uint64_t Pack(uint32_t begin, uint32_t end) {
+    return (static_cast<uint64_t>(begin) << 32) | end;
+  }
+
+  JxlParallelRetCode Run(void* jpegxl_opaque, JxlParallelRunInit init,
+                         JxlParallelRunFunction func, uint32_t start_range,
+                         uint32_t end_range);
+
+  // Takes a chunk of tasks from the front of the range of `slot`.
+  bool TakeFront(uint32_t slot, uint32_t* begin, uint32_t* end);
+  // Moves the back half of the range of `victim` to `thief`.
+  bool StealBack(uint32_t victim, uint32_t thief);
+  // Runs and steals tasks of the current call until none is left.
+  void RunTasks(uint32_t thread);
+
+  // Returns the new value of generation_ once it differs from `seen`.
+  uint64_t WaitForGeneration(uint64_t seen);
+  // Waits (spinning, then sleeping) until pending_ (if `wait_for_tasks`) or
+  // num_active_ (otherwise) reaches zero.
+  void WaitForCompletion(bool wait_for_tasks);
+  void NotifyCaller();
+
+  void ThreadFunc(uint32_t worker);
+
+  // Fills steal_order_ and returns the CPU to bind each worker to, or an empty
+  // vector if workers are not pinned.
+  std::vector<int> AssignWorkers(bool numa_aware, bool pin_threads);
+
+  const uint32_t num_worker_threads_;
+  const uint32_t num_threads_;  // == num_worker_threads_ + 1
+  const uint32_t spin_iterations_;
+
+  std::vector<std::thread> threads_;
+
+  // Thread 0 is the calling thread, thread i > 0 is worker i - 1.
+  std::unique_ptr<Slot[]> slots_;
+  // For each thread, the other threads in the order they are stolen from.
+  std::vector<std::vector<uint32_t>> steal_order_;
+
+  std::atomic<int> depth_{0};  // detects if Run is re-entered (not supported).
+
+  // Odd while a call is running, even otherwise. Written by the calling
+  // thread only.
+  std::atomic<uint64_t> generation_{0};
+  std::atomic<bool> exit_{false};
+
+  // Written by the calling thread before generation_ becomes odd.
+  JxlParallelRunFunction data_func_;
+  void* jpegxl_opaque_;
+  uint32_t num_job_threads_ = 0;
+
+  uint8_t padding1[64];
+  // Number of tasks of the current call that did not finish yet.
+  std::atomic<uint32_t> pending_{0};
+  uint8_t padding2[64];
+  // Number of workers that may be looking at the current call.
+  std::atomic<uint32_t> num_active_{0};
+  uint8_t padding3[64];
+
+  std::mutex mutex_;  // guards both cv.
+  std::condition_variable wake_cv_;
+  std::atomic<uint32_t> num_sleeping_{0};
+  std::condition_variable done_cv_;
+  std::atomic<bool> caller_sleeping_{false};
+};
+
+}  // namespace jpegxl
+
+#endif  // LIB_THREADS_WORK_STEALING_PARALLEL_RUNNER_INTERNAL_H_
@@ -0,0 +1,138 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include <jxl/parallel_runner.h>
+#include <jxl/types.h>
+#include <jxl/work_stealing_parallel_runner.h>
+#include <jxl/work_stealing_parallel_runner_cxx.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "lib/jxl/base/data_parallel.h"
+#include "lib/jxl/base/status.h"
+#include "lib/jxl/testing.h"
+
+namespace jpegxl {
+namespace {
+
+JxlWorkStealingParallelRunnerPtr MakeRunner(size_t num_worker_threads,
+                                            bool pin_threads = false,
+                                            bool numa_aware = true) {
+  JxlWorkStealingParallelRunnerOptions options;
+  JxlWorkStealingParallelRunnerDefaultOptions(&options);
+  options.num_worker_threads = num_worker_threads;
+  options.pin_threads = TO_JXL_BOOL(pin_threads);
+  options.numa_aware = TO_JXL_BOOL(numa_aware);
+  return JxlWorkStealingParallelRunnerMake(nullptr, &options);
+}
+
+// Ensures every task runs exactly once with a thread index below the number
+// passed to init, and that the runner can be reused.
+TEST(WorkStealingParallelRunnerTest, TestRunner) {
+  for (size_t num_workers = 0; num_workers <= 9; ++num_workers) {
+    auto runner = MakeRunner(num_workers);
+    ASSERT_TRUE(runner);
+    jxl::ThreadPool pool(JxlWorkStealingParallelRunner, runner.get());
+    for (uint32_t num_tasks : {0, 1, 2, 3, 7, 64, 1000}) {
+      for (uint32_t begin : {0u, 5u}) {
+        std::vector<std::atomic<int>> counts(num_tasks);
+        for (auto& count : counts) count.store(0);
+        size_t num_init_threads = 0;
+        const auto init = [&num_init_threads](size_t num_threads) {
+          num_init_threads = num_threads;
+          return true;
+        };
+        const auto do_task = [&](const uint32_t task,
+                                 const size_t thread) -> jxl::Status {
+          EXPECT_GE(task, begin);
+          EXPECT_LT(task, begin + num_tasks);
+          EXPECT_LT(thread, num_init_threads);
+          counts.at(task - begin).fetch_add(1);
+          return true;
+        };
+        EXPECT_TRUE(
+            RunOnPool(&pool, begin, begin + num_tasks, init, do_task, "Test"));
+        if (num_tasks != 0) {
+          EXPECT_LE(num_init_threads, num_workers + 1);
+          EXPECT_LE(num_init_threads, num_tasks);
+        }
+        for (const auto& count : counts) EXPECT_EQ(1, count.load());
+      }
+    }
+  }
+}
+
+// Same, with pinned threads and without NUMA-aware stealing; both are only
+// hints, so the results must not change.
+TEST(WorkStealingParallelRunnerTest, TestOptions) {
+  for (bool pin_threads : {false, true}) {
+    for (bool numa_aware : {false, true}) {
+      auto runner = MakeRunner(4, pin_threads, numa_aware);
+      ASSERT_TRUE(runner);
+      jxl::ThreadPool pool(JxlWorkStealingParallelRunner, runner.get());
+      std::atomic<uint64_t> sum{0};
+      const auto do_task = [&sum](const uint32_t task,
+                                  size_t /*thread*/) -> jxl::Status {
+        sum.fetch_add(task);
+        return true;
+      };
+      EXPECT_TRUE(RunOnPool(&pool, 0, 10000, jxl::ThreadPool::NoInit,
+                            do_task, "TestOptions"));
+      EXPECT_EQ(10000ull * 9999 / 2, sum.load());
+    }
+  }
+}
+
+TEST(WorkStealingParallelRunnerTest, TestDefaultOptions) {
+  auto runner = JxlWorkStealingParallelRunnerMake(nullptr, nullptr);
+  ASSERT_TRUE(runner);
+  jxl::ThreadPool pool(JxlWorkStealingParallelRunner, runner.get());
+  std::atomic<int> num_calls{0};
+  const auto do_task = [&num_calls](uint32_t /*task*/,
+                                    size_t /*thread*/) -> jxl::Status {
+    num_calls.fetch_add(1);
+    return true;
+  };
+  EXPECT_TRUE(RunOnPool(&pool, 0, 100, jxl::ThreadPool::NoInit, do_task,
+                        "TestDefaultOptions"));
+  EXPECT_EQ(100, num_calls.load());
+}
+
+// Nested calls on the same runner are not supported and must fail instead of
+// dead-locking.
+TEST(WorkStealingParallelRunnerTest, TestNestedCallFails) {
+  auto runner = MakeRunner(2);
+  ASSERT_TRUE(runner);
+  void* opaque = runner.get();
+  std::atomic<int> num_nested_errors{0};
+  struct Data {
+    void* runner;
+    std::atomic<int>* num_nested_errors;
+  } data = {opaque, &num_nested_errors};
+  const auto init = [](void* /*opaque*/, size_t /*num_threads*/) -> int {
+    return JXL_PARALLEL_RET_SUCCESS;
+  };
+  const auto outer = [](void* opaque, uint32_t /*value*/, size_t /*thread*/) {
+    Data* data = static_cast<Data*>(opaque);
+    const auto nested_init = [](void* /*opaque*/,
+                                size_t /*num_threads*/) -> int {
+      return JXL_PARALLEL_RET_SUCCESS;
+    };
+    const auto nested_task = [](void* /*opaque*/, uint32_t /*value*/,
+                                size_t /*thread*/) {};
+    JxlParallelRetCode ret = JxlWorkStealingParallelRunner(
+        data->runner, nullptr, nested_init, nested_task, 0, 100);
+    if (ret != JXL_PARALLEL_RET_SUCCESS) data->num_nested_errors->fetch_add(1);
+  };
+  EXPECT_EQ(JXL_PARALLEL_RET_SUCCESS,
+            JxlWorkStealingParallelRunner(opaque, &data, init, outer, 0, 3));
+  EXPECT_EQ(3, num_nested_errors.load());
+}
+
+}  // namespace
+}  // namespace jpegxl
@@ -277,7 +277,7 @@ Status DoCompress(const std::string& filename, const PackedPixelFile& ppf,
                                                             : 80.f;
 
       const JxlCmsInterface& cms = *JxlGetDefaultCms();
-      JxlButteraugliComparator comparator(params, cms);
+      JxlButteraugliComparator comparator(params, cms, inner_pool);
       JXL_RETURN_IF_ERROR(ComputeScore(ib1, ib2, &comparator, cms, &distance,
                                        &distmap, inner_pool,
                                        codec->IgnoreAlpha()));
@@ -295,7 +295,8 @@ Status DoCompress(const std::string& filename, const PackedPixelFile& ppf,
     double pnorm =
         ComputeDistanceP(distmap, ButteraugliParams(), Args()->error_pnorm);
     s->distance_p_norm += pnorm * input_pixels;
-    JXL_ASSIGN_OR_RETURN(Msssim msssim, ComputeSSIMULACRA2(ib1, ib2));
+    JXL_ASSIGN_OR_RETURN(Msssim msssim,
+                         ComputeSSIMULACRA2(ib1, ib2, 0.5f, inner_pool));
     double ssimulacra2 = msssim.Score();
     s->ssimulacra2 += ssimulacra2 * input_pixels;
     s->max_distance = std::max(s->max_distance, distance);
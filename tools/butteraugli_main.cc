@@ -109,7 +109,7 @@ Status RunButteraugli(const char* pathname1, const char* pathname2,
                                               : 80.f;  // sRGB intensity target.
   }
   const JxlCmsInterface& cms = *JxlGetDefaultCms();
-  JxlButteraugliComparator comparator(butteraugli_params, cms);
+  JxlButteraugliComparator comparator(butteraugli_params, cms, pool.get());
   float distance;
   JXL_RETURN_IF_ERROR(ComputeScore(io1.Main(), io2.Main(), &comparator, cms,
                                    &distance, &distmap, pool.get(),
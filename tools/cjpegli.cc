@@ -3,17 +3,27 @@
 // Use of this source code is governed by a BSD-style
 // license that can be found in the LICENSE file.
 
+#include <jxl/encode.h>
+#include <jxl/encode_cxx.h>
+#include <jxl/thread_parallel_runner.h>
+#include <jxl/thread_parallel_runner_cxx.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <memory>
+#include <utility>
 #include <vector>
 
 #include "lib/extras/dec/decode.h"
 #include "lib/extras/enc/jpegli.h"
 #include "lib/extras/time.h"
+#include "lib/jxl/base/common.h"
+#include "lib/jxl/base/data_parallel.h"
 #include "lib/jxl/base/printf_macros.h"
 #include "lib/jxl/base/span.h"
+#include "lib/jxl/encode_internal.h"
+#include "lib/jxl/jpeg/jpeg_data.h"
 #include "tools/args.h"
 #include "tools/cmdline.h"
 #include "tools/file_io.h"
@@ -32,6 +42,12 @@ struct Args {
     cmdline->AddPositionalOption("OUTPUT", /* required = */ true,
                                  "the compressed JPEG output file", &file_out);
 
+    cmdline->AddOptionValue(
+        '\0', "jxl_out", "FILE",
+        "Also write a JPEG XL file, from which the JPEG output can be\n"
+        "    reconstructed exactly, without decoding the JPEG output again.",
+        &jxl_out, &ParseString, 1);
+
     cmdline->AddOptionFlag('\0', "disable_output",
                            "No output file will be written (for benchmarking)",
                            &disable_output, &SetBooleanTrue, 1);
@@ -97,6 +113,11 @@ struct Args {
                             "How many times to compress. (For benchmarking).",
                             &num_reps, &ParseUnsigned, 1);
 
+    cmdline->AddOptionValue('\0', "num_threads", "N",
+                            "Number of worker threads (-1 == use machine "
+                            "default, 0 == do not use multithreading).",
+                            &num_threads, &ParseSigned, 1);
+
     cmdline->AddOptionFlag('\0', "quiet", "Suppress informative output", &quiet,
                            &SetBooleanTrue, 1);
 
@@ -108,11 +129,13 @@ struct Args {
 
   const char* file_in = nullptr;
   const char* file_out = nullptr;
+  std::string jxl_out;
   bool disable_output = false;
   ColorHintsProxy color_hints_proxy;
   jxl::extras::JpegSettings settings;
   int quality = 90;
   size_t num_reps = 1;
+  int32_t num_threads = -1;
   bool quiet = false;
   bool verbose = false;
   // References (ids) of specific options to check if they were matched.
@@ -139,6 +162,10 @@ bool ValidateArgs(const Args& args) {
     fprintf(stderr, "Invalid --progressive_level argument\n");
     return false;
   }
+  if (args.num_threads < -1) {
+    fprintf(stderr, "Invalid --num_threads argument\n");
+    return false;
+  }
   if (settings.progressive_level > 0 && !settings.optimize_coding) {
     fprintf(stderr, "--fixed_code must be used together with -p 0\n");
     return false;
@@ -164,6 +191,42 @@ bool SetDistance(const Args& args, const CommandLineParser& cmdline,
   return true;
 }
 
+// Transcodes the parsed JPEG output to a JPEG XL file with reconstruction data.
+bool EncodeJxlFromJPEGData(std::unique_ptr<jxl::jpeg::JPEGData> jpeg_data,
+                           void* runner, std::vector<uint8_t>* jxl_bytes) {
+  JxlEncoderPtr enc = JxlEncoderMake(nullptr);
+  if (JxlEncoderSetParallelRunner(enc.get(), JxlThreadParallelRunner,
+                                  runner) != JXL_ENC_SUCCESS) {
+    return false;
+  }
+  if (JxlEncoderUseContainer(enc.get(), JXL_TRUE) != JXL_ENC_SUCCESS ||
+      JxlEncoderStoreJPEGMetadata(enc.get(), JXL_TRUE) != JXL_ENC_SUCCESS) {
+    return false;
+  }
+  JxlEncoderFrameSettings* frame_settings =
+      JxlEncoderFrameSettingsCreate(enc.get(), nullptr);
+  if (jxl::AddJPEGFrame(frame_settings, std::move(jpeg_data)) !=
+      JXL_ENC_SUCCESS) {
+    return false;
+  }
+  JxlEncoderCloseInput(enc.get());
+  jxl_bytes->resize(1 << 16);
+  uint8_t* next_out = jxl_bytes->data();
+  size_t avail_out = jxl_bytes->size();
+  JxlEncoderStatus status = JXL_ENC_NEED_MORE_OUTPUT;
+  while (status == JXL_ENC_NEED_MORE_OUTPUT) {
+    status = JxlEncoderProcessOutput(enc.get(), &next_out, &avail_out);
+    if (status == JXL_ENC_NEED_MORE_OUTPUT) {
+      size_t offset = next_out - jxl_bytes->data();
+      jxl_bytes->resize(jxl_bytes->size() * 2);
+      next_out = jxl_bytes->data() + offset;
+      avail_out = jxl_bytes->size() - offset;
+    }
+  }
+  jxl_bytes->resize(next_out - jxl_bytes->data());
+  return status == JXL_ENC_SUCCESS;
+}
+
 int CJpegliMain(int argc, const char* argv[]) {
   Args args;
   CommandLineParser cmdline;
@@ -222,11 +285,24 @@ int CJpegliMain(int argc, const char* argv[]) {
             s.optimize_coding ? "OPT" : "FIX");
   }
 
+  size_t num_worker_threads = JxlThreadParallelRunnerDefaultNumWorkerThreads();
+  if (args.num_threads > -1) {
+    num_worker_threads = args.num_threads;
+  }
+  JxlThreadParallelRunnerPtr runner = JxlThreadParallelRunnerMake(
+      /*memory_manager=*/nullptr, num_worker_threads);
+  jxl::ThreadPool pool(JxlThreadParallelRunner, runner.get());
+
   jpegxl::tools::SpeedStats stats;
   std::vector<uint8_t> jpeg_bytes;
+  std::unique_ptr<jxl::jpeg::JPEGData> jpeg_data;
+  if (!args.jxl_out.empty()) {
+    jpeg_data = jxl::make_unique<jxl::jpeg::JPEGData>();
+  }
   for (size_t num_rep = 0; num_rep < args.num_reps; ++num_rep) {
     const double t0 = jxl::Now();
-    if (!jxl::extras::EncodeJpeg(ppf, args.settings, nullptr, &jpeg_bytes)) {
+    if (!jxl::extras::EncodeJpeg(ppf, args.settings, &pool, &jpeg_bytes,
+                                 jpeg_data.get())) {
       fprintf(stderr, "jpegli encoding failed\n");
       return EXIT_FAILURE;
     }
@@ -241,6 +317,18 @@ int CJpegliMain(int argc, const char* argv[]) {
       return EXIT_FAILURE;
     }
   }
+  if (jpeg_data && !args.disable_output) {
+    std::vector<uint8_t> jxl_bytes;
+    if (!EncodeJxlFromJPEGData(std::move(jpeg_data), runner.get(),
+                               &jxl_bytes)) {
+      fprintf(stderr, "JPEG XL transcoding failed\n");
+      return EXIT_FAILURE;
+    }
+    if (!WriteFile(args.jxl_out, jxl_bytes)) {
+      fprintf(stderr, "Could not write jxl to %s\n", args.jxl_out.c_str());
+      return EXIT_FAILURE;
+    }
+  }
   if (!args.quiet) {
     fprintf(stderr, "Compressed to %" PRIuS " bytes ", jpeg_bytes.size());
     const size_t num_pixels = ppf.info.xsize * ppf.info.ysize;
@@ -3,18 +3,25 @@
 // Use of this source code is governed by a BSD-style
 // license that can be found in the LICENSE file.
 
+#include <jxl/thread_parallel_runner.h>
+#include <jxl/thread_parallel_runner_cxx.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "lib/extras/dec/jpegli.h"
 #include "lib/extras/enc/apng.h"
 #include "lib/extras/enc/encode.h"
+#include "lib/extras/mmap.h"
 #include "lib/extras/time.h"
+#include "lib/jxl/base/data_parallel.h"
 #include "lib/jxl/base/printf_macros.h"
+#include "lib/jxl/base/span.h"
+#include "lib/jxl/base/status.h"
 #include "tools/cmdline.h"
 #include "tools/file_io.h"
 #include "tools/speed_stats.h"
@@ -47,6 +54,11 @@ struct Args {
                             "Used for benchmarking, the default is 1.",
                             &num_reps, &ParseUnsigned);
 
+    cmdline->AddOptionValue('\0', "num_threads", "N",
+                            "Number of worker threads (-1 == use machine "
+                            "default, 0 == do not use multithreading).",
+                            &num_threads, &ParseSigned);
+
     cmdline->AddOptionFlag('\0', "quiet", "Silence output (except for errors).",
                            &quiet, &SetBooleanTrue);
   }
@@ -56,6 +68,7 @@ struct Args {
   bool disable_output = false;
   size_t bitdepth = 8;
   size_t num_reps = 1;
+  int32_t num_threads = -1;
   bool quiet = false;
 };
 
@@ -64,6 +77,10 @@ bool ValidateArgs(const Args& args) {
     fprintf(stderr, "Invalid --bitdepth argument\n");
     return false;
   }
+  if (args.num_threads < -1) {
+    fprintf(stderr, "Invalid --num_threads argument\n");
+    return false;
+  }
   return true;
 }
 
@@ -114,10 +131,25 @@ int DJpegliMain(int argc, const char* argv[]) {
     return EXIT_FAILURE;
   }
 
-  std::vector<uint8_t> jpeg_bytes;
-  if (!ReadFile(args.file_in, &jpeg_bytes)) {
-    fprintf(stderr, "Failed to read input image %s\n", args.file_in);
-    return EXIT_FAILURE;
+  // Regular files are memory mapped and decoded in place, other inputs (e.g.
+  // standard input) are read into memory.
+  jxl::MemoryMappedFile jpeg_file;
+  std::vector<uint8_t> jpeg_data;
+  jxl::Span<const uint8_t> jpeg_bytes;
+  if (std::string(args.file_in) != "-") {
+    jxl::StatusOr<jxl::MemoryMappedFile> jpeg_file_or =
+        jxl::MemoryMappedFile::Init(args.file_in);
+    if (jpeg_file_or.ok()) {
+      jpeg_file = std::move(jpeg_file_or).value_();
+      jpeg_bytes = jxl::Span<const uint8_t>(jpeg_file.data(), jpeg_file.size());
+    }
+  }
+  if (jpeg_bytes.empty()) {
+    if (!ReadFile(args.file_in, &jpeg_data)) {
+      fprintf(stderr, "Failed to read input image %s\n", args.file_in);
+      return EXIT_FAILURE;
+    }
+    jpeg_bytes = jxl::Span<const uint8_t>(jpeg_data);
   }
 
   if (!args.quiet) {
@@ -139,11 +171,19 @@ int DJpegliMain(int argc, const char* argv[]) {
   jxl::extras::JpegDecompressParams dparams;
   SetDecompressParams(args, extension, &dparams);
 
+  size_t num_worker_threads = JxlThreadParallelRunnerDefaultNumWorkerThreads();
+  if (args.num_threads > -1) {
+    num_worker_threads = args.num_threads;
+  }
+  JxlThreadParallelRunnerPtr runner = JxlThreadParallelRunnerMake(
+      /*memory_manager=*/nullptr, num_worker_threads);
+  jxl::ThreadPool pool(JxlThreadParallelRunner, runner.get());
+
   jxl::extras::PackedPixelFile ppf;
   jpegxl::tools::SpeedStats stats;
   for (size_t num_rep = 0; num_rep < args.num_reps; ++num_rep) {
     const double t0 = jxl::Now();
-    if (!jxl::extras::DecodeJpeg(jpeg_bytes, dparams, nullptr, &ppf)) {
+    if (!jxl::extras::DecodeJpeg(jpeg_bytes, dparams, &pool, &ppf)) {
       fprintf(stderr, "jpegli decoding failed\n");
       return EXIT_FAILURE;
     }
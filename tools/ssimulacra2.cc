@@ -28,11 +28,20 @@ Design:
 #include <jxl/memory_manager.h>
 
 #include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <cstddef>
 #include <cstdio>
 #include <utility>
+#include <vector>
+
+#undef HWY_TARGET_INCLUDE
+#define HWY_TARGET_INCLUDE "tools/ssimulacra2.cc"
+#include <hwy/foreach_target.h>
+#include <hwy/highway.h>
 
 #include "lib/jxl/base/compiler_specific.h"
+#include "lib/jxl/base/data_parallel.h"
 #include "lib/jxl/base/printf_macros.h"
 #include "lib/jxl/base/status.h"
 #include "lib/jxl/color_encoding_internal.h"
@@ -42,26 +51,150 @@ Design:
 #include "tools/gauss_blur.h"
 #include "tools/no_memory_manager.h"
 
+HWY_BEFORE_NAMESPACE();
+namespace jxl {
+namespace HWY_NAMESPACE {
 namespace {
 
-using ::jxl::Image3F;
-using ::jxl::ImageBundle;
-using ::jxl::ImageF;
-using ::jxl::Status;
-using ::jxl::StatusOr;
+// These templates are not found via ADL.
+using hwy::HWY_NAMESPACE::Abs;
+using hwy::HWY_NAMESPACE::Add;
+using hwy::HWY_NAMESPACE::Div;
+using hwy::HWY_NAMESPACE::Mul;
+using hwy::HWY_NAMESPACE::Sub;
 
 const float kC2 = 0.0009f;
-const int kNumScales = 6;
 
-StatusOr<Image3F> Downsample(const Image3F& in, size_t fx, size_t fy) {
+double Quartic(double x) {
+  x *= x;
+  x *= x;
+  return x;
+}
+
+// The map rows are computed in blocks of this many pixels: the per-pixel
+// ratios with SIMD in single precision, then their norms are accumulated in
+// double precision, pixel by pixel as in the scalar reference.
+constexpr size_t kBlockSize = 256;
+
+void MultiplyRow(const float* JXL_RESTRICT in1, const float* JXL_RESTRICT in2,
+                 const size_t xsize, float* JXL_RESTRICT out) {
+  const HWY_FULL(float) d;
+  for (size_t x = 0; x < xsize; x += Lanes(d)) {
+    Store(Mul(Load(d, in1 + x), Load(d, in2 + x)), d, out + x);
+  }
+}
+
+// Adds the sum of 1 - SSIM' and of its 4th power over the row to `sums`.
+void SSIMMapRow(const float* JXL_RESTRICT row_m1,
+                const float* JXL_RESTRICT row_m2,
+                const float* JXL_RESTRICT row_s11,
+                const float* JXL_RESTRICT row_s22,
+                const float* JXL_RESTRICT row_s12, const size_t xsize,
+                double* JXL_RESTRICT sums) {
+  const HWY_FULL(float) d;
+  const auto one = Set(d, 1.0f);
+  const auto two = Set(d, 2.0f);
+  const auto c2 = Set(d, kC2);
+  HWY_ALIGN float ratio[kBlockSize];
+  for (size_t x0 = 0; x0 < xsize; x0 += kBlockSize) {
+    const size_t len = std::min(kBlockSize, xsize - x0);
+    // The rows are padded to a whole number of vectors.
+    for (size_t i = 0; i < len; i += Lanes(d)) {
+      const size_t x = x0 + i;
+      const auto mu1 = Load(d, row_m1 + x);
+      const auto mu2 = Load(d, row_m2 + x);
+      const auto mu11 = Mul(mu1, mu1);
+      const auto mu22 = Mul(mu2, mu2);
+      const auto mu12 = Mul(mu1, mu2);
+      const auto diff = Sub(mu1, mu2);
+      /* Correction applied compared to the original SSIM formula, which has:
+
+           luma_err = 2 * mu1 * mu2 / (mu1^2 + mu2^2)
+                    = 1 - (mu1 - mu2)^2 / (mu1^2 + mu2^2)
+
+         The denominator causes error in the darks (low mu1 and mu2) to weigh
+         more than error in the brights (high mu1 and mu2). This would make
+         sense if values correspond to linear luma. However, the actual values
+         are either gamma-compressed luma (which supposedly is already
+         perceptually uniform) or chroma (where weighing green more than red
+         or blue more than yellow does not make any sense at all). So it is
+         better to simply drop this denominator.
+      */
+      const auto num_m = Sub(one, Mul(diff, diff));
+      const auto num_s = Add(Mul(two, Sub(Load(d, row_s12 + x), mu12)), c2);
+      const auto denom_s = Add(Add(Sub(Load(d, row_s11 + x), mu11),
+                                   Sub(Load(d, row_s22 + x), mu22)),
+                               c2);
+      Store(Div(Mul(num_m, num_s), denom_s), d, ratio + i);
+    }
+    for (size_t i = 0; i < len; ++i) {
+      // Use 1 - SSIM' so it becomes an error score instead of a quality
+      // index. This makes it make sense to compute an L_4 norm.
+      const double err = std::max(1.0 - ratio[i], 0.0);
+      sums[0] += err;
+      sums[1] += Quartic(err);
+    }
+  }
+}
+
+// Adds the sums of the artifact and detail lost maps and of their 4th powers
+// over the row to `sums`.
+void EdgeDiffMapRow(const float* JXL_RESTRICT row1,
+                    const float* JXL_RESTRICT rowm1,
+                    const float* JXL_RESTRICT row2,
+                    const float* JXL_RESTRICT rowm2, const size_t xsize,
+                    double* JXL_RESTRICT sums) {
+  const HWY_FULL(float) d;
+  HWY_ALIGN float edge1[kBlockSize];
+  HWY_ALIGN float edge2[kBlockSize];
+  for (size_t x0 = 0; x0 < xsize; x0 += kBlockSize) {
+    const size_t len = std::min(kBlockSize, xsize - x0);
+    for (size_t i = 0; i < len; i += Lanes(d)) {
+      const size_t x = x0 + i;
+      Store(Abs(Sub(Load(d, row1 + x), Load(d, rowm1 + x))), d, edge1 + i);
+      Store(Abs(Sub(Load(d, row2 + x), Load(d, rowm2 + x))), d, edge2 + i);
+    }
+    for (size_t i = 0; i < len; ++i) {
+      const double d1 = (1.0 + edge2[i]) / (1.0 + edge1[i]) - 1.0;
+      // d1 > 0: distorted has an edge where original is smooth
+      //         (indicating ringing, color banding, blockiness, etc)
+      const double artifact = std::max(d1, 0.0);
+      sums[0] += artifact;
+      sums[1] += Quartic(artifact);
+      // d1 < 0: original has an edge where distorted is smooth
+      //         (indicating smoothing, blurring, smearing, etc)
+      const double detail_lost = std::max(-d1, 0.0);
+      sums[2] += detail_lost;
+      sums[3] += Quartic(detail_lost);
+    }
+  }
+}
+
+}  // namespace
+// NOLINTNEXTLINE(google-readability-namespace-comments)
+}  // namespace HWY_NAMESPACE
+}  // namespace jxl
+HWY_AFTER_NAMESPACE();
+
+#if HWY_ONCE
+namespace jxl {
+namespace {
+
+HWY_EXPORT(MultiplyRow);
+HWY_EXPORT(SSIMMapRow);
+HWY_EXPORT(EdgeDiffMapRow);
+
+StatusOr<Image3F> Downsample(const Image3F& in, size_t fx, size_t fy,
+                             ThreadPool* pool) {
   const size_t out_xsize = (in.xsize() + fx - 1) / fx;
   const size_t out_ysize = (in.ysize() + fy - 1) / fy;
   JXL_ASSIGN_OR_RETURN(
       Image3F out,
       Image3F::Create(jpegxl::tools::NoMemoryManager(), out_xsize, out_ysize));
   const float normalize = 1.0f / (fx * fy);
-  for (size_t c = 0; c < 3; ++c) {
-    for (size_t oy = 0; oy < out_ysize; ++oy) {
+  const auto process_row = [&](const uint32_t oy,
+                               size_t /* thread */) -> Status {
+    for (size_t c = 0; c < 3; ++c) {
       float* JXL_RESTRICT row_out = out.PlaneRow(c, oy);
       for (size_t ox = 0; ox < out_xsize; ++ox) {
         float sum = 0.0f;
@@ -75,150 +208,145 @@ StatusOr<Image3F> Downsample(const Image3F& in, size_t fx, size_t fy) {
         row_out[ox] = sum * normalize;
       }
     }
-  }
+    return true;
+  };
+  JXL_RETURN_IF_ERROR(RunOnPool(pool, 0, out_ysize, ThreadPool::NoInit,
+                                process_row, "SSIMULACRA2Downsample"));
   return out;
 }
 
-void Multiply(const Image3F& a, const Image3F& b, Image3F* mul) {
-  for (size_t c = 0; c < 3; ++c) {
-    for (size_t y = 0; y < a.ysize(); ++y) {
-      const float* JXL_RESTRICT in1 = a.PlaneRow(c, y);
-      const float* JXL_RESTRICT in2 = b.PlaneRow(c, y);
-      float* JXL_RESTRICT out = mul->PlaneRow(c, y);
-      for (size_t x = 0; x < a.xsize(); ++x) {
-        out[x] = in1[x] * in2[x];
-      }
-    }
+void Multiply(const ImageF& a, const ImageF& b, ImageF* mul) {
+  for (size_t y = 0; y < a.ysize(); ++y) {
+    HWY_DYNAMIC_DISPATCH(MultiplyRow)
+    (a.ConstRow(y), b.ConstRow(y), a.xsize(), mul->Row(y));
   }
 }
 
-// Temporary storage for Gaussian blur, reused for multiple images.
-class Blur {
- public:
-  static StatusOr<Blur> Create(const size_t xsize, const size_t ysize) {
-    JxlMemoryManager* memory_manager = jpegxl::tools::NoMemoryManager();
-    Blur result;
-    JXL_ASSIGN_OR_RETURN(result.temp_,
-                         ImageF::Create(memory_manager, xsize, ysize));
-    return result;
-  }
-
-  Status BlurPlane(const ImageF& in, ImageF* JXL_RESTRICT out) {
-    JXL_RETURN_IF_ERROR(FastGaussian(
-        rg_, in.xsize(), in.ysize(), [&](size_t y) { return in.ConstRow(y); },
-        [&](size_t y) { return temp_.Row(y); },
-        [&](size_t y) { return out->Row(y); }));
-    return true;
-  }
-
-  StatusOr<Image3F> operator()(const Image3F& in) {
-    JxlMemoryManager* memory_manager = jpegxl::tools::NoMemoryManager();
-    JXL_ASSIGN_OR_RETURN(
-        Image3F out, Image3F::Create(memory_manager, in.xsize(), in.ysize()));
-    JXL_RETURN_IF_ERROR(BlurPlane(in.Plane(0), &out.Plane(0)));
-    JXL_RETURN_IF_ERROR(BlurPlane(in.Plane(1), &out.Plane(1)));
-    JXL_RETURN_IF_ERROR(BlurPlane(in.Plane(2), &out.Plane(2)));
-    return out;
-  }
+// Blurred images of one scale; the inputs of the SSIM formula.
+enum BlurredImage { kMu1, kMu2, kSigma11, kSigma22, kSigma12, kNumBlurred };
 
-  // Allows reusing across scales.
-  Status ShrinkTo(const size_t xsize, const size_t ysize) {
-    return temp_.ShrinkTo(xsize, ysize);
+// Computes the blurred images, one task per image and channel.
+Status BlurImages(const Image3F& img1, const Image3F& img2, ThreadPool* pool,
+                  Image3F* blurred) {
+  JxlMemoryManager* memory_manager = jpegxl::tools::NoMemoryManager();
+  const size_t xsize = img1.xsize();
+  const size_t ysize = img1.ysize();
+  for (size_t i = 0; i < kNumBlurred; ++i) {
+    JXL_ASSIGN_OR_RETURN(blurred[i],
+                         Image3F::Create(memory_manager, xsize, ysize));
   }
-
- private:
-  Blur() : rg_(jxl::CreateRecursiveGaussian(1.5)) {}
-  jxl::RecursiveGaussian rg_;
-  ImageF temp_;
-};
-
-double quartic(double x) {
-  x *= x;
-  x *= x;
-  return x;
-}
-void SSIMMap(const Image3F& m1, const Image3F& m2, const Image3F& s11,
-             const Image3F& s22, const Image3F& s12, double* plane_averages) {
-  const double onePerPixels = 1.0 / (m1.ysize() * m1.xsize());
-  for (size_t c = 0; c < 3; ++c) {
-    double sum1[2] = {0.0};
-    for (size_t y = 0; y < m1.ysize(); ++y) {
-      const float* JXL_RESTRICT row_m1 = m1.PlaneRow(c, y);
-      const float* JXL_RESTRICT row_m2 = m2.PlaneRow(c, y);
-      const float* JXL_RESTRICT row_s11 = s11.PlaneRow(c, y);
-      const float* JXL_RESTRICT row_s22 = s22.PlaneRow(c, y);
-      const float* JXL_RESTRICT row_s12 = s12.PlaneRow(c, y);
-      for (size_t x = 0; x < m1.xsize(); ++x) {
-        float mu1 = row_m1[x];
-        float mu2 = row_m2[x];
-        float mu11 = mu1 * mu1;
-        float mu22 = mu2 * mu2;
-        float mu12 = mu1 * mu2;
-        /* Correction applied compared to the original SSIM formula, which has:
-
-             luma_err = 2 * mu1 * mu2 / (mu1^2 + mu2^2)
-                      = 1 - (mu1 - mu2)^2 / (mu1^2 + mu2^2)
-
-           The denominator causes error in the darks (low mu1 and mu2) to weigh
-           more than error in the brights (high mu1 and mu2). This would make
-           sense if values correspond to linear luma. However, the actual values
-           are either gamma-compressed luma (which supposedly is already
-           perceptually uniform) or chroma (where weighing green more than red
-           or blue more than yellow does not make any sense at all). So it is
-           better to simply drop this denominator.
-        */
-        float num_m = 1.0 - (mu1 - mu2) * (mu1 - mu2);
-        float num_s = 2 * (row_s12[x] - mu12) + kC2;
-        float denom_s = (row_s11[x] - mu11) + (row_s22[x] - mu22) + kC2;
-
-        // Use 1 - SSIM' so it becomes an error score instead of a quality
-        // index. This makes it make sense to compute an L_4 norm.
-        double d = 1.0 - (num_m * num_s / denom_s);
-        d = std::max(d, 0.0);
-        sum1[0] += d;
-        sum1[1] += quartic(d);
-      }
+  const jxl::RecursiveGaussian rg = jxl::CreateRecursiveGaussian(1.5);
+  // Scratch images, one per thread that runs a task. There are only
+  // 3 * kNumBlurred tasks, so at most that many threads need them.
+  std::vector<ImageF> temp;
+  std::vector<ImageF> mul;
+  std::vector<int> thread_slot;
+  std::atomic<size_t> num_used_slots{0};
+  const auto init = [&](const size_t num_threads) -> Status {
+    const size_t num_slots = std::min<size_t>(num_threads, 3 * kNumBlurred);
+    temp.resize(num_slots);
+    mul.resize(num_slots);
+    for (size_t i = 0; i < num_slots; ++i) {
+      JXL_ASSIGN_OR_RETURN(temp[i],
+                           ImageF::Create(memory_manager, xsize, ysize));
+      JXL_ASSIGN_OR_RETURN(mul[i],
+                           ImageF::Create(memory_manager, xsize, ysize));
     }
-    plane_averages[c * 2] = onePerPixels * sum1[0];
-    plane_averages[c * 2 + 1] = sqrt(sqrt(onePerPixels * sum1[1]));
-  }
+    thread_slot.assign(num_threads, -1);
+    return true;
+  };
+  const auto blur = [&](const uint32_t task, const size_t thread) -> Status {
+    if (thread_slot[thread] < 0) {
+      thread_slot[thread] = static_cast<int>(num_used_slots++);
+    }
+    const size_t slot = thread_slot[thread];
+    JXL_ENSURE(slot < temp.size());
+    const size_t c = task % 3;
+    const size_t image = task / 3;
+    const ImageF* in = &mul[slot];
+    if (image == kMu1) {
+      in = &img1.Plane(c);
+    } else if (image == kMu2) {
+      in = &img2.Plane(c);
+    } else if (image == kSigma11) {
+      Multiply(img1.Plane(c), img1.Plane(c), &mul[slot]);
+    } else if (image == kSigma22) {
+      Multiply(img2.Plane(c), img2.Plane(c), &mul[slot]);
+    } else {
+      Multiply(img1.Plane(c), img2.Plane(c), &mul[slot]);
+    }
+    ImageF& out = blurred[image].Plane(c);
+    return jxl::FastGaussian(
+        rg, xsize, ysize, [&](size_t y) { return in->ConstRow(y); },
+        [&](size_t y) { return temp[slot].Row(y); },
+        [&](size_t y) { return out.Row(y); });
+  };
+  return RunOnPool(pool, 0, 3 * kNumBlurred, init, blur, "SSIMULACRA2Blur");
 }
 
-void EdgeDiffMap(const Image3F& img1, const Image3F& mu1, const Image3F& img2,
-                 const Image3F& mu2, double* plane_averages) {
-  const double onePerPixels = 1.0 / (img1.ysize() * img1.xsize());
+// Computes the norms of the SSIM and edge difference maps of one scale. The
+// sums are accumulated per row and then added up in order, so the result does
+// not depend on the number of threads.
+Status ComputeScale(const Image3F& img1, const Image3F& img2,
+                    const Image3F* blurred, ThreadPool* pool,
+                    MsssimScale* sscale) {
+  const size_t xsize = img1.xsize();
+  const size_t ysize = img1.ysize();
+  // For each row and channel: 2 sums of the SSIM map, then 4 of the edge maps.
+  constexpr size_t kNumSums = 6;
+  std::vector<double> row_sums(ysize * 3 * kNumSums);
+  const auto process_row = [&](const uint32_t y,
+                               size_t /* thread */) -> Status {
+    for (size_t c = 0; c < 3; ++c) {
+      double* sums = &row_sums[(y * 3 + c) * kNumSums];
+      HWY_DYNAMIC_DISPATCH(SSIMMapRow)
+      (blurred[kMu1].ConstPlaneRow(c, y), blurred[kMu2].ConstPlaneRow(c, y),
+       blurred[kSigma11].ConstPlaneRow(c, y),
+       blurred[kSigma22].ConstPlaneRow(c, y),
+       blurred[kSigma12].ConstPlaneRow(c, y), xsize, sums);
+      HWY_DYNAMIC_DISPATCH(EdgeDiffMapRow)
+      (img1.ConstPlaneRow(c, y), blurred[kMu1].ConstPlaneRow(c, y),
+       img2.ConstPlaneRow(c, y), blurred[kMu2].ConstPlaneRow(c, y), xsize,
+       sums + 2);
+    }
+    return true;
+  };
+  JXL_RETURN_IF_ERROR(RunOnPool(pool, 0, ysize, ThreadPool::NoInit,
+                                process_row, "SSIMULACRA2Maps"));
+  const double one_per_pixels = 1.0 / (xsize * ysize);
   for (size_t c = 0; c < 3; ++c) {
-    double sum1[4] = {0.0};
-    for (size_t y = 0; y < img1.ysize(); ++y) {
-      const float* JXL_RESTRICT row1 = img1.PlaneRow(c, y);
-      const float* JXL_RESTRICT row2 = img2.PlaneRow(c, y);
-      const float* JXL_RESTRICT rowm1 = mu1.PlaneRow(c, y);
-      const float* JXL_RESTRICT rowm2 = mu2.PlaneRow(c, y);
-      for (size_t x = 0; x < img1.xsize(); ++x) {
-        double d1 = (1.0 + std::abs(row2[x] - rowm2[x])) /
-                        (1.0 + std::abs(row1[x] - rowm1[x])) -
-                    1.0;
-
-        // d1 > 0: distorted has an edge where original is smooth
-        //         (indicating ringing, color banding, blockiness, etc)
-        double artifact = std::max(d1, 0.0);
-        sum1[0] += artifact;
-        sum1[1] += quartic(artifact);
-
-        // d1 < 0: original has an edge where distorted is smooth
-        //         (indicating smoothing, blurring, smearing, etc)
-        double detail_lost = std::max(-d1, 0.0);
-        sum1[2] += detail_lost;
-        sum1[3] += quartic(detail_lost);
+    double sums[kNumSums] = {0.0};
+    for (size_t y = 0; y < ysize; ++y) {
+      for (size_t i = 0; i < kNumSums; ++i) {
+        sums[i] += row_sums[(y * 3 + c) * kNumSums + i];
       }
     }
-    plane_averages[c * 4] = onePerPixels * sum1[0];
-    plane_averages[c * 4 + 1] = sqrt(sqrt(onePerPixels * sum1[1]));
-    plane_averages[c * 4 + 2] = onePerPixels * sum1[2];
-    plane_averages[c * 4 + 3] = sqrt(sqrt(onePerPixels * sum1[3]));
+    sscale->avg_ssim[c * 2] = one_per_pixels * sums[0];
+    sscale->avg_ssim[c * 2 + 1] =
+        std::sqrt(std::sqrt(one_per_pixels * sums[1]));
+    for (size_t i = 0; i < 4; i += 2) {
+      sscale->avg_edgediff[c * 4 + i] = one_per_pixels * sums[2 + i];
+      sscale->avg_edgediff[c * 4 + i + 1] =
+          std::sqrt(std::sqrt(one_per_pixels * sums[2 + i + 1]));
+    }
   }
+  return true;
 }
 
+}  // namespace
+}  // namespace jxl
+
+namespace {
+
+using ::jxl::Image3F;
+using ::jxl::ImageBundle;
+using ::jxl::ImageF;
+using ::jxl::Status;
+using ::jxl::StatusOr;
+using ::jxl::ThreadPool;
+
+const int kNumScales = 6;
+
 /* Get all components in more or less 0..1 range
    Range of Rec2020 with these adjustments:
     X: 0.017223..0.998838
@@ -444,7 +572,8 @@ double Msssim::Score() const {
 }
 
 StatusOr<Msssim> ComputeSSIMULACRA2(const ImageBundle& orig,
-                                    const ImageBundle& dist, float bg) {
+                                    const ImageBundle& dist, float bg,
+                                    ThreadPool* pool) {
   JxlMemoryManager* memory_manager = jpegxl::tools::NoMemoryManager();
   Msssim msssim;
 
@@ -463,66 +592,60 @@ StatusOr<Msssim> ComputeSSIMULACRA2(const ImageBundle& orig,
   orig2.ClearExtraChannels();
   dist2.ClearExtraChannels();
 
-  JXL_RETURN_IF_ERROR(orig2.TransformTo(
-      jxl::ColorEncoding::LinearSRGB(orig2.IsGray()), *JxlGetDefaultCms()));
-  JXL_RETURN_IF_ERROR(dist2.TransformTo(
-      jxl::ColorEncoding::LinearSRGB(dist2.IsGray()), *JxlGetDefaultCms()));
+  JXL_RETURN_IF_ERROR(
+      orig2.TransformTo(jxl::ColorEncoding::LinearSRGB(orig2.IsGray()),
+                        *JxlGetDefaultCms(), pool));
+  JXL_RETURN_IF_ERROR(
+      dist2.TransformTo(jxl::ColorEncoding::LinearSRGB(dist2.IsGray()),
+                        *JxlGetDefaultCms(), pool));
 
   JXL_RETURN_IF_ERROR(
-      jxl::ToXYB(orig2, nullptr, &img1, *JxlGetDefaultCms(), nullptr));
+      jxl::ToXYB(orig2, pool, &img1, *JxlGetDefaultCms(), nullptr));
   JXL_RETURN_IF_ERROR(
-      jxl::ToXYB(dist2, nullptr, &img2, *JxlGetDefaultCms(), nullptr));
+      jxl::ToXYB(dist2, pool, &img2, *JxlGetDefaultCms(), nullptr));
   MakePositiveXYB(img1);
   MakePositiveXYB(img2);
 
-  JXL_ASSIGN_OR_RETURN(
-      Image3F mul, Image3F::Create(memory_manager, img1.xsize(), img1.ysize()));
-  JXL_ASSIGN_OR_RETURN(Blur blur, Blur::Create(img1.xsize(), img1.ysize()));
-
+  Image3F blurred[jxl::kNumBlurred];
   for (int scale = 0; scale < kNumScales; scale++) {
     if (img1.xsize() < 8 || img1.ysize() < 8) {
       break;
     }
     if (scale) {
-      JXL_ASSIGN_OR_RETURN(Image3F tmp, Downsample(*orig2.color(), 2, 2));
+      JXL_ASSIGN_OR_RETURN(Image3F tmp,
+                           jxl::Downsample(*orig2.color(), 2, 2, pool));
       JXL_RETURN_IF_ERROR(orig2.SetFromImage(
           std::move(tmp), jxl::ColorEncoding::LinearSRGB(orig2.IsGray())));
-      JXL_ASSIGN_OR_RETURN(tmp, Downsample(*dist2.color(), 2, 2));
+      JXL_ASSIGN_OR_RETURN(tmp,
+                           jxl::Downsample(*dist2.color(), 2, 2, pool));
       JXL_RETURN_IF_ERROR(dist2.SetFromImage(
           std::move(tmp), jxl::ColorEncoding::LinearSRGB(dist2.IsGray())));
       JXL_RETURN_IF_ERROR(img1.ShrinkTo(orig2.xsize(), orig2.ysize()));
       JXL_RETURN_IF_ERROR(img2.ShrinkTo(orig2.xsize(), orig2.ysize()));
       JXL_RETURN_IF_ERROR(
-          jxl::ToXYB(orig2, nullptr, &img1, *JxlGetDefaultCms(), nullptr));
+          jxl::ToXYB(orig2, pool, &img1, *JxlGetDefaultCms(), nullptr));
       JXL_RETURN_IF_ERROR(
-          jxl::ToXYB(dist2, nullptr, &img2, *JxlGetDefaultCms(), nullptr));
+          jxl::ToXYB(dist2, pool, &img2, *JxlGetDefaultCms(), nullptr));
       MakePositiveXYB(img1);
       MakePositiveXYB(img2);
     }
-    JXL_RETURN_IF_ERROR(mul.ShrinkTo(img1.xsize(), img1.ysize()));
-    JXL_RETURN_IF_ERROR(blur.ShrinkTo(img1.xsize(), img1.ysize()));
-
-    Multiply(img1, img1, &mul);
-    JXL_ASSIGN_OR_RETURN(Image3F sigma1_sq, blur(mul));
-
-    Multiply(img2, img2, &mul);
-    JXL_ASSIGN_OR_RETURN(Image3F sigma2_sq, blur(mul));
-
-    Multiply(img1, img2, &mul);
-    JXL_ASSIGN_OR_RETURN(Image3F sigma12, blur(mul));
-
-    JXL_ASSIGN_OR_RETURN(Image3F mu1, blur(img1));
-    JXL_ASSIGN_OR_RETURN(Image3F mu2, blur(img2));
+    JXL_RETURN_IF_ERROR(jxl::BlurImages(img1, img2, pool, blurred));
 
     MsssimScale sscale;
-    SSIMMap(mu1, mu2, sigma1_sq, sigma2_sq, sigma12, sscale.avg_ssim);
-    EdgeDiffMap(img1, mu1, img2, mu2, sscale.avg_edgediff);
+    JXL_RETURN_IF_ERROR(
+        jxl::ComputeScale(img1, img2, blurred, pool, &sscale));
     msssim.scales.push_back(sscale);
   }
   return msssim;
 }
 
+StatusOr<Msssim> ComputeSSIMULACRA2(const ImageBundle& orig,
+                                    const ImageBundle& dist, float bg) {
+  return ComputeSSIMULACRA2(orig, dist, bg, /*pool=*/nullptr);
+}
+
 StatusOr<Msssim> ComputeSSIMULACRA2(const ImageBundle& orig,
                                     const ImageBundle& distorted) {
   return ComputeSSIMULACRA2(orig, distorted, 0.5f);
 }
+#endif  // HWY_ONCE
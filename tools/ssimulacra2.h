@@ -8,6 +8,7 @@
 
 #include <vector>
 
+#include "lib/jxl/base/data_parallel.h"
 #include "lib/jxl/base/status.h"
 #include "lib/jxl/image_bundle.h"
 
@@ -24,7 +25,12 @@ struct Msssim {
 
 // Computes the SSIMULACRA 2 score between reference image 'orig' and
 // distorted image 'distorted'. In case of alpha transparency, assume
-// a gray background if intensity 'bg' (in range 0..1).
+// a gray background if intensity 'bg' (in range 0..1). The scales are
+// computed with the channels and the rows of the error maps in parallel on
+// 'pool'; the score does not depend on the number of threads.
+jxl::StatusOr<Msssim> ComputeSSIMULACRA2(const jxl::ImageBundle &orig,
+                                         const jxl::ImageBundle &distorted,
+                                         float bg, jxl::ThreadPool *pool);
 jxl::StatusOr<Msssim> ComputeSSIMULACRA2(const jxl::ImageBundle &orig,
                                          const jxl::ImageBundle &distorted,
                                          float bg);
@@ -0,0 +1,82 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include <jxl/memory_manager.h>
+
+#include <cstddef>
+#include <utility>
+
+#include "benchmark/benchmark.h"
+#include "lib/jxl/base/random.h"
+#include "lib/jxl/base/status.h"
+#include "lib/jxl/color_encoding_internal.h"
+#include "lib/jxl/image.h"
+#include "lib/jxl/image_bundle.h"
+#include "lib/jxl/image_metadata.h"
+#include "tools/no_memory_manager.h"
+#include "tools/ssimulacra2.h"
+#include "tools/thread_pool_internal.h"
+
+namespace jxl {
+namespace {
+
+#define QUIT(M)           \
+  state.SkipWithError(M); \
+  return;
+
+#define BM_CHECK(C) \
+  if (!(C)) {       \
+    QUIT(#C)        \
+  }
+
+void BM_SSIMULACRA2(benchmark::State& state) {
+  JxlMemoryManager* memory_manager = jpegxl::tools::NoMemoryManager();
+  const size_t xsize = state.range(0);
+  const size_t ysize = xsize;
+  const size_t num_threads = state.range(1);
+
+  JXL_ASSIGN_OR_QUIT(Image3F orig,
+                     Image3F::Create(memory_manager, xsize, ysize),
+                     "Failed to allocate image.");
+  JXL_ASSIGN_OR_QUIT(Image3F distorted,
+                     Image3F::Create(memory_manager, xsize, ysize),
+                     "Failed to allocate image.");
+  Rng rng(129);
+  for (size_t c = 0; c < 3; ++c) {
+    for (size_t y = 0; y < ysize; ++y) {
+      float* JXL_RESTRICT row_orig = orig.PlaneRow(c, y);
+      float* JXL_RESTRICT row_distorted = distorted.PlaneRow(c, y);
+      for (size_t x = 0; x < xsize; ++x) {
+        row_orig[x] = rng.UniformF(0.1f, 0.9f);
+        row_distorted[x] = row_orig[x] + rng.UniformF(-0.05f, 0.05f);
+      }
+    }
+  }
+
+  ImageMetadata metadata;
+  ImageBundle ib_orig(memory_manager, &metadata);
+  ImageBundle ib_distorted(memory_manager, &metadata);
+  BM_CHECK(ib_orig.SetFromImage(std::move(orig), ColorEncoding::SRGB()));
+  BM_CHECK(
+      ib_distorted.SetFromImage(std::move(distorted), ColorEncoding::SRGB()));
+
+  jpegxl::tools::ThreadPoolInternal pool(num_threads);
+  for (auto _ : state) {
+    JXL_ASSIGN_OR_QUIT(
+        Msssim msssim,
+        ComputeSSIMULACRA2(ib_orig, ib_distorted, 0.5f, pool.get()),
+        "ComputeSSIMULACRA2 failed.");
+    // Prevent optimizing out
+    benchmark::DoNotOptimize(msssim.Score());
+  }
+  state.SetItemsProcessed(xsize * ysize * state.iterations());
+}
+
+BENCHMARK(BM_SSIMULACRA2)
+    ->ArgsProduct({{256, 1024, 2048}, {0, 4}})
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace jxl
@@ -0,0 +1,283 @@
+// Copyright (c) the JPEG XL Project Authors. All rights reserved.
+//
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "tools/ssimulacra2.h"
+
+#include <jxl/cms.h>
+#include <jxl/memory_manager.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "lib/jxl/base/compiler_specific.h"
+#include "lib/jxl/base/status.h"
+#include "lib/jxl/codec_in_out.h"
+#include "lib/jxl/color_encoding_internal.h"
+#include "lib/jxl/enc_xyb.h"
+#include "lib/jxl/image.h"
+#include "lib/jxl/image_bundle.h"
+#include "lib/jxl/test_image.h"
+#include "lib/jxl/test_memory_manager.h"
+#include "lib/jxl/test_utils.h"
+#include "lib/jxl/testing.h"
+#include "tools/gauss_blur.h"
+
+namespace jxl {
+namespace {
+
+// Scalar implementation of the metric before it used SIMD kernels and a
+// thread pool, with the sums of the error maps accumulated pixel by pixel.
+namespace reference {
+
+const float kC2 = 0.0009f;
+const int kNumScales = 6;
+
+StatusOr<Image3F> Downsample(const Image3F& in, size_t fx, size_t fy) {
+  const size_t out_xsize = (in.xsize() + fx - 1) / fx;
+  const size_t out_ysize = (in.ysize() + fy - 1) / fy;
+  JXL_ASSIGN_OR_RETURN(
+      Image3F out,
+      Image3F::Create(test::MemoryManager(), out_xsize, out_ysize));
+  const float normalize = 1.0f / (fx * fy);
+  for (size_t c = 0; c < 3; ++c) {
+    for (size_t oy = 0; oy < out_ysize; ++oy) {
+      float* JXL_RESTRICT row_out = out.PlaneRow(c, oy);
+      for (size_t ox = 0; ox < out_xsize; ++ox) {
+        float sum = 0.0f;
+        for (size_t iy = 0; iy < fy; ++iy) {
+          for (size_t ix = 0; ix < fx; ++ix) {
+            const size_t x = std::min(ox * fx + ix, in.xsize() - 1);
+            const size_t y = std::min(oy * fy + iy, in.ysize() - 1);
+            sum += in.PlaneRow(c, y)[x];
+          }
+        }
+        row_out[ox] = sum * normalize;
+      }
+    }
+  }
+  return out;
+}
+
+StatusOr<Image3F> Multiply(const Image3F& a, const Image3F& b) {
+  JXL_ASSIGN_OR_RETURN(Image3F out, Image3F::Create(test::MemoryManager(),
+                                                     a.xsize(), a.ysize()));
+  for (size_t c = 0; c < 3; ++c) {
+    for (size_t y = 0; y < a.ysize(); ++y) {
+      for (size_t x = 0; x < a.xsize(); ++x) {
+        out.PlaneRow(c, y)[x] = a.PlaneRow(c, y)[x] * b.PlaneRow(c, y)[x];
+      }
+    }
+  }
+  return out;
+}
+
+StatusOr<Image3F> Blur(const Image3F& in) {
+  JxlMemoryManager* memory_manager = test::MemoryManager();
+  const RecursiveGaussian rg = CreateRecursiveGaussian(1.5);
+  JXL_ASSIGN_OR_RETURN(ImageF temp,
+                       ImageF::Create(memory_manager, in.xsize(), in.ysize()));
+  JXL_ASSIGN_OR_RETURN(Image3F out,
+                       Image3F::Create(memory_manager, in.xsize(), in.ysize()));
+  for (size_t c = 0; c < 3; ++c) {
+    JXL_RETURN_IF_ERROR(FastGaussian(
+        rg, in.xsize(), in.ysize(),
+        [&](size_t y) { return in.ConstPlaneRow(c, y); },
+        [&](size_t y) { return temp.Row(y); },
+        [&](size_t y) { return out.PlaneRow(c, y); }));
+  }
+  return out;
+}
+
+double Quartic(double x) {
+  x *= x;
+  x *= x;
+  return x;
+}
+
+void SSIMMap(const Image3F& m1, const Image3F& m2, const Image3F& s11,
+             const Image3F& s22, const Image3F& s12, double* plane_averages) {
+  const double one_per_pixels = 1.0 / (m1.ysize() * m1.xsize());
+  for (size_t c = 0; c < 3; ++c) {
+    double sums[2] = {0.0};
+    for (size_t y = 0; y < m1.ysize(); ++y) {
+      for (size_t x = 0; x < m1.xsize(); ++x) {
+        float mu1 = m1.ConstPlaneRow(c, y)[x];
+        float mu2 = m2.ConstPlaneRow(c, y)[x];
+        float num_m = 1.0 - (mu1 - mu2) * (mu1 - mu2);
+        float num_s = 2 * (s12.ConstPlaneRow(c, y)[x] - mu1 * mu2) + kC2;
+        float denom_s = (s11.ConstPlaneRow(c, y)[x] - mu1 * mu1) +
+                        (s22.ConstPlaneRow(c, y)[x] - mu2 * mu2) + kC2;
+        double d = std::max(1.0 - (num_m * num_s / denom_s), 0.0);
+        sums[0] += d;
+        sums[1] += Quartic(d);
+      }
+    }
+    plane_averages[c * 2] = one_per_pixels * sums[0];
+    plane_averages[c * 2 + 1] = std::sqrt(std::sqrt(one_per_pixels * sums[1]));
+  }
+}
+
+void EdgeDiffMap(const Image3F& img1, const Image3F& mu1, const Image3F& img2,
+                 const Image3F& mu2, double* plane_averages) {
+  const double one_per_pixels = 1.0 / (img1.ysize() * img1.xsize());
+  for (size_t c = 0; c < 3; ++c) {
+    double sums[4] = {0.0};
+    for (size_t y = 0; y < img1.ysize(); ++y) {
+      for (size_t x = 0; x < img1.xsize(); ++x) {
+        double d1 = (1.0 + std::abs(img2.ConstPlaneRow(c, y)[x] -
+                                    mu2.ConstPlaneRow(c, y)[x])) /
+                        (1.0 + std::abs(img1.ConstPlaneRow(c, y)[x] -
+                                        mu1.ConstPlaneRow(c, y)[x])) -
+                    1.0;
+        double artifact = std::max(d1, 0.0);
+        sums[0] += artifact;
+        sums[1] += Quartic(artifact);
+        double detail_lost = std::max(-d1, 0.0);
+        sums[2] += detail_lost;
+        sums[3] += Quartic(detail_lost);
+      }
+    }
+    for (size_t i = 0; i < 4; i += 2) {
+      plane_averages[c * 4 + i] = one_per_pixels * sums[i];
+      plane_averages[c * 4 + i + 1] =
+          std::sqrt(std::sqrt(one_per_pixels * sums[i + 1]));
+    }
+  }
+}
+
+void MakePositiveXYB(Image3F& img) {
+  for (size_t y = 0; y < img.ysize(); ++y) {
+    float* JXL_RESTRICT rowY = img.PlaneRow(1, y);
+    float* JXL_RESTRICT rowB = img.PlaneRow(2, y);
+    float* JXL_RESTRICT rowX = img.PlaneRow(0, y);
+    for (size_t x = 0; x < img.xsize(); ++x) {
+      rowB[x] = (rowB[x] - rowY[x]) + 0.55f;
+      rowX[x] = rowX[x] * 14.f + 0.42f;
+      rowY[x] += 0.01f;
+    }
+  }
+}
+
+void AlphaBlend(ImageBundle& img, float bg) {
+  for (size_t y = 0; y < img.ysize(); ++y) {
+    const float* JXL_RESTRICT a = img.alpha()->Row(y);
+    for (size_t c = 0; c < 3; ++c) {
+      float* JXL_RESTRICT row = img.color()->PlaneRow(c, y);
+      for (size_t x = 0; x < img.xsize(); ++x) {
+        row[x] = a[x] * row[x] + (1.f - a[x]) * bg;
+      }
+    }
+  }
+}
+
+Status ToPositiveXYB(const ImageBundle& ib, Image3F* xyb) {
+  JXL_RETURN_IF_ERROR(ToXYB(ib, nullptr, xyb, *JxlGetDefaultCms(), nullptr));
+  MakePositiveXYB(*xyb);
+  return true;
+}
+
+StatusOr<Msssim> ComputeSSIMULACRA2(const ImageBundle& orig,
+                                    const ImageBundle& dist, float bg) {
+  JxlMemoryManager* memory_manager = test::MemoryManager();
+  Msssim msssim;
+  JXL_ASSIGN_OR_RETURN(ImageBundle orig2, orig.Copy());
+  JXL_ASSIGN_OR_RETURN(ImageBundle dist2, dist.Copy());
+  if (orig.HasAlpha()) AlphaBlend(orig2, bg);
+  if (dist.HasAlpha()) AlphaBlend(dist2, bg);
+  orig2.ClearExtraChannels();
+  dist2.ClearExtraChannels();
+  JXL_RETURN_IF_ERROR(orig2.TransformTo(
+      ColorEncoding::LinearSRGB(orig2.IsGray()), *JxlGetDefaultCms()));
+  JXL_RETURN_IF_ERROR(dist2.TransformTo(
+      ColorEncoding::LinearSRGB(dist2.IsGray()), *JxlGetDefaultCms()));
+  for (int scale = 0; scale < kNumScales; scale++) {
+    if (orig2.xsize() < 8 || orig2.ysize() < 8) {
+      break;
+    }
+    if (scale) {
+      JXL_ASSIGN_OR_RETURN(Image3F tmp, Downsample(*orig2.color(), 2, 2));
+      JXL_RETURN_IF_ERROR(orig2.SetFromImage(
+          std::move(tmp), ColorEncoding::LinearSRGB(orig2.IsGray())));
+      JXL_ASSIGN_OR_RETURN(tmp, Downsample(*dist2.color(), 2, 2));
+      JXL_RETURN_IF_ERROR(dist2.SetFromImage(
+          std::move(tmp), ColorEncoding::LinearSRGB(dist2.IsGray())));
+    }
+    JXL_ASSIGN_OR_RETURN(
+        Image3F img1,
+        Image3F::Create(memory_manager, orig2.xsize(), orig2.ysize()));
+    JXL_ASSIGN_OR_RETURN(
+        Image3F img2,
+        Image3F::Create(memory_manager, orig2.xsize(), orig2.ysize()));
+    JXL_RETURN_IF_ERROR(ToPositiveXYB(orig2, &img1));
+    JXL_RETURN_IF_ERROR(ToPositiveXYB(dist2, &img2));
+
+    JXL_ASSIGN_OR_RETURN(Image3F mul, Multiply(img1, img1));
+    JXL_ASSIGN_OR_RETURN(Image3F sigma1_sq, Blur(mul));
+    JXL_ASSIGN_OR_RETURN(mul, Multiply(img2, img2));
+    JXL_ASSIGN_OR_RETURN(Image3F sigma2_sq, Blur(mul));
+    JXL_ASSIGN_OR_RETURN(mul, Multiply(img1, img2));
+    JXL_ASSIGN_OR_RETURN(Image3F sigma12, Blur(mul));
+    JXL_ASSIGN_OR_RETURN(Image3F mu1, Blur(img1));
+    JXL_ASSIGN_OR_RETURN(Image3F mu2, Blur(img2));
+
+    MsssimScale sscale;
+    SSIMMap(mu1, mu2, sigma1_sq, sigma2_sq, sigma12, sscale.avg_ssim);
+    EdgeDiffMap(img1, mu1, img2, mu2, sscale.avg_edgediff);
+    msssim.scales.push_back(sscale);
+  }
+  return msssim;
+}
+
+}  // namespace reference
+
+TEST(Ssimulacra2Test, SameScoreAsScalarReferenceAndForAnyThreads) {
+  // Not a multiple of the vector size, with 5 scales.
+  const size_t xsize = 257;
+  const size_t ysize = 131;
+  std::vector<uint8_t> pixels = test::GetSomeTestImage(xsize, ysize, 4, 0);
+  std::vector<uint8_t> distorted = pixels;
+  // Perturb the low bytes of the 16-bit big endian samples.
+  for (size_t i = 1; i < distorted.size(); i += 2) {
+    distorted[i] ^= static_cast<uint8_t>((i * 37) & 0x7F);
+  }
+  CodecInOut io1 = test::SomeTestImageToCodecInOut(pixels, 4, xsize, ysize);
+  CodecInOut io2 = test::SomeTestImageToCodecInOut(distorted, 4, xsize, ysize);
+
+  JXL_TEST_ASSIGN_OR_DIE(
+      Msssim expected,
+      reference::ComputeSSIMULACRA2(io1.Main(), io2.Main(), 0.5f));
+  JXL_TEST_ASSIGN_OR_DIE(
+      Msssim actual,
+      ::ComputeSSIMULACRA2(io1.Main(), io2.Main(), 0.5f, /*pool=*/nullptr));
+  ASSERT_EQ(expected.scales.size(), actual.scales.size());
+  for (size_t s = 0; s < expected.scales.size(); ++s) {
+    for (size_t i = 0; i < 6; ++i) {
+      EXPECT_NEAR(expected.scales[s].avg_ssim[i], actual.scales[s].avg_ssim[i],
+                  1e-6);
+    }
+    for (size_t i = 0; i < 12; ++i) {
+      EXPECT_NEAR(expected.scales[s].avg_edgediff[i],
+                  actual.scales[s].avg_edgediff[i], 1e-6);
+    }
+  }
+  const double score = actual.Score();
+  EXPECT_NEAR(expected.Score(), score, 1e-4);
+  EXPECT_LT(score, 100.0);
+
+  for (int num_threads : {1, 3, 8}) {
+    test::ThreadPoolForTests pool(num_threads);
+    JXL_TEST_ASSIGN_OR_DIE(
+        Msssim threaded,
+        ::ComputeSSIMULACRA2(io1.Main(), io2.Main(), 0.5f, pool.get()));
+    EXPECT_EQ(score, threaded.Score()) << num_threads << " threads";
+  }
+}
+
+}  // namespace
+}  // namespace jxl
@@ -99,6 +99,7 @@ void TrackingMemoryManager::Free(void* opaque, void* address) {
   if (found) {
     std::lock_guard<std::mutex> guard(self->numbers_mutex_);
     self->num_allocations_--;
+    self->total_frees++;
     self->bytes_in_use_ -= size;
   }
   self->inner_->free(self->inner_->opaque, address);
@@ -117,9 +118,18 @@ jxl::Status TrackingMemoryManager::Reset() {
   seen_oom = false;
   max_bytes_in_use = 0;
   total_allocations = 0;
+  total_frees = 0;
   total_bytes_allocated = 0;
   return true;
 }
 
+void TrackingMemoryManager::ResetCounters() {
+  std::lock_guard<std::mutex> guard(numbers_mutex_);
+  max_bytes_in_use = bytes_in_use_;
+  total_allocations = 0;
+  total_frees = 0;
+  total_bytes_allocated = 0;
+}
+
 }  // namespace tools
 }  // namespace jpegxl
@@ -31,9 +31,14 @@ class TrackingMemoryManager {
 
   jxl::Status Reset();
 
+  // Zeroes the statistics without requiring all memory to be freed, e.g. to
+  // measure only the allocations made from now on.
+  void ResetCounters();
+
   bool seen_oom = false;
   uint64_t max_bytes_in_use = 0;
   uint64_t total_allocations = 0;
+  uint64_t total_frees = 0;
   uint64_t total_bytes_allocated = 0;
 
  private: